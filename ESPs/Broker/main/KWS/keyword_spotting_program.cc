@@ -35,6 +35,7 @@ extern "C" {
 #include "keyword_spotting_interface.h"
 #include "keyword_spotting_config.h"
 #include "keyword_spotting_model.h"
+#include "control/control_interface.h"
 }
 
 #define USED_PSRAM 1
@@ -53,11 +54,9 @@ static TaskHandle_t g_keyword_spotting_task_handler;
 extern bool g_reset_slice_needed;
 
 
-extern uint8_t is_new_data;
-extern uint8_t g_recvData[30];
-extern uint8_t g_recvTopic[30];
-extern uint8_t g_recvDataLen;
-extern uint8_t g_recvTopicLen;
+/* Servo commands sent to node 2 on a detection */
+static const char g_kws_servo_on_cmd[]  = "2{\"action\": \"servo\", \"value\": 180.0, \"timestamp\": \"2025-04-16T14:34:30.729291\"}\n";
+static const char g_kws_servo_off_cmd[] = "2{\"action\": \"servo\", \"value\": 0.000, \"timestamp\": \"2025-04-16T14:34:30.729291\"}\n";
 
 
 /* Static function prototype */
@@ -323,16 +322,12 @@ static void keyword_spotting_loop(void)
       if( kCategoryLabels[max_idx][0] == 'O' && kCategoryLabels[max_idx][1] == 'N' )
       {
         MicroPrintf("Detected %7s, score: %.2f", kCategoryLabels[max_idx] , static_cast<double>(max_result));
-        is_new_data = 1;
-        memcpy( (char *)g_recvData  , "2{\"action\": \"servo\", \"value\": 180.0, \"timestamp\": \"2025-04-16T14:34:30.729291\"}\n"  , 81 );
-        g_recvDataLen = 81;
+        control_push( CONTROL_SRC_KWS , (const uint8_t *)g_kws_servo_on_cmd , sizeof(g_kws_servo_on_cmd) - 1 );
       }
       else if( kCategoryLabels[max_idx][0] == 'O' && kCategoryLabels[max_idx][1] == 'F' )
       {
         MicroPrintf("Detected %7s, score: %.2f", kCategoryLabels[max_idx] , static_cast<double>(max_result));
-        is_new_data = 1;
-        memcpy( (char *)g_recvData  , "2{\"action\": \"servo\", \"value\": 0.000, \"timestamp\": \"2025-04-16T14:34:30.729291\"}\n"  , 81 );
-        g_recvDataLen = 81;      
+        control_push( CONTROL_SRC_KWS , (const uint8_t *)g_kws_servo_off_cmd , sizeof(g_kws_servo_off_cmd) - 1 );
       }
 
     }
@@ -21,6 +21,7 @@
 #include "Network_config.h"
 #include "../error_led/error_led.h"
 #include "Network_inteface.h"
+#include "pool/pool.h"
 
 
 /* TAG used for serial message */
@@ -228,6 +229,8 @@ static void Network_handling_no_station_connection_handler(void)
 {
 	/* A variable indicat that the it is connected or not  */
 	g_station_connected = 0;
+	/* The pooled connections went down with the AP */
+	Network_pool_close_all();
 	/* Turn on error led */
 	error_led_on();
 	/* Delay 10ms, then try to connect again */
@@ -431,7 +434,11 @@ static void Network_app_task(void *pvParameter)
 	ESP_LOGI( TAG , "Entring infinity loop" );
     for(;;)
     {
-        if( xQueueReceive( Network_app_queue_handler , &received_msg , portMAX_DELAY) )
+		/* Wake up now and then to close the pooled connections that stay idle */
+        if( xQueueReceive( Network_app_queue_handler , &received_msg , pdMS_TO_TICKS(NETWORK_POOL_IDLE_CHECK_MS) ) != pdTRUE )
+		{
+			Network_pool_close_idle();
+		}else
 		{
             switch (received_msg.msgID)
             {
@@ -482,6 +489,9 @@ void Netwok_app_start(void)
 	/* Create the message queue for this task */
 	Network_app_queue_handler = xQueueCreate( 50 , sizeof(Network_app_queue_message_t) );
 
+	/* Keep alive connections of the senders */
+	Network_pool_init();
+
 	/* Start Network task in FreeRTOS */
 	BaseType_t TaskStatus = xTaskCreatePinnedToCore( &Network_app_task , "Network task" , NETWORK_APP_TASK_STACK_SIZE , NULL , NETWORK_APP_TASK_PRIORITY , NULL , NETWORK_APP_TASK_CORE_ID );
 
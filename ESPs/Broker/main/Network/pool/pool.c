@@ -0,0 +1,322 @@
+/*
+ *  pool.c
+ *
+ *  Keep alive TCP connections for the sendData functions
+ */
+
+#include <errno.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "lwip/sockets.h"
+#include "pool.h"
+
+/* State of a pool entry */
+typedef enum Network_pool_state
+{
+	POOL_FREE,
+	POOL_IDLE,        /* Connected, waiting for the next message */
+	POOL_BUSY,        /* Handed out, or connecting */
+}Network_pool_state_e;
+
+typedef struct Network_pool_entry
+{
+	Network_pool_state_e state;
+	int      socket;
+	uint16_t port;
+	uint8_t  stale;           /* WiFi went down while busy, closed on release */
+	int64_t  last_used_us;
+}Network_pool_entry_t;
+
+static const char TAG[] = "Network pool";
+
+static Network_pool_entry_t s_pool[NETWORK_POOL_SIZE];
+static SemaphoreHandle_t s_pool_lock = NULL;     /* Guards s_pool and s_stats, never held while connecting or sending */
+static Network_pool_stats_t s_stats;
+
+
+/**
+ * Network_pool_alive
+ * Check a pooled socket before reusing it, without waiting
+ * @param a_socketHandler : socket handler
+ * @return 1 if it is still open, 0 if the server closed it or it failed
+ */
+static uint8_t Network_pool_alive( int a_socketHandler )
+{
+	uint8_t l_byte;
+	int l_status = recv( a_socketHandler , &l_byte , 1 , MSG_PEEK | MSG_DONTWAIT );
+
+	if( l_status > 0 )   /* The server sent something, the connection is open */
+	{
+		return 1;
+	}
+	if( l_status == 0 )  /* FIN received */
+	{
+		return 0;
+	}
+	return ( errno == EAGAIN || errno == EWOULDBLOCK );
+}
+
+
+/**
+ * Network_pool_connect
+ * Open a new connection with keep alive probes and without Nagle delay,
+ * a header and its data are sent back to back
+ * @param a_portNumber    : server port
+ * @param a_socketHandler : (out) socket handler
+ * @return SOCKET_ERROR_e
+ */
+static SOCKET_ERROR_e Network_pool_connect( uint16_t a_portNumber , int *a_socketHandler )
+{
+	SOCKET_ERROR_e l_status = Socket_start_TCP_connect( a_socketHandler , a_portNumber );
+	if( l_status != SOCKET_OK )
+	{
+		if( l_status == SOCKET_CONNECTION_ERROR )
+		{
+			Socket_close_socket( *a_socketHandler );  /* Created but not connected */
+		}
+		return l_status;
+	}
+
+	int l_on = 1;
+	int l_idle = NETWORK_POOL_KEEPALIVE_IDLE_S;
+	int l_interval = NETWORK_POOL_KEEPALIVE_INTERVAL_S;
+	int l_count = NETWORK_POOL_KEEPALIVE_COUNT;
+	setsockopt( *a_socketHandler , SOL_SOCKET , SO_KEEPALIVE , &l_on , sizeof(l_on) );
+	setsockopt( *a_socketHandler , IPPROTO_TCP , TCP_KEEPIDLE , &l_idle , sizeof(l_idle) );
+	setsockopt( *a_socketHandler , IPPROTO_TCP , TCP_KEEPINTVL , &l_interval , sizeof(l_interval) );
+	setsockopt( *a_socketHandler , IPPROTO_TCP , TCP_KEEPCNT , &l_count , sizeof(l_count) );
+	setsockopt( *a_socketHandler , IPPROTO_TCP , TCP_NODELAY , &l_on , sizeof(l_on) );
+
+	return SOCKET_OK;
+}
+
+
+/**
+ * Network_pool_drop
+ * Close the connection of an entry, the pool lock is held
+ * @param a_entry : pool entry
+ */
+static void Network_pool_drop( Network_pool_entry_t *a_entry )
+{
+	Socket_close_socket( a_entry->socket );
+	a_entry->socket = -1;
+	a_entry->stale  = 0;
+	a_entry->state  = POOL_FREE;
+}
+
+
+/**
+ * Network_pool_init
+ * Create the pool lock, called once before the Network task starts
+ */
+void Network_pool_init( void )
+{
+	for( int i=0 ; i<NETWORK_POOL_SIZE ; i++ )
+	{
+		s_pool[i].state  = POOL_FREE;
+		s_pool[i].socket = -1;
+	}
+	s_pool_lock = xSemaphoreCreateMutex();
+	if( s_pool_lock == NULL )
+	{
+		ESP_LOGE( TAG , "No memory for the pool lock, every message opens a connection" );
+	}
+}
+
+
+/**
+ * Network_pool_acquire
+ * Take a connection to a server port: an idle pooled one when it is still
+ * open, else a new one. Give it back with Network_pool_release()
+ * @param a_portNumber    : server port
+ * @param a_socketHandler : (out) socket handler
+ * @param a_reused        : (out) 1 if the connection carried messages before,
+ *                          a failure on it is worth a retry on a new one
+ * @return SOCKET_ERROR_e
+ */
+SOCKET_ERROR_e Network_pool_acquire( uint16_t a_portNumber , int *a_socketHandler , uint8_t *a_reused )
+{
+	*a_reused = 0;
+	if( s_pool_lock == NULL )
+	{
+		return Network_pool_connect( a_portNumber , a_socketHandler );
+	}
+
+	int64_t l_now = esp_timer_get_time();
+	int l_free = -1;
+	uint8_t l_port_conns = 0;
+
+	xSemaphoreTake( s_pool_lock , portMAX_DELAY );
+	for( int i=0 ; i<NETWORK_POOL_SIZE ; i++ )
+	{
+		Network_pool_entry_t *l_entry = &s_pool[i];
+
+		if( l_entry->state == POOL_IDLE && l_entry->port == a_portNumber )
+		{
+			if( l_now - l_entry->last_used_us > (int64_t)NETWORK_POOL_IDLE_TIMEOUT_MS * 1000 )
+			{
+				Network_pool_drop( l_entry );
+				s_stats.idle_closes++;
+			}else if( !Network_pool_alive( l_entry->socket ) )
+			{
+				Network_pool_drop( l_entry );
+				s_stats.broken++;
+			}else
+			{
+				l_entry->state = POOL_BUSY;
+				*a_socketHandler = l_entry->socket;
+				*a_reused = 1;
+				s_stats.reuses++;
+				xSemaphoreGive( s_pool_lock );
+				return SOCKET_OK;
+			}
+		}
+
+		if( l_entry->state == POOL_FREE )
+		{
+			if( l_free < 0 )
+				l_free = i;
+		}else if( l_entry->port == a_portNumber )
+		{
+			l_port_conns++;
+		}
+	}
+
+	/* Reserve the slot, the connect runs without the lock */
+	Network_pool_entry_t *l_slot = NULL;
+	if( l_free >= 0 && l_port_conns < NETWORK_POOL_CONNS_PER_PORT )
+	{
+		l_slot = &s_pool[l_free];
+		l_slot->state  = POOL_BUSY;
+		l_slot->port   = a_portNumber;
+		l_slot->socket = -1;
+		l_slot->stale  = 0;
+	}else
+	{
+		s_stats.one_shots++;
+	}
+	xSemaphoreGive( s_pool_lock );
+
+	SOCKET_ERROR_e l_status = Network_pool_connect( a_portNumber , a_socketHandler );
+
+	if( l_slot != NULL )
+	{
+		xSemaphoreTake( s_pool_lock , portMAX_DELAY );
+		if( l_status == SOCKET_OK )
+		{
+			l_slot->socket = *a_socketHandler;
+			s_stats.connects++;
+		}else
+		{
+			l_slot->state = POOL_FREE;
+		}
+		xSemaphoreGive( s_pool_lock );
+	}
+
+	return l_status;
+}
+
+
+/**
+ * Network_pool_release
+ * Give back a connection of Network_pool_acquire(). It stays open for the
+ * next message unless the message failed on it
+ * @param a_socketHandler : socket handler
+ * @param a_status        : result of the message sent on it
+ */
+void Network_pool_release( int a_socketHandler , SOCKET_ERROR_e a_status )
+{
+	if( s_pool_lock != NULL )
+	{
+		xSemaphoreTake( s_pool_lock , portMAX_DELAY );
+		for( int i=0 ; i<NETWORK_POOL_SIZE ; i++ )
+		{
+			Network_pool_entry_t *l_entry = &s_pool[i];
+			if( l_entry->state != POOL_BUSY || l_entry->socket != a_socketHandler )
+				continue;
+
+			if( a_status != SOCKET_OK || l_entry->stale )
+			{
+				if( a_status != SOCKET_OK )
+					s_stats.broken++;
+				Network_pool_drop( l_entry );
+			}else
+			{
+				l_entry->state = POOL_IDLE;
+				l_entry->last_used_us = esp_timer_get_time();
+			}
+			xSemaphoreGive( s_pool_lock );
+			return;
+		}
+		xSemaphoreGive( s_pool_lock );
+	}
+
+	/* Not pooled, every slot was busy */
+	Socket_close_socket( a_socketHandler );
+}
+
+
+/**
+ * Network_pool_close_idle
+ * Close the connections idle for NETWORK_POOL_IDLE_TIMEOUT_MS, so the
+ * server doesn't close them first under a send
+ */
+void Network_pool_close_idle( void )
+{
+	if( s_pool_lock == NULL )
+		return;
+
+	int64_t l_now = esp_timer_get_time();
+
+	xSemaphoreTake( s_pool_lock , portMAX_DELAY );
+	for( int i=0 ; i<NETWORK_POOL_SIZE ; i++ )
+	{
+		if( s_pool[i].state == POOL_IDLE &&
+		    l_now - s_pool[i].last_used_us > (int64_t)NETWORK_POOL_IDLE_TIMEOUT_MS * 1000 )
+		{
+			Network_pool_drop( &s_pool[i] );
+			s_stats.idle_closes++;
+		}
+	}
+	xSemaphoreGive( s_pool_lock );
+}
+
+
+/**
+ * Network_pool_close_all
+ * The station lost the AP: close every idle connection, the busy ones are
+ * closed when they are released
+ */
+void Network_pool_close_all( void )
+{
+	if( s_pool_lock == NULL )
+		return;
+
+	xSemaphoreTake( s_pool_lock , portMAX_DELAY );
+	for( int i=0 ; i<NETWORK_POOL_SIZE ; i++ )
+	{
+		if( s_pool[i].state == POOL_IDLE )
+			Network_pool_drop( &s_pool[i] );
+		else if( s_pool[i].state == POOL_BUSY )
+			s_pool[i].stale = 1;
+	}
+	xSemaphoreGive( s_pool_lock );
+}
+
+
+/**
+ * Network_pool_get_stats
+ * Copy the counters of the pool
+ * @param a_stats : (out) counters
+ */
+void Network_pool_get_stats( Network_pool_stats_t *a_stats )
+{
+	if( a_stats == NULL || s_pool_lock == NULL )
+		return;
+
+	xSemaphoreTake( s_pool_lock , portMAX_DELAY );
+	*a_stats = s_stats;
+	xSemaphoreGive( s_pool_lock );
+}
@@ -0,0 +1,49 @@
+/*
+ *  pool.h
+ *
+ *  Keep alive TCP connections for the sendData functions
+ *
+ *  Every server port gets up to NETWORK_POOL_CONNS_PER_PORT connections that
+ *  stay open between messages, so a small reading costs one send instead of
+ *  a TCP handshake and teardown. A pooled socket is checked before it is
+ *  handed out again: a peek tells if the server closed it, and a socket idle
+ *  for longer than NETWORK_POOL_IDLE_TIMEOUT_MS is closed instead of reused,
+ *  servers drop quiet connections. Sockets also run TCP keep alive probes,
+ *  so a dead server is noticed while nothing is sent.
+ */
+
+#ifndef NETWORK_POOL_H_
+#define NETWORK_POOL_H_
+
+#include <stdint.h>
+#include "../socket/socket.h"
+
+#define NETWORK_POOL_SIZE                    8       /* Pooled connections, all ports */
+#define NETWORK_POOL_CONNS_PER_PORT          2       /* More senders at once use a one shot connection */
+#define NETWORK_POOL_IDLE_TIMEOUT_MS         30000   /* Below the server's idle timeout */
+#define NETWORK_POOL_IDLE_CHECK_MS           5000    /* Period of Network_pool_close_idle() in the Network task */
+#define NETWORK_POOL_KEEPALIVE_IDLE_S        10      /* TCP keep alive probes after this long without traffic */
+#define NETWORK_POOL_KEEPALIVE_INTERVAL_S    5
+#define NETWORK_POOL_KEEPALIVE_COUNT         3
+
+
+/* Counters of the pool */
+typedef struct Network_pool_stats
+{
+	uint32_t connects;       /* New connections */
+	uint32_t reuses;         /* Messages sent on a pooled connection */
+	uint32_t broken;         /* Pooled connections found closed or failing, reconnected */
+	uint32_t idle_closes;    /* Connections closed for their idle time */
+	uint32_t one_shots;      /* Connections outside the pool, every slot busy */
+}Network_pool_stats_t;
+
+
+/*** Function prototypes ***/
+void Network_pool_init( void );
+SOCKET_ERROR_e Network_pool_acquire( uint16_t a_portNumber , int *a_socketHandler , uint8_t *a_reused );
+void Network_pool_release( int a_socketHandler , SOCKET_ERROR_e a_status );
+void Network_pool_close_idle( void );
+void Network_pool_close_all( void );
+void Network_pool_get_stats( Network_pool_stats_t *a_stats );
+
+#endif /* NETWORK_POOL_H_ */
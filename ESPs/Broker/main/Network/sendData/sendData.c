@@ -1,6 +1,8 @@
+#include <string.h>
 #include "esp_wifi.h"
 #include "sendData.h"
 #include "esp_log.h"
+#include "../pool/pool.h"
 #include "../../device_info.h"
 
 /***
@@ -429,65 +431,112 @@ SOCKET_ERROR_e Network_app_send_TCP_image( uint8_t *a_image_frames , uint32_t a_
 }
 
 
+/**
+ * Send_header_and_data
+ * This static helper sends the header then the data on a connected socket
+ * A small data is copied behind the header, so both leave in one segment
+ * @param a_socketHandler : socket handler
+ * @param a_header        : header of NETWORK_TOTAL_HEADER_SIZE bytes
+ * @param a_data          : send data
+ * @param a_size          : the size of send array
+ * @return SOCKET_ERROR_e
+ **/
+static
+SOCKET_ERROR_e Send_header_and_data( int a_socketHandler , uint8_t *a_header , uint8_t *a_data , uint32_t a_size )
+{
+   if( a_size <= NETWORK_INLINE_DATA_SIZE )
+   {
+      uint8_t l_message[NETWORK_TOTAL_HEADER_SIZE + NETWORK_INLINE_DATA_SIZE];
+      memcpy( l_message , a_header , NETWORK_TOTAL_HEADER_SIZE );
+      memcpy( l_message + NETWORK_TOTAL_HEADER_SIZE , a_data , a_size );
+      return Socket_send_TCP_data( a_socketHandler , l_message , NETWORK_TOTAL_HEADER_SIZE + a_size );
+   }
+
+   /*** Send the header first ***/
+   SOCKET_ERROR_e l_socketStatus = Socket_send_TCP_data( a_socketHandler , a_header , NETWORK_TOTAL_HEADER_SIZE );
+   if( l_socketStatus != SOCKET_OK )
+   {
+      return l_socketStatus;
+   }
+
+   /*** Send the message ***/
+   return Socket_send_TCP_data( a_socketHandler , a_data , a_size );
+}
+
+
 /**
  * Network_app_send_TCP_data_with_header
  * 
  * This function sends a data to a server with a header contains the lenght of message
+ * KEEP_ALIVE messages go through the connection pool: the connection of the
+ * previous message is reused, a new one is opened when it was closed meanwhile
  * @param a_meg_type      : The type of the message
  * @param a_conn_type     : The type of connection, keep alife or close after send
  * @param a_data          : send data
  * @param a_size          : the size of send array
- * @param a_socketHandler : (out) socekt handler used if it's is keep alive
+ * @param a_socketHandler : (out) socekt handler used if it's is keep alive, it stays owned by the pool, may be NULL
  * @param a_portNumber    : port number
  * @return SOCKET_ERROR_e
  **/
 SOCKET_ERROR_e Network_app_send_TCP_data_with_header( Network_app_message_e a_msg_type , Network_connection_type_e a_conn_type , uint8_t *a_data , uint32_t a_size , int *a_socketHandler , uint16_t a_portNumber )
 {
-   /*** Init TCP connection ***/
-   int l_socketHandler;
-   SOCKET_ERROR_e l_socketStatus = Socket_start_TCP_connect( &l_socketHandler , a_portNumber );
-   if( l_socketStatus != SOCKET_OK )
-   {
-     return l_socketStatus;
-   }
-
-
    /*** Handle header array ***/
    uint8_t l_header[NETWORK_TOTAL_HEADER_SIZE];
    uint8_t l_status = Handle_header( l_header , a_msg_type ,  a_conn_type , a_size );
    /* There an error in handling header */
    if( l_status != 1 )
    {
-
+      return SOCKET_ERROR_OTHER;
    }
 
-   
-   /*** Send the header first ***/
-   l_socketStatus = Socket_send_TCP_data( l_socketHandler , (uint8_t *)l_header , NETWORK_TOTAL_HEADER_SIZE );
-   if( l_socketStatus != SOCKET_OK )
+   int l_socketHandler;
+   SOCKET_ERROR_e l_socketStatus;
+
+   /*** Keep alive, send on a pooled connection ***/
+   if( a_conn_type == KEEP_ALIVE )
    {
-      Socket_close_socket(l_socketHandler);  /* Close connection */
+      uint8_t l_reused;
+      /* A pooled connection can die between its check and the send, then one retry on a new connection */
+      for( int i=0 ; i<2 ; i++ )
+      {
+         l_socketStatus = Network_pool_acquire( a_portNumber , &l_socketHandler , &l_reused );
+         if( l_socketStatus != SOCKET_OK )
+         {
+            return l_socketStatus;
+         }
+
+         l_socketStatus = Send_header_and_data( l_socketHandler , l_header , a_data , a_size );
+         Network_pool_release( l_socketHandler , l_socketStatus );
+         if( l_socketStatus == SOCKET_OK || l_reused == 0 )
+         {
+            break;
+         }
+      }
+
+      if( l_socketStatus == SOCKET_OK && a_socketHandler != NULL )
+      {
+         *a_socketHandler = l_socketHandler;
+      }
       return l_socketStatus;
    }
 
+   /*** Init TCP connection ***/
+   l_socketStatus = Socket_start_TCP_connect( &l_socketHandler , a_portNumber );
+   if( l_socketStatus != SOCKET_OK )
+   {
+     return l_socketStatus;
+   }
 
-   /*** Send the message ***/
-   l_socketStatus = Socket_send_TCP_data( l_socketHandler , (uint8_t *)a_data , a_size );
+   /*** Send the header and the message ***/
+   l_socketStatus = Send_header_and_data( l_socketHandler , l_header , a_data , a_size );
    if( l_socketStatus != SOCKET_OK )
    {
       Socket_close_socket(l_socketHandler);  /* Close connection */
       return l_socketStatus;
    }
 
-
-   /*** Finally, close the connection if it's not keep alive ***/
-   if( a_conn_type == CLOSE_AFTER_SEND )
-   {
-      l_socketStatus = Socket_close_socket(l_socketHandler);
-   }else
-   {
-      *a_socketHandler = l_socketStatus;
-   }
+   /*** Finally, close the connection ***/
+   l_socketStatus = Socket_close_socket(l_socketHandler);
    return l_socketStatus;
 
 }
@@ -511,7 +560,7 @@ SOCKET_ERROR_e Network_app_send_big_TCP_data_with_header( Network_app_message_e
 {
    /*** Init connection ***/
    *image_bytes_counter = 0;
-   printf("Msg size = %ld, and stat size = %ld\n" , a_size , (*image_bytes_counter) );
+   printf("Msg size = %lu, and stat size = %lu\n" , (unsigned long)a_size , (unsigned long)(*image_bytes_counter) );
    int l_socketHandler;
    SOCKET_ERROR_e l_socketStatus = Socket_start_TCP_connect( &l_socketHandler , a_portNumber );
    if( l_socketStatus != SOCKET_OK )
@@ -544,7 +593,7 @@ SOCKET_ERROR_e Network_app_send_big_TCP_data_with_header( Network_app_message_e
    for(  ; (*image_bytes_counter)<(a_size-MAX_PACKET_SIZE)
        ;(*image_bytes_counter)+=MAX_PACKET_SIZE )
    {
-      printf("%ld %ld\n" , (*image_bytes_counter) , a_size );
+      printf("%lu %lu\n" , (unsigned long)(*image_bytes_counter) , (unsigned long)a_size );
       for( int k=0 ; k<4 ; k++ )
       {
          l_socketStatus = Socket_send_TCP_data( l_socketHandler , (uint8_t *)(a_data+(*image_bytes_counter)) , MAX_PACKET_SIZE );
@@ -589,7 +638,7 @@ SOCKET_ERROR_e Network_app_send_big_TCP_data_with_header( Network_app_message_e
       l_socketStatus = Socket_close_socket(l_socketHandler);
    }else
    {
-      *a_socketHandler = l_socketStatus;
+      *a_socketHandler = l_socketHandler;
    }
 
    printf("\nFinish\n");
@@ -776,7 +825,7 @@ SOCKET_ERROR_e Network_app_send_big_data_over_UDP( uint8_t *a_data , uint32_t a_
    /* Add the data to the array */
    for(int j=0;j<remain_data_size;j++,i++)
    {
-      temp_send_arr[i] = (uint8_t *)(a_data+image_bytes_counter)[j]; 
+      temp_send_arr[i] = ((uint8_t *)(a_data+image_bytes_counter))[j] ; 
    }
    l_socketStatus = Socket_send_UDP_data( (uint8_t *)(temp_send_arr) , remain_data_size , a_socketHandler , a_portNumber );
    if( l_socketStatus != SOCKET_OK )
@@ -22,6 +22,7 @@
 #define NETWORK_MAX_SEND_HEADER_LENGHT               20
 #define NETWORK_MAX_RECV_HEADER_LENGHT               20
 #define NETWORK_MAX_VOICE_STREAM_HEADER_LENGHT       20
+#define NETWORK_INLINE_DATA_SIZE                     64   /* Data up to this size is sent in the header's segment */
 
 
 /***************************************
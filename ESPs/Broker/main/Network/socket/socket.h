@@ -5,7 +5,9 @@
 #define SOCKET_H_
 
 /*** Defines ***/
+#ifndef WIFI_STA_SERVER_SOCKET_ADDRESS   /* The host tests point it at the loopback server */
 #define WIFI_STA_SERVER_SOCKET_ADDRESS        "192.168.100.138"
+#endif
 
 /*** Enum ***/
 typedef enum socket_error {
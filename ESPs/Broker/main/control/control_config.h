@@ -0,0 +1,45 @@
+/**
+ * @file control_config.h
+ * @brief Control frame handoff configuration
+ */
+#ifndef CONTROL_CONFIG_H
+#define CONTROL_CONFIG_H
+
+#include <stdint.h>
+
+/**
+ * @brief Control ring parameters
+ */
+#define CONTROL_FRAME_SIZE     256   /* Max bytes of one control frame (node ID + command) */
+#define CONTROL_RING_SIZE      8     /* Frames per source, must be a power of two */
+
+/**
+ * @brief Sources of control frames, each one owns a single-producer ring
+ */
+typedef enum {
+    CONTROL_SRC_MQTT,           /* MQTT event handler (wot/control/<node>) */
+    CONTROL_SRC_KWS,            /* Keyword spotting detections */
+    CONTROL_SRC_LOCAL_BROKER,   /* LAN clients of the local broker (wot/control/<node>) */
+    CONTROL_SRC_UDP,            /* Authenticated control datagrams (see udp_control_interface.h) */
+    CONTROL_SRC_COUNT
+} control_source_t;
+
+/**
+ * @brief One control frame, exactly the bytes sent to the UART bridge
+ */
+typedef struct {
+    int64_t stamp_us;   /* esp_timer time of the commit */
+    uint16_t len;
+    uint8_t data[CONTROL_FRAME_SIZE];
+} control_frame_t;
+
+/**
+ * @brief Per source counters
+ */
+typedef struct {
+    uint32_t pushed;         /* Frames accepted */
+    uint32_t dropped_full;   /* Frames lost because the ring was full */
+    uint32_t dropped_size;   /* Frames lost because they were larger than CONTROL_FRAME_SIZE */
+} control_stats_t;
+
+#endif /* CONTROL_CONFIG_H */
@@ -0,0 +1,95 @@
+/**
+ * @file control_interface.h
+ * @brief Lock-free handoff of control frames to the dispatcher
+ *
+ * Every source has its own single-producer/single-consumer ring, so the
+ * producer (MQTT event handler, KWS task, ...) and the dispatcher never
+ * take a lock. Frames of a source are delivered in order; when a ring is
+ * full the new frame is dropped and counted, queued frames are never
+ * overwritten.
+ */
+#ifndef CONTROL_INTERFACE_H
+#define CONTROL_INTERFACE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_err.h"
+#include "control_config.h"
+
+/**
+ * @brief Reset all rings and counters
+ *
+ * @return ESP_OK
+ */
+esp_err_t control_init(void);
+
+/**
+ * @brief Register the task woken up when a frame is committed
+ *
+ * @param task        Consumer task, NULL to disable the notification
+ * @param notify_bits Bits set in the task notification value (eSetBits)
+ */
+void control_set_consumer(TaskHandle_t task, uint32_t notify_bits);
+
+/**
+ * @brief Producer side: get the next free frame of a source
+ *
+ * The frame must be filled and committed by the same producer before it
+ * reserves again.
+ *
+ * @param src Frame source
+ * @return The frame to fill, or NULL if the ring is full (counted as a drop)
+ */
+control_frame_t *control_reserve(control_source_t src);
+
+/**
+ * @brief Producer side: publish the frame returned by control_reserve()
+ *
+ * @param src Frame source
+ */
+void control_commit(control_source_t src);
+
+/**
+ * @brief Producer side: copy a frame into the ring of a source
+ *
+ * @param src  Frame source
+ * @param data Frame bytes
+ * @param len  Frame length
+ * @return true if queued, false if dropped
+ */
+bool control_push(control_source_t src, const uint8_t *data, size_t len);
+
+/**
+ * @brief Count a frame that the producer couldn't fit in CONTROL_FRAME_SIZE
+ *
+ * @param src Frame source
+ */
+void control_drop_oversized(control_source_t src);
+
+/**
+ * @brief Consumer side: oldest frame of a source, without removing it
+ *
+ * @param src Frame source
+ * @return The frame, or NULL if the ring is empty
+ */
+const control_frame_t *control_peek(control_source_t src);
+
+/**
+ * @brief Consumer side: remove the frame returned by control_peek()
+ *
+ * @param src Frame source
+ */
+void control_release(control_source_t src);
+
+/**
+ * @brief Copy the counters of a source
+ *
+ * @param src   Frame source
+ * @param stats Output counters
+ */
+void control_get_stats(control_source_t src, control_stats_t *stats);
+
+#endif /* CONTROL_INTERFACE_H */
@@ -0,0 +1,152 @@
+/**
+ * @file control_program.c
+ * @brief Lock-free handoff of control frames to the dispatcher
+ */
+#include <string.h>
+#include <stdatomic.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "control_interface.h"
+#include "control_config.h"
+
+#define CONTROL_RING_MASK   (CONTROL_RING_SIZE - 1)
+
+_Static_assert((CONTROL_RING_SIZE & CONTROL_RING_MASK) == 0, "CONTROL_RING_SIZE must be a power of two");
+
+/**
+ * @brief Single-producer/single-consumer ring
+ *
+ * head is only written by the producer and tail only by the consumer, both
+ * run freely and are masked on access.
+ */
+typedef struct {
+    _Atomic uint32_t head;
+    _Atomic uint32_t tail;
+    control_frame_t frames[CONTROL_RING_SIZE];
+    control_stats_t stats;
+} control_ring_t;
+
+static const char *TAG = "CONTROL";
+static control_ring_t g_rings[CONTROL_SRC_COUNT];
+static TaskHandle_t g_consumer = NULL;
+static uint32_t g_consumer_bits = 0;
+
+esp_err_t control_init(void)
+{
+    for (int i = 0; i < CONTROL_SRC_COUNT; i++)
+    {
+        atomic_store(&g_rings[i].head, 0);
+        atomic_store(&g_rings[i].tail, 0);
+        memset(&g_rings[i].stats, 0, sizeof(control_stats_t));
+    }
+
+    ESP_LOGI(TAG, "Control rings ready, %d frames per source", CONTROL_RING_SIZE);
+    return ESP_OK;
+}
+
+void control_set_consumer(TaskHandle_t task, uint32_t notify_bits)
+{
+    g_consumer_bits = notify_bits;
+    g_consumer = task;
+}
+
+control_frame_t *control_reserve(control_source_t src)
+{
+    if (src >= CONTROL_SRC_COUNT)
+        return NULL;
+
+    control_ring_t *ring = &g_rings[src];
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+    if (head - tail >= CONTROL_RING_SIZE)
+    {
+        ring->stats.dropped_full++;
+        return NULL;
+    }
+
+    return &ring->frames[head & CONTROL_RING_MASK];
+}
+
+void control_commit(control_source_t src)
+{
+    if (src >= CONTROL_SRC_COUNT)
+        return;
+
+    control_ring_t *ring = &g_rings[src];
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    ring->frames[head & CONTROL_RING_MASK].stamp_us = esp_timer_get_time();
+
+    /* Release makes the frame bytes visible before the new head */
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    ring->stats.pushed++;
+
+    TaskHandle_t consumer = g_consumer;
+    if (consumer != NULL)
+        xTaskNotify(consumer, g_consumer_bits, eSetBits);
+}
+
+bool control_push(control_source_t src, const uint8_t *data, size_t len)
+{
+    if (src >= CONTROL_SRC_COUNT || data == NULL)
+        return false;
+
+    if (len > CONTROL_FRAME_SIZE)
+    {
+        control_drop_oversized(src);
+        return false;
+    }
+
+    control_frame_t *frame = control_reserve(src);
+    if (frame == NULL)
+        return false;
+
+    memcpy(frame->data, data, len);
+    frame->len = (uint16_t)len;
+    control_commit(src);
+
+    return true;
+}
+
+void control_drop_oversized(control_source_t src)
+{
+    if (src < CONTROL_SRC_COUNT)
+        g_rings[src].stats.dropped_size++;
+}
+
+const control_frame_t *control_peek(control_source_t src)
+{
+    if (src >= CONTROL_SRC_COUNT)
+        return NULL;
+
+    control_ring_t *ring = &g_rings[src];
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+    if (head == tail)
+        return NULL;
+
+    return &ring->frames[tail & CONTROL_RING_MASK];
+}
+
+void control_release(control_source_t src)
+{
+    if (src >= CONTROL_SRC_COUNT)
+        return;
+
+    control_ring_t *ring = &g_rings[src];
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+
+    /* Release so the producer only reuses the frame once we are done with it */
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+}
+
+void control_get_stats(control_source_t src, control_stats_t *stats)
+{
+    if (src >= CONTROL_SRC_COUNT || stats == NULL)
+        return;
+
+    *stats = g_rings[src].stats;
+}
@@ -0,0 +1,32 @@
+/**
+ * @file dispatcher_config.h
+ * @brief Broker dispatcher configuration
+ */
+#ifndef DISPATCHER_CONFIG_H
+#define DISPATCHER_CONFIG_H
+
+/**
+ * @brief Dispatcher task configuration
+ */
+#define DISPATCHER_TASK_STACK_SIZE   (1024*6)
+#define DISPATCHER_TASK_PRIORITY     6
+#define DISPATCHER_TASK_CORE_ID      0
+
+/**
+ * @brief Task notification bits, one per event source
+ */
+#define DISPATCHER_EVT_UART_RX       (1UL << 0)
+#define DISPATCHER_EVT_CONTROL       (1UL << 1)
+#define DISPATCHER_EVT_UART_TX       (1UL << 2)   /* Queued TX is out, room for held control frames */
+#define DISPATCHER_EVT_BATCH         (1UL << 3)   /* The open telemetry batch reached its latency */
+
+/**
+ * @brief MQTT_EVENT_DATA -> uart_send_async latency measurement
+ *
+ * The last DISPATCHER_LATENCY_SAMPLES latencies of every control source are
+ * kept, p50/p99 are logged every DISPATCHER_LATENCY_SAMPLES commands of a source.
+ */
+#define DISPATCHER_LATENCY_STATS     1
+#define DISPATCHER_LATENCY_SAMPLES   64
+
+#endif /* DISPATCHER_CONFIG_H */
@@ -0,0 +1,44 @@
+/**
+ * @file dispatcher_interface.h
+ * @brief Event driven dispatcher between the UART bridge, MQTT and KWS
+ *
+ * The dispatcher task sleeps on its task notification and is woken by the
+ * UART task (a line arrived) or by any control frame producer (MQTT
+ * command, KWS detection), so nothing waits for a polling period.
+ */
+#ifndef DISPATCHER_INTERFACE_H
+#define DISPATCHER_INTERFACE_H
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "dispatcher_config.h"
+#include "control/control_config.h"
+
+/**
+ * @brief Start the dispatcher task and register it with its event sources
+ *
+ * @return ESP_OK on success, ESP_FAIL if the task can't be created
+ */
+esp_err_t dispatcher_start(void);
+
+/**
+ * @brief Latency from a control frame's commit to uart_send_async over the last samples
+ *
+ * For MQTT this is MQTT_EVENT_DATA -> UART, for UDP datagram received -> UART.
+ * Only frames uart_send_async took are measured.
+ *
+ * @param src    Control source
+ * @param p50_us Median latency in microseconds
+ * @param p99_us 99th percentile latency in microseconds
+ * @return ESP_OK, or ESP_ERR_INVALID_STATE if no command was measured yet
+ */
+esp_err_t dispatcher_get_latency(control_source_t src, uint32_t *p50_us, uint32_t *p99_us);
+
+/**
+ * @brief Control frames of a source dropped because uart_send_async refused them
+ *
+ * A full TX queue is not a failure, the frame waits for DISPATCHER_EVT_UART_TX.
+ */
+uint32_t dispatcher_get_send_failures(control_source_t src);
+
+#endif /* DISPATCHER_INTERFACE_H */
@@ -0,0 +1,268 @@
+/**
+ * @file dispatcher_program.c
+ * @brief Event driven dispatcher between the UART bridge, MQTT and KWS
+ */
+#include <string.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+
+#include "dispatcher_interface.h"
+#include "dispatcher_config.h"
+#include "uart/uart_interface.h"
+#include "control/control_interface.h"
+#include "mqtt/mqtt_interface.h"
+#include "mqtt/mqtt_config.h"
+#include "mqtt/batch/batch.h"
+#include "mqtt/route/route.h"
+#include "mqtt/deadband/deadband.h"
+#include "mqtt/ratelimit/ratelimit.h"
+#include "local_broker/local_broker_interface.h"
+#include "mqtt/cbor/cbor.h"
+
+static const char *TAG = "DISPATCHER";
+static TaskHandle_t dispatcher_task_handle = NULL;
+static uint32_t g_send_failed[CONTROL_SRC_COUNT];   /* Control frames uart_send_async refused, dispatcher task only */
+
+#if ( DISPATCHER_LATENCY_STATS == 1 )
+static portMUX_TYPE g_latency_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t g_latency_us[CONTROL_SRC_COUNT][DISPATCHER_LATENCY_SAMPLES];
+static uint32_t g_latency_count[CONTROL_SRC_COUNT];
+static const char *const g_latency_names[CONTROL_SRC_COUNT] = { "MQTT", "KWS", "Local broker", "UDP" };
+
+static void latency_sort(uint32_t *samples, uint32_t count)
+{
+    for (uint32_t i = 1; i < count; i++)
+    {
+        uint32_t v = samples[i];
+        uint32_t j = i;
+        for (; j > 0 && samples[j - 1] > v; j--)
+            samples[j] = samples[j - 1];
+        samples[j] = v;
+    }
+}
+
+static void latency_record(control_source_t src, int64_t stamp_us)
+{
+    uint32_t latency = (uint32_t)(esp_timer_get_time() - stamp_us);
+
+    taskENTER_CRITICAL(&g_latency_lock);
+    g_latency_us[src][g_latency_count[src] % DISPATCHER_LATENCY_SAMPLES] = latency;
+    g_latency_count[src]++;
+    taskEXIT_CRITICAL(&g_latency_lock);
+
+    if ((g_latency_count[src] % DISPATCHER_LATENCY_SAMPLES) == 0)
+    {
+        uint32_t p50, p99;
+        if (dispatcher_get_latency(src, &p50, &p99) == ESP_OK)
+            ESP_LOGI(TAG, "%s->UART latency p50=%lu us p99=%lu us", g_latency_names[src], (unsigned long)p50, (unsigned long)p99);
+    }
+}
+#endif
+
+esp_err_t dispatcher_get_latency(control_source_t src, uint32_t *p50_us, uint32_t *p99_us)
+{
+#if ( DISPATCHER_LATENCY_STATS == 1 )
+    uint32_t samples[DISPATCHER_LATENCY_SAMPLES];
+    uint32_t count;
+
+    if (src >= CONTROL_SRC_COUNT)
+        return ESP_ERR_INVALID_ARG;
+
+    taskENTER_CRITICAL(&g_latency_lock);
+    count = (g_latency_count[src] < DISPATCHER_LATENCY_SAMPLES) ? g_latency_count[src] : DISPATCHER_LATENCY_SAMPLES;
+    memcpy(samples, g_latency_us[src], count * sizeof(uint32_t));
+    taskEXIT_CRITICAL(&g_latency_lock);
+
+    if (count == 0)
+        return ESP_ERR_INVALID_STATE;
+
+    latency_sort(samples, count);
+    if (p50_us != NULL)
+        *p50_us = samples[(count - 1) * 50 / 100];
+    if (p99_us != NULL)
+        *p99_us = samples[(count - 1) * 99 / 100];
+    return ESP_OK;
+#else
+    (void)src;
+    return ESP_ERR_INVALID_STATE;
+#endif
+}
+
+uint32_t dispatcher_get_send_failures(control_source_t src)
+{
+    return (src < CONTROL_SRC_COUNT) ? g_send_failed[src] : 0;
+}
+
+/**
+ * @brief Forward one reading of a node to MQTT
+ */
+static void dispatch_reading(const mqtt_route_t *route, const uint8_t *payload, size_t payload_len)
+{
+#if ( MQTT_DEADBAND_ENABLE == 1 )
+    /* Nothing changed since the last forwarded reading of this node */
+    if( !mqtt_deadband_pass( route , payload , payload_len ) )
+        return;
+#endif
+
+#if ( MQTT_CBOR_ENABLE == 1 )
+    /* Compact binary on the uplink, readings that can't be transcoded stay JSON */
+    static uint8_t cbor[MQTT_CBOR_MAX_SIZE];
+    size_t cbor_len = mqtt_cbor_from_json( payload , payload_len , cbor , sizeof(cbor) );
+    if( cbor_len > 0 )
+    {
+        payload = cbor;
+        payload_len = cbor_len;
+    }
+#endif
+
+#if ( LOCAL_BROKER_ENABLE == 1 )
+    /* LAN subscribers get every reading on its node topic, batched or not */
+    local_broker_publish( route->sensor_topic , strlen(route->sensor_topic) , payload , payload_len );
+#endif
+
+    /* Send message to mqtt server */
+#if ( MQTT_BATCH_ENABLE == 1 )
+    mqtt_batch_add( route->id_str , payload , payload_len );
+#else
+    mqtt_send_buffer( route->sensor_topic , payload , payload_len , MQTT_TELEMETRY_QOS , 0 , MQTT_LANE_TELEMETRY );
+#endif
+}
+
+/**
+ * @brief Forward one line from the UART bridge to MQTT
+ */
+static void dispatch_uart_line(uart_queue_msg_t *rx_msg)
+{
+    if (rx_msg->data_len == 0)
+        return;
+
+    // Null-terminate for printing as string (if appropriate)
+    if (rx_msg->data_len >= UART_BUF_SIZE)
+        rx_msg->data_len = UART_BUF_SIZE - 1;
+    rx_msg->data[rx_msg->data_len] = '\0';
+    ESP_LOGI(TAG, "Received message: %s", (char *)(rx_msg->data) );
+
+    size_t payload_off = 0;
+    const mqtt_route_t *route;
+    if( rx_msg->node_id != BRIDGE_NODE_NONE )
+        route = mqtt_route_get( rx_msg->node_id );   /* Framed, the ID came in the header */
+    else
+        route = mqtt_route_from_line( rx_msg->data , rx_msg->data_len , &payload_off );
+    if( route == NULL )
+    {
+        ESP_LOGW(TAG, "Line without node ID dropped");
+        return;
+    }
+
+    const uint8_t *payload = rx_msg->data + payload_off;
+    size_t payload_len = rx_msg->data_len - payload_off;
+
+#if ( MQTT_RATELIMIT_ENABLE == 1 )
+    /* Over its rate the node's reading is held or dropped, other nodes keep their share */
+    if( !mqtt_ratelimit_admit( route , payload , payload_len ) )
+        return;
+#endif
+
+    dispatch_reading( route , payload , payload_len );
+}
+
+/**
+ * @brief Forward every queued control frame to the UART bridge, in arrival order per source
+ */
+static void dispatch_control_frames(void)
+{
+    for( int src = 0 ; src < CONTROL_SRC_COUNT ; src++ )
+    {
+        const control_frame_t *frame;
+        while( (frame = control_peek( (control_source_t)src )) != NULL )
+        {
+            esp_err_t status = uart_send_async( frame->data , frame->len , 0 );
+            if (status == ESP_ERR_TIMEOUT)
+                return;     /* TX queue full, the frame stays in its ring until DISPATCHER_EVT_UART_TX */
+            if (status == ESP_OK)
+            {
+#if ( DISPATCHER_LATENCY_STATS == 1 )
+                latency_record( (control_source_t)src , frame->stamp_us );
+#endif
+            }
+            else
+            {
+                /* Refused for good, the frame is dropped and measures nothing */
+                g_send_failed[src]++;
+                ESP_LOGE(TAG, "Uart sending message");
+            }
+            control_release( (control_source_t)src );
+        }
+    }
+}
+
+static void dispatcher_task(void *pvParameters)
+{
+    static uart_queue_msg_t rx_msg;
+    uint32_t events = 0;
+    TickType_t wait = portMAX_DELAY;
+
+    ESP_LOGI(TAG, "Dispatcher started");
+
+    while (1)
+    {
+        /* Control first, a command must not wait behind a burst of telemetry */
+        dispatch_control_frames();
+
+        while( uart_receive(&rx_msg, 0) )
+        {
+            if (rx_msg.msg_type == UART_MSG_RECEIVED)
+                dispatch_uart_line(&rx_msg);
+            dispatch_control_frames();
+        }
+
+        /* Published here, the batch's latency timer only wakes us */
+        if (events & DISPATCHER_EVT_BATCH)
+            mqtt_batch_flush_due();
+
+#if ( MQTT_RATELIMIT_ENABLE == 1 )
+        /* Held readings of throttled nodes, wake up again when the next one may go */
+        wait = mqtt_ratelimit_release( dispatch_reading );
+#endif
+
+        /* Sleep until a source signals new work, the bits set meanwhile are kept */
+        xTaskNotifyWait(0, DISPATCHER_EVT_UART_RX | DISPATCHER_EVT_UART_TX | DISPATCHER_EVT_CONTROL | DISPATCHER_EVT_BATCH, &events, wait);
+    }
+}
+
+esp_err_t dispatcher_start(void)
+{
+    if (!uart_is_started())
+    {
+        ESP_LOGE(TAG, "UART not started");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    BaseType_t task_created = xTaskCreatePinnedToCore(
+        dispatcher_task,
+        "dispatcher",
+        DISPATCHER_TASK_STACK_SIZE,
+        NULL,
+        DISPATCHER_TASK_PRIORITY,
+        &dispatcher_task_handle,
+        DISPATCHER_TASK_CORE_ID
+    );
+
+    if (task_created != pdPASS)
+    {
+        ESP_LOGE(TAG, "Failed to create dispatcher task");
+        return ESP_FAIL;
+    }
+
+    /* Wake the dispatcher on every source, then once more for anything queued before */
+    uart_set_rx_notify(dispatcher_task_handle, DISPATCHER_EVT_UART_RX);
+    uart_set_tx_notify(dispatcher_task_handle, DISPATCHER_EVT_UART_TX);
+    control_set_consumer(dispatcher_task_handle, DISPATCHER_EVT_CONTROL);
+    mqtt_batch_set_consumer(dispatcher_task_handle, DISPATCHER_EVT_BATCH);
+    xTaskNotify(dispatcher_task_handle, DISPATCHER_EVT_UART_RX | DISPATCHER_EVT_CONTROL, eSetBits);
+
+    return ESP_OK;
+}
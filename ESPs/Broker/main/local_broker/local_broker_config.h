@@ -0,0 +1,66 @@
+/**
+ * @file local_broker_config.h
+ * @brief Embedded MQTT 3.1.1 broker configuration
+ */
+#ifndef LOCAL_BROKER_CONFIG_H
+#define LOCAL_BROKER_CONFIG_H
+
+#include "sdkconfig.h"
+#include "Network/pool/pool.h"
+
+/**
+ * @brief lwIP sockets the rest of the firmware may hold at once
+ *
+ * The Network connection pool, one one shot Network connection, the MQTT
+ * client and the UDP control socket. The broker's clients get what is left
+ * of CONFIG_LWIP_MAX_SOCKETS after these and the listener, so a busy LAN
+ * can't starve the Network pool or the upstream connection.
+ */
+#define LOCAL_BROKER_OTHER_SOCKETS   (NETWORK_POOL_SIZE + 3)
+
+/**
+ * @brief Broker parameters
+ */
+#define LOCAL_BROKER_ENABLE          1
+#define LOCAL_BROKER_PORT            1883
+#define LOCAL_BROKER_MAX_CLIENTS     (CONFIG_LWIP_MAX_SOCKETS - LOCAL_BROKER_OTHER_SOCKETS - 1)   /* 20 of 32 sockets */
+#define LOCAL_BROKER_MAX_SUBS        8      /* Topic filters per client */
+#define LOCAL_BROKER_TOPIC_SIZE      64     /* Longest topic filter + NUL */
+#define LOCAL_BROKER_RX_SIZE         1024   /* Largest packet a client may send */
+#define LOCAL_BROKER_CONNECT_MS      5000   /* Time a new client has to send CONNECT */
+#define LOCAL_BROKER_USE_PSRAM       1
+
+/**
+ * @brief Messages handed to the broker by other tasks (telemetry, upstream control)
+ */
+#define LOCAL_BROKER_QUEUE_SIZE      16
+#define LOCAL_BROKER_MSG_SIZE        256
+
+/**
+ * @brief Bridge to the upstream broker
+ *
+ * Publishes under LOCAL_BROKER_BRIDGE_PREFIX are also sent upstream.
+ * Upstream control commands and node telemetry are delivered to LAN
+ * subscribers.
+ *
+ * LAN publishes on MQTT_CONTROL_TOPIC_PREFIX are never sent upstream. With
+ * LOCAL_BROKER_CONTROL_ENABLE they go straight to the UART bridge, otherwise
+ * they are refused: the broker has no authentication, so anyone on the LAN
+ * could drive the nodes. Use the HMAC authenticated UDP control path instead.
+ */
+#define LOCAL_BROKER_BRIDGE_ENABLE   1
+#define LOCAL_BROKER_BRIDGE_PREFIX   "wot/"
+#define LOCAL_BROKER_CONTROL_ENABLE  0
+
+/**
+ * @brief Broker task configuration
+ */
+#define LOCAL_BROKER_TASK_STACK_SIZE (1024*5)
+#define LOCAL_BROKER_TASK_PRIORITY   6
+#define LOCAL_BROKER_TASK_CORE_ID    0
+
+#if ( LOCAL_BROKER_ENABLE == 1 ) && ( LOCAL_BROKER_MAX_CLIENTS < 4 )
+#error "CONFIG_LWIP_MAX_SOCKETS leaves the local broker fewer than 4 clients, raise it or shrink NETWORK_POOL_SIZE"
+#endif
+
+#endif /* LOCAL_BROKER_CONFIG_H */
@@ -0,0 +1,61 @@
+/**
+ * @file local_broker_interface.h
+ * @brief Embedded MQTT 3.1.1 broker for LAN clients
+ *
+ * A single task serves up to LOCAL_BROKER_MAX_CLIENTS clients with select(),
+ * so LAN clients and the local control loop keep working when the upstream
+ * broker is slow or down. With LOCAL_BROKER_CONTROL_ENABLE, control commands
+ * published on the LAN reach the UART bridge without leaving the ESP.
+ *
+ * Supported: CONNECT, PUBLISH (QoS 0, 1 and 2 in), SUBSCRIBE with + and #
+ * wildcards, UNSUBSCRIBE, PINGREQ, DISCONNECT, keep alive. Not supported:
+ * retained messages, wills, persistent sessions and authentication. Every
+ * subscription is granted QoS 0, a client too slow to take a message misses it.
+ */
+#ifndef LOCAL_BROKER_INTERFACE_H
+#define LOCAL_BROKER_INTERFACE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "local_broker_config.h"
+
+/**
+ * @brief Broker counters
+ */
+typedef struct {
+    uint32_t clients;        /* Clients connected now */
+    uint32_t connects;       /* CONNECTs accepted */
+    uint32_t rejected;       /* Connections refused, no free slot or bad CONNECT */
+    uint32_t publishes_in;   /* PUBLISH packets from clients and other tasks */
+    uint32_t delivered;      /* PUBLISH packets sent to subscribers */
+    uint32_t dropped;        /* Deliveries lost, socket full or queue full */
+    uint32_t bridged;        /* LAN publishes sent upstream */
+    uint32_t refused;        /* LAN control publishes refused, LOCAL_BROKER_CONTROL_ENABLE is 0 */
+} local_broker_stats_t;
+
+/**
+ * @brief Start the broker task listening on LOCAL_BROKER_PORT
+ *
+ * @return ESP_OK on success, ESP_ERR_NO_MEM or ESP_FAIL otherwise
+ */
+esp_err_t local_broker_start(void);
+
+/**
+ * @brief Publish a message to the LAN subscribers, from any task
+ *
+ * @param topic     Topic bytes, not NUL-terminated
+ * @param topic_len Topic length
+ * @param data      Payload
+ * @param len       Payload length
+ * @return ESP_OK, ESP_ERR_INVALID_SIZE if it doesn't fit a queue item,
+ *         ESP_ERR_TIMEOUT if the queue is full, ESP_ERR_INVALID_STATE if not started
+ */
+esp_err_t local_broker_publish(const char *topic, size_t topic_len, const void *data, size_t len);
+
+/**
+ * @brief Copy the broker counters
+ */
+void local_broker_get_stats(local_broker_stats_t *stats);
+
+#endif /* LOCAL_BROKER_INTERFACE_H */
@@ -0,0 +1,724 @@
+/**
+ * @file local_broker_program.c
+ * @brief Embedded MQTT 3.1.1 broker for LAN clients
+ */
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "esp_vfs_eventfd.h"
+#include "lwip/sockets.h"
+
+#include "local_broker_interface.h"
+#include "control/control_interface.h"
+#include "mqtt/mqtt_interface.h"
+#include "mqtt/mqtt_config.h"
+#include "mqtt/route/route.h"
+
+/**
+ * @brief MQTT 3.1.1 control packet types (high nibble of the first byte)
+ */
+#define LB_CONNECT       1
+#define LB_CONNACK       2
+#define LB_PUBLISH       3
+#define LB_PUBACK        4
+#define LB_PUBREC        5
+#define LB_PUBREL        6
+#define LB_PUBCOMP       7
+#define LB_SUBSCRIBE     8
+#define LB_SUBACK        9
+#define LB_UNSUBSCRIBE   10
+#define LB_UNSUBACK      11
+#define LB_PINGREQ       12
+#define LB_PINGRESP      13
+#define LB_DISCONNECT    14
+
+#define LB_CONNACK_ACCEPTED      0
+#define LB_CONNACK_BAD_PROTOCOL  1
+#define LB_SUBACK_FAILURE        0x80
+#define LB_MAX_FILTERS           16     /* Topic filters in one SUBSCRIBE */
+
+static const char *TAG = "LOCAL_BROKER";
+
+/**
+ * @brief One client connection, free while sock is -1
+ */
+typedef struct {
+    int      sock;
+    bool     connected;                  /* CONNECT accepted */
+    uint16_t keepalive_s;                /* 0 = no keep alive */
+    int64_t  last_rx_us;
+    uint16_t rx_len;
+    uint8_t  rx[LOCAL_BROKER_RX_SIZE];   /* Bytes of the packet being received */
+    uint8_t  sub_count;
+    char     subs[LOCAL_BROKER_MAX_SUBS][LOCAL_BROKER_TOPIC_SIZE];
+} lb_client_t;
+
+/**
+ * @brief Message handed over by another task
+ */
+typedef struct {
+    uint8_t  topic_len;
+    uint16_t len;
+    char     topic[LOCAL_BROKER_TOPIC_SIZE];
+    uint8_t  data[LOCAL_BROKER_MSG_SIZE];
+} lb_msg_t;
+
+static lb_client_t *g_clients = NULL;
+static QueueHandle_t g_queue = NULL;
+static int g_event_fd = -1;         /* Wakes select() when g_queue has messages */
+static int g_listen_fd = -1;
+static uint8_t g_tx[5 + 2 + LOCAL_BROKER_RX_SIZE];
+static portMUX_TYPE g_stats_lock = portMUX_INITIALIZER_UNLOCKED;
+static local_broker_stats_t g_stats;
+
+#define LB_STAT_ADD(field, n) do { \
+        taskENTER_CRITICAL(&g_stats_lock); \
+        g_stats.field += (n); \
+        taskEXIT_CRITICAL(&g_stats_lock); \
+    } while (0)
+
+/* Fixed header, returns its length */
+static size_t lb_header(uint8_t *buf, uint8_t first, size_t remaining)
+{
+    size_t n = 0;
+
+    buf[n++] = first;
+    do {
+        uint8_t b = remaining & 0x7F;
+        remaining >>= 7;
+        buf[n++] = remaining ? (b | 0x80) : b;
+    } while (remaining);
+
+    return n;
+}
+
+/* Remaining length, 0 if more bytes are needed, -1 if malformed */
+static int lb_remaining(const uint8_t *buf, size_t len, size_t *remaining, size_t *header_len)
+{
+    size_t value = 0;
+
+    for (size_t i = 1; i < 5; i++) {
+        if (i >= len)
+            return 0;
+        value |= (size_t)(buf[i] & 0x7F) << (7 * (i - 1));
+        if ((buf[i] & 0x80) == 0) {
+            *remaining = value;
+            *header_len = i + 1;
+            return 1;
+        }
+    }
+
+    return -1;
+}
+
+/* Length prefixed string at *p, NULL if it overruns end */
+static const uint8_t *lb_string(const uint8_t **p, const uint8_t *end, size_t *len)
+{
+    if (end - *p < 2)
+        return NULL;
+    *len = ((size_t)(*p)[0] << 8) | (*p)[1];
+    if ((size_t)(end - *p - 2) < *len)
+        return NULL;
+
+    const uint8_t *s = *p + 2;
+    *p += 2 + *len;
+    return s;
+}
+
+/* '+' must be a whole level, '#' the whole last level */
+static bool lb_filter_valid(const uint8_t *f, size_t len)
+{
+    if (len == 0 || len >= LOCAL_BROKER_TOPIC_SIZE || memchr(f, '\0', len) != NULL)
+        return false;
+
+    for (size_t i = 0; i < len; i++) {
+        if (f[i] != '+' && f[i] != '#')
+            continue;
+        if (i > 0 && f[i - 1] != '/')
+            return false;
+        if (f[i] == '#' && i != len - 1)
+            return false;
+        if (f[i] == '+' && i + 1 < len && f[i + 1] != '/')
+            return false;
+    }
+
+    return true;
+}
+
+static bool lb_topic_match(const char *filter, const char *topic, size_t topic_len)
+{
+    const char *t = topic;
+    const char *end = topic + topic_len;
+
+    /* Wildcards at the first level don't match $SYS style topics */
+    if (topic_len > 0 && topic[0] == '$' && (filter[0] == '+' || filter[0] == '#'))
+        return false;
+
+    while (*filter) {
+        if (*filter == '#')
+            return true;
+        if (*filter == '+') {
+            while (t < end && *t != '/')
+                t++;
+            filter++;
+        } else {
+            while (*filter && *filter != '/') {
+                if (t >= end || *t != *filter)
+                    return false;
+                t++;
+                filter++;
+            }
+        }
+
+        if (*filter != '/')
+            break;
+        if (t >= end)
+            return filter[1] == '#' && filter[2] == '\0';   /* "a/#" matches "a" */
+        if (*t != '/')
+            return false;
+        filter++;
+        t++;
+    }
+
+    return t == end;
+}
+
+static void lb_close(lb_client_t *c)
+{
+    if (c->sock < 0)
+        return;
+
+    close(c->sock);
+    c->sock = -1;
+    c->rx_len = 0;
+    c->sub_count = 0;
+    if (c->connected) {
+        c->connected = false;
+        taskENTER_CRITICAL(&g_stats_lock);
+        g_stats.clients--;
+        taskEXIT_CRITICAL(&g_stats_lock);
+    }
+}
+
+/* Whole packet or nothing, a partial write would corrupt the stream so the client is closed */
+static bool lb_send(lb_client_t *c, const uint8_t *buf, size_t len)
+{
+    int sent = send(c->sock, buf, len, MSG_DONTWAIT);
+
+    if (sent == (int)len)
+        return true;
+    if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        LB_STAT_ADD(dropped, 1);
+        return false;
+    }
+
+    ESP_LOGW(TAG, "Client too slow or gone, closing");
+    lb_close(c);
+    return false;
+}
+
+static void lb_ack(lb_client_t *c, uint8_t type, uint8_t flags, uint16_t packet_id)
+{
+    uint8_t ack[4] = { (uint8_t)((type << 4) | flags), 2, (uint8_t)(packet_id >> 8), (uint8_t)packet_id };
+    lb_send(c, ack, sizeof(ack));
+}
+
+/* PUBLISH at QoS 0 to every client with a matching filter */
+static void lb_deliver(const char *topic, size_t topic_len, const uint8_t *data, size_t len)
+{
+    size_t n;
+    uint32_t delivered = 0;
+
+    if (topic_len > LOCAL_BROKER_RX_SIZE || len > sizeof(g_tx) - 7 - topic_len)
+        return;
+
+    n = lb_header(g_tx, LB_PUBLISH << 4, 2 + topic_len + len);
+    g_tx[n++] = (uint8_t)(topic_len >> 8);
+    g_tx[n++] = (uint8_t)topic_len;
+    memcpy(g_tx + n, topic, topic_len);
+    n += topic_len;
+    memcpy(g_tx + n, data, len);
+    n += len;
+
+    for (int i = 0; i < LOCAL_BROKER_MAX_CLIENTS; i++) {
+        lb_client_t *c = &g_clients[i];
+        if (c->sock < 0 || !c->connected)
+            continue;
+        for (int s = 0; s < c->sub_count; s++) {
+            if (lb_topic_match(c->subs[s], topic, topic_len)) {
+                if (lb_send(c, g_tx, n))
+                    delivered++;
+                break;
+            }
+        }
+    }
+
+    LB_STAT_ADD(delivered, delivered);
+}
+
+/* LAN publish: control commands to the UART bridge if allowed, the rest upstream */
+static void lb_route(const char *topic, size_t topic_len, const uint8_t *data, size_t len)
+{
+    size_t prefix_len = strlen(MQTT_CONTROL_TOPIC_PREFIX);
+
+    if (topic_len >= prefix_len && memcmp(topic, MQTT_CONTROL_TOPIC_PREFIX, prefix_len) == 0) {
+#if ( LOCAL_BROKER_CONTROL_ENABLE == 1 )
+        /* Only nodes heard on the UART bridge, a publish never adds a route */
+        const mqtt_route_t *route = mqtt_route_from_topic(topic, topic_len);
+        if (route == NULL)
+            return;
+        if (len + route->id_len > CONTROL_FRAME_SIZE) {
+            control_drop_oversized(CONTROL_SRC_LOCAL_BROKER);
+            return;
+        }
+        control_frame_t *frame = control_reserve(CONTROL_SRC_LOCAL_BROKER);
+        if (frame == NULL)
+            return;
+        memcpy(frame->data, route->id_str, route->id_len);   /* Add node ID at first */
+        memcpy(frame->data + route->id_len, data, len);
+        frame->len = len + route->id_len;
+        control_commit(CONTROL_SRC_LOCAL_BROKER);
+#else
+        /* Not upstream either, the command would come back down to the UART */
+        LB_STAT_ADD(refused, 1);
+#endif
+        return;
+    }
+
+#if ( LOCAL_BROKER_BRIDGE_ENABLE == 1 )
+    size_t bridge_len = strlen(LOCAL_BROKER_BRIDGE_PREFIX);
+    char bridge_topic[LOCAL_BROKER_TOPIC_SIZE];
+
+    if (topic_len >= sizeof(bridge_topic) || topic_len < bridge_len ||
+        memcmp(topic, LOCAL_BROKER_BRIDGE_PREFIX, bridge_len) != 0)
+        return;
+    memcpy(bridge_topic, topic, topic_len);
+    bridge_topic[topic_len] = '\0';
+    if (mqtt_send_buffer(bridge_topic, data, len, 0, 0, MQTT_LANE_TELEMETRY) == ESP_OK)
+        LB_STAT_ADD(bridged, 1);
+#endif
+}
+
+static bool lb_on_connect(lb_client_t *c, const uint8_t *p, const uint8_t *end)
+{
+    static const uint8_t protocol[] = { 0, 4, 'M', 'Q', 'T', 'T', 4 };
+    uint8_t connack[4] = { LB_CONNACK << 4, 2, 0, LB_CONNACK_ACCEPTED };
+
+    if (c->connected)
+        return false;   /* A second CONNECT is a protocol violation */
+    if (end - p < (int)sizeof(protocol) + 3 || memcmp(p, protocol, sizeof(protocol)) != 0) {
+        connack[3] = LB_CONNACK_BAD_PROTOCOL;
+        lb_send(c, connack, sizeof(connack));
+        return false;
+    }
+
+    /* Client ID, will, user name and password are read but not used */
+    c->keepalive_s = ((uint16_t)p[8] << 8) | p[9];
+    if (!lb_send(c, connack, sizeof(connack)))
+        return false;
+
+    c->connected = true;
+    taskENTER_CRITICAL(&g_stats_lock);
+    g_stats.clients++;
+    g_stats.connects++;
+    taskEXIT_CRITICAL(&g_stats_lock);
+    return true;
+}
+
+static bool lb_on_publish(lb_client_t *c, uint8_t flags, const uint8_t *p, const uint8_t *end)
+{
+    uint8_t qos = (flags >> 1) & 3;
+    uint16_t packet_id = 0;
+    size_t topic_len;
+    const uint8_t *topic = lb_string(&p, end, &topic_len);
+
+    if (topic == NULL || topic_len == 0 || qos == 3)
+        return false;
+    if (memchr(topic, '+', topic_len) != NULL || memchr(topic, '#', topic_len) != NULL)
+        return false;
+    if (qos > 0) {
+        if (end - p < 2)
+            return false;
+        packet_id = ((uint16_t)p[0] << 8) | p[1];
+        p += 2;
+    }
+
+    LB_STAT_ADD(publishes_in, 1);
+    lb_route((const char *)topic, topic_len, p, end - p);
+    lb_deliver((const char *)topic, topic_len, p, end - p);
+
+    /* QoS 2 is delivered on PUBLISH, a resent PUBLISH would be delivered twice */
+    if (qos == 1)
+        lb_ack(c, LB_PUBACK, 0, packet_id);
+    else if (qos == 2)
+        lb_ack(c, LB_PUBREC, 0, packet_id);
+
+    return true;
+}
+
+static bool lb_on_subscribe(lb_client_t *c, const uint8_t *p, const uint8_t *end)
+{
+    uint8_t suback[4 + LB_MAX_FILTERS];
+    size_t count = 0;
+
+    if (end - p < 2)
+        return false;
+    uint16_t packet_id = ((uint16_t)p[0] << 8) | p[1];
+    p += 2;
+
+    while (p < end) {
+        size_t len;
+        const uint8_t *filter = lb_string(&p, end, &len);
+        if (filter == NULL || p >= end || count == LB_MAX_FILTERS)
+            return false;
+        p++;   /* Requested QoS, every subscription is QoS 0 */
+
+        uint8_t code = LB_SUBACK_FAILURE;
+        if (lb_filter_valid(filter, len)) {
+            int s;
+            for (s = 0; s < c->sub_count; s++) {
+                if (strlen(c->subs[s]) == len && memcmp(c->subs[s], filter, len) == 0)
+                    break;
+            }
+            if (s == c->sub_count && c->sub_count < LOCAL_BROKER_MAX_SUBS) {
+                memcpy(c->subs[s], filter, len);
+                c->subs[s][len] = '\0';
+                c->sub_count++;
+            }
+            if (s < c->sub_count)
+                code = 0;
+        }
+        suback[4 + count++] = code;
+    }
+    if (count == 0)
+        return false;
+
+    size_t n = lb_header(suback, LB_SUBACK << 4, 2 + count);   /* 2 bytes, count <= LB_MAX_FILTERS */
+    suback[n++] = (uint8_t)(packet_id >> 8);
+    suback[n++] = (uint8_t)packet_id;
+    lb_send(c, suback, n + count);
+    return true;
+}
+
+static bool lb_on_unsubscribe(lb_client_t *c, const uint8_t *p, const uint8_t *end)
+{
+    if (end - p < 2)
+        return false;
+    uint16_t packet_id = ((uint16_t)p[0] << 8) | p[1];
+    p += 2;
+
+    while (p < end) {
+        size_t len;
+        const uint8_t *filter = lb_string(&p, end, &len);
+        if (filter == NULL)
+            return false;
+        for (int s = 0; s < c->sub_count; s++) {
+            if (strlen(c->subs[s]) == len && memcmp(c->subs[s], filter, len) == 0) {
+                memcpy(c->subs[s], c->subs[--c->sub_count], LOCAL_BROKER_TOPIC_SIZE);
+                break;
+            }
+        }
+    }
+
+    lb_ack(c, LB_UNSUBACK, 0, packet_id);
+    return true;
+}
+
+/* One complete packet, false closes the connection */
+static bool lb_handle(lb_client_t *c, const uint8_t *pkt, size_t header_len, size_t remaining)
+{
+    uint8_t type = pkt[0] >> 4;
+    uint8_t flags = pkt[0] & 0x0F;
+    const uint8_t *p = pkt + header_len;
+    const uint8_t *end = p + remaining;
+
+    if (!c->connected && type != LB_CONNECT)
+        return false;
+
+    switch (type) {
+        case LB_CONNECT:
+            return lb_on_connect(c, p, end);
+        case LB_PUBLISH:
+            return lb_on_publish(c, flags, p, end);
+        case LB_PUBREL:
+            if (remaining < 2)
+                return false;
+            lb_ack(c, LB_PUBCOMP, 0, ((uint16_t)p[0] << 8) | p[1]);
+            return true;
+        case LB_SUBSCRIBE:
+            return flags == 0x2 && lb_on_subscribe(c, p, end);
+        case LB_UNSUBSCRIBE:
+            return flags == 0x2 && lb_on_unsubscribe(c, p, end);
+        case LB_PINGREQ: {
+            static const uint8_t pingresp[2] = { LB_PINGRESP << 4, 0 };
+            lb_send(c, pingresp, sizeof(pingresp));
+            return true;
+        }
+        case LB_PUBACK:
+        case LB_PUBREC:
+        case LB_PUBCOMP:
+            return true;   /* Deliveries are QoS 0, nothing to track */
+        default:
+            return false;  /* DISCONNECT or a packet only a server sends */
+    }
+}
+
+static void lb_receive(lb_client_t *c)
+{
+    int got = recv(c->sock, c->rx + c->rx_len, sizeof(c->rx) - c->rx_len, MSG_DONTWAIT);
+
+    if (got == 0 || (got < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+        lb_close(c);
+        return;
+    }
+    if (got < 0)
+        return;
+    c->rx_len += got;
+    c->last_rx_us = esp_timer_get_time();
+
+    while (c->sock >= 0 && c->rx_len > 0) {
+        size_t remaining, header_len;
+        int status = lb_remaining(c->rx, c->rx_len, &remaining, &header_len);
+        if (status == 0)
+            return;
+        if (status < 0 || header_len + remaining > sizeof(c->rx)) {
+            ESP_LOGW(TAG, "Malformed or oversized packet, closing");
+            lb_close(c);
+            return;
+        }
+        size_t total = header_len + remaining;
+        if (c->rx_len < total)
+            return;
+
+        if (!lb_handle(c, c->rx, header_len, remaining)) {
+            lb_close(c);
+            return;
+        }
+        if (c->sock < 0)
+            return;   /* Closed by a failed send */
+        c->rx_len -= total;
+        memmove(c->rx, c->rx + total, c->rx_len);
+    }
+}
+
+static void lb_accept(void)
+{
+    int sock = accept(g_listen_fd, NULL, NULL);
+    int one = 1;
+
+    if (sock < 0)
+        return;
+
+    for (int i = 0; i < LOCAL_BROKER_MAX_CLIENTS; i++) {
+        lb_client_t *c = &g_clients[i];
+        if (c->sock >= 0)
+            continue;
+        fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+        setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        c->sock = sock;
+        c->connected = false;
+        c->keepalive_s = 0;
+        c->rx_len = 0;
+        c->sub_count = 0;
+        c->last_rx_us = esp_timer_get_time();
+        return;
+    }
+
+    ESP_LOGW(TAG, "No free client slot");
+    LB_STAT_ADD(rejected, 1);
+    close(sock);
+}
+
+/* Close clients silent for 1.5 keep alive periods, or that never sent CONNECT */
+static void lb_expire(int64_t now_us)
+{
+    for (int i = 0; i < LOCAL_BROKER_MAX_CLIENTS; i++) {
+        lb_client_t *c = &g_clients[i];
+        if (c->sock < 0)
+            continue;
+        int64_t limit_us = c->connected ? (int64_t)c->keepalive_s * 1500000 : (int64_t)LOCAL_BROKER_CONNECT_MS * 1000;
+        if (limit_us > 0 && now_us - c->last_rx_us > limit_us) {
+            ESP_LOGI(TAG, "Client timed out");
+            if (!c->connected)
+                LB_STAT_ADD(rejected, 1);
+            lb_close(c);
+        }
+    }
+}
+
+static void lb_drain_queue(void)
+{
+    static lb_msg_t msg;
+    uint64_t count;
+
+    read(g_event_fd, &count, sizeof(count));
+    while (xQueueReceive(g_queue, &msg, 0) == pdPASS) {
+        LB_STAT_ADD(publishes_in, 1);
+        lb_deliver(msg.topic, msg.topic_len, msg.data, msg.len);
+    }
+}
+
+static void local_broker_task(void *pvParameters)
+{
+    ESP_LOGI(TAG, "Local broker listening on port %d", LOCAL_BROKER_PORT);
+
+    while (1) {
+        fd_set rfds;
+        int max_fd = (g_listen_fd > g_event_fd) ? g_listen_fd : g_event_fd;
+        struct timeval tv = { .tv_sec = 1, .tv_usec = 0 };
+
+        FD_ZERO(&rfds);
+        FD_SET(g_listen_fd, &rfds);
+        FD_SET(g_event_fd, &rfds);
+        for (int i = 0; i < LOCAL_BROKER_MAX_CLIENTS; i++) {
+            if (g_clients[i].sock >= 0) {
+                FD_SET(g_clients[i].sock, &rfds);
+                if (g_clients[i].sock > max_fd)
+                    max_fd = g_clients[i].sock;
+            }
+        }
+
+        int ready = select(max_fd + 1, &rfds, NULL, NULL, &tv);
+        if (ready < 0) {
+            ESP_LOGE(TAG, "select failed, errno %d", errno);
+            vTaskDelay(pdMS_TO_TICKS(100));
+            continue;
+        }
+
+        if (ready > 0) {
+            if (FD_ISSET(g_event_fd, &rfds))
+                lb_drain_queue();
+            for (int i = 0; i < LOCAL_BROKER_MAX_CLIENTS; i++) {
+                if (g_clients[i].sock >= 0 && FD_ISSET(g_clients[i].sock, &rfds))
+                    lb_receive(&g_clients[i]);
+            }
+            if (FD_ISSET(g_listen_fd, &rfds))
+                lb_accept();
+        }
+
+        lb_expire(esp_timer_get_time());
+    }
+}
+
+/* Undo a partly done local_broker_start(), the eventfd VFS stays registered */
+static void lb_free(void)
+{
+    if (g_listen_fd >= 0)
+        close(g_listen_fd);
+    if (g_event_fd >= 0)
+        close(g_event_fd);
+    if (g_queue != NULL)
+        vQueueDelete(g_queue);
+    heap_caps_free(g_clients);
+    g_listen_fd = -1;
+    g_event_fd = -1;
+    g_queue = NULL;
+    g_clients = NULL;
+}
+
+esp_err_t local_broker_start(void)
+{
+    esp_vfs_eventfd_config_t eventfd_config = ESP_VFS_EVENTD_CONFIG_DEFAULT();
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(LOCAL_BROKER_PORT),
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+    };
+    int one = 1;
+
+    if (g_clients != NULL)
+        return ESP_OK;
+
+#if ( LOCAL_BROKER_USE_PSRAM == 1 )
+    g_clients = heap_caps_calloc(LOCAL_BROKER_MAX_CLIENTS, sizeof(lb_client_t), MALLOC_CAP_SPIRAM);
+#endif
+    if (g_clients == NULL)
+        g_clients = heap_caps_calloc(LOCAL_BROKER_MAX_CLIENTS, sizeof(lb_client_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    g_queue = xQueueCreate(LOCAL_BROKER_QUEUE_SIZE, sizeof(lb_msg_t));
+    if (g_clients == NULL || g_queue == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate the local broker");
+        lb_free();
+        return ESP_ERR_NO_MEM;
+    }
+    for (int i = 0; i < LOCAL_BROKER_MAX_CLIENTS; i++)
+        g_clients[i].sock = -1;
+
+    /* ESP_ERR_INVALID_STATE: already registered by another module */
+    esp_err_t err = esp_vfs_eventfd_register(&eventfd_config);
+    if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) {
+        lb_free();
+        return err;
+    }
+    g_event_fd = eventfd(0, 0);
+
+    g_listen_fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (g_event_fd < 0 || g_listen_fd < 0) {
+        ESP_LOGE(TAG, "Failed to create the broker sockets");
+        lb_free();
+        return ESP_FAIL;
+    }
+    setsockopt(g_listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(g_listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        listen(g_listen_fd, 4) != 0) {
+        ESP_LOGE(TAG, "Failed to listen on port %d, errno %d", LOCAL_BROKER_PORT, errno);
+        lb_free();
+        return ESP_FAIL;
+    }
+
+    BaseType_t task_created = xTaskCreatePinnedToCore(
+        local_broker_task,
+        "local_broker",
+        LOCAL_BROKER_TASK_STACK_SIZE,
+        NULL,
+        LOCAL_BROKER_TASK_PRIORITY,
+        NULL,
+        LOCAL_BROKER_TASK_CORE_ID
+    );
+    if (task_created != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create local broker task");
+        lb_free();
+        return ESP_FAIL;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t local_broker_publish(const char *topic, size_t topic_len, const void *data, size_t len)
+{
+    lb_msg_t item;
+    uint64_t one = 1;
+
+    if (g_queue == NULL || g_event_fd < 0)
+        return ESP_ERR_INVALID_STATE;
+    if (topic_len >= LOCAL_BROKER_TOPIC_SIZE || len > LOCAL_BROKER_MSG_SIZE)
+        return ESP_ERR_INVALID_SIZE;
+
+    item.topic_len = (uint8_t)topic_len;
+    item.len = (uint16_t)len;
+    memcpy(item.topic, topic, topic_len);
+    memcpy(item.data, data, len);
+
+    if (xQueueSend(g_queue, &item, 0) != pdPASS) {
+        LB_STAT_ADD(dropped, 1);
+        return ESP_ERR_TIMEOUT;
+    }
+
+    write(g_event_fd, &one, sizeof(one));
+    return ESP_OK;
+}
+
+void local_broker_get_stats(local_broker_stats_t *stats)
+{
+    if (stats == NULL)
+        return;
+
+    taskENTER_CRITICAL(&g_stats_lock);
+    *stats = g_stats;
+    taskEXIT_CRITICAL(&g_stats_lock);
+}
@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <string.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "esp_log.h"
@@ -7,6 +8,10 @@
 #include "mqtt/mqtt_config.h"
 #include "Network/Network_inteface.h"
 #include "KWS/keyword_spotting_interface.h"
+#include "control/control_interface.h"
+#include "dispatcher/dispatcher_interface.h"
+#include "local_broker/local_broker_interface.h"
+#include "udp_control/udp_control_interface.h"
 
 #include "uart/uart_interface.h"
 
@@ -15,12 +20,6 @@ static const char *TAG = "MAIN";
 char message[64];
 char uart_message[64];
 
-extern uint8_t is_new_data;
-extern uint8_t g_recvData[30];
-extern uint8_t g_recvTopic[30];
-extern uint8_t g_recvDataLen;
-extern uint8_t g_recvTopicLen;
-
 void app_main(void) 
 {
     // Initialize NVS
@@ -32,6 +31,9 @@ void app_main(void)
     }
     ESP_ERROR_CHECK(ret);
     
+    // Control frames from MQTT and KWS to the UART bridge
+    control_init();
+
     // Initialize WiFi
     Netwok_app_start();
 
@@ -39,6 +41,18 @@ void app_main(void)
     
     // Initialize MQTT (this will create the MQTT task)
     mqtt_init();
+
+#if ( LOCAL_BROKER_ENABLE == 1 )
+    // LAN clients keep working when the upstream broker is down
+    if (local_broker_start() != ESP_OK)
+        ESP_LOGE(TAG, "Local broker not started");
+#endif
+
+#if ( UDP_CONTROL_ENABLE == 1 )
+    // One hop path for latency critical commands
+    if (udp_control_start() != ESP_OK)
+        ESP_LOGE(TAG, "UDP control not started");
+#endif
     
     /* Start UART task */
     uart_start_task();
@@ -52,48 +66,8 @@ void app_main(void)
     
     ESP_LOGI(TAG, "Application started");
 
-    // Example of sending data
-    const char *msg = "Hello from node 1\r\n";
-    int status = uart_send_data((const uint8_t *)msg, strlen(msg));
-    if (status != -1) 
-        ESP_LOGI(TAG, "Message sent correctly");
-    else 
-        ESP_LOGE(TAG, "Error sending message");
-    
-
-    uart_queue_msg_t rx_msg;
-    while (1) 
-    {
-        if( xQueueReceive(uart_get_queue(), &rx_msg, pdMS_TO_TICKS(5000)) == pdPASS ) 
-        {
-            if (rx_msg.msg_type == UART_MSG_RECEIVED) 
-            {
-                // Null-terminate for printing as string (if appropriate)
-                rx_msg.data[rx_msg.data_len] = '\0';
-                ESP_LOGI(TAG, "Received message: %s", (char *)(rx_msg.data) );
-                uint8_t node_id = rx_msg.data[0];
-
-                /* Send message to mqtt server */
-                if( node_id == '1' )
-                    mqtt_send_message( MQTT_NODE_1_SENDSOR_TOPIC , (char *)(rx_msg.data+1) , 0 , 0 );
-                else if( node_id == '2' )
-                    mqtt_send_message( MQTT_NODE_2_SENDSOR_TOPIC , (char *)(rx_msg.data+1) , 0 , 0 );
-            }
-        }
-
-        if( is_new_data == 1 )
-        {
-            is_new_data = 0;
-            int status = uart_send_data( (uint8_t *)g_recvData , g_recvDataLen );
-            if (status != -1) 
-                ESP_LOGI(TAG, "Uart sent correctly");
-            else 
-                ESP_LOGE(TAG, "Uart sending message");   
-        }
-
-        vTaskDelay(pdMS_TO_TICKS(100));
-    }    
-
+    /* Route UART lines, MQTT commands and KWS detections as they arrive */
+    dispatcher_start();
 }
 
 
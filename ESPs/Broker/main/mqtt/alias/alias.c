@@ -0,0 +1,92 @@
+/**
+ * @file alias.c
+ * @brief MQTT 5 topic aliases of the outgoing topics
+ */
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "../mqtt_config.h"
+#include "alias.h"
+
+#define ALIAS_TOPIC_SIZE      48    /* Longer topics are sent in full */
+#define ALIAS_PROPERTY_SIZE   3     /* Identifier + 2 bytes alias */
+
+/**
+ * @brief One alias, established while gen matches g_generation
+ */
+typedef struct {
+    char     topic[ALIAS_TOPIC_SIZE];
+    uint32_t gen;
+    uint32_t last_use;
+} alias_entry_t;
+
+static alias_entry_t g_aliases[MQTT5_TOPIC_ALIAS_MAX];   /* Alias n is g_aliases[n - 1] */
+static volatile uint32_t g_generation = 1;               /* Bumped on every connect */
+static uint32_t g_clock = 0;
+static portMUX_TYPE g_stats_lock = portMUX_INITIALIZER_UNLOCKED;
+static mqtt_alias_stats_t g_stats;
+
+void mqtt_alias_reset(void)
+{
+    g_generation++;
+}
+
+const char *mqtt_alias_lookup(const char *topic, uint16_t *alias)
+{
+    size_t len = strlen(topic);
+    alias_entry_t *lru = &g_aliases[0];
+
+    *alias = 0;
+    if (len == 0 || len >= ALIAS_TOPIC_SIZE || len <= ALIAS_PROPERTY_SIZE)
+        return topic;
+
+    for (int i = 0; i < MQTT5_TOPIC_ALIAS_MAX; i++) {
+        alias_entry_t *entry = &g_aliases[i];
+        if (strcmp(entry->topic, topic) == 0) {
+            entry->last_use = ++g_clock;
+            *alias = (uint16_t)(i + 1);
+            return (entry->gen == g_generation) ? "" : topic;
+        }
+        if (entry->last_use < lru->last_use)
+            lru = entry;
+    }
+
+    /* Rebind the least recently used alias, the next publish sends the topic */
+    memcpy(lru->topic, topic, len + 1);
+    lru->gen = 0;
+    lru->last_use = ++g_clock;
+    *alias = (uint16_t)(lru - g_aliases + 1);
+
+    taskENTER_CRITICAL(&g_stats_lock);
+    g_stats.assigned++;
+    taskEXIT_CRITICAL(&g_stats_lock);
+
+    return topic;
+}
+
+void mqtt_alias_sent(uint16_t alias, size_t topic_len, bool full)
+{
+    if (alias == 0 || alias > MQTT5_TOPIC_ALIAS_MAX)
+        return;
+
+    if (full) {
+        g_aliases[alias - 1].gen = g_generation;
+        return;
+    }
+
+    taskENTER_CRITICAL(&g_stats_lock);
+    g_stats.aliased++;
+    g_stats.bytes_saved += topic_len - ALIAS_PROPERTY_SIZE;
+    taskEXIT_CRITICAL(&g_stats_lock);
+}
+
+void mqtt_alias_get_stats(mqtt_alias_stats_t *stats)
+{
+    if (stats == NULL)
+        return;
+
+    taskENTER_CRITICAL(&g_stats_lock);
+    *stats = g_stats;
+    taskEXIT_CRITICAL(&g_stats_lock);
+}
@@ -0,0 +1,60 @@
+/**
+ * @file alias.h
+ * @brief MQTT 5 topic aliases of the outgoing topics
+ *
+ * Each topic gets an alias from 1 to MQTT5_TOPIC_ALIAS_MAX, the least
+ * recently used one is given to a new topic when all are taken. The first
+ * publish of a topic on a connection carries the topic and the alias, later
+ * ones an empty topic and the alias only. Mappings only live as long as the
+ * network connection, mqtt_alias_reset() forgets them on every connect.
+ *
+ * Only QoS 0 publishes use aliases: the client may resend a QoS 1 publish on
+ * the next connection, where an alias-only PUBLISH would be a protocol error.
+ *
+ * mqtt_alias_lookup() and mqtt_alias_sent() are for mqtt_task only.
+ */
+#ifndef MQTT_ALIAS_H
+#define MQTT_ALIAS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * @brief Alias counters
+ */
+typedef struct {
+    uint32_t aliased;        /* Publishes sent with an empty topic */
+    uint32_t bytes_saved;    /* Topic bytes left out, minus the 3 bytes alias property */
+    uint32_t assigned;       /* Aliases (re)bound to a topic */
+} mqtt_alias_stats_t;
+
+/**
+ * @brief Forget every mapping, call on MQTT_EVENT_CONNECTED
+ */
+void mqtt_alias_reset(void);
+
+/**
+ * @brief Alias of a topic and the topic string to publish with
+ *
+ * @param topic Topic of the message
+ * @param alias Set to the alias, 0 if the topic gets none
+ * @return topic, or "" when the broker already knows the alias
+ */
+const char *mqtt_alias_lookup(const char *topic, uint16_t *alias);
+
+/**
+ * @brief The publish of mqtt_alias_lookup() went out
+ *
+ * @param alias     Alias returned by mqtt_alias_lookup()
+ * @param topic_len Length of the topic the alias stands for
+ * @param full      true if the full topic was sent (establishes the alias)
+ */
+void mqtt_alias_sent(uint16_t alias, size_t topic_len, bool full);
+
+/**
+ * @brief Copy the alias counters
+ */
+void mqtt_alias_get_stats(mqtt_alias_stats_t *stats);
+
+#endif /* MQTT_ALIAS_H */
@@ -0,0 +1,175 @@
+/**
+ * @file batch.c
+ * @brief Batching of node telemetry into a single MQTT publish
+ */
+#include <stdbool.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/timers.h"
+#include "esp_log.h"
+
+#include "../mqtt_config.h"
+#include "../mqtt_interface.h"
+#include "batch.h"
+
+static const char *TAG = "MQTT_BATCH";
+
+static SemaphoreHandle_t g_lock = NULL;
+static TimerHandle_t g_latency_timer = NULL;
+static mqtt_outbox_slot_t *g_slot = NULL;   /* Batch being filled, NULL when none is open */
+static size_t g_limit = 0;                  /* Payload limit of the open batch */
+static mqtt_batch_stats_t g_stats;
+static volatile bool g_due = false;         /* The latency timer fired for the open batch */
+static TaskHandle_t g_consumer = NULL;
+static uint32_t g_consumer_bits = 0;
+
+/* Hand the open batch to the MQTT task, g_lock must be held */
+static void batch_flush_locked(void)
+{
+    if (g_slot == NULL)
+        return;
+
+    xTimerStop(g_latency_timer, 0);
+    g_due = false;
+
+    mqtt_outbox_slot_t *slot = g_slot;
+    uint8_t count = (uint8_t)slot->data[3];
+    g_slot = NULL;
+
+    /* The batch rarely fills its reservation, the rest of it goes back to the outbox now */
+    mqtt_outbox_trim(slot);
+
+    /* The slot goes back to the outbox on failure, don't touch it afterwards */
+    if (mqtt_send_slot(slot) == ESP_OK) {
+        g_stats.publishes++;
+    } else {
+        g_stats.dropped += count;
+        ESP_LOGE(TAG, "Failed to queue batch");
+    }
+}
+
+/* Runs on the timer service task, which must not block on g_lock nor publish */
+static void batch_latency_cb(TimerHandle_t timer)
+{
+    (void)timer;
+    g_due = true;
+    if (g_consumer != NULL)
+        xTaskNotify(g_consumer, g_consumer_bits, eSetBits);
+}
+
+esp_err_t mqtt_batch_init(void)
+{
+    if (g_lock != NULL)
+        return ESP_OK;
+
+    g_lock = xSemaphoreCreateMutex();
+    g_latency_timer = xTimerCreate("mqtt_batch", pdMS_TO_TICKS(MQTT_BATCH_MAX_LATENCY_MS), pdFALSE, NULL, batch_latency_cb);
+    if (g_lock == NULL || g_latency_timer == NULL) {
+        ESP_LOGE(TAG, "Failed to create batch lock or timer");
+        return ESP_ERR_NO_MEM;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t mqtt_batch_add(const char *node_id, const uint8_t *data, size_t len)
+{
+    if (g_lock == NULL || node_id == NULL || data == NULL)
+        return ESP_FAIL;
+
+    size_t id_len = strlen(node_id);
+    size_t record_len = 1 + id_len + 2 + len;
+    if (id_len > 0xFF || len > 0xFFFF) {
+        g_stats.dropped++;
+        return ESP_FAIL;
+    }
+
+    xSemaphoreTake(g_lock, portMAX_DELAY);
+
+    /* Close the open batch if this reading doesn't fit anymore */
+    if (g_slot != NULL && g_slot->data_len + record_len > g_limit)
+        batch_flush_locked();
+
+    if (g_slot == NULL) {
+        /* A single oversized reading still gets a batch of its own */
+        g_limit = MQTT_BATCH_MAX_BYTES;
+        if (MQTT_BATCH_HEADER_SIZE + record_len > g_limit)
+            g_limit = MQTT_BATCH_HEADER_SIZE + record_len;
+
+        /* Never blocks, g_lock is held and the other producers would wait behind it */
+        g_slot = mqtt_reserve_slot(MQTT_BATCH_TOPIC, g_limit, MQTT_LANE_TELEMETRY);
+        if (g_slot == NULL) {
+            g_stats.dropped++;
+            xSemaphoreGive(g_lock);
+            ESP_LOGE(TAG, "No outbox room for a batch of %d bytes", (int)g_limit);
+            return ESP_FAIL;
+        }
+
+        uint8_t *hdr = (uint8_t *)g_slot->data;
+        hdr[0] = MQTT_BATCH_MAGIC_0;
+        hdr[1] = MQTT_BATCH_MAGIC_1;
+        hdr[2] = MQTT_BATCH_VERSION;
+        hdr[3] = 0;
+        g_slot->data_len = MQTT_BATCH_HEADER_SIZE;
+        g_slot->qos = MQTT_TELEMETRY_QOS;
+
+        xTimerChangePeriod(g_latency_timer, pdMS_TO_TICKS(MQTT_BATCH_MAX_LATENCY_MS), 0);
+    }
+
+    /* Append the record in place */
+    uint8_t *p = (uint8_t *)g_slot->data + g_slot->data_len;
+    *p++ = (uint8_t)id_len;
+    memcpy(p, node_id, id_len);
+    p += id_len;
+    *p++ = (uint8_t)(len >> 8);
+    *p++ = (uint8_t)(len & 0xFF);
+    memcpy(p, data, len);
+    g_slot->data_len += record_len;
+
+    uint8_t count = ++((uint8_t *)g_slot->data)[3];
+    g_stats.readings++;
+
+    if (count >= MQTT_BATCH_MAX_COUNT || count == 0xFF || g_slot->data_len >= g_limit)
+        batch_flush_locked();
+
+    xSemaphoreGive(g_lock);
+    return ESP_OK;
+}
+
+void mqtt_batch_set_consumer(TaskHandle_t task, uint32_t notify_bits)
+{
+    g_consumer_bits = notify_bits;
+    g_consumer = task;
+}
+
+void mqtt_batch_flush(void)
+{
+    if (g_lock == NULL)
+        return;
+
+    xSemaphoreTake(g_lock, portMAX_DELAY);
+    batch_flush_locked();
+    xSemaphoreGive(g_lock);
+}
+
+void mqtt_batch_flush_due(void)
+{
+    if (g_lock == NULL || !g_due)
+        return;
+
+    xSemaphoreTake(g_lock, portMAX_DELAY);
+    if (g_due)
+        batch_flush_locked();
+    xSemaphoreGive(g_lock);
+}
+
+void mqtt_batch_get_stats(mqtt_batch_stats_t *stats)
+{
+    if (stats == NULL || g_lock == NULL)
+        return;
+
+    xSemaphoreTake(g_lock, portMAX_DELAY);
+    *stats = g_stats;
+    xSemaphoreGive(g_lock);
+}
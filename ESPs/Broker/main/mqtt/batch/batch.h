@@ -0,0 +1,79 @@
+/**
+ * @file batch.h
+ * @brief Batching of node telemetry into a single MQTT publish
+ *
+ * Batch payload layout (all integers big endian):
+ *
+ *   'W' 'B' <version:1> <count:1>
+ *   count x { <id_len:1> <node id> <data_len:2> <data> }
+ *
+ * A batch is published on MQTT_BATCH_TOPIC when it reaches
+ * MQTT_BATCH_MAX_BYTES, MQTT_BATCH_MAX_COUNT readings, or
+ * MQTT_BATCH_MAX_LATENCY_MS after its first reading, whichever comes first.
+ * The latency timer only wakes the consumer task, the publish itself runs
+ * in mqtt_batch_flush_due() on that task.
+ */
+#ifndef MQTT_BATCH_H
+#define MQTT_BATCH_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_err.h"
+
+#define MQTT_BATCH_MAGIC_0        'W'
+#define MQTT_BATCH_MAGIC_1        'B'
+#define MQTT_BATCH_VERSION        1
+#define MQTT_BATCH_HEADER_SIZE    4
+
+/**
+ * @brief Batching counters
+ */
+typedef struct {
+    uint32_t readings;   /* Readings added to batches */
+    uint32_t publishes;  /* Batches handed to the MQTT task */
+    uint32_t dropped;    /* Readings lost (no slot, or too large) */
+} mqtt_batch_stats_t;
+
+/**
+ * @brief Create the batch lock and the latency timer
+ *
+ * @return ESP_OK on success, ESP_ERR_NO_MEM otherwise
+ */
+esp_err_t mqtt_batch_init(void);
+
+/**
+ * @brief Append one node reading to the open batch
+ *
+ * @param node_id  NUL-terminated node ID
+ * @param data     Reading payload
+ * @param len      Payload length
+ * @return ESP_OK if the reading was batched, ESP_FAIL otherwise
+ */
+esp_err_t mqtt_batch_add(const char *node_id, const uint8_t *data, size_t len);
+
+/**
+ * @brief Register the task woken up when the open batch reached its latency
+ *
+ * @param task        Consumer task, calls mqtt_batch_flush_due() when woken
+ * @param notify_bits Bits set in the task notification value (eSetBits)
+ */
+void mqtt_batch_set_consumer(TaskHandle_t task, uint32_t notify_bits);
+
+/**
+ * @brief Publish the open batch now, if any
+ */
+void mqtt_batch_flush(void);
+
+/**
+ * @brief Publish the open batch if it reached MQTT_BATCH_MAX_LATENCY_MS
+ */
+void mqtt_batch_flush_due(void);
+
+/**
+ * @brief Copy the batching counters
+ */
+void mqtt_batch_get_stats(mqtt_batch_stats_t *stats);
+
+#endif /* MQTT_BATCH_H */
@@ -0,0 +1,212 @@
+/**
+ * @file cbor.c
+ * @brief JSON -> CBOR (RFC 8949) transcoding of node readings
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "../mqtt_config.h"
+#include "../flatjson/flatjson.h"
+#include "cbor.h"
+
+#define CBOR_MAJOR_UINT    0
+#define CBOR_MAJOR_NINT    1
+#define CBOR_MAJOR_TEXT    3
+#define CBOR_MAJOR_ARRAY   4
+#define CBOR_MAJOR_MAP     5
+#define CBOR_MAJOR_TAG     6
+
+#define CBOR_FALSE         0xf4
+#define CBOR_TRUE          0xf5
+#define CBOR_NULL          0xf6
+#define CBOR_FLOAT64       0xfb
+
+#define CBOR_TAG_DECIMAL   4
+
+static const char *const g_keys[] = MQTT_CBOR_KEYS;
+#define CBOR_KEY_COUNT  (sizeof(g_keys) / sizeof(g_keys[0]))
+
+/**
+ * @brief Output cursor, p is NULL once the output overflowed
+ */
+typedef struct {
+    uint8_t *p;
+    uint8_t *end;
+} cbor_writer_t;
+
+static void cbor_bytes(cbor_writer_t *w, const void *data, size_t len)
+{
+    if (w->p == NULL || (size_t)(w->end - w->p) < len) {
+        w->p = NULL;
+        return;
+    }
+    memcpy(w->p, data, len);
+    w->p += len;
+}
+
+/* Initial byte plus the shortest argument encoding */
+static void cbor_head(cbor_writer_t *w, uint8_t major, uint64_t value)
+{
+    uint8_t buf[9];
+    size_t n;
+
+    if (value < 24) {
+        buf[0] = (uint8_t)((major << 5) | value);
+        n = 1;
+    } else if (value <= 0xFF) {
+        buf[0] = (uint8_t)((major << 5) | 24);
+        n = 2;
+    } else if (value <= 0xFFFF) {
+        buf[0] = (uint8_t)((major << 5) | 25);
+        n = 3;
+    } else if (value <= 0xFFFFFFFFu) {
+        buf[0] = (uint8_t)((major << 5) | 26);
+        n = 5;
+    } else {
+        buf[0] = (uint8_t)((major << 5) | 27);
+        n = 9;
+    }
+    for (size_t i = 1; i < n; i++)
+        buf[i] = (uint8_t)(value >> (8 * (n - 1 - i)));
+
+    cbor_bytes(w, buf, n);
+}
+
+static void cbor_int(cbor_writer_t *w, int64_t value)
+{
+    if (value >= 0)
+        cbor_head(w, CBOR_MAJOR_UINT, (uint64_t)value);
+    else
+        cbor_head(w, CBOR_MAJOR_NINT, (uint64_t)(-(value + 1)));
+}
+
+static void cbor_text(cbor_writer_t *w, const uint8_t *s, size_t len)
+{
+    cbor_head(w, CBOR_MAJOR_TEXT, len);
+    cbor_bytes(w, s, len);
+}
+
+/* JSON number -> integer, decimal fraction, or float64 when the digits don't fit an int64 */
+static void cbor_number(cbor_writer_t *w, const uint8_t *s, size_t len)
+{
+    size_t i = 0;
+    bool negative = false;
+    bool is_int = true;
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+
+    if (s[i] == '-') {
+        negative = true;
+        i++;
+    }
+    for (; i < len && s[i] != 'e' && s[i] != 'E'; i++) {
+        if (s[i] == '.') {
+            is_int = false;
+            continue;
+        }
+        /* Leading zeros don't count against the 18 digits limit */
+        if (mantissa != 0 || s[i] != '0')
+            digits++;
+        if (digits > 18)
+            goto as_double;
+        mantissa = mantissa * 10 + (uint64_t)(s[i] - '0');
+        if (!is_int)
+            exponent--;
+    }
+    if (i < len) {
+        /* e[+-]ddd */
+        is_int = false;
+        int sign = 1, e = 0;
+        i++;
+        if (s[i] == '+' || s[i] == '-')
+            sign = (s[i++] == '-') ? -1 : 1;
+        for (; i < len; i++) {
+            e = e * 10 + (s[i] - '0');
+            if (e > 1000)
+                goto as_double;
+        }
+        exponent += sign * e;
+    }
+
+    int64_t value = negative ? -(int64_t)mantissa : (int64_t)mantissa;
+    if (is_int) {
+        cbor_int(w, value);
+        return;
+    }
+
+    cbor_head(w, CBOR_MAJOR_TAG, CBOR_TAG_DECIMAL);
+    cbor_head(w, CBOR_MAJOR_ARRAY, 2);
+    cbor_int(w, exponent);
+    cbor_int(w, value);
+    return;
+
+as_double: {
+        char num[40];
+        uint8_t buf[9];
+        union { double d; uint64_t u; } v;
+
+        if (len >= sizeof(num)) {
+            w->p = NULL;
+            return;
+        }
+        memcpy(num, s, len);
+        num[len] = '\0';
+        v.d = strtod(num, NULL);
+        buf[0] = CBOR_FLOAT64;
+        for (int b = 0; b < 8; b++)
+            buf[1 + b] = (uint8_t)(v.u >> (56 - 8 * b));
+        cbor_bytes(w, buf, sizeof(buf));
+    }
+}
+
+size_t mqtt_cbor_from_json(const uint8_t *json, size_t len, uint8_t *out, size_t cap)
+{
+    static const uint8_t marker[3] = { MQTT_CBOR_MARKER_0, MQTT_CBOR_MARKER_1, MQTT_CBOR_MARKER_2 };
+    mqtt_flatjson_field_t fields[MQTT_CBOR_MAX_FIELDS];
+    cbor_writer_t w = { out, out + cap };
+
+    int n = mqtt_flatjson_parse(json, len, fields, MQTT_CBOR_MAX_FIELDS);
+    if (n < 0 || out == NULL)
+        return 0;
+
+    cbor_bytes(&w, marker, sizeof(marker));
+    cbor_head(&w, CBOR_MAJOR_MAP, (uint64_t)n);
+
+    for (int i = 0; i < n; i++) {
+        const mqtt_flatjson_field_t *f = &fields[i];
+
+        size_t k;
+        for (k = 0; k < CBOR_KEY_COUNT; k++) {
+            if (strlen(g_keys[k]) == f->key_len && memcmp(g_keys[k], f->key, f->key_len) == 0)
+                break;
+        }
+        if (k < CBOR_KEY_COUNT)
+            cbor_head(&w, CBOR_MAJOR_UINT, k);
+        else
+            cbor_text(&w, f->key, f->key_len);
+        switch (f->type) {
+            case MQTT_FLATJSON_NUMBER:
+                cbor_number(&w, f->val, f->val_len);
+                break;
+            case MQTT_FLATJSON_STRING:
+                /* Escapes would need decoding, leave such readings as JSON */
+                if (memchr(f->val, '\\', f->val_len) != NULL)
+                    return 0;
+                cbor_text(&w, f->val, f->val_len);
+                break;
+            case MQTT_FLATJSON_TRUE:
+                cbor_bytes(&w, (const uint8_t[]){ CBOR_TRUE }, 1);
+                break;
+            case MQTT_FLATJSON_FALSE:
+                cbor_bytes(&w, (const uint8_t[]){ CBOR_FALSE }, 1);
+                break;
+            case MQTT_FLATJSON_NULL:
+                cbor_bytes(&w, (const uint8_t[]){ CBOR_NULL }, 1);
+                break;
+        }
+    }
+
+    return (w.p == NULL) ? 0 : (size_t)(w.p - out);
+}
@@ -0,0 +1,225 @@
+/**
+ * @file deadband.c
+ * @brief Change only reporting of node readings
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+
+#include "../mqtt_config.h"
+#include "../flatjson/flatjson.h"
+#include "deadband.h"
+
+static const char *TAG = "MQTT_DEADBAND";
+
+/**
+ * @brief Deadband of one field name, from MQTT_DEADBAND_RULES
+ */
+typedef struct {
+    const char *name;
+    float abs;
+    float rel;
+} deadband_rule_t;
+
+/**
+ * @brief Last forwarded value of one field
+ */
+typedef struct {
+    uint32_t key;        /* FNV-1a hash of the field name */
+    uint8_t  numeric;
+    union {
+        float    value;  /* numeric */
+        uint32_t hash;   /* !numeric, FNV-1a hash of the raw value */
+    };
+} deadband_field_t;
+
+/**
+ * @brief Per node state, indexed by mqtt_route_t.index
+ */
+typedef struct {
+    uint32_t last_sent_ms;
+    uint8_t  field_count;   /* 0 until the first reading was forwarded */
+    deadband_field_t fields[MQTT_DEADBAND_FIELDS];
+} deadband_node_t;
+
+static const deadband_rule_t g_rules[] = MQTT_DEADBAND_RULES;
+#define DEADBAND_RULE_COUNT  (sizeof(g_rules) / sizeof(g_rules[0]))
+
+static uint32_t g_rule_keys[DEADBAND_RULE_COUNT];
+static deadband_node_t *g_nodes = NULL;
+static portMUX_TYPE g_stats_lock = portMUX_INITIALIZER_UNLOCKED;
+static mqtt_deadband_stats_t g_stats;
+
+static uint32_t deadband_hash(const uint8_t *s, size_t len)
+{
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++)
+        h = (h ^ s[i]) * 16777619u;
+    return h;
+}
+
+/* Fields of a flat JSON object, -1 if it isn't one or has too many fields */
+static int deadband_parse(const uint8_t *p, size_t len, deadband_field_t *out)
+{
+    mqtt_flatjson_field_t tok[MQTT_DEADBAND_FIELDS];
+    int n = mqtt_flatjson_parse(p, len, tok, MQTT_DEADBAND_FIELDS);
+
+    for (int i = 0; i < n; i++)
+    {
+        char num[32];
+
+        out[i].key = deadband_hash(tok[i].key, tok[i].key_len);
+        out[i].numeric = 0;
+        if (tok[i].type == MQTT_FLATJSON_NUMBER && tok[i].val_len < sizeof(num))
+        {
+            memcpy(num, tok[i].val, tok[i].val_len);
+            num[tok[i].val_len] = '\0';
+            float f = strtof(num, NULL);
+            if (isfinite(f))
+            {
+                out[i].numeric = 1;
+                out[i].value = f;
+            }
+        }
+        /* The type is part of the hash so "1" and 1 differ */
+        if (!out[i].numeric)
+            out[i].hash = deadband_hash(tok[i].val, tok[i].val_len) ^ (uint32_t)tok[i].type;
+    }
+
+    return n;
+}
+
+static bool deadband_moved(uint32_t key, float last, float now)
+{
+    float abs_band = MQTT_DEADBAND_ABS;
+    float rel_band = MQTT_DEADBAND_REL;
+
+    for (size_t r = 0; r < DEADBAND_RULE_COUNT; r++)
+    {
+        if (g_rule_keys[r] == key)
+        {
+            abs_band = g_rules[r].abs;
+            rel_band = g_rules[r].rel;
+            break;
+        }
+    }
+
+    float band = rel_band * fabsf(last);
+    if (abs_band > band)
+        band = abs_band;
+
+    return fabsf(now - last) > band;
+}
+
+/* true if a field of the reading left its deadband, appeared, changed type or disappeared */
+static bool deadband_changed(const deadband_node_t *node, const deadband_field_t *fields, int count)
+{
+    if (node->field_count == 0 || node->field_count != count)
+        return true;
+
+    for (int i = 0; i < count; i++)
+    {
+        const deadband_field_t *last = NULL;
+        for (int j = 0; j < node->field_count; j++)
+        {
+            if (node->fields[j].key == fields[i].key)
+            {
+                last = &node->fields[j];
+                break;
+            }
+        }
+
+        if (last == NULL || last->numeric != fields[i].numeric)
+            return true;
+        if (fields[i].numeric ? deadband_moved(fields[i].key, last->value, fields[i].value)
+                              : last->hash != fields[i].hash)
+            return true;
+    }
+
+    return false;
+}
+
+esp_err_t mqtt_deadband_init(void)
+{
+    if (g_nodes != NULL)
+        return ESP_OK;
+
+    for (size_t r = 0; r < DEADBAND_RULE_COUNT; r++)
+        g_rule_keys[r] = deadband_hash((const uint8_t *)g_rules[r].name, strlen(g_rules[r].name));
+
+#if ( MQTT_DEADBAND_USE_PSRAM == 1 )
+    g_nodes = heap_caps_calloc(MQTT_ROUTE_MAX_NODES, sizeof(deadband_node_t), MALLOC_CAP_SPIRAM);
+#endif
+    if (g_nodes == NULL)
+        g_nodes = heap_caps_calloc(MQTT_ROUTE_MAX_NODES, sizeof(deadband_node_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (g_nodes == NULL)
+    {
+        ESP_LOGE(TAG, "Failed to allocate deadband state");
+        return ESP_ERR_NO_MEM;
+    }
+
+    return ESP_OK;
+}
+
+bool mqtt_deadband_pass(const mqtt_route_t *route, const uint8_t *payload, size_t len)
+{
+    deadband_field_t fields[MQTT_DEADBAND_FIELDS];
+    bool pass;
+    bool heartbeat = false;
+
+    if (g_nodes == NULL || route == NULL || route->index >= MQTT_ROUTE_MAX_NODES)
+        return true;
+
+    deadband_node_t *node = &g_nodes[route->index];
+    uint32_t now_ms = (uint32_t)(esp_timer_get_time() / 1000);
+    int count = deadband_parse(payload, len, fields);
+
+    if (count < 0)
+    {
+        /* Nothing to compare, forward it and start over with the next reading */
+        node->field_count = 0;
+        pass = true;
+    }
+    else
+    {
+        pass = deadband_changed(node, fields, count);
+        if (!pass && (now_ms - node->last_sent_ms) >= MQTT_DEADBAND_HEARTBEAT_MS)
+            pass = heartbeat = true;
+        if (pass)
+        {
+            memcpy(node->fields, fields, count * sizeof(deadband_field_t));
+            node->field_count = (uint8_t)count;
+        }
+    }
+    if (pass)
+        node->last_sent_ms = now_ms;
+
+    taskENTER_CRITICAL(&g_stats_lock);
+    g_stats.received++;
+    if (pass)
+        g_stats.forwarded++;
+    else
+        g_stats.suppressed++;
+    if (heartbeat)
+        g_stats.heartbeats++;
+    taskEXIT_CRITICAL(&g_stats_lock);
+
+    return pass;
+}
+
+void mqtt_deadband_get_stats(mqtt_deadband_stats_t *stats)
+{
+    if (stats == NULL)
+        return;
+
+    taskENTER_CRITICAL(&g_stats_lock);
+    *stats = g_stats;
+    taskEXIT_CRITICAL(&g_stats_lock);
+
+    stats->suppressed_pct = stats->received ? (uint32_t)((uint64_t)stats->suppressed * 100 / stats->received) : 0;
+}
@@ -0,0 +1,56 @@
+/**
+ * @file deadband.h
+ * @brief Change only reporting of node readings
+ *
+ * Readings are flat JSON objects ({"temperature": 21.5, "light": 350, ...}).
+ * For every node the filter keeps the last forwarded value of each field and
+ * suppresses a reading unless one of its fields moved out of that field's
+ * deadband, a field appeared or changed type, or the node hasn't been
+ * forwarded for MQTT_DEADBAND_HEARTBEAT_MS. Non numeric values pass on any
+ * change. Payloads that aren't flat JSON objects always pass.
+ *
+ * Only the dispatcher task calls mqtt_deadband_pass().
+ */
+#ifndef MQTT_DEADBAND_H
+#define MQTT_DEADBAND_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "../route/route.h"
+
+/**
+ * @brief Deadband counters
+ */
+typedef struct {
+    uint32_t received;         /* Readings checked */
+    uint32_t forwarded;        /* Readings passed on, heartbeats included */
+    uint32_t suppressed;       /* Readings dropped because nothing changed */
+    uint32_t heartbeats;       /* Readings passed only because of the heartbeat */
+    uint32_t suppressed_pct;   /* suppressed * 100 / received */
+} mqtt_deadband_stats_t;
+
+/**
+ * @brief Allocate the per node state (MQTT_ROUTE_MAX_NODES entries)
+ *
+ * @return ESP_OK on success, ESP_ERR_NO_MEM otherwise
+ */
+esp_err_t mqtt_deadband_init(void);
+
+/**
+ * @brief Check a reading against the last forwarded one of its node
+ *
+ * @param route   Route of the node
+ * @param payload Reading, not NUL-terminated
+ * @param len     Reading length
+ * @return true if the reading must be forwarded
+ */
+bool mqtt_deadband_pass(const mqtt_route_t *route, const uint8_t *payload, size_t len);
+
+/**
+ * @brief Copy the deadband counters
+ */
+void mqtt_deadband_get_stats(mqtt_deadband_stats_t *stats);
+
+#endif /* MQTT_DEADBAND_H */
@@ -0,0 +1,129 @@
+/**
+ * @file flatjson.c
+ * @brief Tokenizer for the flat JSON objects sent by the nodes
+ */
+#include <string.h>
+
+#include "flatjson.h"
+
+static size_t flatjson_skip_ws(const uint8_t *p, size_t len, size_t i)
+{
+    while (i < len && (p[i] == ' ' || p[i] == '\t' || p[i] == '\r' || p[i] == '\n'))
+        i++;
+    return i;
+}
+
+/* true if p[0..len) is a JSON number */
+static int flatjson_is_number(const uint8_t *p, size_t len)
+{
+    size_t i = 0;
+    size_t digits = 0;
+
+    if (i < len && p[i] == '-')
+        i++;
+    while (i < len && p[i] >= '0' && p[i] <= '9')
+        i++, digits++;
+    if (digits == 0)
+        return 0;
+
+    if (i < len && p[i] == '.')
+    {
+        i++;
+        digits = 0;
+        while (i < len && p[i] >= '0' && p[i] <= '9')
+            i++, digits++;
+        if (digits == 0)
+            return 0;
+    }
+
+    if (i < len && (p[i] == 'e' || p[i] == 'E'))
+    {
+        i++;
+        if (i < len && (p[i] == '+' || p[i] == '-'))
+            i++;
+        digits = 0;
+        while (i < len && p[i] >= '0' && p[i] <= '9')
+            i++, digits++;
+        if (digits == 0)
+            return 0;
+    }
+
+    return i == len;
+}
+
+int mqtt_flatjson_parse(const uint8_t *p, size_t len, mqtt_flatjson_field_t *fields, int max_fields)
+{
+    int n = 0;
+
+    if (p == NULL)
+        return -1;
+    size_t i = flatjson_skip_ws(p, len, 0);
+    if (i >= len || p[i] != '{')
+        return -1;
+    i = flatjson_skip_ws(p, len, i + 1);
+    if (i < len && p[i] == '}')
+        return 0;
+
+    while (i < len)
+    {
+        if (n == max_fields || p[i] != '"')
+            return -1;
+        mqtt_flatjson_field_t *f = &fields[n];
+
+        /* Key, escapes aren't expected in field names */
+        f->key = p + ++i;
+        while (i < len && p[i] != '"' && p[i] != '\\')
+            i++;
+        if (i >= len || p[i] != '"')
+            return -1;
+        f->key_len = (size_t)(p + i - f->key);
+
+        i = flatjson_skip_ws(p, len, i + 1);
+        if (i >= len || p[i] != ':')
+            return -1;
+        i = flatjson_skip_ws(p, len, i + 1);
+        if (i >= len)
+            return -1;
+
+        /* Value */
+        if (p[i] == '"')
+        {
+            f->val = p + ++i;
+            while (i < len && p[i] != '"')
+                i += (p[i] == '\\') ? 2 : 1;
+            if (i >= len)
+                return -1;
+            f->val_len = (size_t)(p + i - f->val);
+            f->type = MQTT_FLATJSON_STRING;
+            i++;
+        }
+        else
+        {
+            f->val = p + i;
+            while (i < len && p[i] != ',' && p[i] != '}' && p[i] != ' ' && p[i] != '\t' && p[i] != '\r' && p[i] != '\n')
+                i++;
+            f->val_len = (size_t)(p + i - f->val);
+
+            if (f->val_len == 4 && memcmp(f->val, "true", 4) == 0)
+                f->type = MQTT_FLATJSON_TRUE;
+            else if (f->val_len == 5 && memcmp(f->val, "false", 5) == 0)
+                f->type = MQTT_FLATJSON_FALSE;
+            else if (f->val_len == 4 && memcmp(f->val, "null", 4) == 0)
+                f->type = MQTT_FLATJSON_NULL;
+            else if (flatjson_is_number(f->val, f->val_len))
+                f->type = MQTT_FLATJSON_NUMBER;
+            else
+                return -1;   /* Objects, arrays or garbage */
+        }
+        n++;
+
+        i = flatjson_skip_ws(p, len, i);
+        if (i < len && p[i] == '}')
+            return n;
+        if (i >= len || p[i] != ',')
+            return -1;
+        i = flatjson_skip_ws(p, len, i + 1);
+    }
+
+    return -1;
+}
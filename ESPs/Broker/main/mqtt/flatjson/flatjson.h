@@ -0,0 +1,46 @@
+/**
+ * @file flatjson.h
+ * @brief Tokenizer for the flat JSON objects sent by the nodes
+ *
+ * Node readings are one level objects of scalars, e.g.
+ * {"temperature": 42.1, "humidity": 65.2, "light": 350}. The tokenizer
+ * splits them in place without allocating and without copying; nested
+ * objects, arrays and escaped keys are rejected.
+ */
+#ifndef MQTT_FLATJSON_H
+#define MQTT_FLATJSON_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef enum {
+    MQTT_FLATJSON_NUMBER = 0,
+    MQTT_FLATJSON_STRING,     /* val excludes the quotes, escapes are left as is */
+    MQTT_FLATJSON_TRUE,
+    MQTT_FLATJSON_FALSE,
+    MQTT_FLATJSON_NULL,
+} mqtt_flatjson_type_t;
+
+/**
+ * @brief One field of the object, key and val point into the parsed buffer
+ */
+typedef struct {
+    const uint8_t *key;
+    size_t key_len;
+    const uint8_t *val;
+    size_t val_len;
+    mqtt_flatjson_type_t type;
+} mqtt_flatjson_field_t;
+
+/**
+ * @brief Split a flat JSON object into its fields
+ *
+ * @param json       Object bytes, not NUL-terminated
+ * @param len        Object length
+ * @param fields     Output fields
+ * @param max_fields Size of fields
+ * @return Number of fields, or -1 if json isn't a flat object or has more than max_fields fields
+ */
+int mqtt_flatjson_parse(const uint8_t *json, size_t len, mqtt_flatjson_field_t *fields, int max_fields);
+
+#endif /* MQTT_FLATJSON_H */
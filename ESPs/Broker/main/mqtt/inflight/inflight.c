@@ -0,0 +1,230 @@
+/**
+ * @file inflight.c
+ * @brief Window of QoS 1 publishes waiting for their PUBACK
+ *
+ * Only mqtt_task adds, releases and resends entries. The event handler only
+ * marks them acknowledged, so a slot is never given back while mqtt_task is
+ * still publishing from it.
+ */
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_random.h"
+
+#include "../mqtt_config.h"
+#include "inflight.h"
+
+static const char *TAG = "MQTT_INFLIGHT";
+
+typedef enum {
+    INFLIGHT_FREE = 0,
+    INFLIGHT_SENT,
+    INFLIGHT_ACKED,
+    INFLIGHT_DROPPED,   /* Deleted by the client, released as lost */
+} inflight_state_t;
+
+typedef struct {
+    mqtt_outbox_slot_t *slot;
+    int      msg_id;
+    uint32_t seq;
+    TickType_t sent;    /* Tick of the last (re)transmission */
+    inflight_state_t state;
+} inflight_entry_t;
+
+static portMUX_TYPE g_inflight_lock = portMUX_INITIALIZER_UNLOCKED;
+static inflight_entry_t g_window[MQTT_INFLIGHT_WINDOW];
+static uint32_t g_used = 0;        /* SENT + ACKED entries */
+static uint32_t g_next_seq = 1;
+static uint16_t g_boot_id = 0;
+
+/* Acks that came in before mqtt_task could add their publish to the window */
+#define INFLIGHT_EARLY_ACKS  4
+static int g_early_acks[INFLIGHT_EARLY_ACKS];
+static uint32_t g_early_next = 0;
+
+void mqtt_inflight_init(void)
+{
+    memset(g_window, 0, sizeof(g_window));
+    memset(g_early_acks, 0, sizeof(g_early_acks));
+    g_used = 0;
+    g_next_seq = 1;
+    g_boot_id = (uint16_t)esp_random();
+}
+
+uint32_t mqtt_inflight_next_seq(void)
+{
+    return g_next_seq++;
+}
+
+size_t mqtt_inflight_header(uint8_t *buf, uint32_t seq)
+{
+    buf[0] = MQTT_RELIABLE_MAGIC_0;
+    buf[1] = MQTT_RELIABLE_MAGIC_1;
+    buf[2] = (uint8_t)(g_boot_id >> 8);
+    buf[3] = (uint8_t)g_boot_id;
+    buf[4] = (uint8_t)(seq >> 24);
+    buf[5] = (uint8_t)(seq >> 16);
+    buf[6] = (uint8_t)(seq >> 8);
+    buf[7] = (uint8_t)seq;
+
+    return MQTT_RELIABLE_HEADER_SIZE;
+}
+
+bool mqtt_inflight_full(void)
+{
+    return g_used >= MQTT_INFLIGHT_WINDOW;
+}
+
+uint32_t mqtt_inflight_count(void)
+{
+    return g_used;
+}
+
+esp_err_t mqtt_inflight_add(mqtt_outbox_slot_t *slot, int msg_id, uint32_t seq)
+{
+    esp_err_t err = ESP_ERR_NO_MEM;
+
+    taskENTER_CRITICAL(&g_inflight_lock);
+    for (int i = 0; i < MQTT_INFLIGHT_WINDOW; i++) {
+        inflight_entry_t *entry = &g_window[i];
+        if (entry->state == INFLIGHT_FREE) {
+            entry->slot   = slot;
+            entry->msg_id = msg_id;
+            entry->seq    = seq;
+            entry->sent   = xTaskGetTickCount();
+            entry->state  = INFLIGHT_SENT;
+            g_used++;
+            err = ESP_OK;
+            break;
+        }
+    }
+    /* The broker may ack before we get here */
+    for (int i = 0; err == ESP_OK && i < INFLIGHT_EARLY_ACKS; i++) {
+        if (g_early_acks[i] == msg_id) {
+            g_early_acks[i] = 0;
+            for (int j = 0; j < MQTT_INFLIGHT_WINDOW; j++) {
+                if (g_window[j].state == INFLIGHT_SENT && g_window[j].msg_id == msg_id)
+                    g_window[j].state = INFLIGHT_ACKED;
+            }
+            break;
+        }
+    }
+    taskEXIT_CRITICAL(&g_inflight_lock);
+
+    return err;
+}
+
+bool mqtt_inflight_ack(int msg_id)
+{
+    bool found = false;
+
+    taskENTER_CRITICAL(&g_inflight_lock);
+    for (int i = 0; i < MQTT_INFLIGHT_WINDOW; i++) {
+        inflight_entry_t *entry = &g_window[i];
+        if (entry->state == INFLIGHT_SENT && entry->msg_id == msg_id) {
+            entry->state = INFLIGHT_ACKED;
+            found = true;
+            break;
+        }
+    }
+    if (!found && msg_id > 0) {
+        g_early_acks[g_early_next] = msg_id;
+        g_early_next = (g_early_next + 1) % INFLIGHT_EARLY_ACKS;
+    }
+    taskEXIT_CRITICAL(&g_inflight_lock);
+
+    return found;
+}
+
+bool mqtt_inflight_drop(int msg_id)
+{
+    bool found = false;
+
+    taskENTER_CRITICAL(&g_inflight_lock);
+    for (int i = 0; i < MQTT_INFLIGHT_WINDOW; i++) {
+        inflight_entry_t *entry = &g_window[i];
+        if (entry->state == INFLIGHT_SENT && entry->msg_id == msg_id) {
+            entry->state = INFLIGHT_DROPPED;
+            found = true;
+            break;
+        }
+    }
+    taskEXIT_CRITICAL(&g_inflight_lock);
+
+    return found;
+}
+
+uint32_t mqtt_inflight_collect(uint32_t *lost)
+{
+    mqtt_outbox_slot_t *done[MQTT_INFLIGHT_WINDOW];
+    uint32_t count = 0, dropped = 0;
+    TickType_t now = xTaskGetTickCount();
+
+    taskENTER_CRITICAL(&g_inflight_lock);
+    for (int i = 0; i < MQTT_INFLIGHT_WINDOW; i++) {
+        inflight_entry_t *entry = &g_window[i];
+        if (entry->state == INFLIGHT_SENT && (now - entry->sent) >= pdMS_TO_TICKS(MQTT_INFLIGHT_ACK_TIMEOUT_MS))
+            entry->state = INFLIGHT_DROPPED;
+        if (entry->state == INFLIGHT_ACKED || entry->state == INFLIGHT_DROPPED) {
+            if (entry->state == INFLIGHT_DROPPED)
+                dropped++;
+            done[count++] = entry->slot;
+            entry->state = INFLIGHT_FREE;
+            entry->slot = NULL;
+            g_used--;
+        }
+    }
+    taskEXIT_CRITICAL(&g_inflight_lock);
+
+    /* Outside the critical section, release may touch a queue */
+    for (uint32_t i = 0; i < count; i++)
+        mqtt_outbox_release(done[i]);
+
+    if (dropped > 0)
+        ESP_LOGW(TAG, "%lu publishes never acknowledged, given up", (unsigned long)dropped);
+    if (lost != NULL)
+        *lost = dropped;
+    return count;
+}
+
+uint32_t mqtt_inflight_resend(mqtt_inflight_publish_t publish)
+{
+    uint32_t sent = 0;
+    uint32_t last_seq = 0;
+
+    /* Oldest first: repeatedly take the smallest seq above the last one sent */
+    while (1) {
+        inflight_entry_t *oldest = NULL;
+
+        taskENTER_CRITICAL(&g_inflight_lock);
+        for (int i = 0; i < MQTT_INFLIGHT_WINDOW; i++) {
+            inflight_entry_t *entry = &g_window[i];
+            if (entry->state == INFLIGHT_SENT && entry->seq > last_seq &&
+                (oldest == NULL || entry->seq < oldest->seq))
+                oldest = entry;
+        }
+        taskEXIT_CRITICAL(&g_inflight_lock);
+
+        if (oldest == NULL)
+            break;
+
+        /* Only mqtt_task frees entries, the slot stays valid without the lock */
+        last_seq = oldest->seq;
+        int msg_id = publish(oldest->slot, oldest->seq);
+        if (msg_id < 0) {
+            ESP_LOGW(TAG, "Retransmission of seq %lu failed", (unsigned long)oldest->seq);
+            break;
+        }
+
+        taskENTER_CRITICAL(&g_inflight_lock);
+        if (oldest->state == INFLIGHT_SENT) {
+            oldest->msg_id = msg_id;
+            oldest->sent = xTaskGetTickCount();
+        }
+        taskEXIT_CRITICAL(&g_inflight_lock);
+        sent++;
+    }
+
+    return sent;
+}
@@ -0,0 +1,110 @@
+/**
+ * @file inflight.h
+ * @brief Window of QoS 1 publishes waiting for their PUBACK
+ *
+ * mqtt_task keeps the outbox slot of every QoS > 0 publish until the broker
+ * acknowledges it, so up to MQTT_INFLIGHT_WINDOW messages are on the wire
+ * at once instead of one round trip per message. The window also caps the
+ * outbox memory held by unacknowledged messages. After a reconnect the
+ * unacknowledged messages are published again, oldest first.
+ *
+ * A publish the client deleted from its own outbox (MQTT_EVENT_DELETED) or
+ * still unacknowledged MQTT_INFLIGHT_ACK_TIMEOUT_MS after it was sent is
+ * given up and counted as lost, so a broker that never acks can't hold the
+ * window shut.
+ *
+ * Each reliable payload starts with an 8 bytes header so the gateway can
+ * drop the duplicates a retransmission may create (big endian):
+ *
+ *   'W' 'R' <boot id:2> <seq:4>
+ *
+ * The boot id is random per boot, seq counts up from 1.
+ */
+#ifndef MQTT_INFLIGHT_H
+#define MQTT_INFLIGHT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "../outbox/outbox.h"
+
+#define MQTT_RELIABLE_MAGIC_0      'W'
+#define MQTT_RELIABLE_MAGIC_1      'R'
+#define MQTT_RELIABLE_HEADER_SIZE  8
+
+/**
+ * @brief Publish function used for retransmissions
+ *
+ * @return Message ID (>= 0) on success, -1 on failure
+ */
+typedef int (*mqtt_inflight_publish_t)(const mqtt_outbox_slot_t *slot, uint32_t seq);
+
+/**
+ * @brief Clear the window and pick the boot id
+ */
+void mqtt_inflight_init(void);
+
+/**
+ * @brief Next sequence number of a reliable publish
+ */
+uint32_t mqtt_inflight_next_seq(void);
+
+/**
+ * @brief Write the reliable header of seq into buf
+ *
+ * @return MQTT_RELIABLE_HEADER_SIZE
+ */
+size_t mqtt_inflight_header(uint8_t *buf, uint32_t seq);
+
+/**
+ * @brief true when no more publishes may be sent before an ack
+ */
+bool mqtt_inflight_full(void);
+
+/**
+ * @brief Unacknowledged publishes in the window
+ */
+uint32_t mqtt_inflight_count(void);
+
+/**
+ * @brief Keep a published slot until its ack (mqtt_task only)
+ *
+ * @return ESP_OK, ESP_ERR_NO_MEM if the window is full
+ */
+esp_err_t mqtt_inflight_add(mqtt_outbox_slot_t *slot, int msg_id, uint32_t seq);
+
+/**
+ * @brief Mark the publish msg_id as acknowledged (MQTT event handler)
+ *
+ * An ack for a msg_id that isn't in the window yet is remembered, in case
+ * mqtt_task adds that publish right after.
+ *
+ * @return true if the message was in the window
+ */
+bool mqtt_inflight_ack(int msg_id);
+
+/**
+ * @brief Give up the publish msg_id, the client deleted it (MQTT event handler)
+ *
+ * @return true if the message was in the window
+ */
+bool mqtt_inflight_drop(int msg_id);
+
+/**
+ * @brief Give the slots of acknowledged, dropped and timed out publishes back to the outbox (mqtt_task only)
+ *
+ * @param lost Set to the number of dropped and timed out publishes, may be NULL
+ * @return Number of slots released
+ */
+uint32_t mqtt_inflight_collect(uint32_t *lost);
+
+/**
+ * @brief Publish every unacknowledged message again, oldest first (mqtt_task only)
+ *
+ * @param publish Publish function
+ * @return Number of messages sent again, stops at the first failure
+ */
+uint32_t mqtt_inflight_resend(mqtt_inflight_publish_t publish);
+
+#endif /* MQTT_INFLIGHT_H */
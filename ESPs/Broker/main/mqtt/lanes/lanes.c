@@ -0,0 +1,144 @@
+/**
+ * @file lanes.c
+ * @brief Priority lanes between the MQTT producers and mqtt_task
+ */
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+
+#include "../mqtt_config.h"
+#include "../stats/stats.h"
+#include "lanes.h"
+
+static const char *TAG = "MQTT_LANES";
+
+typedef struct {
+    QueueHandle_t queue;
+    uint16_t      size;
+    uint8_t       drop;      /* MQTT_DROP_NEWEST or MQTT_DROP_OLDEST */
+    TickType_t    wait;      /* Producer wait for room, MQTT_DROP_NEWEST only */
+    uint32_t      skipped;   /* Consecutive pops that served a higher lane, consumer only */
+} mqtt_lane_ctx_t;
+
+static mqtt_lane_ctx_t g_lanes[MQTT_LANE_COUNT] = {
+    [MQTT_LANE_CONTROL]   = { NULL, MQTT_LANE_CONTROL_SIZE,   MQTT_LANE_CONTROL_DROP,   MQTT_LANE_CONTROL_WAIT,   0 },
+    [MQTT_LANE_TELEMETRY] = { NULL, MQTT_LANE_TELEMETRY_SIZE, MQTT_LANE_TELEMETRY_DROP, MQTT_LANE_TELEMETRY_WAIT, 0 },
+};
+
+/* One count per queued slot, wakes mqtt_task whatever the lane */
+static SemaphoreHandle_t g_pending = NULL;
+
+esp_err_t mqtt_lanes_init(void)
+{
+    uint32_t total = 0;
+
+    if (g_pending != NULL)
+        return ESP_OK;
+
+    for (int i = 0; i < MQTT_LANE_COUNT; i++) {
+        g_lanes[i].queue = xQueueCreate(g_lanes[i].size, sizeof(mqtt_outbox_slot_t *));
+        if (g_lanes[i].queue == NULL) {
+            ESP_LOGE(TAG, "Failed to create lane %d", i);
+            return ESP_ERR_NO_MEM;
+        }
+        total += g_lanes[i].size;
+    }
+
+    g_pending = xSemaphoreCreateCounting(total, 0);
+    if (g_pending == NULL) {
+        ESP_LOGE(TAG, "Failed to create lane semaphore");
+        return ESP_ERR_NO_MEM;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t mqtt_lanes_push(mqtt_outbox_slot_t *slot)
+{
+    if (g_pending == NULL)
+        return ESP_ERR_INVALID_STATE;
+
+    mqtt_lane_ctx_t *lane = &g_lanes[slot->lane];
+
+    if (lane->drop == MQTT_DROP_NEWEST) {
+        if (xQueueSend(lane->queue, &slot, lane->wait) != pdTRUE)
+            return ESP_ERR_TIMEOUT;
+    } else if (xQueueSend(lane->queue, &slot, 0) != pdTRUE) {
+        /* Fresh data wins, give the oldest slot of the lane back */
+        mqtt_outbox_slot_t *oldest;
+        if (xQueueReceive(lane->queue, &oldest, 0) == pdTRUE) {
+            mqtt_stats_drop(oldest->lane);
+            mqtt_outbox_release(oldest);
+        }
+        if (xQueueSend(lane->queue, &slot, 0) != pdTRUE)
+            return ESP_ERR_TIMEOUT;
+    }
+
+    /* A count left over after an eviction only costs mqtt_task an empty pop */
+    xSemaphoreGive(g_pending);
+    return ESP_OK;
+}
+
+esp_err_t mqtt_lanes_evict(mqtt_lane_t lane)
+{
+    mqtt_outbox_slot_t *oldest;
+
+    if (g_pending == NULL || g_lanes[lane].drop != MQTT_DROP_OLDEST)
+        return ESP_ERR_NOT_FOUND;
+
+    /* Its pending count stays, as after an eviction in mqtt_lanes_push() */
+    if (xQueueReceive(g_lanes[lane].queue, &oldest, 0) != pdTRUE)
+        return ESP_ERR_NOT_FOUND;
+
+    mqtt_stats_drop(oldest->lane);
+    mqtt_outbox_release(oldest);
+    return ESP_OK;
+}
+
+mqtt_outbox_slot_t *mqtt_lanes_pop(TickType_t wait)
+{
+    mqtt_outbox_slot_t *slot = NULL;
+    int first = -1;
+    int starved = -1;
+
+    if (g_pending == NULL || xSemaphoreTake(g_pending, wait) != pdTRUE)
+        return NULL;
+
+    /* Highest non-empty lane, and the highest lower lane that waited too long */
+    for (int i = 0; i < MQTT_LANE_COUNT; i++) {
+        mqtt_lane_ctx_t *lane = &g_lanes[i];
+        if (uxQueueMessagesWaiting(lane->queue) == 0) {
+            lane->skipped = 0;
+            continue;
+        }
+        if (first < 0) {
+            first = i;
+            continue;
+        }
+        if (++lane->skipped >= MQTT_LANE_STARVE_LIMIT && starved < 0)
+            starved = i;
+    }
+
+    if (first < 0)
+        return NULL;
+
+    int serve = (starved >= 0) ? starved : first;
+    g_lanes[serve].skipped = 0;
+    if (xQueueReceive(g_lanes[serve].queue, &slot, 0) != pdTRUE)
+        return NULL;
+
+    return slot;
+}
+
+uint32_t mqtt_lanes_depth(void)
+{
+    uint32_t depth = 0;
+
+    for (int i = 0; i < MQTT_LANE_COUNT; i++) {
+        if (g_lanes[i].queue != NULL)
+            depth += uxQueueMessagesWaiting(g_lanes[i].queue);
+    }
+
+    return depth;
+}
@@ -0,0 +1,63 @@
+/**
+ * @file lanes.h
+ * @brief Priority lanes between the MQTT producers and mqtt_task
+ *
+ * Every lane is its own FIFO of outbox slot pointers with its own capacity
+ * and drop policy (MQTT_LANE_<name>_SIZE / _DROP in mqtt_config.h). mqtt_task
+ * always takes from the highest non-empty lane, except that a lower lane
+ * which was passed over MQTT_LANE_STARVE_LIMIT times in a row is served once,
+ * so telemetry keeps moving under a flood of control messages.
+ */
+#ifndef MQTT_LANES_H
+#define MQTT_LANES_H
+
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_err.h"
+#include "../outbox/outbox.h"
+
+/**
+ * @brief Create the lane queues
+ *
+ * @return ESP_OK on success, ESP_ERR_NO_MEM if a queue can't be created
+ */
+esp_err_t mqtt_lanes_init(void);
+
+/**
+ * @brief Queue a slot on the lane given by slot->lane
+ *
+ * A full MQTT_DROP_NEWEST lane waits up to its send wait then refuses the
+ * slot. A full MQTT_DROP_OLDEST lane releases its oldest slot to make room.
+ *
+ * @param slot Filled slot, the caller keeps it if this fails
+ * @return ESP_OK, ESP_ERR_TIMEOUT if the lane is full,
+ *         ESP_ERR_INVALID_STATE before mqtt_lanes_init()
+ */
+esp_err_t mqtt_lanes_push(mqtt_outbox_slot_t *slot);
+
+/**
+ * @brief Release the oldest slot waiting in a MQTT_DROP_OLDEST lane
+ *
+ * For a producer that found no room in the outbox: the slot it would have
+ * pushed out of the lane is given back now, the drop is counted.
+ *
+ * @param lane Lane to evict from
+ * @return ESP_OK if a slot was released, ESP_ERR_NOT_FOUND if the lane is
+ *         empty or keeps its slots (MQTT_DROP_NEWEST)
+ */
+esp_err_t mqtt_lanes_evict(mqtt_lane_t lane);
+
+/**
+ * @brief Take the next slot to publish (single consumer, mqtt_task)
+ *
+ * @param wait Ticks to wait for a slot
+ * @return The slot, or NULL on timeout
+ */
+mqtt_outbox_slot_t *mqtt_lanes_pop(TickType_t wait);
+
+/**
+ * @brief Slots waiting in all lanes
+ */
+uint32_t mqtt_lanes_depth(void);
+
+#endif /* MQTT_LANES_H */
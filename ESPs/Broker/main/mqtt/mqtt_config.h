@@ -7,11 +7,22 @@
 
 #define MQTT_QOS_0_TOPIC          "topic/qos0"
 
-#define MQTT_NODE_1_SENDSOR_TOPIC          "wot/sensors/1"
-#define MQTT_NODE_2_SENDSOR_TOPIC          "wot/sensors/2"
+// Persistent session, the broker keeps subscriptions and QoS 1 state across reconnects
+#define MQTT_PERSISTENT_SESSION   1
+#define MQTT_CLIENT_ID_PREFIX     "wot-broker-"   /* Followed by the WiFi MAC */
+#define MQTT_CONTROL_SUB_QOS      1               /* QoS 1 so commands are queued while we are away */
 
-#define MQTT_NODE_1_CONTROL_TOPIC          "wot/control/1"
-#define MQTT_NODE_2_CONTROL_TOPIC          "wot/control/2"
+// Node topics are <prefix><node id>, e.g. wot/sensors/1 and wot/control/1
+#define MQTT_SENSOR_TOPIC_PREFIX           "wot/sensors/"
+#define MQTT_CONTROL_TOPIC_PREFIX          "wot/control/"
+#define MQTT_CONTROL_WILDCARD_TOPIC        "wot/control/+"   /* One subscription for every node */
+
+// MQTT 5, topic aliases for QoS 0 publishes and message expiry for telemetry
+// (needs CONFIG_MQTT_PROTOCOL_5 in sdkconfig)
+#define MQTT_PROTOCOL_V5          1
+#define MQTT5_TOPIC_ALIAS_MAX     10      /* Keep <= the broker's limit (mosquitto max_topic_alias defaults to 10) */
+#define MQTT5_TELEMETRY_EXPIRY_S  60      /* Telemetry older than this is stale, the broker drops it */
+#define MQTT5_SESSION_EXPIRY_S    3600    /* How long the broker keeps a persistent session */
 
 // WiFi Configuration
 #define WIFI_SSID             "Moh"
@@ -20,7 +31,88 @@
 // Task Configuration
 #define MQTT_TASK_STACK_SIZE  4096
 #define MQTT_TASK_PRIORITY    5
-#define MQTT_QUEUE_SIZE       10
 #define MQTT_CORE_ID           0
 
+// Priority lanes, control and alarms are published ahead of telemetry
+#define MQTT_DROP_NEWEST           0      /* Full lane refuses the new message */
+#define MQTT_DROP_OLDEST           1      /* Full lane drops its oldest message */
+#define MQTT_LANE_CONTROL_SIZE     4
+#define MQTT_LANE_CONTROL_DROP     MQTT_DROP_NEWEST
+#define MQTT_LANE_CONTROL_WAIT     pdMS_TO_TICKS(20)   /* Ticks a producer may wait for room */
+#define MQTT_LANE_TELEMETRY_SIZE   10
+#define MQTT_LANE_TELEMETRY_DROP   MQTT_DROP_OLDEST
+#define MQTT_LANE_TELEMETRY_WAIT   0
+#define MQTT_LANE_STARVE_LIMIT     8      /* Serve a lower lane after it was passed over this many times */
+
+// Reliable mode, telemetry goes out as QoS 1 with up to MQTT_INFLIGHT_WINDOW unacked publishes
+#define MQTT_RELIABLE_ENABLE       1
+#define MQTT_TELEMETRY_QOS         1      /* 0 when MQTT_RELIABLE_ENABLE is 0 */
+#define MQTT_INFLIGHT_WINDOW       8
+#define MQTT_INFLIGHT_POLL_MS      100    /* mqtt_task wake up period while publishes wait for acks */
+#define MQTT_INFLIGHT_ACK_TIMEOUT_MS 60000 /* Unacked this long after the last send, the publish is lost */
+
+// Outbox, slot descriptors sharing one arena. Keep the slots >= sum of the lane sizes +
+// MQTT_INFLIGHT_WINDOW + 2 (open batch, slot being published) so a full telemetry lane never
+// leaves the control lane without a slot
+#define MQTT_OUTBOX_SLOTS          32     /* Messages that can wait to be published */
+#define MQTT_OUTBOX_ARENA_SIZE     (12*1024)   /* Topic + payload bytes of every message */
+#define MQTT_OUTBOX_MSG_MAX        1024   /* Topic + payload bytes of one message */
+#define MQTT_OUTBOX_CONTROL_RESERVE 1024  /* Arena bytes only the control lane may take */
+#define MQTT_OUTBOX_USE_PSRAM      1
+#define MQTT_OUTBOX_RESERVE_WAIT   pdMS_TO_TICKS(100)  /* Control lane only, telemetry never waits for room */
+
+// Store and forward, messages are kept while the broker is unreachable
+#define MQTT_SF_ENABLE             1
+#define MQTT_SF_RAM_SIZE           (64*1024)  /* PSRAM ring holding the oldest messages */
+#define MQTT_SF_PARTITION_LABEL    "sf_log"   /* Flash overflow partition, see partitions.csv */
+#define MQTT_SF_DRAIN_INTERVAL_MS  100        /* Replay period once the broker is back */
+#define MQTT_SF_DRAIN_BURST        5          /* Messages replayed per period */
+
+// Publish latency instrumentation, a JSON summary is published every MQTT_STATS_PERIOD_MS
+#define MQTT_STATS_ENABLE          1
+#define MQTT_STATS_TOPIC           "wot/stats/broker"
+#define MQTT_STATS_PERIOD_MS       10000
+#define MQTT_STATS_INFLIGHT        32     /* QoS > 0 messages tracked until their ack */
+
+// Node routing table, node ID -> prebuilt topics
+#define MQTT_ROUTE_TABLE_SIZE      2048   /* Hash table entries, power of two */
+#define MQTT_ROUTE_MAX_NODES       1536   /* Keep the table at most 75% full */
+#define MQTT_ROUTE_USE_PSRAM       1
+
+// Deadband filter, a reading is forwarded only if a field moved by more than
+// max(abs, rel * |last forwarded value|) or MQTT_DEADBAND_HEARTBEAT_MS passed since the last one
+#define MQTT_DEADBAND_ENABLE       1
+#define MQTT_DEADBAND_ABS          0.0f   /* Default absolute delta */
+#define MQTT_DEADBAND_REL          0.01f  /* Default relative delta, 1% */
+#define MQTT_DEADBAND_RULES        { { "temperature", 0.2f, 0.0f }, \
+                                     { "humidity",    0.5f, 0.0f }, \
+                                     { "pressure",    0.5f, 0.0f } }   /* Per field { name, abs, rel } */
+#define MQTT_DEADBAND_HEARTBEAT_MS 60000  /* Forward at least this often so silent nodes stay visible */
+#define MQTT_DEADBAND_FIELDS       8      /* Fields tracked per node, readings with more always pass */
+#define MQTT_DEADBAND_USE_PSRAM    1
+
+// Per node rate limit, a token bucket of MQTT_RATELIMIT_BURST readings refilled at
+// MQTT_RATELIMIT_RATE readings per second. Readings over the limit are dropped, or with
+// MQTT_RATELIMIT_KEEP_LATEST the newest one of the node is held and sent once a token is back
+#define MQTT_RATELIMIT_ENABLE      1
+#define MQTT_RATELIMIT_RATE        2      /* Readings per second and node */
+#define MQTT_RATELIMIT_BURST       10     /* Readings a quiet node may send back to back */
+#define MQTT_RATELIMIT_KEEP_LATEST 1
+#define MQTT_RATELIMIT_HELD_SLOTS  16     /* Nodes that can have a held reading at once */
+#define MQTT_RATELIMIT_HELD_SIZE   256    /* Larger readings over the limit are dropped */
+#define MQTT_RATELIMIT_USE_PSRAM   1
+
+// CBOR telemetry, node JSON is transcoded before it is published (see cbor.h)
+#define MQTT_CBOR_ENABLE           1
+#define MQTT_CBOR_MAX_FIELDS       16
+#define MQTT_CBOR_MAX_SIZE         256    /* Larger readings are forwarded as JSON */
+#define MQTT_CBOR_KEYS             { "temperature", "humidity", "light", "pressure" }  /* Sent as their index, keep in sync with the gateway */
+
+// Telemetry batching, readings of many nodes share one publish on MQTT_BATCH_TOPIC
+#define MQTT_BATCH_ENABLE          1
+#define MQTT_BATCH_TOPIC           "wot/sensors/batch"
+#define MQTT_BATCH_MAX_BYTES       768    /* Flush when the batch payload reaches this size */
+#define MQTT_BATCH_MAX_COUNT       16     /* Flush after this many readings */
+#define MQTT_BATCH_MAX_LATENCY_MS  500    /* Flush this long after the first reading of a batch */
+
 #endif /* MQTT_CONFIG_H */
\ No newline at end of file
@@ -4,18 +4,16 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/queue.h"
 #include "mqtt_client.h"
-
-// MQTT Message Structure
-typedef struct {
-    char topic[64];
-    char data[256];
-    int qos;
-    int retain;
-} mqtt_message_t;
+#include "outbox/outbox.h"
+#include "stats/stats.h"
 
 // Public API
 void mqtt_init(void);  // Initialize MQTT system
-esp_err_t mqtt_send_message(const char* topic, const char* data, int qos, int retain);  // Send a message via queue
+esp_err_t mqtt_send_message(const char* topic, const char* data, int qos, int retain);  // Send a message via the telemetry lane
+esp_err_t mqtt_send_message_lane(const char* topic, const char* data, int qos, int retain, mqtt_lane_t lane);  // Send a message via a priority lane
+esp_err_t mqtt_send_buffer(const char* topic, const void* data, size_t len, int qos, int retain, mqtt_lane_t lane);  // Send a binary payload via a priority lane
+mqtt_outbox_slot_t* mqtt_reserve_slot(const char* topic, size_t data_cap, mqtt_lane_t lane);  // Reserve a slot to fill in place, never blocks a telemetry producer (NULL and a drop counted when full)
+esp_err_t mqtt_send_slot(mqtt_outbox_slot_t *slot);  // Queue a slot filled in place on slot->lane (see mqtt_outbox_reserve), the slot is released on failure
 esp_mqtt_client_handle_t mqtt_get_client(void);  // Get the client handle if needed
 
 // WiFi initialization
@@ -10,50 +10,121 @@
 #include "nvs_flash.h"
 #include "esp_netif.h"
 #include "esp_system.h"
+#include "esp_timer.h"
 
 #include "mqtt_config.h"
 #include "mqtt_interface.h"
+#include "batch/batch.h"
+#include "route/route.h"
+#include "store_forward/store_forward.h"
+#include "stats/stats.h"
+#include "lanes/lanes.h"
+#include "inflight/inflight.h"
+#include "deadband/deadband.h"
+#include "ratelimit/ratelimit.h"
+#include "session/session.h"
+#include "alias/alias.h"
+#include "control/control_interface.h"
+#include "local_broker/local_broker_interface.h"
 
 static const char *TAG = "MQTT_MODULE";
 static esp_mqtt_client_handle_t mqtt_client = NULL;
-static QueueHandle_t mqtt_queue = NULL;
+static bool mqtt_lanes_ready = false;
 static TaskHandle_t mqtt_task_handle = NULL;
+static volatile bool mqtt_connected = false;
 
-uint8_t g_recvData[255];
-uint8_t g_recvDataLen;
-uint8_t g_recvTopic[255];
-uint8_t g_recvTopicLen;
-uint8_t is_new_data = 0;
+// Subscriptions of the session, restored by the broker when it kept the session
+static const mqtt_session_sub_t mqtt_subscriptions[] = {
+    { MQTT_CONTROL_WILDCARD_TOPIC, MQTT_CONTROL_SUB_QOS },   /* One subscription for every node */
+};
+#if ( MQTT_RELIABLE_ENABLE == 1 )
+static volatile bool mqtt_resend_pending = false;   /* Unacked publishes must go out again */
+static uint8_t mqtt_tx_buf[MQTT_RELIABLE_HEADER_SIZE + MQTT_OUTBOX_MSG_MAX];   /* mqtt_task only */
+#endif
 
 // MQTT event handler
 static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_t event_id, void *event_data) 
 {
     esp_mqtt_event_handle_t event = event_data;
-    esp_mqtt_client_handle_t client = event->client;
+    control_frame_t *frame;
+    const mqtt_route_t *route;
 
     switch ((esp_mqtt_event_id_t)event_id) 
     {
         case MQTT_EVENT_CONNECTED:
             ESP_LOGI(TAG, "MQTT_EVENT_CONNECTED");
+            mqtt_connected = true;
+#if ( MQTT_RELIABLE_ENABLE == 1 )
+            mqtt_resend_pending = true;
+            if(mqtt_task_handle != NULL)
+                xTaskNotifyGive(mqtt_task_handle);
+#endif
             // esp_mqtt_client_publish(client, MQTT_ESP_CONTROL_TOPIC, "Connected from ESP32-S3", 0, 1, 0);
-            esp_mqtt_client_subscribe(mqtt_client, MQTT_NODE_1_CONTROL_TOPIC , 0);
-            esp_mqtt_client_subscribe(mqtt_client, MQTT_NODE_2_CONTROL_TOPIC , 0);
+#if ( MQTT_PROTOCOL_V5 == 1 )
+            mqtt_alias_reset();
+#endif
+            mqtt_session_connected(event->client, event->session_present);
             break;
         case MQTT_EVENT_DISCONNECTED:
             ESP_LOGI(TAG, "MQTT_EVENT_DISCONNECTED");
+            mqtt_connected = false;
+            mqtt_session_disconnected();
+#if ( MQTT_PROTOCOL_V5 == 1 )
+            mqtt_alias_reset();
+#endif
+            break;
+        case MQTT_EVENT_SUBSCRIBED:
+            ESP_LOGI(TAG, "MQTT_EVENT_SUBSCRIBED, msg_id=%d", event->msg_id);
+            mqtt_session_subscribed(event->msg_id);
             break;
         case MQTT_EVENT_PUBLISHED:
             ESP_LOGI(TAG, "MQTT_EVENT_PUBLISHED, msg_id=%d", event->msg_id);
+            mqtt_stats_acked(event->msg_id);
+#if ( MQTT_RELIABLE_ENABLE == 1 )
+            // Wake mqtt_task in case the window was full
+            if(mqtt_inflight_ack(event->msg_id) && mqtt_task_handle != NULL)
+                xTaskNotifyGive(mqtt_task_handle);
+#endif
+            break;
+        case MQTT_EVENT_DELETED:
+            // The client gave up on the publish (its outbox expired), it will never be acked
+            ESP_LOGW(TAG, "MQTT_EVENT_DELETED, msg_id=%d", event->msg_id);
+#if ( MQTT_RELIABLE_ENABLE == 1 )
+            if(mqtt_inflight_drop(event->msg_id) && mqtt_task_handle != NULL)
+                xTaskNotifyGive(mqtt_task_handle);
+#endif
             break;
         case MQTT_EVENT_DATA:
             printf("TOPIC=%.*s\r\n", event->topic_len, event->topic);
             printf("DATA=%.*s\r\n", event->data_len, event->data);
-            memcpy( (char *)(g_recvData+1)  , event->data  , event->data_len );
-            memcpy( (char *)g_recvTopic , event->topic , event->data_len );
-            is_new_data = 1;
-            g_recvData[0] = event->topic[12]; /* Add topic number at first */
-            g_recvDataLen = event->data_len + 1 ;
-            g_recvTopicLen = event->topic;
+#if ( LOCAL_BROKER_ENABLE == 1 ) && ( LOCAL_BROKER_BRIDGE_ENABLE == 1 )
+            // Upstream commands are also seen by the LAN subscribers
+            if( event->data_len == event->total_data_len )
+                local_broker_publish(event->topic, event->topic_len, event->data, event->data_len);
+#endif
+            route = mqtt_route_from_topic(event->topic, event->topic_len);
+            if( route == NULL )
+            {
+                ESP_LOGW(TAG, "No node for topic %.*s", event->topic_len, event->topic);
+                break;
+            }
+            // Only whole commands fit in a control frame: node ID + data
+            if( event->data_len != event->total_data_len || event->data_len + route->id_len > CONTROL_FRAME_SIZE )
+            {
+                control_drop_oversized(CONTROL_SRC_MQTT);
+                ESP_LOGW(TAG, "Control command dropped, too large");
+                break;
+            }
+            frame = control_reserve(CONTROL_SRC_MQTT);
+            if( frame == NULL )
+            {
+                ESP_LOGW(TAG, "Control ring full, command dropped");
+                break;
+            }
+            memcpy( frame->data , route->id_str , route->id_len ); /* Add node ID at first */
+            memcpy( frame->data + route->id_len , event->data , event->data_len );
+            frame->len = event->data_len + route->id_len;
+            control_commit(CONTROL_SRC_MQTT);
             break; 
         case MQTT_EVENT_ERROR:
             ESP_LOGI(TAG, "MQTT_EVENT_ERROR");
@@ -67,23 +138,133 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_
 // Initialize MQTT Client
 static esp_mqtt_client_handle_t mqtt_app_start(void)
 {
+    if (mqtt_session_init(mqtt_subscriptions, sizeof(mqtt_subscriptions) / sizeof(mqtt_subscriptions[0])) != ESP_OK)
+        ESP_LOGW(TAG, "No NVS for the session record, subscribing on every connect");
+
     esp_mqtt_client_config_t mqtt_cfg = {
         .broker.address.uri  = MQTT_BROKER_URI,
         .broker.address.port = MQTT_BROKER_PORT,
+        .credentials.client_id = mqtt_session_client_id(),
+        .session.disable_clean_session = ( MQTT_PERSISTENT_SESSION == 1 ),
+#if ( MQTT_PROTOCOL_V5 == 1 )
+        .session.protocol_ver = MQTT_PROTOCOL_V_5,
+#endif
     };
 
     esp_mqtt_client_handle_t client = esp_mqtt_client_init(&mqtt_cfg);
+#if ( MQTT_PROTOCOL_V5 == 1 )
+    // A v5 session ends with the connection unless it has an expiry interval
+    esp_mqtt5_connection_property_config_t connect_property = {
+        .session_expiry_interval = ( MQTT_PERSISTENT_SESSION == 1 ) ? MQTT5_SESSION_EXPIRY_S : 0,
+    };
+    esp_mqtt5_client_set_connect_property(client, &connect_property);
+#endif
     esp_mqtt_client_start(client);
     esp_mqtt_client_register_event(client, ESP_EVENT_ANY_ID, mqtt_event_handler, NULL);
     
     return client;
 }
 
+// Message expiry of a lane, control messages never expire (MQTT 5 only)
+static inline uint32_t mqtt_lane_expiry(mqtt_lane_t lane)
+{
+    return (lane == MQTT_LANE_CONTROL) ? 0 : MQTT5_TELEMETRY_EXPIRY_S;
+}
+
+// Every publish goes through here, with the MQTT 5 properties when enabled. -1 on failure
+static int mqtt_client_publish(const char *topic, const char *data, size_t len, int qos, int retain, uint32_t expiry_s)
+{
+#if ( MQTT_PROTOCOL_V5 == 1 )
+    esp_mqtt5_publish_property_config_t property = {
+        .message_expiry_interval = expiry_s,
+    };
+    const char *wire_topic = topic;
+    if(qos == 0)
+        wire_topic = mqtt_alias_lookup(topic, &property.topic_alias);
+    esp_mqtt5_client_set_publish_property(mqtt_client, &property);
+
+    int msg_id = esp_mqtt_client_publish(mqtt_client, wire_topic, data, len, qos, retain);
+    if(msg_id != -1)
+        mqtt_alias_sent(property.topic_alias, strlen(topic), wire_topic == topic);
+    return msg_id;
+#else
+    return esp_mqtt_client_publish(mqtt_client, topic, data, len, qos, retain);
+#endif
+}
+
+#if ( MQTT_RELIABLE_ENABLE == 1 )
+// Publish with the reliable header (see inflight.h) in front of the payload, -1 on failure
+static int mqtt_publish_seq(const char *topic, const char *data, size_t len, int qos, int retain, uint32_t seq, uint32_t expiry_s)
+{
+    size_t off = mqtt_inflight_header(mqtt_tx_buf, seq);
+    if(len > sizeof(mqtt_tx_buf) - off)
+        return -1;
+    memcpy(mqtt_tx_buf + off, data, len);
+    return mqtt_client_publish(topic, (const char *)mqtt_tx_buf, off + len, qos, retain, expiry_s);
+}
+
+// Keep a published QoS 1 slot until its ack. mqtt_inflight_full() gates every publish so this
+// can't fail, if it ever does the publish went out untracked: it is counted lost, not retried
+static void mqtt_track_slot(mqtt_outbox_slot_t *slot, int msg_id, uint32_t seq)
+{
+    if(mqtt_inflight_add(slot, msg_id, seq) == ESP_OK)
+        return;
+    ESP_LOGE(TAG, "In-flight window full, msg_id=%d is not tracked", msg_id);
+    mqtt_stats_lost(1);
+    mqtt_outbox_release(slot);
+}
+
+// Retransmission of a publish still in the window, same seq so the gateway can drop the copy
+static int mqtt_resend_slot(const mqtt_outbox_slot_t *slot, uint32_t seq)
+{
+    return mqtt_publish_seq(slot->topic, slot->data, slot->data_len, slot->qos, slot->retain, seq, mqtt_lane_expiry(slot->lane));
+}
+#endif
+
+// Publish a store and forward message on the client, -1 on failure (it stays in the log)
+static int mqtt_publish(const char *topic, const char *data, size_t len, int qos, int retain, mqtt_lane_t lane)
+{
+#if ( MQTT_RELIABLE_ENABLE == 1 )
+    // A reliable replay takes a window entry like any QoS 1 publish, so it is sent again
+    // after a reconnect and its seq isn't used twice. Waits in the log while the window is full.
+    if(qos > 0)
+    {
+        if(mqtt_inflight_full())
+            return -1;
+        mqtt_outbox_slot_t *slot = mqtt_outbox_reserve(topic, len, lane, 0);
+        if(slot == NULL)
+            return -1;
+        memcpy(slot->data, data, len);
+        slot->data[len] = '\0';
+        slot->data_len = len;
+        slot->qos = qos;
+        slot->retain = retain;
+
+        uint32_t seq = mqtt_inflight_next_seq();
+        int msg_id = mqtt_publish_seq(slot->topic, slot->data, slot->data_len, qos, retain, seq, mqtt_lane_expiry(slot->lane));
+        if(msg_id == -1)
+            mqtt_outbox_release(slot);
+        else
+            mqtt_track_slot(slot, msg_id, seq);
+        return msg_id;
+    }
+#endif
+    return mqtt_client_publish(topic, data, len, qos, retain, mqtt_lane_expiry(lane));
+}
+
 // MQTT Task Function
 static void mqtt_task(void *pvParameters)
 {
     ESP_LOGI(TAG, "Start MQTT task" );
-    mqtt_message_t msg;
+    mqtt_outbox_slot_t *slot;
+    TickType_t now;
+#if ( MQTT_SF_ENABLE == 1 )
+    TickType_t last_drain = 0;
+#endif
+#if ( MQTT_STATS_ENABLE == 1 )
+    static char stats_json[1280];
+    TickType_t last_stats = xTaskGetTickCount();
+#endif
     
     // Wait for WiFi connection before starting MQTT
     vTaskDelay(3000 / portTICK_PERIOD_MS);
@@ -97,26 +278,169 @@ static void mqtt_task(void *pvParameters)
     // Main task loop - process messages from queue
     while(1) 
     {
-        if(xQueueReceive(mqtt_queue, &msg, portMAX_DELAY) == pdTRUE) 
+        TickType_t wait = portMAX_DELAY;
+#if ( MQTT_RELIABLE_ENABLE == 1 )
+        // Acked and given up slots go back to the outbox, unacked ones go out again after a reconnect
+        uint32_t lost;
+        mqtt_inflight_collect(&lost);
+        mqtt_stats_lost(lost);
+        if(mqtt_connected && mqtt_resend_pending)
+        {
+            mqtt_resend_pending = false;
+            mqtt_stats_retry(mqtt_inflight_resend(mqtt_resend_slot));
+        }
+        if(mqtt_inflight_count() > 0)
+            wait = pdMS_TO_TICKS(MQTT_INFLIGHT_POLL_MS);
+#endif
+#if ( MQTT_SF_ENABLE == 1 )
+        // Wake up periodically while there is something to replay
+        if(mqtt_sf_pending() && pdMS_TO_TICKS(MQTT_SF_DRAIN_INTERVAL_MS) < wait)
+            wait = pdMS_TO_TICKS(MQTT_SF_DRAIN_INTERVAL_MS);
+#endif
+#if ( MQTT_STATS_ENABLE == 1 )
+        // And in time for the next stats report
+        now = xTaskGetTickCount();
+        TickType_t stats_wait = pdMS_TO_TICKS(MQTT_STATS_PERIOD_MS) - (now - last_stats);
+        if((now - last_stats) >= pdMS_TO_TICKS(MQTT_STATS_PERIOD_MS))
+            stats_wait = 0;
+        if(stats_wait < wait)
+            wait = stats_wait;
+#endif
+#if ( MQTT_RELIABLE_ENABLE == 1 )
+        // Window full: no new publish until an ack comes in
+        if(mqtt_inflight_full())
         {
-            ESP_LOGI(TAG, "Sending message to topic %s: %s", msg.topic, msg.data );
-            uint8_t status = esp_mqtt_client_publish(mqtt_client, msg.topic, msg.data, strlen(msg.data), msg.qos, msg.retain);
+            ulTaskNotifyTake(pdTRUE, wait);
+            slot = NULL;
+        }
+        else
+#endif
+        slot = mqtt_lanes_pop(wait);
+        if(slot != NULL) 
+        {
+            mqtt_stats_dequeued(slot->lane, slot->enqueue_us, mqtt_lanes_depth());
+#if ( MQTT_SF_ENABLE == 1 )
+            // Keep the telemetry order: behind older buffered messages, or buffered while the broker
+            // is away. Higher lanes skip the backlog.
+            if(!mqtt_connected || (slot->lane >= MQTT_LANE_TELEMETRY && mqtt_sf_pending()))
+            {
+                mqtt_sf_store(slot);
+                mqtt_outbox_release(slot);
+                continue;
+            }
+#endif
+            ESP_LOGI(TAG, "Sending message to topic %s: %.*s", slot->topic, (int)slot->data_len, slot->data );
+            int status;
+#if ( MQTT_RELIABLE_ENABLE == 1 )
+            uint32_t seq = 0;
+            if(slot->qos > 0)
+            {
+                seq = mqtt_inflight_next_seq();
+                status = mqtt_publish_seq(slot->topic, slot->data, slot->data_len, slot->qos, slot->retain, seq, mqtt_lane_expiry(slot->lane));
+            }
+            else
+#endif
+            status = mqtt_client_publish(slot->topic, slot->data, slot->data_len, slot->qos, slot->retain, mqtt_lane_expiry(slot->lane));
             if(status == -1)
-                ESP_LOGE(TAG, "Sending message to topic %s: %s Fails", msg.topic, msg.data);
+            {
+                ESP_LOGE(TAG, "Sending message to topic %s: %.*s Fails", slot->topic, (int)slot->data_len, slot->data);
+#if ( MQTT_SF_ENABLE == 1 )
+                if(mqtt_sf_store(slot) == ESP_OK)
+                    mqtt_stats_retry(1);
+#endif
+            }
+            else
+            {
+                mqtt_stats_published(status, slot->enqueue_us);
+#if ( MQTT_RELIABLE_ENABLE == 1 )
+                // Keep the slot until the broker acks it
+                if(slot->qos > 0)
+                {
+                    mqtt_track_slot(slot, status, seq);
+                    continue;
+                }
+#endif
+            }
+            // Publish copies the payload into the client, the slot can be reused
+            mqtt_outbox_release(slot);
+        }
+
+#if ( MQTT_SF_ENABLE == 1 )
+        // Replay at a controlled rate once the broker is back
+        now = xTaskGetTickCount();
+        if(mqtt_connected && mqtt_sf_pending() && (now - last_drain) >= pdMS_TO_TICKS(MQTT_SF_DRAIN_INTERVAL_MS))
+        {
+            mqtt_stats_retry(mqtt_sf_replay(mqtt_publish, MQTT_SF_DRAIN_BURST));
+            last_drain = now;
         }
+#endif
+
+#if ( MQTT_STATS_ENABLE == 1 )
+        // Periodic latency/throughput report, straight to the client
+        now = xTaskGetTickCount();
+        if((now - last_stats) >= pdMS_TO_TICKS(MQTT_STATS_PERIOD_MS))
+        {
+            last_stats = now;
+            int len = mqtt_stats_to_json(stats_json, sizeof(stats_json));
+            if(mqtt_connected && len > 0)
+                mqtt_client_publish(MQTT_STATS_TOPIC, stats_json, len, 0, 0, MQTT_STATS_PERIOD_MS / 1000);
+        }
+#endif
     }
 }
 
 // Initialize MQTT system
 void mqtt_init(void)
 {
-    // Create message queue
-    mqtt_queue = xQueueCreate(MQTT_QUEUE_SIZE, sizeof(mqtt_message_t));
-    
-    if (mqtt_queue == NULL) {
-        ESP_LOGE(TAG, "Failed to create MQTT queue");
+    // Allocate the outbox arena, the queue only carries slot pointers
+    if (mqtt_outbox_init() != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create MQTT outbox");
         return;
     }
+
+    if (mqtt_route_init() != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create MQTT routing table");
+        return;
+    }
+
+#if ( MQTT_SF_ENABLE == 1 )
+    if (mqtt_sf_init() != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create MQTT store and forward");
+        return;
+    }
+#endif
+
+#if ( MQTT_DEADBAND_ENABLE == 1 )
+    if (mqtt_deadband_init() != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create MQTT deadband filter");
+        return;
+    }
+#endif
+
+#if ( MQTT_RATELIMIT_ENABLE == 1 )
+    if (mqtt_ratelimit_init() != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create MQTT rate limit");
+        return;
+    }
+#endif
+
+#if ( MQTT_BATCH_ENABLE == 1 )
+    if (mqtt_batch_init() != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create MQTT batching");
+        return;
+    }
+#endif
+
+    // Create the priority lanes, they only carry slot pointers
+    if (mqtt_lanes_init() != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create MQTT lanes");
+        return;
+    }
+    mqtt_lanes_ready = true;
+
+#if ( MQTT_RELIABLE_ENABLE == 1 )
+    mqtt_inflight_init();
+#endif
     
     // Create MQTT task
     xTaskCreatePinnedToCore(mqtt_task, "mqtt_task", MQTT_TASK_STACK_SIZE, NULL, MQTT_TASK_PRIORITY, &mqtt_task_handle , MQTT_CORE_ID);
@@ -124,31 +448,85 @@ void mqtt_init(void)
     ESP_LOGI(TAG, "MQTT system initialized");
 }
 
-// Send MQTT message via queue
+// Send MQTT message via the telemetry lane
 esp_err_t mqtt_send_message(const char* topic, const char* data, int qos, int retain)
 {
-    if (mqtt_queue == NULL) {
-        ESP_LOGE(TAG, "MQTT queue not initialized");
+    return mqtt_send_message_lane(topic, data, qos, retain, MQTT_LANE_TELEMETRY);
+}
+
+// Send MQTT message via the given priority lane
+esp_err_t mqtt_send_message_lane(const char* topic, const char* data, int qos, int retain, mqtt_lane_t lane)
+{
+    return mqtt_send_buffer(topic, data, strlen(data), qos, retain, lane);
+}
+
+// Send a binary payload via the given priority lane
+esp_err_t mqtt_send_buffer(const char* topic, const void* data, size_t len, int qos, int retain, mqtt_lane_t lane)
+{
+    if (!mqtt_lanes_ready) {
+        ESP_LOGE(TAG, "MQTT lanes not initialized");
         return ESP_FAIL;
     }
     
-    mqtt_message_t msg;
+    // Sized for the payload, refused rather than truncated when it doesn't fit
+    mqtt_outbox_slot_t *slot = mqtt_reserve_slot(topic, len, lane);
+    if (slot == NULL) {
+        ESP_LOGE(TAG, "No outbox room for a message of %d bytes", (int)len);
+        return ESP_FAIL;
+    }
     
-    // Copy data to message struct
-    strncpy(msg.topic, topic, sizeof(msg.topic) - 1);
-    msg.topic[sizeof(msg.topic) - 1] = '\0';
+    // Copy data straight into the slot
+    memcpy(slot->data, data, len);
+    slot->data[len] = '\0';
+    slot->data_len = len;
     
-    strncpy(msg.data, data, sizeof(msg.data) - 1);
-    msg.data[sizeof(msg.data) - 1] = '\0';
+    slot->qos = qos;
+    slot->retain = retain;
     
-    msg.qos = qos;
-    msg.retain = retain;
+    return mqtt_send_slot(slot);
+}
+
+// Reserve a slot on the given lane, only the control lane waits for room
+mqtt_outbox_slot_t* mqtt_reserve_slot(const char* topic, size_t data_cap, mqtt_lane_t lane)
+{
+    if (lane == MQTT_LANE_CONTROL) {
+        mqtt_outbox_slot_t *slot = mqtt_outbox_reserve(topic, data_cap, lane, MQTT_OUTBOX_RESERVE_WAIT);
+        if (slot == NULL)
+            mqtt_stats_drop(lane);
+        return slot;
+    }
+
+    // Waiting would only let the backlog grow behind the dispatcher while inflight slots hold the
+    // arena, evict the oldest queued telemetry like a full DROP_OLDEST lane does and try once more
+    mqtt_outbox_slot_t *slot = mqtt_outbox_reserve(topic, data_cap, lane, 0);
+    if (slot == NULL && mqtt_lanes_evict(lane) == ESP_OK)
+        slot = mqtt_outbox_reserve(topic, data_cap, lane, 0);
+    if (slot == NULL)
+        mqtt_stats_drop(lane);
+    return slot;
+}
+
+// Send a slot that the caller filled in place
+esp_err_t mqtt_send_slot(mqtt_outbox_slot_t *slot)
+{
+    if (slot == NULL)
+        return ESP_FAIL;
+
+    if (!mqtt_lanes_ready) {
+        ESP_LOGE(TAG, "MQTT lanes not initialized");
+        mqtt_outbox_release(slot);
+        return ESP_FAIL;
+    }
     
-    // Send to queue
-    if (xQueueSend(mqtt_queue, &msg, pdMS_TO_TICKS(100)) != pdTRUE) {
-        ESP_LOGE(TAG, "Failed to queue MQTT message");
+    // Only the slot pointer goes through the lane
+    slot->enqueue_us = esp_timer_get_time();
+    if (mqtt_lanes_push(slot) != ESP_OK) {
+        mqtt_stats_drop(slot->lane);
+        ESP_LOGE(TAG, "Lane %d full, MQTT message dropped", (int)slot->lane);
+        mqtt_outbox_release(slot);
         return ESP_FAIL;
     }
+    mqtt_stats_enqueued();
     
     return ESP_OK;
 }
@@ -0,0 +1,256 @@
+/**
+ * @file outbox.c
+ * @brief Preallocated MQTT outbox of variable length slots
+ */
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+
+#include "../mqtt_config.h"
+#include "outbox.h"
+
+#define OUTBOX_ALIGN        4
+#define OUTBOX_ALIGN_UP(n)  (((n) + OUTBOX_ALIGN - 1) & ~(uint32_t)(OUTBOX_ALIGN - 1))
+
+#if ( MQTT_OUTBOX_ARENA_SIZE % OUTBOX_ALIGN != 0 ) || ( MQTT_OUTBOX_ARENA_SIZE > 0xFFFC )
+#error "MQTT_OUTBOX_ARENA_SIZE must be a multiple of 4 below 64 KB"
+#endif
+
+/**
+ * @brief Block header, followed by the NUL-terminated topic and the payload
+ *
+ * A released block, or the unused end of the arena skipped by a wrap, stays
+ * in the ring until the head reaches it.
+ */
+typedef struct {
+    uint16_t size;       /* Block bytes, header included, multiple of OUTBOX_ALIGN */
+    uint16_t released;
+} outbox_block_t;
+
+static const char *TAG = "MQTT_OUTBOX";
+
+static mqtt_outbox_slot_t g_slots[MQTT_OUTBOX_SLOTS];
+static uint8_t *g_arena = NULL;
+static QueueHandle_t g_free_slots = NULL;   /* Holds pointers of the free descriptors */
+static SemaphoreHandle_t g_space = NULL;    /* Given on every release, wakes the producers waiting for room */
+
+/* Ring state, under g_lock */
+static portMUX_TYPE g_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t g_head = 0;   /* Oldest block */
+static uint32_t g_tail = 0;   /* Where the next block goes */
+static uint32_t g_used = 0;   /* Bytes from head to tail, released and skipped blocks included */
+
+static inline outbox_block_t *outbox_block(uint32_t offset)
+{
+    return (outbox_block_t *)(g_arena + offset);
+}
+
+/* Take need bytes at the tail leaving keep bytes free, g_lock must be held */
+static bool outbox_alloc(uint32_t need, uint32_t keep, uint32_t *offset)
+{
+    uint32_t at, skip = 0;
+
+    if (g_used == 0) {
+        g_head = g_tail = 0;
+    } else if (g_tail == g_head) {
+        return false;   /* Full */
+    }
+
+    if (g_tail >= g_head) {
+        if (need <= MQTT_OUTBOX_ARENA_SIZE - g_tail) {
+            at = g_tail;
+        } else if (need <= g_head) {
+            /* Doesn't fit before the end, the end is skipped and the block starts over at 0 */
+            skip = MQTT_OUTBOX_ARENA_SIZE - g_tail;
+            at = 0;
+        } else {
+            return false;
+        }
+    } else if (need <= g_head - g_tail) {
+        at = g_tail;
+    } else {
+        return false;
+    }
+
+    if (g_used + skip + need + keep > MQTT_OUTBOX_ARENA_SIZE)
+        return false;
+
+    if (skip > 0) {
+        outbox_block(g_tail)->size = (uint16_t)skip;
+        outbox_block(g_tail)->released = 1;
+    }
+    outbox_block(at)->size = (uint16_t)need;
+    outbox_block(at)->released = 0;
+
+    g_tail = (at + need) % MQTT_OUTBOX_ARENA_SIZE;
+    g_used += skip + need;
+    *offset = at;
+    return true;
+}
+
+/* Move the head past the released blocks, g_lock must be held */
+static void outbox_reclaim(void)
+{
+    while (g_used > 0) {
+        outbox_block_t *b = outbox_block(g_head);
+        if (!b->released)
+            break;
+        g_used -= b->size;
+        g_head = (g_head + b->size) % MQTT_OUTBOX_ARENA_SIZE;
+    }
+}
+
+esp_err_t mqtt_outbox_init(void)
+{
+    if (g_arena != NULL)
+        return ESP_OK;
+
+    /* One block for every message, keep it out of internal RAM when PSRAM exists */
+#if ( MQTT_OUTBOX_USE_PSRAM == 1 )
+    g_arena = heap_caps_malloc(MQTT_OUTBOX_ARENA_SIZE, MALLOC_CAP_SPIRAM);
+    if (g_arena == NULL)
+        ESP_LOGW(TAG, "No PSRAM for the outbox, using internal RAM");
+#endif
+    if (g_arena == NULL)
+        g_arena = heap_caps_malloc(MQTT_OUTBOX_ARENA_SIZE, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (g_arena == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate outbox arena");
+        return ESP_ERR_NO_MEM;
+    }
+
+    g_free_slots = xQueueCreate(MQTT_OUTBOX_SLOTS, sizeof(mqtt_outbox_slot_t *));
+    g_space = xSemaphoreCreateCounting(MQTT_OUTBOX_SLOTS, 0);
+    if (g_free_slots == NULL || g_space == NULL) {
+        ESP_LOGE(TAG, "Failed to create outbox free list");
+        if (g_space != NULL)
+            vSemaphoreDelete(g_space);
+        if (g_free_slots != NULL)
+            vQueueDelete(g_free_slots);
+        heap_caps_free(g_arena);
+        g_space = NULL;
+        g_free_slots = NULL;
+        g_arena = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+
+    g_head = g_tail = g_used = 0;
+    for (uint16_t i = 0; i < MQTT_OUTBOX_SLOTS; i++) {
+        mqtt_outbox_slot_t *slot = &g_slots[i];
+        slot->index = i;
+        xQueueSend(g_free_slots, &slot, 0);
+    }
+
+    ESP_LOGI(TAG, "Outbox ready, %d slots sharing %d bytes", MQTT_OUTBOX_SLOTS, MQTT_OUTBOX_ARENA_SIZE);
+    return ESP_OK;
+}
+
+mqtt_outbox_slot_t *mqtt_outbox_reserve(const char *topic, size_t data_cap, mqtt_lane_t lane, TickType_t wait)
+{
+    mqtt_outbox_slot_t *slot = NULL;
+    uint32_t offset;
+    TimeOut_t timeout;
+
+    if (g_free_slots == NULL || topic == NULL)
+        return NULL;
+
+    size_t topic_len = strlen(topic);
+    /* Topic and payload each keep their NUL */
+    if (topic_len + 1 + data_cap + 1 > MQTT_OUTBOX_MSG_MAX) {
+        ESP_LOGE(TAG, "Message on %s too long for the outbox", topic);
+        return NULL;
+    }
+    uint32_t need = OUTBOX_ALIGN_UP(sizeof(outbox_block_t) + topic_len + 1 + data_cap + 1);
+    uint32_t keep = (lane == MQTT_LANE_CONTROL) ? 0 : MQTT_OUTBOX_CONTROL_RESERVE;
+
+    vTaskSetTimeOutState(&timeout);
+    if (xQueueReceive(g_free_slots, &slot, wait) != pdTRUE)
+        return NULL;
+
+    while (1) {
+        taskENTER_CRITICAL(&g_lock);
+        bool ok = outbox_alloc(need, keep, &offset);
+        taskEXIT_CRITICAL(&g_lock);
+        if (ok)
+            break;
+
+        /* Wait for the next release, the room it made may still not be enough */
+        if (xTaskCheckForTimeOut(&timeout, &wait) == pdTRUE || xSemaphoreTake(g_space, wait) != pdTRUE) {
+            xQueueSend(g_free_slots, &slot, 0);
+            return NULL;
+        }
+    }
+
+    slot->block    = offset;
+    slot->topic    = (char *)(g_arena + offset + sizeof(outbox_block_t));
+    memcpy(slot->topic, topic, topic_len + 1);
+    slot->data     = slot->topic + topic_len + 1;
+    slot->data_cap = data_cap;
+    slot->data_len = 0;
+    slot->qos      = 0;
+    slot->retain   = 0;
+    slot->lane     = lane;
+
+    return slot;
+}
+
+void mqtt_outbox_trim(mqtt_outbox_slot_t *slot)
+{
+    if (slot == NULL || slot->data_len >= slot->data_cap)
+        return;
+
+    uint32_t keep = OUTBOX_ALIGN_UP((uint32_t)(slot->data + slot->data_len + 1 - (char *)g_arena) - slot->block);
+
+    taskENTER_CRITICAL(&g_lock);
+    outbox_block_t *b = outbox_block(slot->block);
+    if (keep < b->size) {
+        uint32_t rest = b->size - keep;
+        if ((slot->block + b->size) % MQTT_OUTBOX_ARENA_SIZE == g_tail) {
+            /* Newest block, the tail moves back */
+            g_tail = slot->block + keep;
+            g_used -= rest;
+        } else {
+            /* The rest becomes a released block, reclaimed when the head gets there */
+            outbox_block(slot->block + keep)->size = (uint16_t)rest;
+            outbox_block(slot->block + keep)->released = 1;
+        }
+        b->size = (uint16_t)keep;
+    }
+    taskEXIT_CRITICAL(&g_lock);
+    slot->data_cap = slot->data_len;
+}
+
+void mqtt_outbox_release(mqtt_outbox_slot_t *slot)
+{
+    if (slot == NULL || g_free_slots == NULL)
+        return;
+
+    taskENTER_CRITICAL(&g_lock);
+    outbox_block(slot->block)->released = 1;
+    outbox_reclaim();
+    taskEXIT_CRITICAL(&g_lock);
+
+    if (xQueueSend(g_free_slots, &slot, 0) != pdTRUE)
+        ESP_LOGE(TAG, "Slot %d released twice", slot->index);
+    xSemaphoreGive(g_space);
+}
+
+uint32_t mqtt_outbox_free_slots(void)
+{
+    if (g_free_slots == NULL)
+        return 0;
+
+    return uxQueueMessagesWaiting(g_free_slots);
+}
+
+uint32_t mqtt_outbox_free_bytes(void)
+{
+    taskENTER_CRITICAL(&g_lock);
+    uint32_t free_bytes = MQTT_OUTBOX_ARENA_SIZE - g_used;
+    taskEXIT_CRITICAL(&g_lock);
+
+    return free_bytes;
+}
@@ -0,0 +1,100 @@
+/**
+ * @file outbox.h
+ * @brief Preallocated MQTT outbox of variable length slots
+ *
+ * Producers reserve a slot, write the payload straight into it and hand the
+ * slot pointer to the MQTT task. The MQTT task publishes from the slot and
+ * gives it back to the outbox, so a message is copied only once on its way out.
+ *
+ * A slot is a descriptor from a fixed pool pointing into one byte ring
+ * (the arena). Each message takes a length-prefixed block of the ring sized
+ * for its topic and the payload capacity asked for, so a 60 byte reading
+ * holds about 100 bytes instead of a whole maximum sized slot. Blocks are
+ * taken at the ring's tail; a block released out of order is only marked,
+ * the ring's head moves past it once every older block is released too.
+ */
+#ifndef MQTT_OUTBOX_H
+#define MQTT_OUTBOX_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_err.h"
+
+/**
+ * @brief Priority lane of a message, lower value is served first (see lanes.h)
+ */
+typedef enum {
+    MQTT_LANE_CONTROL = 0,   /* Actuation and alarms */
+    MQTT_LANE_TELEMETRY,     /* Bulk sensor data */
+    MQTT_LANE_COUNT
+} mqtt_lane_t;
+
+/**
+ * @brief One outbox slot
+ *
+ * topic and data point into the slot's block of the arena, the payload may
+ * use every byte up to data_cap.
+ */
+typedef struct {
+    char     *topic;     /* NUL-terminated topic */
+    char     *data;      /* Payload, written in place by the producer */
+    size_t    data_len;  /* Bytes used in data */
+    size_t    data_cap;  /* Bytes available in data */
+    int       qos;
+    int       retain;
+    mqtt_lane_t lane;    /* Lane given to mqtt_outbox_reserve() */
+    int64_t   enqueue_us; /* esp_timer time the slot entered mqtt_queue */
+    uint32_t  block;     /* Offset of the slot's block in the arena */
+    uint16_t  index;     /* Position of the descriptor in the pool */
+} mqtt_outbox_slot_t;
+
+/**
+ * @brief Allocate the arena (PSRAM if configured, internal RAM otherwise)
+ *
+ * @return ESP_OK on success, ESP_ERR_NO_MEM if the arena can't be allocated
+ */
+esp_err_t mqtt_outbox_init(void);
+
+/**
+ * @brief Take a slot with room for data_cap payload bytes and write the topic into it
+ *
+ * The last MQTT_OUTBOX_CONTROL_RESERVE bytes of the arena are only given to
+ * the control lane, a backlog of telemetry can't starve it.
+ *
+ * @param topic    Topic of the message
+ * @param data_cap Payload bytes the producer may write, a NUL is kept behind them
+ * @param lane     Lane the slot will be sent on
+ * @param wait     Ticks to wait for room
+ * @return The slot, or NULL if there is no room or the message can't fit MQTT_OUTBOX_MSG_MAX
+ */
+mqtt_outbox_slot_t *mqtt_outbox_reserve(const char *topic, size_t data_cap, mqtt_lane_t lane, TickType_t wait);
+
+/**
+ * @brief Give the unused end of a slot back, the payload keeps data_len bytes
+ *
+ * For producers that reserved for the largest payload (a batch) and know
+ * the final size only once done.
+ *
+ * @param slot Slot returned by mqtt_outbox_reserve(), data_len set
+ */
+void mqtt_outbox_trim(mqtt_outbox_slot_t *slot);
+
+/**
+ * @brief Give a slot back to the outbox
+ *
+ * @param slot Slot returned by mqtt_outbox_reserve()
+ */
+void mqtt_outbox_release(mqtt_outbox_slot_t *slot);
+
+/**
+ * @brief Number of slot descriptors currently free
+ */
+uint32_t mqtt_outbox_free_slots(void);
+
+/**
+ * @brief Number of arena bytes free for new blocks, a released block counts once the head passed it
+ */
+uint32_t mqtt_outbox_free_bytes(void);
+
+#endif /* MQTT_OUTBOX_H */
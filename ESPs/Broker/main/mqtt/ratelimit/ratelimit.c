@@ -0,0 +1,200 @@
+/**
+ * @file ratelimit.c
+ * @brief Per node token bucket on the uplink
+ */
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+
+#include "../mqtt_config.h"
+#include "ratelimit.h"
+
+#define RATELIMIT_TOKEN      1000u                                   /* Buckets count milli tokens */
+#define RATELIMIT_CAPACITY   (MQTT_RATELIMIT_BURST * RATELIMIT_TOKEN)
+#define RATELIMIT_REFILL     MQTT_RATELIMIT_RATE                     /* Milli tokens per ms */
+#define RATELIMIT_FILL_MS    (RATELIMIT_CAPACITY / RATELIMIT_REFILL) /* Empty -> full */
+
+static const char *TAG = "MQTT_RATELIMIT";
+
+/**
+ * @brief Bucket of one node, indexed by mqtt_route_t.index
+ */
+typedef struct {
+    uint32_t tokens;     /* Milli tokens */
+    uint32_t last_ms;    /* Last refill */
+} ratelimit_bucket_t;
+
+#if ( MQTT_RATELIMIT_KEEP_LATEST == 1 )
+/**
+ * @brief Latest reading of a node over the limit, free while route is NULL
+ */
+typedef struct {
+    const mqtt_route_t *route;
+    uint16_t len;
+    uint8_t  data[MQTT_RATELIMIT_HELD_SIZE];
+} ratelimit_held_t;
+
+static ratelimit_held_t g_held[MQTT_RATELIMIT_HELD_SLOTS];
+#endif
+
+static ratelimit_bucket_t *g_buckets = NULL;
+static portMUX_TYPE g_stats_lock = portMUX_INITIALIZER_UNLOCKED;
+static mqtt_ratelimit_stats_t g_stats;
+
+static void ratelimit_refill(ratelimit_bucket_t *b, uint32_t now_ms)
+{
+    uint32_t elapsed = now_ms - b->last_ms;
+
+    if (elapsed >= RATELIMIT_FILL_MS)
+        b->tokens = RATELIMIT_CAPACITY;
+    else if (b->tokens + elapsed * RATELIMIT_REFILL > RATELIMIT_CAPACITY)
+        b->tokens = RATELIMIT_CAPACITY;
+    else
+        b->tokens += elapsed * RATELIMIT_REFILL;
+    b->last_ms = now_ms;
+}
+
+static bool ratelimit_take(ratelimit_bucket_t *b, uint32_t now_ms)
+{
+    ratelimit_refill(b, now_ms);
+    if (b->tokens < RATELIMIT_TOKEN)
+        return false;
+    b->tokens -= RATELIMIT_TOKEN;
+    return true;
+}
+
+#if ( MQTT_RATELIMIT_KEEP_LATEST == 1 )
+/* Held slot of a node, or a free one when create is set, NULL if there is none */
+static ratelimit_held_t *ratelimit_held(const mqtt_route_t *route, bool create)
+{
+    ratelimit_held_t *free_slot = NULL;
+
+    for (int i = 0; i < MQTT_RATELIMIT_HELD_SLOTS; i++) {
+        if (g_held[i].route == route)
+            return &g_held[i];
+        if (g_held[i].route == NULL && free_slot == NULL)
+            free_slot = &g_held[i];
+    }
+
+    return create ? free_slot : NULL;
+}
+#endif
+
+esp_err_t mqtt_ratelimit_init(void)
+{
+    if (g_buckets != NULL)
+        return ESP_OK;
+
+#if ( MQTT_RATELIMIT_USE_PSRAM == 1 )
+    g_buckets = heap_caps_malloc(MQTT_ROUTE_MAX_NODES * sizeof(ratelimit_bucket_t), MALLOC_CAP_SPIRAM);
+#endif
+    if (g_buckets == NULL)
+        g_buckets = heap_caps_malloc(MQTT_ROUTE_MAX_NODES * sizeof(ratelimit_bucket_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (g_buckets == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate rate limit buckets");
+        return ESP_ERR_NO_MEM;
+    }
+
+    /* A node starts with a full burst */
+    uint32_t now_ms = (uint32_t)(esp_timer_get_time() / 1000);
+    for (int i = 0; i < MQTT_ROUTE_MAX_NODES; i++) {
+        g_buckets[i].tokens = RATELIMIT_CAPACITY;
+        g_buckets[i].last_ms = now_ms;
+    }
+
+    return ESP_OK;
+}
+
+bool mqtt_ratelimit_admit(const mqtt_route_t *route, const uint8_t *payload, size_t len)
+{
+    if (g_buckets == NULL || route == NULL || route->index >= MQTT_ROUTE_MAX_NODES)
+        return true;
+
+    uint32_t now_ms = (uint32_t)(esp_timer_get_time() / 1000);
+    bool pass = ratelimit_take(&g_buckets[route->index], now_ms);
+    bool held = false;
+    bool replaced = false;
+
+#if ( MQTT_RATELIMIT_KEEP_LATEST == 1 )
+    ratelimit_held_t *slot = ratelimit_held(route, !pass);
+    if (slot != NULL) {
+        replaced = (slot->route != NULL);
+        if (pass || len > MQTT_RATELIMIT_HELD_SIZE) {
+            slot->route = NULL;
+        } else {
+            memcpy(slot->data, payload, len);
+            slot->len = (uint16_t)len;
+            slot->route = route;
+            held = true;
+        }
+    }
+#endif
+
+    taskENTER_CRITICAL(&g_stats_lock);
+    if (pass)
+        g_stats.admitted++;
+    else
+        g_stats.limited++;
+    if (held)
+        g_stats.held++;
+    if (replaced)
+        g_stats.replaced++;
+    taskEXIT_CRITICAL(&g_stats_lock);
+
+    return pass;
+}
+
+uint32_t mqtt_ratelimit_release(mqtt_ratelimit_forward_t forward)
+{
+#if ( MQTT_RATELIMIT_KEEP_LATEST == 1 )
+    uint32_t now_ms = (uint32_t)(esp_timer_get_time() / 1000);
+    uint32_t wait_ms = UINT32_MAX;
+    uint32_t released = 0;
+
+    if (g_buckets == NULL)
+        return portMAX_DELAY;
+
+    for (int i = 0; i < MQTT_RATELIMIT_HELD_SLOTS; i++) {
+        ratelimit_held_t *slot = &g_held[i];
+        if (slot->route == NULL)
+            continue;
+
+        ratelimit_bucket_t *b = &g_buckets[slot->route->index];
+        if (ratelimit_take(b, now_ms)) {
+            forward(slot->route, slot->data, slot->len);
+            slot->route = NULL;
+            released++;
+        } else {
+            uint32_t need_ms = (RATELIMIT_TOKEN - b->tokens + RATELIMIT_REFILL - 1) / RATELIMIT_REFILL;
+            if (need_ms < wait_ms)
+                wait_ms = need_ms;
+        }
+    }
+
+    if (released > 0) {
+        taskENTER_CRITICAL(&g_stats_lock);
+        g_stats.released += released;
+        taskEXIT_CRITICAL(&g_stats_lock);
+    }
+
+    if (wait_ms == UINT32_MAX)
+        return portMAX_DELAY;
+    return (pdMS_TO_TICKS(wait_ms) > 0) ? pdMS_TO_TICKS(wait_ms) : 1;
+#else
+    (void)forward;
+    return portMAX_DELAY;
+#endif
+}
+
+void mqtt_ratelimit_get_stats(mqtt_ratelimit_stats_t *stats)
+{
+    if (stats == NULL)
+        return;
+
+    taskENTER_CRITICAL(&g_stats_lock);
+    *stats = g_stats;
+    taskEXIT_CRITICAL(&g_stats_lock);
+}
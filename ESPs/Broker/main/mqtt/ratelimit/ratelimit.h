@@ -0,0 +1,75 @@
+/**
+ * @file ratelimit.h
+ * @brief Per node token bucket on the uplink
+ *
+ * Every node has a bucket of MQTT_RATELIMIT_BURST tokens refilled at
+ * MQTT_RATELIMIT_RATE tokens per second, a reading takes one token. A node
+ * flooding the UART bridge is cut down to its rate and can't starve the
+ * others of the telemetry lane.
+ *
+ * With MQTT_RATELIMIT_KEEP_LATEST a reading over the limit is held instead of
+ * dropped, one per node, a newer reading replaces it. mqtt_ratelimit_release()
+ * hands held readings back once their node has a token again, so a throttled
+ * node still reports its latest state.
+ *
+ * Only the dispatcher task calls mqtt_ratelimit_admit() and mqtt_ratelimit_release().
+ */
+#ifndef MQTT_RATELIMIT_H
+#define MQTT_RATELIMIT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "../route/route.h"
+
+/**
+ * @brief Rate limit counters
+ */
+typedef struct {
+    uint32_t admitted;   /* Readings within the limit */
+    uint32_t limited;    /* Readings over the limit */
+    uint32_t held;       /* Over the limit and held, MQTT_RATELIMIT_KEEP_LATEST */
+    uint32_t replaced;   /* Held readings replaced by a newer one */
+    uint32_t released;   /* Held readings sent later */
+} mqtt_ratelimit_stats_t;
+
+/**
+ * @brief Forward a reading that passed the limit
+ */
+typedef void (*mqtt_ratelimit_forward_t)(const mqtt_route_t *route, const uint8_t *payload, size_t len);
+
+/**
+ * @brief Allocate the per node buckets (MQTT_ROUTE_MAX_NODES entries)
+ *
+ * @return ESP_OK on success, ESP_ERR_NO_MEM otherwise
+ */
+esp_err_t mqtt_ratelimit_init(void);
+
+/**
+ * @brief Take a token for a reading of a node
+ *
+ * A reading over the limit is held (MQTT_RATELIMIT_KEEP_LATEST) or dropped.
+ * A reading within the limit drops the node's held one, it is older.
+ *
+ * @param route   Route of the node
+ * @param payload Reading, not NUL-terminated
+ * @param len     Reading length
+ * @return true if the reading must be forwarded now
+ */
+bool mqtt_ratelimit_admit(const mqtt_route_t *route, const uint8_t *payload, size_t len);
+
+/**
+ * @brief Forward the held readings whose node has a token again
+ *
+ * @param forward Called for every released reading
+ * @return Ticks until the next held reading can go, portMAX_DELAY if none is held
+ */
+uint32_t mqtt_ratelimit_release(mqtt_ratelimit_forward_t forward);
+
+/**
+ * @brief Copy the rate limit counters
+ */
+void mqtt_ratelimit_get_stats(mqtt_ratelimit_stats_t *stats);
+
+#endif /* MQTT_RATELIMIT_H */
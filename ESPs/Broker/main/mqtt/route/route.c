@@ -0,0 +1,187 @@
+/**
+ * @file route.c
+ * @brief Node ID <-> MQTT topic routing table
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdatomic.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+
+#include "../mqtt_config.h"
+#include "route.h"
+
+#define ROUTE_MASK   (MQTT_ROUTE_TABLE_SIZE - 1)
+
+_Static_assert((MQTT_ROUTE_TABLE_SIZE & ROUTE_MASK) == 0, "MQTT_ROUTE_TABLE_SIZE must be a power of two");
+_Static_assert(MQTT_ROUTE_MAX_NODES < MQTT_ROUTE_TABLE_SIZE, "The routing table needs free entries to end a probe");
+
+/**
+ * @brief Table entry, used is set last so readers never see a half written route
+ */
+typedef struct {
+    _Atomic uint8_t used;
+    mqtt_route_t route;
+} route_entry_t;
+
+static const char *TAG = "MQTT_ROUTE";
+
+static route_entry_t *g_table = NULL;
+static SemaphoreHandle_t g_insert_lock = NULL;
+static uint32_t g_count = 0;
+
+/* Fibonacci hashing spreads consecutive node IDs over the table */
+static inline uint32_t route_hash(uint16_t node_id)
+{
+    return ((uint32_t)node_id * 2654435761u) & ROUTE_MASK;
+}
+
+static const mqtt_route_t *route_find(uint16_t node_id)
+{
+    uint32_t i = route_hash(node_id);
+
+    while (atomic_load_explicit(&g_table[i].used, memory_order_acquire))
+    {
+        if (g_table[i].route.node_id == node_id)
+            return &g_table[i].route;
+        i = (i + 1) & ROUTE_MASK;
+    }
+
+    return NULL;
+}
+
+static const mqtt_route_t *route_insert(uint16_t node_id)
+{
+    const mqtt_route_t *route;
+
+    xSemaphoreTake(g_insert_lock, portMAX_DELAY);
+
+    /* Another task may have added it meanwhile */
+    route = route_find(node_id);
+    if (route != NULL || g_count >= MQTT_ROUTE_MAX_NODES)
+    {
+        xSemaphoreGive(g_insert_lock);
+        if (route == NULL)
+            ESP_LOGE(TAG, "Routing table full, node %u ignored", node_id);
+        return route;
+    }
+
+    uint32_t i = route_hash(node_id);
+    while (atomic_load_explicit(&g_table[i].used, memory_order_relaxed))
+        i = (i + 1) & ROUTE_MASK;
+
+    mqtt_route_t *r = &g_table[i].route;
+    r->node_id = node_id;
+    r->index = (uint16_t)g_count;
+    r->id_len = (uint8_t)snprintf(r->id_str, sizeof(r->id_str), "%u", node_id);
+    snprintf(r->sensor_topic, sizeof(r->sensor_topic), "%s%s", MQTT_SENSOR_TOPIC_PREFIX, r->id_str);
+
+    atomic_store_explicit(&g_table[i].used, 1, memory_order_release);
+    g_count++;
+
+    xSemaphoreGive(g_insert_lock);
+
+    ESP_LOGI(TAG, "New node %s -> %s", r->id_str, r->sensor_topic);
+    return r;
+}
+
+/* Parse up to 5 leading decimal digits, returns the number of digits used */
+static size_t route_parse_id(const uint8_t *s, size_t len, uint16_t *node_id)
+{
+    uint32_t id = 0;
+    size_t n = 0;
+
+    while (n < len && n < MQTT_ROUTE_ID_SIZE - 1 && s[n] >= '0' && s[n] <= '9')
+    {
+        id = id * 10 + (s[n] - '0');
+        n++;
+    }
+
+    if (n == 0 || id > 0xFFFF)
+        return 0;
+
+    *node_id = (uint16_t)id;
+    return n;
+}
+
+esp_err_t mqtt_route_init(void)
+{
+    if (g_table != NULL)
+        return ESP_OK;
+
+#if ( MQTT_ROUTE_USE_PSRAM == 1 )
+    g_table = heap_caps_calloc(MQTT_ROUTE_TABLE_SIZE, sizeof(route_entry_t), MALLOC_CAP_SPIRAM);
+#endif
+    if (g_table == NULL)
+        g_table = heap_caps_calloc(MQTT_ROUTE_TABLE_SIZE, sizeof(route_entry_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    g_insert_lock = xSemaphoreCreateMutex();
+
+    if (g_table == NULL || g_insert_lock == NULL)
+    {
+        ESP_LOGE(TAG, "Failed to allocate routing table");
+        return ESP_ERR_NO_MEM;
+    }
+
+    return ESP_OK;
+}
+
+const mqtt_route_t *mqtt_route_get(uint16_t node_id)
+{
+    if (g_table == NULL)
+        return NULL;
+
+    const mqtt_route_t *route = route_find(node_id);
+    if (route == NULL)
+        route = route_insert(node_id);
+
+    return route;
+}
+
+const mqtt_route_t *mqtt_route_find(uint16_t node_id)
+{
+    if (g_table == NULL)
+        return NULL;
+
+    return route_find(node_id);
+}
+
+const mqtt_route_t *mqtt_route_from_line(const uint8_t *line, size_t len, size_t *payload_off)
+{
+    uint16_t node_id;
+
+    if (line == NULL)
+        return NULL;
+
+    size_t n = route_parse_id(line, len, &node_id);
+    if (n == 0)
+        return NULL;
+
+    if (payload_off != NULL)
+        *payload_off = n;
+
+    return mqtt_route_get(node_id);
+}
+
+const mqtt_route_t *mqtt_route_from_topic(const char *topic, size_t topic_len)
+{
+    static const size_t prefix_len = sizeof(MQTT_CONTROL_TOPIC_PREFIX) - 1;
+    uint16_t node_id;
+
+    if (topic == NULL || topic_len <= prefix_len || memcmp(topic, MQTT_CONTROL_TOPIC_PREFIX, prefix_len) != 0)
+        return NULL;
+
+    /* The whole last level must be the node ID */
+    size_t n = route_parse_id((const uint8_t *)topic + prefix_len, topic_len - prefix_len, &node_id);
+    if (n == 0 || n != topic_len - prefix_len)
+        return NULL;
+
+    /* Commands only go to nodes that were heard from */
+    return mqtt_route_find(node_id);
+}
+
+uint32_t mqtt_route_count(void)
+{
+    return g_count;
+}
@@ -0,0 +1,80 @@
+/**
+ * @file route.h
+ * @brief Node ID <-> MQTT topic routing table
+ *
+ * Every node gets one entry holding its ID as text and its prebuilt sensor
+ * topic, so routing a message is a hash lookup and never builds a string.
+ * Entries are added the first time a node sends on the UART bridge and are
+ * never removed; control commands from MQTT, the LAN broker or UDP only look
+ * routes up, so they can't fill the table with nodes that don't exist.
+ * Lookups are lock free, adding a node takes a short lock.
+ */
+#ifndef MQTT_ROUTE_H
+#define MQTT_ROUTE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+#define MQTT_ROUTE_ID_SIZE      6    /* "65535" + NUL */
+#define MQTT_ROUTE_TOPIC_SIZE   32
+
+/**
+ * @brief Route of one node
+ */
+typedef struct {
+    uint16_t node_id;
+    uint16_t index;                                /* Dense 0 .. MQTT_ROUTE_MAX_NODES-1, for per node arrays */
+    uint8_t  id_len;
+    char     id_str[MQTT_ROUTE_ID_SIZE];           /* Node ID as sent on the UART bridge */
+    char     sensor_topic[MQTT_ROUTE_TOPIC_SIZE];  /* MQTT_SENSOR_TOPIC_PREFIX + ID */
+} mqtt_route_t;
+
+/**
+ * @brief Allocate the routing table
+ *
+ * @return ESP_OK on success, ESP_ERR_NO_MEM otherwise
+ */
+esp_err_t mqtt_route_init(void);
+
+/**
+ * @brief Route of a node heard on the UART bridge, added if the node is new
+ *
+ * @param node_id Node ID
+ * @return The route, or NULL if the table is full
+ */
+const mqtt_route_t *mqtt_route_get(uint16_t node_id);
+
+/**
+ * @brief Route of a known node, never adds one
+ *
+ * @param node_id Node ID
+ * @return The route, or NULL if the node was never heard on the UART bridge
+ */
+const mqtt_route_t *mqtt_route_find(uint16_t node_id);
+
+/**
+ * @brief Route of a line received from the UART bridge ("<node id><payload>")
+ *
+ * @param line        Line bytes
+ * @param len         Line length
+ * @param payload_off Set to the offset of the payload after the node ID
+ * @return The route, or NULL if the line has no valid node ID or the table is full
+ */
+const mqtt_route_t *mqtt_route_from_line(const uint8_t *line, size_t len, size_t *payload_off);
+
+/**
+ * @brief Route of an inbound control topic (MQTT_CONTROL_TOPIC_PREFIX + ID)
+ *
+ * @param topic     Topic bytes, not NUL-terminated
+ * @param topic_len Topic length
+ * @return The route, or NULL if the topic isn't the control topic of a known node
+ */
+const mqtt_route_t *mqtt_route_from_topic(const char *topic, size_t topic_len);
+
+/**
+ * @brief Number of nodes in the table
+ */
+uint32_t mqtt_route_count(void);
+
+#endif /* MQTT_ROUTE_H */
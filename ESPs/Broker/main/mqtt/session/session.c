@@ -0,0 +1,177 @@
+/**
+ * @file session.c
+ * @brief Persistent MQTT session bookkeeping
+ */
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "esp_timer.h"
+#include "nvs.h"
+
+#include "../mqtt_config.h"
+#include "session.h"
+
+#define SESSION_NVS_NAMESPACE  "mqtt_session"
+#define SESSION_NVS_KEY        "sub_fp"
+#define SESSION_MAX_SUBS       8
+
+static const char *TAG = "MQTT_SESSION";
+
+static const mqtt_session_sub_t *g_subs = NULL;
+static size_t g_sub_count = 0;
+static uint32_t g_fingerprint = 0;     /* Of g_subs */
+static uint32_t g_recorded = 0;        /* Fingerprint of the set the broker acknowledged, 0 = none */
+static char g_client_id[32];
+
+static int g_pending_ids[SESSION_MAX_SUBS];   /* SUBSCRIBE message IDs waiting for their SUBACK */
+static size_t g_pending = 0;
+static bool g_sub_failed = false;             /* A SUBSCRIBE of this connect couldn't be sent */
+static int64_t g_down_us = 0;                 /* Time of the last disconnect, 0 while connected */
+
+static portMUX_TYPE g_stats_lock = portMUX_INITIALIZER_UNLOCKED;
+static mqtt_session_stats_t g_stats;
+
+static uint32_t session_fingerprint(const mqtt_session_sub_t *subs, size_t count)
+{
+    uint32_t h = 2166136261u;
+
+    for (size_t i = 0; i < count; i++) {
+        for (const char *c = subs[i].topic; *c; c++)
+            h = (h ^ (uint8_t)*c) * 16777619u;
+        h = (h ^ (uint8_t)subs[i].qos) * 16777619u;
+    }
+
+    return h ? h : 1;
+}
+
+/* Store the acknowledged fingerprint, 0 erases the record */
+static void session_record(uint32_t fingerprint)
+{
+    nvs_handle_t nvs;
+
+    g_recorded = fingerprint;
+    if (nvs_open(SESSION_NVS_NAMESPACE, NVS_READWRITE, &nvs) != ESP_OK) {
+        ESP_LOGW(TAG, "Can't open NVS, subscription record kept in RAM only");
+        return;
+    }
+    if (fingerprint != 0)
+        nvs_set_u32(nvs, SESSION_NVS_KEY, fingerprint);
+    else
+        nvs_erase_key(nvs, SESSION_NVS_KEY);
+    nvs_commit(nvs);
+    nvs_close(nvs);
+}
+
+/* Subscriptions are in place, close the reconnect measurement */
+static void session_ready(bool skipped)
+{
+    int64_t now = esp_timer_get_time();
+
+    taskENTER_CRITICAL(&g_stats_lock);
+    if (g_down_us != 0) {
+        g_stats.reconnects++;
+        g_stats.last_reconnect_ms = (uint32_t)((now - g_down_us) / 1000);
+    }
+    if (skipped)
+        g_stats.resubscribes_skipped++;
+    else
+        g_stats.resubscribes++;
+    taskEXIT_CRITICAL(&g_stats_lock);
+
+    g_down_us = 0;
+}
+
+esp_err_t mqtt_session_init(const mqtt_session_sub_t *subs, size_t count)
+{
+    uint8_t mac[6] = { 0 };
+    nvs_handle_t nvs;
+    esp_err_t err;
+
+    if (count > SESSION_MAX_SUBS)
+        count = SESSION_MAX_SUBS;
+    g_subs = subs;
+    g_sub_count = count;
+    g_fingerprint = session_fingerprint(subs, count);
+
+    esp_read_mac(mac, ESP_MAC_WIFI_STA);
+    snprintf(g_client_id, sizeof(g_client_id), "%s%02x%02x%02x%02x%02x%02x", MQTT_CLIENT_ID_PREFIX,
+             mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+
+    err = nvs_open(SESSION_NVS_NAMESPACE, NVS_READWRITE, &nvs);
+    if (err != ESP_OK)
+        return err;
+    if (nvs_get_u32(nvs, SESSION_NVS_KEY, &g_recorded) != ESP_OK)
+        g_recorded = 0;
+    nvs_close(nvs);
+
+    return ESP_OK;
+}
+
+const char *mqtt_session_client_id(void)
+{
+    return g_client_id;
+}
+
+void mqtt_session_connected(esp_mqtt_client_handle_t client, bool session_present)
+{
+#if ( MQTT_PERSISTENT_SESSION == 1 )
+    if (session_present && g_recorded == g_fingerprint) {
+        ESP_LOGI(TAG, "Session present, %d subscriptions kept by the broker", (int)g_sub_count);
+        session_ready(true);
+        return;
+    }
+    /* The broker lost the session or the subscription set changed */
+    if (g_recorded != 0)
+        session_record(0);
+#endif
+
+    g_pending = 0;
+    g_sub_failed = false;
+    for (size_t i = 0; i < g_sub_count; i++) {
+        int msg_id = esp_mqtt_client_subscribe(client, g_subs[i].topic, g_subs[i].qos);
+        if (msg_id >= 0) {
+            g_pending_ids[g_pending++] = msg_id;
+        } else {
+            g_sub_failed = true;
+            ESP_LOGE(TAG, "Subscribe to %s failed", g_subs[i].topic);
+        }
+    }
+}
+
+void mqtt_session_disconnected(void)
+{
+    g_pending = 0;
+    if (g_down_us == 0)
+        g_down_us = esp_timer_get_time();
+}
+
+void mqtt_session_subscribed(int msg_id)
+{
+    for (size_t i = 0; i < g_pending; i++) {
+        if (g_pending_ids[i] == msg_id) {
+            g_pending_ids[i] = g_pending_ids[--g_pending];
+            if (g_pending == 0) {
+#if ( MQTT_PERSISTENT_SESSION == 1 )
+                /* Only a complete set may be skipped on the next connect */
+                if (!g_sub_failed)
+                    session_record(g_fingerprint);
+#endif
+                session_ready(false);
+            }
+            return;
+        }
+    }
+}
+
+void mqtt_session_get_stats(mqtt_session_stats_t *stats)
+{
+    if (stats == NULL)
+        return;
+
+    taskENTER_CRITICAL(&g_stats_lock);
+    *stats = g_stats;
+    taskEXIT_CRITICAL(&g_stats_lock);
+}
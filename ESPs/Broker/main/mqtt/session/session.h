@@ -0,0 +1,81 @@
+/**
+ * @file session.h
+ * @brief Persistent MQTT session bookkeeping
+ *
+ * With MQTT_PERSISTENT_SESSION the client connects with clean_session off and
+ * a client ID derived from the WiFi MAC, so the broker keeps our
+ * subscriptions and QoS 1 state across disconnects. The subscription set the
+ * broker acknowledged is recorded in NVS as a fingerprint (FNV-1a of every
+ * topic and QoS). When CONNACK reports the session present and the
+ * fingerprint matches, nothing is subscribed again and a reconnect costs a
+ * single CONNECT round trip.
+ *
+ * Everything except mqtt_session_get_stats() runs in the MQTT event handler.
+ */
+#ifndef MQTT_SESSION_H
+#define MQTT_SESSION_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "mqtt_client.h"
+
+/**
+ * @brief One subscription of the session
+ */
+typedef struct {
+    const char *topic;
+    int qos;
+} mqtt_session_sub_t;
+
+/**
+ * @brief Reconnect counters
+ */
+typedef struct {
+    uint32_t reconnects;
+    uint32_t last_reconnect_ms;      /* DISCONNECTED -> connected with subscriptions in place */
+    uint32_t resubscribes;           /* Connects that had to subscribe again */
+    uint32_t resubscribes_skipped;   /* Connects that found the session present */
+} mqtt_session_stats_t;
+
+/**
+ * @brief Build the client ID and load the subscription record from NVS
+ *
+ * @param subs  Subscriptions of the session, must stay valid
+ * @param count Number of subscriptions
+ * @return ESP_OK, or the NVS error (the session then always subscribes)
+ */
+esp_err_t mqtt_session_init(const mqtt_session_sub_t *subs, size_t count);
+
+/**
+ * @brief Stable client ID, "<MQTT_CLIENT_ID_PREFIX><WiFi MAC>"
+ */
+const char *mqtt_session_client_id(void);
+
+/**
+ * @brief MQTT_EVENT_CONNECTED, subscribes unless the broker kept the session
+ *
+ * @param client          Client handle
+ * @param session_present Session present flag of the CONNACK
+ */
+void mqtt_session_connected(esp_mqtt_client_handle_t client, bool session_present);
+
+/**
+ * @brief MQTT_EVENT_DISCONNECTED
+ */
+void mqtt_session_disconnected(void);
+
+/**
+ * @brief MQTT_EVENT_SUBSCRIBED, records the set once every SUBACK is in
+ *
+ * @param msg_id Message ID of the acknowledged SUBSCRIBE
+ */
+void mqtt_session_subscribed(int msg_id);
+
+/**
+ * @brief Copy the reconnect counters
+ */
+void mqtt_session_get_stats(mqtt_session_stats_t *stats);
+
+#endif /* MQTT_SESSION_H */
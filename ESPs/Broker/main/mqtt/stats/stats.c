@@ -0,0 +1,314 @@
+/**
+ * @file stats.c
+ * @brief MQTT publish latency and throughput instrumentation
+ */
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+
+#include "../mqtt_config.h"
+#include "stats.h"
+#include "../deadband/deadband.h"
+#include "../ratelimit/ratelimit.h"
+#include "../session/session.h"
+#include "../alias/alias.h"
+
+#define HIST_SUB_COUNT   (1u << MQTT_HIST_SUB_BITS)
+#define HIST_SUB_MASK    (HIST_SUB_COUNT - 1)
+
+/**
+ * @brief Message waiting for its broker ack
+ */
+typedef struct {
+    int msg_id;              /* 0 when the entry is free */
+    int64_t enqueue_us;
+    int64_t publish_us;
+} stats_inflight_t;
+
+static portMUX_TYPE g_stats_lock = portMUX_INITIALIZER_UNLOCKED;
+static mqtt_stats_t g_stats;
+static stats_inflight_t g_inflight[MQTT_STATS_INFLIGHT];
+static uint32_t g_inflight_next = 0;
+static int64_t g_window_us = 0;              /* Start of the throughput window */
+static uint32_t g_window_published = 0;      /* g_stats.published at that time */
+
+/*************************** Histogram ***************************/
+
+static uint32_t hist_index(uint32_t value)
+{
+    if (value < HIST_SUB_COUNT)
+        return value;
+
+    uint32_t msb = 31 - __builtin_clz(value);
+    uint32_t shift = msb - MQTT_HIST_SUB_BITS;
+    return ((shift + 1) << MQTT_HIST_SUB_BITS) + ((value >> shift) & HIST_SUB_MASK);
+}
+
+/* Smallest value that falls in bucket index */
+static uint64_t hist_lower(uint32_t index)
+{
+    if (index < HIST_SUB_COUNT)
+        return index;
+
+    uint32_t exp = index >> MQTT_HIST_SUB_BITS;
+    uint32_t sub = index & HIST_SUB_MASK;
+    return (uint64_t)(HIST_SUB_COUNT + sub) << (exp - 1);
+}
+
+void mqtt_hist_record(mqtt_hist_t *hist, uint32_t value)
+{
+    hist->counts[hist_index(value)]++;
+    hist->total++;
+    hist->sum += value;
+    if (value > hist->max)
+        hist->max = value;
+}
+
+uint32_t mqtt_hist_percentile(const mqtt_hist_t *hist, uint32_t percent)
+{
+    if (hist->total == 0)
+        return 0;
+
+    /* Rank of the sample, rounded up */
+    uint64_t rank = ((uint64_t)hist->total * percent + 99) / 100;
+    if (rank == 0)
+        rank = 1;
+
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < MQTT_HIST_BUCKETS; i++)
+    {
+        seen += hist->counts[i];
+        if (seen >= rank)
+        {
+            /* Report the top of the bucket, never above the real maximum */
+            uint64_t upper = hist_lower(i + 1) - 1;
+            return (upper > hist->max) ? hist->max : (uint32_t)upper;
+        }
+    }
+
+    return hist->max;
+}
+
+/*************************** Sending path hooks ***************************/
+
+static inline uint32_t stats_elapsed(int64_t from_us, int64_t to_us)
+{
+    return (to_us > from_us) ? (uint32_t)(to_us - from_us) : 0;
+}
+
+void mqtt_stats_enqueued(void)
+{
+    taskENTER_CRITICAL(&g_stats_lock);
+    g_stats.enqueued++;
+    taskEXIT_CRITICAL(&g_stats_lock);
+}
+
+void mqtt_stats_drop(mqtt_lane_t lane)
+{
+    taskENTER_CRITICAL(&g_stats_lock);
+    g_stats.drops++;
+    g_stats.lane_drops[lane]++;
+    taskEXIT_CRITICAL(&g_stats_lock);
+}
+
+void mqtt_stats_retry(uint32_t count)
+{
+    taskENTER_CRITICAL(&g_stats_lock);
+    g_stats.retries += count;
+    taskEXIT_CRITICAL(&g_stats_lock);
+}
+
+void mqtt_stats_lost(uint32_t count)
+{
+    taskENTER_CRITICAL(&g_stats_lock);
+    g_stats.lost += count;
+    taskEXIT_CRITICAL(&g_stats_lock);
+}
+
+void mqtt_stats_dequeued(mqtt_lane_t lane, int64_t enqueue_us, uint32_t queue_depth)
+{
+    uint32_t wait = stats_elapsed(enqueue_us, esp_timer_get_time());
+
+    taskENTER_CRITICAL(&g_stats_lock);
+    mqtt_hist_record(&g_stats.queue_us, wait);
+    mqtt_hist_record(&g_stats.lane_queue_us[lane], wait);
+    g_stats.queue_depth = queue_depth;
+    if (queue_depth > g_stats.queue_depth_max)
+        g_stats.queue_depth_max = queue_depth;
+    taskEXIT_CRITICAL(&g_stats_lock);
+}
+
+void mqtt_stats_published(int msg_id, int64_t enqueue_us)
+{
+    int64_t now = esp_timer_get_time();
+
+    taskENTER_CRITICAL(&g_stats_lock);
+    g_stats.published++;
+    if (msg_id <= 0)
+    {
+        /* QoS 0 is never acked, the publish is the end of the path */
+        mqtt_hist_record(&g_stats.total_us, stats_elapsed(enqueue_us, now));
+    }
+    else
+    {
+        stats_inflight_t *entry = &g_inflight[g_inflight_next];
+        g_inflight_next = (g_inflight_next + 1) % MQTT_STATS_INFLIGHT;
+        if (entry->msg_id != 0)
+            g_stats.untracked++;
+        entry->msg_id = msg_id;
+        entry->enqueue_us = enqueue_us;
+        entry->publish_us = now;
+    }
+    taskEXIT_CRITICAL(&g_stats_lock);
+}
+
+void mqtt_stats_acked(int msg_id)
+{
+    int64_t now = esp_timer_get_time();
+
+    taskENTER_CRITICAL(&g_stats_lock);
+    for (uint32_t i = 0; i < MQTT_STATS_INFLIGHT; i++)
+    {
+        stats_inflight_t *entry = &g_inflight[i];
+        if (entry->msg_id == msg_id)
+        {
+            mqtt_hist_record(&g_stats.ack_us, stats_elapsed(entry->publish_us, now));
+            mqtt_hist_record(&g_stats.total_us, stats_elapsed(entry->enqueue_us, now));
+            g_stats.acked++;
+            entry->msg_id = 0;
+            break;
+        }
+    }
+    taskEXIT_CRITICAL(&g_stats_lock);
+}
+
+/*************************** Reporting ***************************/
+
+void mqtt_stats_snapshot(mqtt_stats_t *stats)
+{
+    if (stats == NULL)
+        return;
+
+    taskENTER_CRITICAL(&g_stats_lock);
+    *stats = g_stats;
+    taskEXIT_CRITICAL(&g_stats_lock);
+}
+
+void mqtt_stats_reset(void)
+{
+    int64_t now = esp_timer_get_time();
+
+    taskENTER_CRITICAL(&g_stats_lock);
+    memset(&g_stats, 0, sizeof(g_stats));
+    memset(g_inflight, 0, sizeof(g_inflight));
+    g_inflight_next = 0;
+    g_window_us = now;
+    g_window_published = 0;
+    taskEXIT_CRITICAL(&g_stats_lock);
+}
+
+uint32_t mqtt_stats_window_rate(void)
+{
+    int64_t now = esp_timer_get_time();
+
+    taskENTER_CRITICAL(&g_stats_lock);
+    uint32_t published = g_stats.published - g_window_published;
+    int64_t elapsed = now - g_window_us;
+    g_window_published = g_stats.published;
+    g_window_us = now;
+    taskEXIT_CRITICAL(&g_stats_lock);
+
+    return (elapsed > 0) ? (uint32_t)((uint64_t)published * 1000000 / (uint64_t)elapsed) : 0;
+}
+
+static int stats_hist_json(char *buf, size_t size, const char *name, const mqtt_hist_t *hist)
+{
+    return snprintf(buf, size, "\"%s\": {\"count\": %lu, \"p50\": %lu, \"p99\": %lu, \"max\": %lu}",
+                    name,
+                    (unsigned long)hist->total,
+                    (unsigned long)mqtt_hist_percentile(hist, 50),
+                    (unsigned long)mqtt_hist_percentile(hist, 99),
+                    (unsigned long)hist->max);
+}
+
+int mqtt_stats_to_json(char *buf, size_t size)
+{
+    static mqtt_stats_t s;   /* Too large for the caller's stack */
+    int len;
+
+    mqtt_stats_snapshot(&s);
+    uint32_t rate = mqtt_stats_window_rate();
+
+    len = snprintf(buf, size,
+                   "{\"enqueued\": %lu, \"published\": %lu, \"published_per_s\": %lu, \"acked\": %lu, \"drops\": %lu, "
+                   "\"retries\": %lu, \"untracked\": %lu, \"lost\": %lu, \"queue_depth\": %lu, \"queue_depth_max\": %lu, ",
+                   (unsigned long)s.enqueued, (unsigned long)s.published, (unsigned long)rate, (unsigned long)s.acked,
+                   (unsigned long)s.drops, (unsigned long)s.retries, (unsigned long)s.untracked,
+                   (unsigned long)s.lost,
+                   (unsigned long)s.queue_depth, (unsigned long)s.queue_depth_max);
+    if (len < 0 || (size_t)len >= size)
+        return -1;
+    len += stats_hist_json(buf + len, size - len, "queue_us", &s.queue_us);
+    if ((size_t)len + 2 >= size)
+        return -1;
+    len += snprintf(buf + len, size - len, ", ");
+    len += stats_hist_json(buf + len, size - len, "ack_us", &s.ack_us);
+    if ((size_t)len + 2 >= size)
+        return -1;
+    len += snprintf(buf + len, size - len, ", ");
+    len += stats_hist_json(buf + len, size - len, "total_us", &s.total_us);
+    for (int i = 0; i < MQTT_LANE_COUNT; i++)
+    {
+        char name[24];
+        snprintf(name, sizeof(name), "lane%d_queue_us", i);
+        if ((size_t)len + 2 >= size)
+            return -1;
+        len += snprintf(buf + len, size - len, ", ");
+        len += stats_hist_json(buf + len, size - len, name, &s.lane_queue_us[i]);
+        if ((size_t)len >= size)
+            return -1;
+        len += snprintf(buf + len, size - len, ", \"lane%d_drops\": %lu", i, (unsigned long)s.lane_drops[i]);
+    }
+    mqtt_session_stats_t ss;
+    mqtt_session_get_stats(&ss);
+    if ((size_t)len >= size)
+        return -1;
+    len += snprintf(buf + len, size - len, ", \"reconnects\": %lu, \"last_reconnect_ms\": %lu, "
+                    "\"resubscribes\": %lu, \"resubscribes_skipped\": %lu",
+                    (unsigned long)ss.reconnects, (unsigned long)ss.last_reconnect_ms,
+                    (unsigned long)ss.resubscribes, (unsigned long)ss.resubscribes_skipped);
+#if ( MQTT_PROTOCOL_V5 == 1 )
+    mqtt_alias_stats_t as;
+    mqtt_alias_get_stats(&as);
+    if ((size_t)len >= size)
+        return -1;
+    len += snprintf(buf + len, size - len, ", \"alias_publishes\": %lu, \"alias_bytes_saved\": %lu",
+                    (unsigned long)as.aliased, (unsigned long)as.bytes_saved);
+#endif
+#if ( MQTT_DEADBAND_ENABLE == 1 )
+    mqtt_deadband_stats_t db;
+    mqtt_deadband_get_stats(&db);
+    if ((size_t)len >= size)
+        return -1;
+    len += snprintf(buf + len, size - len, ", \"deadband_received\": %lu, \"deadband_suppressed\": %lu, "
+                    "\"deadband_heartbeats\": %lu, \"deadband_suppressed_pct\": %lu",
+                    (unsigned long)db.received, (unsigned long)db.suppressed,
+                    (unsigned long)db.heartbeats, (unsigned long)db.suppressed_pct);
+#endif
+#if ( MQTT_RATELIMIT_ENABLE == 1 )
+    mqtt_ratelimit_stats_t rl;
+    mqtt_ratelimit_get_stats(&rl);
+    if ((size_t)len >= size)
+        return -1;
+    len += snprintf(buf + len, size - len, ", \"ratelimit_limited\": %lu, \"ratelimit_replaced\": %lu, "
+                    "\"ratelimit_released\": %lu",
+                    (unsigned long)rl.limited, (unsigned long)rl.replaced, (unsigned long)rl.released);
+#endif
+    if ((size_t)len + 1 >= size)
+        return -1;
+    len += snprintf(buf + len, size - len, "}");
+
+    return ((size_t)len < size) ? len : -1;
+}
@@ -0,0 +1,371 @@
+/**
+ * @file store_forward.c
+ * @brief Store and forward log for MQTT outages
+ */
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "esp_partition.h"
+
+#include "../mqtt_config.h"
+#include "store_forward.h"
+
+#define SF_MAGIC          0x5346   /* Record */
+#define SF_WRAP_MAGIC     0x5357   /* Rest of the partition is unused, go on at offset 0 */
+#define SF_SECTOR_SIZE    4096
+
+/**
+ * @brief Record header, followed by the NUL-terminated topic and the payload
+ */
+typedef struct __attribute__((packed)) {
+    uint16_t magic;
+    uint16_t topic_len;   /* Including the NUL */
+    uint16_t data_len;
+    uint8_t  qos;
+    uint8_t  retain;
+    uint8_t  lane;        /* mqtt_lane_t of the stored slot */
+    uint8_t  reserved;
+    uint32_t stamp_ms;
+} sf_record_hdr_t;
+
+static const char *TAG = "MQTT_SF";
+
+static SemaphoreHandle_t g_lock = NULL;
+
+/* RAM ring, always holds the oldest records */
+static uint8_t *g_ram = NULL;
+static uint32_t g_ram_head = 0;
+static uint32_t g_ram_tail = 0;
+static uint32_t g_ram_used = 0;
+static uint32_t g_ram_records = 0;
+
+/* Flash log, used once the RAM ring is full */
+static const esp_partition_t *g_part = NULL;
+static uint32_t g_flash_wr = 0;
+static uint32_t g_flash_rd = 0;
+static uint32_t g_flash_used = 0;
+static uint32_t g_flash_records = 0;
+
+static mqtt_sf_stats_t g_stats;
+static bool g_replay_active = false;
+static int64_t g_replay_start_us = 0;
+static uint32_t g_replay_bytes = 0;
+
+/* Replayed records are read here, they came from the outbox so they fit */
+static char g_replay_buf[MQTT_OUTBOX_MSG_MAX];
+
+static inline uint32_t sf_now_ms(void)
+{
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+/*************************** RAM ring ***************************/
+
+static void ram_put(const void *src, uint32_t len)
+{
+    uint32_t first = MQTT_SF_RAM_SIZE - g_ram_head;
+    if (first > len)
+        first = len;
+
+    memcpy(g_ram + g_ram_head, src, first);
+    memcpy(g_ram, (const uint8_t *)src + first, len - first);
+    g_ram_head = (g_ram_head + len) % MQTT_SF_RAM_SIZE;
+    g_ram_used += len;
+}
+
+/* Copy len bytes starting off bytes after the oldest one */
+static void ram_peek(uint32_t off, void *dst, uint32_t len)
+{
+    uint32_t pos = (g_ram_tail + off) % MQTT_SF_RAM_SIZE;
+    uint32_t first = MQTT_SF_RAM_SIZE - pos;
+    if (first > len)
+        first = len;
+
+    memcpy(dst, g_ram + pos, first);
+    memcpy((uint8_t *)dst + first, g_ram, len - first);
+}
+
+static void ram_consume(uint32_t len)
+{
+    g_ram_tail = (g_ram_tail + len) % MQTT_SF_RAM_SIZE;
+    g_ram_used -= len;
+}
+
+/*************************** Flash log ***************************/
+
+/* Erase every sector that the write [off, off+len) enters for the first time */
+static esp_err_t flash_prepare(uint32_t off, uint32_t len)
+{
+    uint32_t sector = (off + SF_SECTOR_SIZE - 1) / SF_SECTOR_SIZE * SF_SECTOR_SIZE;
+
+    for (; sector < off + len; sector += SF_SECTOR_SIZE)
+    {
+        esp_err_t ret = esp_partition_erase_range(g_part, sector, SF_SECTOR_SIZE);
+        if (ret != ESP_OK)
+            return ret;
+    }
+
+    return ESP_OK;
+}
+
+static esp_err_t flash_store(const sf_record_hdr_t *hdr, const char *topic, const char *data)
+{
+    uint32_t size = g_part->size;
+    uint32_t rec = sizeof(sf_record_hdr_t) + hdr->topic_len + hdr->data_len;
+    uint32_t waste = (g_flash_wr + rec > size) ? size - g_flash_wr : 0;
+
+    /* Keep one sector between writer and reader, erasing must never hit unread records */
+    if (g_flash_used + waste + rec + SF_SECTOR_SIZE > size)
+        return ESP_ERR_NO_MEM;
+
+    if (waste > 0)
+    {
+        if (waste >= sizeof(sf_record_hdr_t))
+        {
+            sf_record_hdr_t wrap = { .magic = SF_WRAP_MAGIC };
+            if (flash_prepare(g_flash_wr, sizeof(wrap)) != ESP_OK ||
+                esp_partition_write(g_part, g_flash_wr, &wrap, sizeof(wrap)) != ESP_OK)
+                return ESP_FAIL;
+        }
+        g_flash_wr = 0;
+        g_flash_used += waste;
+    }
+
+    if (flash_prepare(g_flash_wr, rec) != ESP_OK ||
+        esp_partition_write(g_part, g_flash_wr, hdr, sizeof(sf_record_hdr_t)) != ESP_OK ||
+        esp_partition_write(g_part, g_flash_wr + sizeof(sf_record_hdr_t), topic, hdr->topic_len) != ESP_OK ||
+        esp_partition_write(g_part, g_flash_wr + sizeof(sf_record_hdr_t) + hdr->topic_len, data, hdr->data_len) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Flash write failed at %lu", (unsigned long)g_flash_wr);
+        return ESP_FAIL;
+    }
+
+    g_flash_wr += rec;
+    if (g_flash_wr >= size)
+        g_flash_wr = 0;
+    g_flash_used += rec;
+    g_flash_records++;
+
+    return ESP_OK;
+}
+
+/* Read the header of the oldest flash record, skipping the wrap padding */
+static esp_err_t flash_peek(sf_record_hdr_t *hdr)
+{
+    uint32_t size = g_part->size;
+
+    for (int tries = 0; tries < 2; tries++)
+    {
+        if (size - g_flash_rd >= sizeof(sf_record_hdr_t))
+        {
+            if (esp_partition_read(g_part, g_flash_rd, hdr, sizeof(sf_record_hdr_t)) != ESP_OK)
+                return ESP_FAIL;
+            if (hdr->magic == SF_MAGIC)
+                return ESP_OK;
+            if (hdr->magic != SF_WRAP_MAGIC)
+                return ESP_ERR_INVALID_CRC;
+        }
+
+        g_flash_used -= size - g_flash_rd;
+        g_flash_rd = 0;
+    }
+
+    return ESP_ERR_INVALID_CRC;
+}
+
+static void flash_reset(void)
+{
+    g_flash_wr = 0;
+    g_flash_rd = 0;
+    g_flash_used = 0;
+    g_flash_records = 0;
+}
+
+/*************************** API ***************************/
+
+esp_err_t mqtt_sf_init(void)
+{
+    if (g_lock != NULL)
+        return ESP_OK;
+
+    g_ram = heap_caps_malloc(MQTT_SF_RAM_SIZE, MALLOC_CAP_SPIRAM);
+    if (g_ram == NULL)
+        g_ram = heap_caps_malloc(MQTT_SF_RAM_SIZE, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    g_lock = xSemaphoreCreateMutex();
+    if (g_ram == NULL || g_lock == NULL)
+    {
+        ESP_LOGE(TAG, "Failed to allocate store and forward ring");
+        return ESP_ERR_NO_MEM;
+    }
+
+    g_part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, MQTT_SF_PARTITION_LABEL);
+    if (g_part == NULL)
+        ESP_LOGW(TAG, "No %s partition, storing in RAM only", MQTT_SF_PARTITION_LABEL);
+    else
+        ESP_LOGI(TAG, "Overflow to %s, %lu bytes", MQTT_SF_PARTITION_LABEL, (unsigned long)g_part->size);
+
+    return ESP_OK;
+}
+
+esp_err_t mqtt_sf_store(const mqtt_outbox_slot_t *slot)
+{
+    if (g_lock == NULL || slot == NULL)
+        return ESP_FAIL;
+
+    sf_record_hdr_t hdr = {
+        .magic     = SF_MAGIC,
+        .topic_len = (uint16_t)(strlen(slot->topic) + 1),
+        .data_len  = (uint16_t)slot->data_len,
+        .qos       = (uint8_t)slot->qos,
+        .retain    = (uint8_t)slot->retain,
+        .lane      = (uint8_t)slot->lane,
+        .stamp_ms  = sf_now_ms(),
+    };
+    uint32_t rec = sizeof(hdr) + hdr.topic_len + hdr.data_len;
+    esp_err_t ret = ESP_OK;
+
+    xSemaphoreTake(g_lock, portMAX_DELAY);
+
+    /* RAM only while flash is empty, so RAM stays older than flash */
+    if (g_flash_records == 0 && g_ram_used + rec <= MQTT_SF_RAM_SIZE)
+    {
+        ram_put(&hdr, sizeof(hdr));
+        ram_put(slot->topic, hdr.topic_len);
+        ram_put(slot->data, hdr.data_len);
+        g_ram_records++;
+    }
+    else if (g_part == NULL || flash_store(&hdr, slot->topic, slot->data) != ESP_OK)
+    {
+        ret = ESP_ERR_NO_MEM;
+    }
+
+    if (ret == ESP_OK)
+        g_stats.stored++;
+    else
+        g_stats.dropped++;
+
+    xSemaphoreGive(g_lock);
+
+    if (ret != ESP_OK)
+        ESP_LOGW(TAG, "Store and forward full, message to %s dropped", slot->topic);
+    return ret;
+}
+
+int mqtt_sf_replay(mqtt_sf_publish_t publish, int max_records)
+{
+    int n = 0;
+
+    if (g_lock == NULL || publish == NULL)
+        return 0;
+
+    xSemaphoreTake(g_lock, portMAX_DELAY);
+
+    if (!g_replay_active && (g_ram_records + g_flash_records) > 0)
+    {
+        g_replay_active = true;
+        g_replay_start_us = esp_timer_get_time();
+        g_replay_bytes = 0;
+        ESP_LOGI(TAG, "Replaying %lu messages", (unsigned long)(g_ram_records + g_flash_records));
+    }
+
+    while (n < max_records && (g_ram_records + g_flash_records) > 0)
+    {
+        sf_record_hdr_t hdr;
+        bool from_ram = (g_ram_records > 0);
+
+        if (from_ram)
+        {
+            ram_peek(0, &hdr, sizeof(hdr));
+            ram_peek(sizeof(hdr), g_replay_buf, hdr.topic_len + hdr.data_len);
+        }
+        else
+        {
+            if (flash_peek(&hdr) != ESP_OK ||
+                hdr.topic_len + hdr.data_len > sizeof(g_replay_buf) ||
+                esp_partition_read(g_part, g_flash_rd + sizeof(hdr), g_replay_buf, hdr.topic_len + hdr.data_len) != ESP_OK)
+            {
+                ESP_LOGE(TAG, "Flash log corrupted, %lu messages lost", (unsigned long)g_flash_records);
+                g_stats.dropped += g_flash_records;
+                flash_reset();
+                break;
+            }
+        }
+
+        const char *topic = g_replay_buf;
+        const char *data = g_replay_buf + hdr.topic_len;
+        mqtt_lane_t lane = (hdr.lane < MQTT_LANE_COUNT) ? (mqtt_lane_t)hdr.lane : MQTT_LANE_TELEMETRY;
+        if (publish(topic, data, hdr.data_len, hdr.qos, hdr.retain, lane) < 0)
+            break;
+
+        uint32_t rec = sizeof(hdr) + hdr.topic_len + hdr.data_len;
+        if (from_ram)
+        {
+            ram_consume(rec);
+            g_ram_records--;
+        }
+        else
+        {
+            g_flash_rd += rec;
+            if (g_flash_rd >= g_part->size)
+                g_flash_rd = 0;
+            g_flash_used -= rec;
+            if (--g_flash_records == 0)
+                flash_reset();
+        }
+
+        g_stats.replayed++;
+        g_replay_bytes += rec;
+        n++;
+    }
+
+    if (g_replay_active)
+    {
+        int64_t elapsed_us = esp_timer_get_time() - g_replay_start_us;
+        if (elapsed_us > 0)
+            g_stats.replay_bytes_per_sec = (uint32_t)((int64_t)g_replay_bytes * 1000000 / elapsed_us);
+        if ((g_ram_records + g_flash_records) == 0)
+        {
+            g_replay_active = false;
+            ESP_LOGI(TAG, "Replay done, %lu bytes/s", (unsigned long)g_stats.replay_bytes_per_sec);
+        }
+    }
+
+    xSemaphoreGive(g_lock);
+    return n;
+}
+
+bool mqtt_sf_pending(void)
+{
+    return (g_ram_records + g_flash_records) > 0;
+}
+
+void mqtt_sf_get_stats(mqtt_sf_stats_t *stats)
+{
+    if (g_lock == NULL || stats == NULL)
+        return;
+
+    xSemaphoreTake(g_lock, portMAX_DELAY);
+
+    *stats = g_stats;
+    stats->ram_bytes = g_ram_used;
+    stats->flash_bytes = g_flash_used;
+    stats->buffered_bytes = g_ram_used + g_flash_used;
+    stats->buffered_records = g_ram_records + g_flash_records;
+    stats->oldest_age_ms = 0;
+
+    sf_record_hdr_t hdr;
+    if (g_ram_records > 0)
+    {
+        ram_peek(0, &hdr, sizeof(hdr));
+        stats->oldest_age_ms = sf_now_ms() - hdr.stamp_ms;
+    }
+    else if (g_flash_records > 0 && flash_peek(&hdr) == ESP_OK)
+    {
+        stats->oldest_age_ms = sf_now_ms() - hdr.stamp_ms;
+    }
+
+    xSemaphoreGive(g_lock);
+}
@@ -0,0 +1,87 @@
+/**
+ * @file store_forward.h
+ * @brief Store and forward log for MQTT outages
+ *
+ * While the broker is unreachable the MQTT task moves outgoing messages into
+ * a PSRAM ring; when the ring is full they overflow to the MQTT_SF_PARTITION_LABEL
+ * flash partition. Once connected again the log is replayed oldest first,
+ * MQTT_SF_DRAIN_BURST messages every MQTT_SF_DRAIN_INTERVAL_MS.
+ *
+ * Everything in RAM is older than everything in flash, so replaying RAM
+ * first and flash next keeps the original order. The log isn't kept across
+ * a reboot.
+ */
+#ifndef MQTT_STORE_FORWARD_H
+#define MQTT_STORE_FORWARD_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "../outbox/outbox.h"
+
+/**
+ * @brief Publish function used for the replay
+ *
+ * lane is the lane the message was stored from, so the replay keeps its
+ * expiry and priority.
+ *
+ * @return Message ID (>= 0) on success, -1 if the message must stay in the log
+ */
+typedef int (*mqtt_sf_publish_t)(const char *topic, const char *data, size_t len, int qos, int retain, mqtt_lane_t lane);
+
+/**
+ * @brief Store and forward metrics
+ */
+typedef struct {
+    uint32_t buffered_bytes;        /* RAM + flash bytes waiting for replay */
+    uint32_t buffered_records;
+    uint32_t ram_bytes;
+    uint32_t flash_bytes;
+    uint32_t oldest_age_ms;         /* Age of the oldest buffered message, 0 when empty */
+    uint32_t stored;                /* Messages stored since boot */
+    uint32_t replayed;              /* Messages replayed since boot */
+    uint32_t dropped;               /* Messages lost because RAM and flash were full */
+    uint32_t replay_bytes_per_sec;  /* Throughput of the current (or last) replay */
+} mqtt_sf_stats_t;
+
+/**
+ * @brief Allocate the RAM ring and open the flash partition
+ *
+ * Runs RAM only if the partition is missing.
+ *
+ * @return ESP_OK on success, ESP_ERR_NO_MEM if the ring can't be allocated
+ */
+esp_err_t mqtt_sf_init(void);
+
+/**
+ * @brief Append a message to the log
+ *
+ * @param slot Message to store, the caller keeps ownership of the slot
+ * @return ESP_OK, or ESP_ERR_NO_MEM if the message was dropped
+ */
+esp_err_t mqtt_sf_store(const mqtt_outbox_slot_t *slot);
+
+/**
+ * @brief Replay the oldest messages
+ *
+ * Stops at the first message the publish function refuses, that message
+ * stays at the head of the log.
+ *
+ * @param publish     Publish function
+ * @param max_records Maximum number of messages to replay
+ * @return Number of messages replayed
+ */
+int mqtt_sf_replay(mqtt_sf_publish_t publish, int max_records);
+
+/**
+ * @brief true while messages are waiting in the log
+ */
+bool mqtt_sf_pending(void);
+
+/**
+ * @brief Copy the store and forward metrics
+ */
+void mqtt_sf_get_stats(mqtt_sf_stats_t *stats);
+
+#endif /* MQTT_STORE_FORWARD_H */
@@ -0,0 +1,300 @@
+/**
+ * @file baud.c
+ * @brief Baud rate negotiation with the bridge nodes
+ */
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "../uart_interface.h"
+#include "baud.h"
+
+#if ( UART_BAUD_NEGOTIATE == 1 )
+
+typedef enum {
+    BAUD_IDLE,
+    BAUD_WAIT,          /* Until the next proposal */
+    BAUD_WAIT_ACK,
+    BAUD_SWITCHING,     /* Giving the node time to switch */
+    BAUD_WAIT_ECHO,
+} baud_state_t;
+
+/* Negotiation of one port */
+typedef struct {
+    size_t port;
+    baud_state_t state;
+    int64_t deadline_us;
+    size_t next;              /* Candidate proposed next */
+    size_t trying;            /* Candidate being verified */
+    uint32_t baud;
+    bool answered;            /* The node ever answered a proposal */
+    uint8_t echoed;           /* Test frames back so far */
+    int64_t test_us;          /* Test frames sent */
+    uint8_t error_run;
+    uart_baud_stats_t stats;  /* Under g_stats_lock */
+} baud_port_t;
+
+static const char *TAG = "UART_BAUD";
+static const uint32_t g_candidates[] = { UART_BAUD_CANDIDATES };
+#define BAUD_CANDIDATE_COUNT (sizeof(g_candidates) / sizeof(g_candidates[0]))
+
+static baud_port_t g_ports[UART_PORT_COUNT];
+static uint8_t g_pattern[UART_BAUD_TEST_SIZE];   /* uart task only, shared by the ports */
+
+static portMUX_TYPE g_stats_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/* Test frame n, every byte value once, in an order distinct per n */
+static void baud_pattern(uint8_t n)
+{
+    for (int i = 0; i < UART_BAUD_TEST_SIZE; i++)
+        g_pattern[i] = (uint8_t)(i * 167 + n * 59);
+}
+
+static void baud_wait(baud_port_t *b, baud_state_t state, uint32_t ms)
+{
+    b->state = state;
+    b->deadline_us = esp_timer_get_time() + (int64_t)ms * 1000;
+}
+
+/* Propose the next candidate, or settle at the current rate */
+static void baud_propose(baud_port_t *b)
+{
+    uint8_t rate[4];
+
+    if (b->next >= BAUD_CANDIDATE_COUNT) {
+        ESP_LOGI(TAG, "Port %d: no candidate left, link stays at %lu baud", (int)b->port, (unsigned long)b->baud);
+        b->state = BAUD_IDLE;
+        return;
+    }
+
+    b->trying = b->next;
+    bridge_put_u32(rate, g_candidates[b->trying]);
+    uart_queue_frame(b->port, BRIDGE_FRAME_BAUD_REQ, BRIDGE_NODE_NONE, rate, sizeof(rate));
+    baud_wait(b, BAUD_WAIT_ACK, UART_BAUD_ACK_TIMEOUT_MS);
+
+    taskENTER_CRITICAL(&g_stats_lock);
+    b->stats.attempts++;
+    taskEXIT_CRITICAL(&g_stats_lock);
+}
+
+/* Back to the base rate, break included since the node may be at another rate */
+static void baud_fall_back(baud_port_t *b, uint32_t retry_ms)
+{
+    uart_switch_baud(b->port, UART_BAUD_RATE, true);
+    b->baud = UART_BAUD_RATE;
+    b->error_run = 0;
+    b->next = b->trying + 1;
+    baud_wait(b, BAUD_WAIT, retry_ms);
+
+    taskENTER_CRITICAL(&g_stats_lock);
+    b->stats.baud = b->baud;
+    taskEXIT_CRITICAL(&g_stats_lock);
+}
+
+static void baud_fail(baud_port_t *b, const char *reason)
+{
+    ESP_LOGW(TAG, "Port %d: %lu baud failed: %s", (int)b->port, (unsigned long)g_candidates[b->trying], reason);
+
+    taskENTER_CRITICAL(&g_stats_lock);
+    b->stats.failures++;
+    taskEXIT_CRITICAL(&g_stats_lock);
+
+    /* The node must be back at the base rate before the next proposal */
+    baud_fall_back(b, BRIDGE_BAUD_VERIFY_MS + 200);
+}
+
+static void baud_send_tests(baud_port_t *b)
+{
+    b->echoed = 0;
+    b->test_us = esp_timer_get_time();
+    for (uint8_t n = 0; n < UART_BAUD_TEST_FRAMES; n++) {
+        baud_pattern(n);
+        uart_queue_frame(b->port, BRIDGE_FRAME_BAUD_TEST, BRIDGE_NODE_NONE, g_pattern, sizeof(g_pattern));
+    }
+    baud_wait(b, BAUD_WAIT_ECHO, UART_BAUD_ECHO_TIMEOUT_MS);
+}
+
+static void baud_on_ack(baud_port_t *b, const bridge_frame_t *frame)
+{
+    if (b->state != BAUD_WAIT_ACK || frame->len != 4)
+        return;
+
+    b->answered = true;
+    if (bridge_get_u32(frame->payload) != g_candidates[b->trying]) {
+        ESP_LOGI(TAG, "Port %d: node refused %lu baud", (int)b->port, (unsigned long)g_candidates[b->trying]);
+        b->next = b->trying + 1;
+        baud_propose(b);
+        return;
+    }
+
+    uart_switch_baud(b->port, g_candidates[b->trying], false);
+    baud_wait(b, BAUD_SWITCHING, UART_BAUD_SWITCH_MS);
+}
+
+static void baud_on_test(baud_port_t *b, const bridge_frame_t *frame)
+{
+    if (b->state != BAUD_WAIT_ECHO)
+        return;
+
+    baud_pattern(b->echoed);
+    if (frame->len != sizeof(g_pattern) || memcmp(frame->payload, g_pattern, sizeof(g_pattern)) != 0) {
+        baud_fail(b, "test pattern corrupted");
+        return;
+    }
+    if (++b->echoed < UART_BAUD_TEST_FRAMES)
+        return;
+
+    /* Verified, repeated since the node falls back without it */
+    for (int i = 0; i < UART_BAUD_COMMIT_REPEAT; i++)
+        uart_queue_frame(b->port, BRIDGE_FRAME_BAUD_COMMIT, BRIDGE_NODE_NONE, NULL, 0);
+
+    int64_t elapsed_us = esp_timer_get_time() - b->test_us;
+    uint32_t kbps = (uint32_t)((2LL * UART_BAUD_TEST_FRAMES * UART_BAUD_TEST_SIZE * 8 * 1000) /
+                               (elapsed_us > 0 ? elapsed_us : 1));
+    b->baud = g_candidates[b->trying];
+    b->error_run = 0;
+    b->state = BAUD_IDLE;
+    ESP_LOGI(TAG, "Port %d: link at %lu baud, %d test frames echoed in %lld us, %lu kbit/s", (int)b->port,
+             (unsigned long)b->baud, UART_BAUD_TEST_FRAMES, (long long)elapsed_us, (unsigned long)kbps);
+
+    taskENTER_CRITICAL(&g_stats_lock);
+    b->stats.baud = b->baud;
+    b->stats.verify_kbps = kbps;
+    taskEXIT_CRITICAL(&g_stats_lock);
+}
+
+/* Handle the timeout of one port, returns its next deadline or 0 when idle */
+static int64_t baud_poll_port(baud_port_t *b)
+{
+    if (b->state == BAUD_IDLE)
+        return 0;
+
+    if (esp_timer_get_time() >= b->deadline_us) {
+        switch (b->state) {
+            case BAUD_WAIT:
+                baud_propose(b);
+                break;
+            case BAUD_WAIT_ACK:
+                if (b->answered) {
+                    /* ACK lost, the node may have switched */
+                    baud_fail(b, "no ACK");
+                } else {
+                    ESP_LOGI(TAG, "Port %d: node doesn't negotiate, link stays at %lu baud",
+                             (int)b->port, (unsigned long)b->baud);
+                    b->state = BAUD_IDLE;
+                }
+                break;
+            case BAUD_SWITCHING:
+                baud_send_tests(b);
+                break;
+            case BAUD_WAIT_ECHO:
+                baud_fail(b, "echo timeout");
+                break;
+            default:
+                break;
+        }
+    }
+
+    return (b->state == BAUD_IDLE) ? 0 : b->deadline_us;
+}
+
+void uart_baud_start(void)
+{
+    for (size_t i = 0; i < UART_PORT_COUNT; i++) {
+        baud_port_t *b = &g_ports[i];
+
+        b->port = i;
+        b->baud = UART_BAUD_RATE;
+        b->next = 0;
+        b->answered = false;
+        b->error_run = 0;
+        taskENTER_CRITICAL(&g_stats_lock);
+        b->stats = (uart_baud_stats_t){ .baud = UART_BAUD_RATE };
+        taskEXIT_CRITICAL(&g_stats_lock);
+        baud_wait(b, BAUD_WAIT, UART_BAUD_START_DELAY_MS);
+    }
+}
+
+TickType_t uart_baud_poll(void)
+{
+    int64_t next_us = 0;
+
+    for (size_t i = 0; i < UART_PORT_COUNT; i++) {
+        int64_t deadline_us = baud_poll_port(&g_ports[i]);
+        if (deadline_us != 0 && (next_us == 0 || deadline_us < next_us))
+            next_us = deadline_us;
+    }
+    if (next_us == 0)
+        return portMAX_DELAY;
+
+    TickType_t ticks = pdMS_TO_TICKS((next_us - esp_timer_get_time() + 999) / 1000);
+    return ticks > 0 ? ticks : 1;
+}
+
+void uart_baud_on_frame(size_t port, const bridge_frame_t *frame)
+{
+    baud_port_t *b = &g_ports[port];
+
+    b->error_run = 0;
+
+    switch (frame->type) {
+        case BRIDGE_FRAME_BAUD_ACK:
+            baud_on_ack(b, frame);
+            break;
+        case BRIDGE_FRAME_BAUD_TEST:
+            baud_on_test(b, frame);
+            break;
+        default:
+            break;
+    }
+}
+
+void uart_baud_on_error(size_t port)
+{
+    baud_port_t *b = &g_ports[port];
+
+    if (b->state == BAUD_SWITCHING)
+        return;     /* Bytes caught by the switch */
+    if (b->state == BAUD_WAIT_ECHO) {
+        /* A rate that garbles anything during its test isn't reliable */
+        baud_fail(b, "bad frame during the test");
+        return;
+    }
+    if (b->baud == UART_BAUD_RATE || ++b->error_run < UART_BAUD_MAX_ERRORS)
+        return;
+
+    ESP_LOGW(TAG, "Port %d: %d bad frames in a row at %lu baud, back to %d", (int)b->port, UART_BAUD_MAX_ERRORS,
+             (unsigned long)b->baud, UART_BAUD_RATE);
+    taskENTER_CRITICAL(&g_stats_lock);
+    b->stats.fallbacks++;
+    taskEXIT_CRITICAL(&g_stats_lock);
+
+    baud_fall_back(b, UART_BAUD_RENEGOTIATE_MS);
+}
+
+void uart_baud_get_stats(size_t port, uart_baud_stats_t *stats)
+{
+    if (stats == NULL || port >= UART_PORT_COUNT)
+        return;
+
+    taskENTER_CRITICAL(&g_stats_lock);
+    *stats = g_ports[port].stats;
+    taskEXIT_CRITICAL(&g_stats_lock);
+}
+
+#else
+
+void uart_baud_start(void) { }
+TickType_t uart_baud_poll(void) { return portMAX_DELAY; }
+void uart_baud_on_frame(size_t port, const bridge_frame_t *frame) { }
+void uart_baud_on_error(size_t port) { }
+
+void uart_baud_get_stats(size_t port, uart_baud_stats_t *stats)
+{
+    if (stats != NULL)
+        *stats = (uart_baud_stats_t){ .baud = UART_BAUD_RATE };
+}
+
+#endif
@@ -0,0 +1,72 @@
+/**
+ * @file baud.h
+ * @brief Baud rate negotiation with the bridge nodes
+ *
+ * The link starts at UART_BAUD_RATE. UART_BAUD_START_DELAY_MS after boot
+ * the broker proposes the highest of UART_BAUD_CANDIDATES, both ends switch
+ * and UART_BAUD_TEST_FRAMES test patterns must come back unchanged before
+ * the rate is committed (protocol in bridge_frame.h). A refused rate is
+ * skipped, a failed one makes the broker send a line break, which returns
+ * the node to the base rate, and the next candidate is tried.
+ *
+ * Once committed, UART_BAUD_MAX_ERRORS bad frames in a row take the link
+ * back to the base rate the same way, the rates below the failed one are
+ * tried again after UART_BAUD_RENEGOTIATE_MS.
+ *
+ * A node that doesn't answer the first proposal keeps the base rate.
+ *
+ * Every port of UART_PORTS negotiates on its own, a slow bridge doesn't
+ * hold the others back.
+ *
+ * Everything except uart_baud_get_stats() runs in the uart task.
+ */
+#ifndef UART_BAUD_H
+#define UART_BAUD_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "freertos/FreeRTOS.h"
+#include "bridge_frame.h"
+
+/**
+ * @brief Negotiation counters of a port
+ */
+typedef struct {
+    uint32_t baud;          /* Current rate of the link */
+    uint32_t attempts;      /* Rates proposed */
+    uint32_t failures;      /* Rates that failed their verification */
+    uint32_t fallbacks;     /* Committed rates given up for errors */
+    uint32_t verify_kbps;   /* Echo throughput of the last verified rate, both directions */
+} uart_baud_stats_t;
+
+/**
+ * @brief Schedule the first negotiation of every port, from the uart task
+ */
+void uart_baud_start(void);
+
+/**
+ * @brief Handle the timeouts of every port
+ *
+ * @return Ticks until the next timeout, portMAX_DELAY when none is pending
+ */
+TickType_t uart_baud_poll(void);
+
+/**
+ * @brief A valid frame was received on a port, handles the BAUD_* types
+ */
+void uart_baud_on_frame(size_t port, const bridge_frame_t *frame);
+
+/**
+ * @brief A bad frame or a line error was received on a port
+ */
+void uart_baud_on_error(size_t port);
+
+/**
+ * @brief Copy the negotiation counters of a port
+ *
+ * @param port  Index in UART_PORTS
+ * @param stats Filled with the counters
+ */
+void uart_baud_get_stats(size_t port, uart_baud_stats_t *stats);
+
+#endif /* UART_BAUD_H */
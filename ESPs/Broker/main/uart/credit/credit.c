@@ -0,0 +1,128 @@
+/**
+ * @file credit.c
+ * @brief Credit based flow control of the bridge links
+ */
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "../uart_interface.h"
+#include "credit.h"
+
+#if ( UART_CREDIT_ENABLE == 1 )
+
+/* Flow control of one port */
+typedef struct {
+    bool seen;              /* A frame of the node was received, its seq is known */
+    bool heard;             /* A frame came since the last periodic grant */
+    uint16_t next;          /* seq expected next */
+    bool granted;           /* limit was sent */
+    uint16_t limit;         /* Last limit sent */
+    int64_t refresh_us;     /* Next periodic grant */
+    uart_credit_stats_t stats;
+} credit_port_t;
+
+static const char *TAG = "UART_CREDIT";
+
+static portMUX_TYPE g_lock = portMUX_INITIALIZER_UNLOCKED;
+static credit_port_t g_ports[UART_PORT_COUNT];
+
+/* Send a grant, always when forced, else only when it lets the node send more in a useful way */
+static void credit_grant(size_t port, size_t free_bytes, bool force)
+{
+    credit_port_t *c = &g_ports[port];
+    /* The ports share the RX message buffer, each node is granted its share */
+    uint16_t slots = (uint16_t)(free_bytes / UART_CREDIT_SLOT_BYTES / UART_PORT_COUNT);
+    uint8_t payload[3];
+
+    taskENTER_CRITICAL(&g_lock);
+    if (!c->seen) {
+        /* Nothing received since boot, the node's seq is unknown */
+        payload[0] = BRIDGE_CREDIT_RELATIVE;
+        payload[1] = (uint8_t)(slots >> 8);
+        payload[2] = (uint8_t)slots;
+        force = true;
+    } else {
+        uint16_t limit = (uint16_t)(c->next + slots);
+        int16_t moved = (int16_t)(limit - c->limit);
+        bool exhausted = c->granted && (int16_t)(c->limit - c->next) <= 0;
+
+        if (!force && c->granted && moved < UART_CREDIT_BATCH && !(exhausted && moved > 0)) {
+            taskEXIT_CRITICAL(&g_lock);
+            return;
+        }
+        c->granted = true;
+        c->limit = limit;
+        payload[0] = BRIDGE_CREDIT_LIMIT;
+        payload[1] = (uint8_t)(limit >> 8);
+        payload[2] = (uint8_t)limit;
+    }
+    c->refresh_us = esp_timer_get_time() + (int64_t)UART_CREDIT_REFRESH_MS * 1000;
+    c->stats.grants++;
+    if (slots == 0)
+        c->stats.stalls++;
+    taskEXIT_CRITICAL(&g_lock);
+
+    if (slots == 0)
+        ESP_LOGW(TAG, "Port %d: RX buffer full, node out of credit", (int)port);
+    // Queued, the dispatcher calls this from uart_receive(). A grant lost to a full buffer is repeated by the refresh
+    uart_queue_frame(port, BRIDGE_FRAME_CREDIT, BRIDGE_NODE_NONE, payload, sizeof(payload));
+}
+
+void uart_credit_on_frame(size_t port, uint16_t seq)
+{
+    taskENTER_CRITICAL(&g_lock);
+    g_ports[port].seen = true;
+    g_ports[port].heard = true;
+    g_ports[port].next = (uint16_t)(seq + 1);
+    taskEXIT_CRITICAL(&g_lock);
+}
+
+void uart_credit_update(size_t free_bytes)
+{
+    for (size_t i = 0; i < UART_PORT_COUNT; i++)
+        credit_grant(i, free_bytes, false);
+}
+
+TickType_t uart_credit_poll(size_t free_bytes)
+{
+    int64_t next_us = INT64_MAX;
+
+    for (size_t i = 0; i < UART_PORT_COUNT; i++) {
+        int64_t refresh_us;
+
+        taskENTER_CRITICAL(&g_lock);
+        refresh_us = g_ports[i].refresh_us;
+        taskEXIT_CRITICAL(&g_lock);
+
+        if (esp_timer_get_time() >= refresh_us) {
+            taskENTER_CRITICAL(&g_lock);
+            /* Silent for a whole period: what the node sent was taken or lost on the line, and the
+             * lost DATA frames took credit the limit never gave back. Granted from its own seq again */
+            if (!g_ports[i].heard)
+                g_ports[i].seen = false;
+            g_ports[i].heard = false;
+            taskEXIT_CRITICAL(&g_lock);
+            credit_grant(i, free_bytes, true);
+            refresh_us = esp_timer_get_time() + (int64_t)UART_CREDIT_REFRESH_MS * 1000;
+        }
+        if (refresh_us < next_us)
+            next_us = refresh_us;
+    }
+
+    TickType_t ticks = pdMS_TO_TICKS((next_us - esp_timer_get_time() + 999) / 1000);
+    return ticks > 0 ? ticks : 1;
+}
+
+void uart_credit_get_stats(size_t port, uart_credit_stats_t *stats)
+{
+    if (stats == NULL || port >= UART_PORT_COUNT)
+        return;
+
+    taskENTER_CRITICAL(&g_lock);
+    *stats = g_ports[port].stats;
+    taskEXIT_CRITICAL(&g_lock);
+}
+
+#endif
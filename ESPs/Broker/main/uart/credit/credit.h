@@ -0,0 +1,67 @@
+/**
+ * @file credit.h
+ * @brief Credit based flow control of the bridge links
+ *
+ * The node may send DATA frames up to the seq limit of the last CREDIT
+ * frame (protocol in bridge_frame.h). The limit is the seq expected next
+ * plus the messages the RX message buffer still has room for, counted in
+ * UART_CREDIT_SLOT_BYTES. While the dispatcher is stuck behind a slow MQTT
+ * link the buffer fills, the limit stops moving and the node holds its
+ * readings instead of the broker dropping them.
+ *
+ * A grant goes out when the limit moved by UART_CREDIT_BATCH, when the node
+ * had run out, and every UART_CREDIT_REFRESH_MS in case one was lost. A node
+ * silent for a whole refresh period is granted from its own seq again: DATA
+ * frames lost on the line took credit that the limit never gives back.
+ *
+ * The ports of UART_PORTS share the RX message buffer, each node gets an
+ * equal share of its room and a seq limit of its own.
+ */
+#ifndef UART_CREDIT_H
+#define UART_CREDIT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "freertos/FreeRTOS.h"
+
+/**
+ * @brief Flow control counters of a port
+ */
+typedef struct {
+    uint32_t grants;    /* CREDIT frames sent */
+    uint32_t stalls;    /* Grants that left the node no credit */
+} uart_credit_stats_t;
+
+/**
+ * @brief A frame of a node was received, from the uart task
+ *
+ * @param port Index in UART_PORTS it came in on
+ * @param seq  Its seq
+ */
+void uart_credit_on_frame(size_t port, uint16_t seq);
+
+/**
+ * @brief Room in the RX message buffer changed, grants credit on every port where worth a frame
+ *
+ * @param free_bytes Free bytes of the RX message buffer
+ */
+void uart_credit_update(size_t free_bytes);
+
+/**
+ * @brief Periodic grants of every port, from the uart task
+ *
+ * @param free_bytes Free bytes of the RX message buffer
+ * @return Ticks until the next one
+ */
+TickType_t uart_credit_poll(size_t free_bytes);
+
+/**
+ * @brief Copy the flow control counters of a port
+ *
+ * @param port  Index in UART_PORTS
+ * @param stats Filled with the counters
+ */
+void uart_credit_get_stats(size_t port, uart_credit_stats_t *stats);
+
+#endif /* UART_CREDIT_H */
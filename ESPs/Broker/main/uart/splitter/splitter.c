@@ -0,0 +1,64 @@
+/**
+ * @file splitter.c
+ * @brief Incremental splitter of the UART byte stream into messages
+ */
+#include <string.h>
+
+#include "splitter.h"
+
+void uart_splitter_init(uart_splitter_t *s, uint8_t *buf, size_t cap, uint8_t delimiter)
+{
+    s->buf = buf;
+    s->cap = cap;
+    s->len = 0;
+    s->delimiter = delimiter;
+    s->discard = false;
+    s->overflows = 0;
+}
+
+void uart_splitter_reset(uart_splitter_t *s)
+{
+    s->len = 0;
+    s->discard = false;
+}
+
+uint8_t *uart_splitter_space(uart_splitter_t *s, size_t *room)
+{
+    *room = s->cap - s->len;
+    return s->buf + s->len;
+}
+
+size_t uart_splitter_feed(uart_splitter_t *s, size_t n, uart_splitter_emit_t emit, void *ctx)
+{
+    size_t end = s->len + n;
+    size_t start = 0;        /* Of the current message */
+    size_t scan = s->len;    /* The bytes held have no delimiter, only the new ones are searched */
+    size_t emitted = 0;
+    uint8_t *p;
+
+    while (scan < end && (p = memchr(s->buf + scan, s->delimiter, end - scan)) != NULL) {
+        size_t stop = (size_t)(p - s->buf);
+
+        if (s->discard) {
+            s->discard = false;
+        } else {
+            emit(s->buf + start, stop - start, ctx);
+            emitted++;
+        }
+        start = scan = stop + 1;
+    }
+
+    size_t tail = end - start;
+    if (tail == s->cap) {
+        /* A whole buffer without a delimiter, keep dropping until the next one */
+        if (!s->discard)
+            s->overflows++;
+        s->discard = true;
+        tail = 0;
+    } else if (start > 0 && tail > 0) {
+        memmove(s->buf, s->buf + start, tail);
+    }
+    s->len = tail;
+
+    return emitted;
+}
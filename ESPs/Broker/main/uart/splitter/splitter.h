@@ -0,0 +1,68 @@
+/**
+ * @file splitter.h
+ * @brief Incremental splitter of the UART byte stream into messages
+ *
+ * Reads land straight in the splitter's buffer (uart_splitter_space()),
+ * uart_splitter_feed() then hands every complete message to the callback
+ * as a slice of that buffer, without copying it. A message cut by the end
+ * of a read stays at the start of the buffer until the rest arrives; it is
+ * the only thing ever moved. A message that doesn't fit the buffer is
+ * dropped up to the next delimiter and counted.
+ *
+ * Not thread safe, one splitter belongs to the task reading the UART.
+ */
+#ifndef UART_SPLITTER_H
+#define UART_SPLITTER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/**
+ * @brief Called for every complete message
+ *
+ * @param msg Message without its delimiter, may be modified in place within len bytes
+ * @param len Message length, 0 for back-to-back delimiters
+ * @param ctx Context given to uart_splitter_feed()
+ */
+typedef void (*uart_splitter_emit_t)(uint8_t *msg, size_t len, void *ctx);
+
+/**
+ * @brief Splitter state
+ */
+typedef struct {
+    uint8_t *buf;
+    size_t cap;
+    size_t len;            /* Bytes held, the start of a message */
+    uint8_t delimiter;
+    bool discard;          /* Message overflowed, drop it up to the next delimiter */
+    uint32_t overflows;    /* Messages dropped for their size */
+} uart_splitter_t;
+
+/**
+ * @brief Set up a splitter on buf
+ *
+ * @param cap Capacity of buf, the longest message is cap - 1 bytes
+ */
+void uart_splitter_init(uart_splitter_t *s, uint8_t *buf, size_t cap, uint8_t delimiter);
+
+/**
+ * @brief Drop the partial message, after bytes were lost
+ */
+void uart_splitter_reset(uart_splitter_t *s);
+
+/**
+ * @brief Where the next read goes
+ *
+ * @param room Filled with the bytes free there, never 0
+ */
+uint8_t *uart_splitter_space(uart_splitter_t *s, size_t *room);
+
+/**
+ * @brief Account n bytes read to uart_splitter_space() and emit the complete messages
+ *
+ * @return Messages emitted
+ */
+size_t uart_splitter_feed(uart_splitter_t *s, size_t n, uart_splitter_emit_t emit, void *ctx);
+
+#endif /* UART_SPLITTER_H */
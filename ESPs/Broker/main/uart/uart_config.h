@@ -7,37 +7,130 @@
 
 #include "driver/uart.h"
 #include "driver/gpio.h"
+#include "bridge_frame.h"
+
+/**
+ * @brief One UART with a bridge node behind it
+ */
+typedef struct {
+    uart_port_t num;
+    gpio_num_t tx_pin;
+    gpio_num_t rx_pin;
+} uart_port_config_t;
 
 /**
  * @brief UART configuration parameters
+ *
+ * Every port of UART_PORTS gets its own framing, baud rate and credit state,
+ * one reactor task serves them all, see uart_program.c. A second bridge is
+ * added with its entry and UART_PORT_COUNT 2, e.g.
+ *   { UART_NUM_2, GPIO_NUM_15, GPIO_NUM_16 },
  */
-#define UART_PORT_NUM      UART_NUM_1
-#define UART_BAUD_RATE     115200
-#define UART_TX_PIN        GPIO_NUM_17
-#define UART_RX_PIN        GPIO_NUM_18
+#ifndef UART_PORTS
+#define UART_PORTS                                   \
+    {                                                \
+        { UART_NUM_1, GPIO_NUM_17, GPIO_NUM_18 },    \
+    }
+#define UART_PORT_COUNT    1                  /* Entries of UART_PORTS */
+#endif
+#define UART_BAUD_RATE     BRIDGE_BAUD_BASE   /* Rate the links start at, see UART_BAUD_NEGOTIATE */
 #define UART_BUF_SIZE      (1024)
+#define UART_NODE_MAP_SIZE 64                 /* Node ID -> port entries, direct mapped, see uart_send_data() */
 
 /**
  * @brief UART task configuration
  */
 #define UART_TASK_STACK_SIZE   1024*10
 #define UART_TASK_PRIORITY     5
-#define UART_QUEUE_SIZE        10
-#define UART_READ_TIMEOUT      (pdMS_TO_TICKS(1000))
+#define UART_MSG_BUFFER_SIZE   4096   /* Shared by the ports, a message takes its length + 7 (sizeof(size_t) + node ID + type) */
+#define UART_RX_SPLIT_SIZE     (UART_BUF_SIZE * 2)    /* Splitter buffer: a partial message held plus the next read */
+
+/**
+ * @brief TX path, uart_send_async() -> uart_tx task -> driver TX ring -> wire
+ */
+#define UART_TX_RING_SIZE        4096   /* Driver TX ring, uart_write_bytes returns once the bytes are in */
+#define UART_TX_MSG_BUFFER_SIZE  1024   /* Messages waiting for the uart_tx task */
+#define UART_TX_MSG_MAX          BRIDGE_FRAME_MAX_PAYLOAD
+#define UART_TX_TASK_STACK_SIZE  (1024*4)
+#define UART_TX_TASK_PRIORITY    5
+#define UART_TX_DONE_TIMEOUT     (pdMS_TO_TICKS(100))   /* Wire drain before the TX notification */
+#define UART_LINK_BUFFER_SIZE    2048   /* Credit and baud frames and baud switches for the uart_tx task, sent first */
+#define UART_LINK_PAYLOAD_MAX    UART_BAUD_TEST_SIZE   /* Largest link frame, a baud test pattern */
+
+/**
+ * @brief Link framing, 1: COBS frames of bridge_frame.h, 0: newline terminated text
+ *
+ * Both ends must agree, see BRIDGE_FRAMED in the node sketches.
+ */
+#define UART_FRAMED              1
+
+/**
+ * @brief Baud rate negotiation with the bridge node, needs UART_FRAMED
+ *
+ * The candidates are tried from the top, each one verified with echoed
+ * test frames, see uart/baud/baud.h.
+ */
+#define UART_BAUD_NEGOTIATE        1
+#define UART_BAUD_CANDIDATES       2000000, 921600, 460800, 230400
+#ifndef UART_BAUD_START_DELAY_MS
+#define UART_BAUD_START_DELAY_MS   3000    /* After boot, the node must be up */
+#endif
+#define UART_BAUD_ACK_TIMEOUT_MS   300     /* No ACK: the node doesn't negotiate, stay at UART_BAUD_RATE */
+#define UART_BAUD_SWITCH_MS        20      /* The node switches once its ACK is out */
+#define UART_BAUD_TEST_FRAMES      4
+#define UART_BAUD_TEST_SIZE        256     /* Payload of a test frame */
+#define UART_BAUD_ECHO_TIMEOUT_MS  500     /* Below BRIDGE_BAUD_VERIFY_MS */
+#define UART_BAUD_COMMIT_REPEAT    3
+#define UART_BAUD_MAX_ERRORS       3       /* Bad frames in a row at a negotiated rate before falling back */
+#define UART_BAUD_RENEGOTIATE_MS   60000   /* From a fallback to the next attempt */
+#define UART_BAUD_BREAK_BITS       255     /* Break that returns the node to the base rate, in bit times */
+
+#if ( UART_BAUD_NEGOTIATE == 1 ) && ( UART_FRAMED != 1 )
+#error "UART_BAUD_NEGOTIATE needs UART_FRAMED"
+#endif
+
+/**
+ * @brief Credit based flow control of the node, needs UART_FRAMED, see uart/credit/credit.h
+ */
+#define UART_CREDIT_ENABLE         1
+/* RX message buffer bytes counted per frame granted, split between the ports: the largest DATA
+ * frame with its node ID, type and length word, so the granted frames fit whatever their size */
+#define UART_CREDIT_SLOT_BYTES     (BRIDGE_FRAME_MAX_PAYLOAD + 3 + sizeof(size_t))
+#define UART_CREDIT_BATCH          2       /* Grant once the limit moved this far */
+#define UART_CREDIT_REFRESH_MS     1000    /* Grant repeated at least this often */
+
+#if ( UART_CREDIT_ENABLE == 1 ) && ( UART_FRAMED != 1 )
+#error "UART_CREDIT_ENABLE needs UART_FRAMED"
+#endif
+
+/**
+ * @brief RX framing, the driver raises UART_PATTERN_DET on every line end or frame delimiter
+ */
+#define UART_EVENT_QUEUE_SIZE    20     /* Per port, the reactor's queue set holds UART_PORT_COUNT times this */
+#if ( UART_FRAMED == 1 )
+#define UART_PATTERN_CHR         BRIDGE_FRAME_DELIMITER
+#else
+#define UART_PATTERN_CHR         '\n'
+#endif
+#define UART_PATTERN_CHR_NUM     1      /* One delimiter ends a line */
+#define UART_PATTERN_CHR_TOUT    9      /* Baud cycles between pattern characters */
+#define UART_PATTERN_QUEUE_SIZE  16     /* Line ends recorded before the task reads them */
 
 /**
  * @brief Message types for UART queue
  */
 typedef enum {
-    UART_MSG_SEND,
-    UART_MSG_RECEIVED
+    UART_MSG_RECEIVED = 1
 } uart_msg_type_t;
 
 /**
- * @brief UART message structure for queue
+ * @brief UART message as read by uart_receive()
+ *
+ * Only the consumer holds one, the message buffer stores the actual bytes.
  */
 typedef struct {
     uart_msg_type_t msg_type;
+    uint16_t node_id;             /* Of a frame, BRIDGE_NODE_NONE: text line, data starts with the node ID */
     uint8_t data[UART_BUF_SIZE];
     size_t data_len;
 } uart_queue_msg_t;
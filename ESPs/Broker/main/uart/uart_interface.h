@@ -9,36 +9,153 @@
 #include <stdbool.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/queue.h"
+#include "freertos/task.h"
 #include "uart_config.h"
 
 /**
- * @brief Initialize UART driver
+ * @brief Port argument of uart_get_frame_stats() for the sum of every port
+ */
+#define UART_PORT_ALL      UART_PORT_COUNT
+
+/**
+ * @brief Framing counters of a link, see UART_FRAMED
+ */
+typedef struct {
+    uint32_t frames;     /* Valid frames received */
+    uint32_t errors;     /* Frames dropped: bad COBS or CRC, unexpected type */
+    uint32_t lost;       /* Frames missing from the node's sequence */
+    uint32_t oversized;  /* Lines or frames dropped for their length */
+    uint32_t rx_dropped; /* Messages lost to a full RX message buffer */
+    uint32_t tx_sent;    /* Messages written by uart_send_data() */
+    uint32_t tx_full;    /* uart_send_async() calls refused, no room; the queue is shared, same for every port */
+} uart_frame_stats_t;
+
+/**
+ * @brief Initialize the UART driver of every port of UART_PORTS
  *
  * @return ESP_OK on success, appropriate error code otherwise
  */
 esp_err_t uart_init(void);
 
 /**
- * @brief Start the UART task
+ * @brief Start the UART task, one reactor serving every port
  * 
  * @return ESP_OK on success, appropriate error code otherwise
  */
 esp_err_t uart_start_task(void);
 
+/**
+ * @brief Queue data for the uart_tx task, returns without waiting for the UART
+ *
+ * The bytes are copied once into the TX message buffer; the uart_tx task
+ * sends them with uart_send_data(). Messages go out in the order queued.
+ *
+ * @param data Buffer containing data to send, as for uart_send_data()
+ * @param len  Length of data, up to UART_TX_MSG_MAX
+ * @param wait Ticks to wait for room
+ * @return ESP_OK, ESP_ERR_TIMEOUT when there was no room, ESP_ERR_INVALID_ARG
+ */
+esp_err_t uart_send_async(const uint8_t *data, size_t len, TickType_t wait);
+
+/**
+ * @brief Register a task notified each time the queued TX has left the wire
+ *
+ * @param task        Task to notify, NULL to disable the notification
+ * @param notify_bits Bits set in the task notification value (eSetBits)
+ */
+void uart_set_tx_notify(TaskHandle_t task, uint32_t notify_bits);
+
 /**
  * @brief Send data through UART
  *
+ * Returns once the bytes are in the driver's TX ring, it only blocks while
+ * the ring is full.
+ *
+ * With UART_FRAMED, data is "<node id><command>" as in text mode: the
+ * leading digits become the frame's node ID and the rest its payload. The
+ * frame goes to the port the node's last DATA frame came in on, to every
+ * port while the node wasn't heard yet. Text lines go to every port.
+ *
  * @param data Buffer containing data to send
  * @param len Length of data to send
  * @return Number of bytes sent, or -1 on error
  */
 int uart_send_data(const uint8_t *data, size_t len);
 
+#if ( UART_FRAMED == 1 )
 /**
- * @brief Get the UART queue handler
- * 
- * @return QueueHandle_t UART queue handle
+ * @brief Send one frame of bridge_frame.h
+ *
+ * Writes under the port's TX lock and blocks while the driver's TX ring is
+ * full, the uart task queues its frames with uart_queue_frame() instead.
+ *
+ * @param port    Index in UART_PORTS
+ * @param type    bridge_frame_type_t
+ * @param node_id Node addressed, BRIDGE_NODE_NONE for the link itself
+ * @param payload Payload, may be NULL when len is 0
+ * @param len     Payload length, up to BRIDGE_FRAME_MAX_PAYLOAD
+ * @return Number of bytes sent, or -1 on error
+ */
+int uart_send_frame(size_t port, uint8_t type, uint16_t node_id, const uint8_t *payload, size_t len);
+
+/**
+ * @brief Queue one link frame for the uart_tx task, returns without waiting for the UART
+ *
+ * Used by the reactor and the credit grants, the frames go out before the
+ * messages of uart_send_async().
+ *
+ * @param port    Index in UART_PORTS
+ * @param type    bridge_frame_type_t
+ * @param node_id Node addressed, BRIDGE_NODE_NONE for the link itself
+ * @param payload Payload, may be NULL when len is 0
+ * @param len     Payload length, up to UART_LINK_PAYLOAD_MAX
+ * @return ESP_OK, ESP_ERR_TIMEOUT when the link buffer is full, ESP_ERR_INVALID_ARG
+ */
+esp_err_t uart_queue_frame(size_t port, uint8_t type, uint16_t node_id, const uint8_t *payload, size_t len);
+
+/**
+ * @brief Change the link's baud rate once the pending TX is out, from the uart task
+ *
+ * Queued like uart_queue_frame(), the uart_tx task makes the switch once the
+ * link frames queued before it are out. The reactor doesn't read the port
+ * until then and resets its splitter after. Received bytes not read yet are
+ * dropped, they were sampled around the switch.
+ *
+ * @param port       Index in UART_PORTS
+ * @param baud       New rate
+ * @param send_break Send a line break first, it returns the node to the base rate
+ */
+void uart_switch_baud(size_t port, uint32_t baud, bool send_break);
+#endif
+
+/**
+ * @brief Take the oldest message, single consumer
+ *
+ * @param msg  Filled with the message
+ * @param wait Ticks to wait for a message
+ * @return true if msg was filled
+ */
+bool uart_receive(uart_queue_msg_t *msg, TickType_t wait);
+
+/**
+ * @brief Whether the UART was initialized and messages can be received
+ */
+bool uart_is_started(void);
+
+/**
+ * @brief Register a task notified each time a received message is queued
+ *
+ * @param task        Task to notify, NULL to disable the notification
+ * @param notify_bits Bits set in the task notification value (eSetBits)
+ */
+void uart_set_rx_notify(TaskHandle_t task, uint32_t notify_bits);
+
+/**
+ * @brief Copy the framing counters
+ *
+ * @param port  Index in UART_PORTS, or UART_PORT_ALL for the sum
+ * @param stats Filled with the counters
  */
-QueueHandle_t uart_get_queue(void);
+void uart_get_frame_stats(size_t port, uart_frame_stats_t *stats);
 
 #endif /* UART_INTERFACE_H */
\ No newline at end of file
@@ -7,49 +7,514 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/message_buffer.h"
 #include "uart_interface.h"
 #include "uart_config.h"
+#include "baud/baud.h"
+#include "splitter/splitter.h"
+#include "credit/credit.h"
 
 static const char *TAG = "UART";
-static QueueHandle_t uart_queue = NULL;
+/* Records are the message bytes followed by the node ID (2 bytes, big endian) and their uart_msg_type_t,
+ * the reactor is the only writer */
+#define UART_RECORD_TAIL 3
+static MessageBufferHandle_t uart_msg_buffer = NULL;
+/* Messages of uart_send_async(), writers take uart_tx_queue_lock, the uart_tx task reads */
+static MessageBufferHandle_t uart_tx_buffer = NULL;
+static SemaphoreHandle_t uart_tx_queue_lock = NULL;
+static TaskHandle_t uart_tx_notify_task = NULL;
+static uint32_t uart_tx_notify_bits = 0;
+static uint32_t uart_tx_full = 0;
+static TaskHandle_t uart_tx_task_handle = NULL;   /* Notified on every record queued */
+#if ( UART_FRAMED == 1 )
+/* Link records for the uart_tx task, taken before uart_tx_buffer. A record is op | port followed by
+ * type | node ID:2 | payload for UART_LINK_FRAME, or baud:4 | break for UART_LINK_SWITCH.
+ * Writers take uart_link_lock and build the record in uart_link_record */
+#define UART_LINK_FRAME      0
+#define UART_LINK_SWITCH     1
+#define UART_LINK_HEADER     5
+#define UART_LINK_RECORD_MAX (UART_LINK_HEADER + UART_LINK_PAYLOAD_MAX)
+static MessageBufferHandle_t uart_link_buffer = NULL;
+static SemaphoreHandle_t uart_link_lock = NULL;
+static uint8_t uart_link_record[UART_LINK_RECORD_MAX];
+#endif
+
+/**
+ * @brief State of one port, the RX side is owned by the reactor
+ */
+typedef struct {
+    uart_port_t num;
+    size_t index;                              /* In uart_ports */
+    QueueHandle_t event_queue;                 /* Member of uart_event_set */
+    uart_splitter_t rx_splitter;
+    uint8_t rx_buf[UART_RX_SPLIT_SIZE];
+    uint32_t rx_overflows;                     /* rx_splitter.overflows already counted */
+#if ( UART_FRAMED == 1 )
+    /* The encoder's buffer and sequence, taken for the whole write and for a baud switch. Frames of
+     * the reactor and of the credit grants are queued, only the uart_tx task writes them */
+    SemaphoreHandle_t tx_lock;
+    uint8_t tx_frame[BRIDGE_FRAME_MAX_ENCODED];
+    uint16_t tx_seq;
+    bridge_frame_seq_t rx_seq;
+    /* Baud switches queued by uart_switch_baud() and made by the uart_tx task, the reactor doesn't
+     * read the port in between */
+    uint32_t switch_queued;
+    volatile uint32_t switch_made;
+#endif
+    uart_frame_stats_t stats;                  /* Under uart_stats_lock */
+} uart_port_ctx_t;
+
+static const uart_port_config_t uart_port_configs[UART_PORT_COUNT] = UART_PORTS;
+static uart_port_ctx_t uart_ports[UART_PORT_COUNT];
+/* Every port's event queue, the reactor sleeps on it. Each handle it gives back is matched by
+ * exactly one receive, so the port queues are never reset or drained */
+static QueueSetHandle_t uart_event_set = NULL;
+#if ( UART_FRAMED != 1 )
+static uint8_t uart_rx_record[UART_BUF_SIZE];   /* Staging record of text lines, reactor only */
+#endif
+static portMUX_TYPE uart_stats_lock = portMUX_INITIALIZER_UNLOCKED;
+#if ( UART_FRAMED == 1 )
+/* Port each node was last heard on, (node ID << 8) | (port + 1) at node ID % UART_NODE_MAP_SIZE,
+ * 0 when empty. Written by the reactor, read lock free by the senders */
+static volatile uint32_t uart_node_ports[UART_NODE_MAP_SIZE];
+#endif
 static TaskHandle_t uart_task_handle = NULL;
+static TaskHandle_t uart_rx_notify_task = NULL;
+static uint32_t uart_rx_notify_bits = 0;
+
+static int uart_send_message(const uint8_t *data, size_t len, uint32_t *written);
+
+/**
+ * @brief Write node ID and type behind the len message bytes of record
+ *
+ * @return Record length
+ */
+static size_t uart_record_tail(uint8_t *record, size_t len, uint16_t node_id, uart_msg_type_t type)
+{
+    record[len] = (uint8_t)(node_id >> 8);
+    record[len + 1] = (uint8_t)node_id;
+    record[len + 2] = (uint8_t)type;
+
+    return len + UART_RECORD_TAIL;
+}
 
 /**
- * @brief UART task function
+ * @brief Append a record to the message buffer
+ *
+ * @param record Message bytes followed by the record tail
+ * @param len    Record length
+ * @param wait   Ticks to wait for space
+ * @return true if stored
+ */
+static bool uart_put_record(const uint8_t *record, size_t len, TickType_t wait)
+{
+    return xMessageBufferSend(uart_msg_buffer, record, len, wait) == len;
+}
+
+static void uart_count_oversized(uart_port_ctx_t *port)
+{
+    taskENTER_CRITICAL(&uart_stats_lock);
+    port->stats.oversized++;
+    taskEXIT_CRITICAL(&uart_stats_lock);
+}
+
+#if ( UART_FRAMED == 1 )
+/**
+ * @brief Remember the port a node's data came in on, downlink frames take the same way
+ */
+static void uart_node_learn(uint16_t node_id, size_t port)
+{
+    uint32_t entry = ((uint32_t)node_id << 8) | (uint32_t)(port + 1);
+
+    if (uart_node_ports[node_id % UART_NODE_MAP_SIZE] != entry)
+        uart_node_ports[node_id % UART_NODE_MAP_SIZE] = entry;
+}
+
+/**
+ * @brief Port a node was last heard on
+ *
+ * @return Index in UART_PORTS, or UART_PORT_ALL when unknown
+ */
+static size_t uart_node_port(uint16_t node_id)
+{
+    uint32_t entry = uart_node_ports[node_id % UART_NODE_MAP_SIZE];
+
+    if (entry == 0 || (uint16_t)(entry >> 8) != node_id)
+        return UART_PORT_ALL;
+    return (entry & 0xFF) - 1;
+}
+#endif
+
+/**
+ * @brief Splitter callback, queue one line or frame
+ *
+ * @param msg Message without its delimiter, a slice of the port's rx_buf
+ * @param len Message length
+ * @param ctx uart_port_ctx_t it came in on
+ */
+static void uart_queue_message(uint8_t *msg, size_t len, void *ctx)
+{
+    uart_port_ctx_t *port = ctx;
+    uint16_t node_id = BRIDGE_NODE_NONE;
+    uint8_t *out;
+
+#if ( UART_FRAMED == 1 )
+    // Back-to-back delimiters are the node flushing a partial frame, not an error
+    if (len == 0)
+        return;
+
+    bridge_frame_t frame;
+    if (!bridge_frame_decode(msg, len, &frame))
+    {
+        // Dropped, the delimiter already put the link back in sync
+        taskENTER_CRITICAL(&uart_stats_lock);
+        port->stats.errors++;
+        taskEXIT_CRITICAL(&uart_stats_lock);
+        ESP_LOGW(TAG, "Port %d: bad frame of %d bytes dropped", (int)port->index, (int)len);
+        uart_baud_on_error(port->index);
+        return;
+    }
+
+    uint16_t lost = bridge_frame_track(&port->rx_seq, frame.seq);
+    taskENTER_CRITICAL(&uart_stats_lock);
+    port->stats.frames++;
+    port->stats.lost += lost;
+    taskEXIT_CRITICAL(&uart_stats_lock);
+#if ( UART_CREDIT_ENABLE == 1 )
+    uart_credit_on_frame(port->index, frame.seq);
+#endif
+
+    uart_baud_on_frame(port->index, &frame);
+    if (frame.type != BRIDGE_FRAME_DATA)
+        return;
+
+    // Decoded in place: payload plus record tail take less than the encoded frame, no copy needed
+    node_id = frame.node_id;
+    len = frame.len;
+    out = msg;
+    memmove(out, frame.payload, len);
+    if (node_id != BRIDGE_NODE_NONE)
+        uart_node_learn(node_id, port->index);
+#else
+    while (len > 0 && msg[len - 1] == '\r')
+        len--;
+    if (len == 0)
+        return;
+    // A line only gives its '\n' to the tail, staged
+    out = uart_rx_record;
+#endif
+    if (len > UART_BUF_SIZE - UART_RECORD_TAIL)
+    {
+        ESP_LOGW(TAG, "Port %d: message of %d bytes dropped", (int)port->index, (int)len);
+        uart_count_oversized(port);
+        return;
+    }
+#if ( UART_FRAMED != 1 )
+    memcpy(out, msg, len);
+#endif
+
+    if( !uart_put_record(out, uart_record_tail(out, len, node_id, UART_MSG_RECEIVED), pdMS_TO_TICKS(10)) )
+    {
+        ESP_LOGE(TAG, "Failed to send received data to queue");
+        taskENTER_CRITICAL(&uart_stats_lock);
+        port->stats.rx_dropped++;
+        taskEXIT_CRITICAL(&uart_stats_lock);
+    } else
+    {
+        ESP_LOGI(TAG, "Port %d: received %d bytes, sent to queue", (int)port->index, (int)len);
+        if (uart_rx_notify_task != NULL)
+            xTaskNotify(uart_rx_notify_task, uart_rx_notify_bits, eSetBits);
+    }
+}
+
+#if ( UART_FRAMED == 1 )
+/**
+ * @brief Whether every baud switch queued for a port was made, the reactor may read it again
+ *
+ * The splitter is reset once the last switch is out, its partial message
+ * was sampled at the old rate.
+ */
+static bool uart_switch_settled(uart_port_ctx_t *port)
+{
+    static uint32_t settled[UART_PORT_COUNT];   /* switch_made when last settled, reactor only */
+    uint32_t made = port->switch_made;
+
+    if (made != port->switch_queued)
+        return false;
+    if (settled[port->index] != made) {
+        settled[port->index] = made;
+        uart_splitter_reset(&port->rx_splitter);
+    }
+    return true;
+}
+
+/**
+ * @brief Make a baud rate switch, from the uart_tx task
+ *
+ * Queued behind the link frames before it, so it happens once they are out.
+ */
+static void uart_make_switch(uart_port_ctx_t *port, uint32_t baud, bool send_break)
+{
+    static const uint8_t delimiter = BRIDGE_FRAME_DELIMITER;
+
+    // Under the TX lock, no frame is cut by the switch
+    xSemaphoreTake(port->tx_lock, portMAX_DELAY);
+    if (send_break)
+        uart_write_bytes_with_break(port->num, (const char *)&delimiter, 1, UART_BAUD_BREAK_BITS);
+    uart_wait_tx_done(port->num, pdMS_TO_TICKS(100));
+    uart_set_baudrate(port->num, baud);
+    uart_flush_input(port->num);
+    uart_pattern_queue_reset(port->num, UART_PATTERN_QUEUE_SIZE);
+    xSemaphoreGive(port->tx_lock);
+    port->switch_made++;
+
+    ESP_LOGI(TAG, "Port %d switched to %lu baud", (int)port->index, (unsigned long)baud);
+}
+
+/**
+ * @brief Write one record of uart_link_buffer, from the uart_tx task
+ */
+static void uart_send_link(const uint8_t *record, size_t len)
+{
+    if (len < 2 || record[1] >= UART_PORT_COUNT)
+        return;
+
+    uart_port_ctx_t *port = &uart_ports[record[1]];
+    if (record[0] == UART_LINK_SWITCH && len == 7)
+        uart_make_switch(port, bridge_get_u32(record + 2), record[6] != 0);
+    else if (record[0] == UART_LINK_FRAME && len >= UART_LINK_HEADER)
+        uart_send_frame(port->index, record[2], (uint16_t)((record[3] << 8) | record[4]),
+                        record + UART_LINK_HEADER, len - UART_LINK_HEADER);
+}
+
+/**
+ * @brief Append a record built in uart_link_record to uart_link_buffer, caller holds uart_link_lock
+ */
+static esp_err_t uart_queue_link(size_t len)
+{
+    if (xMessageBufferSend(uart_link_buffer, uart_link_record, len, 0) != len)
+        return ESP_ERR_TIMEOUT;
+    if (uart_tx_task_handle != NULL)
+        xTaskNotifyGive(uart_tx_task_handle);
+    return ESP_OK;
+}
+#endif
+
+/**
+ * @brief Read everything the driver buffered on a port, each complete message is queued
+ *
+ * A read can end anywhere: several messages, or the start of one, the
+ * splitter keeps the partial tail for the next read.
+ */
+static void uart_read_messages(uart_port_ctx_t *port)
+{
+    size_t buffered = 0;
+
+#if ( UART_FRAMED == 1 )
+    // Held until the uart_tx task made the switch, the bytes buffered meanwhile are flushed
+    if (!uart_switch_settled(port))
+        return;
+#endif
+
+    // The splitter finds the delimiters, the positions recorded by the driver only woke us
+    while (uart_pattern_pop_pos(port->num) != -1)
+        ;
+
+    uart_get_buffered_data_len(port->num, &buffered);
+    while (buffered > 0)
+    {
+#if ( UART_FRAMED == 1 )
+        // The rest was sent at the new rate, the switch flushes it
+        if (port->switch_queued != port->switch_made)
+            break;
+#endif
+        size_t room;
+        uint8_t *space = uart_splitter_space(&port->rx_splitter, &room);
+        int got = uart_read_bytes(port->num, space, buffered < room ? buffered : room, 0);
+        if (got <= 0)
+            break;
+        uart_splitter_feed(&port->rx_splitter, got, uart_queue_message, port);
+        buffered -= got;
+    }
+
+    if (port->rx_splitter.overflows != port->rx_overflows)
+    {
+        ESP_LOGW(TAG, "Port %d: no delimiter in %d bytes, message dropped", (int)port->index, UART_RX_SPLIT_SIZE);
+        port->rx_overflows = port->rx_splitter.overflows;
+        uart_count_oversized(port);
+    }
+}
+
+/**
+ * @brief Handle one driver event of a port
+ */
+static void uart_handle_event(uart_port_ctx_t *port, const uart_event_t *event)
+{
+    switch (event->type)
+    {
+        case UART_PATTERN_DET:
+        case UART_DATA:
+            // A delimiter arrived, or bytes after an RX timeout: whatever is complete goes now
+            uart_read_messages(port);
+            break;
+        case UART_FIFO_OVF:
+        case UART_BUFFER_FULL:
+            // Bytes were lost, the buffered lines can't be trusted. The events still queued
+            // stay, they find the buffer empty
+            ESP_LOGW(TAG, "Port %d: RX overflow, RX flushed", (int)port->index);
+            uart_flush_input(port->num);
+            uart_pattern_queue_reset(port->num, UART_PATTERN_QUEUE_SIZE);
+            uart_splitter_reset(&port->rx_splitter);
+            break;
+        case UART_FRAME_ERR:
+        case UART_PARITY_ERR:
+        case UART_BREAK:
+            // Line errors, as bad frames they may mean the rate doesn't hold
+            uart_baud_on_error(port->index);
+            break;
+        default:
+            break;
+    }
+}
+
+/**
+ * @brief UART reactor task, sleeps on the event queues of every port at once
  * 
  * @param pvParameters Task parameters
  */
 static void uart_task(void *pvParameters) 
 {
-    uart_queue_msg_t rx_msg;
-    uint8_t rx_buffer[UART_BUF_SIZE];
+    uart_event_t event;
+
+    for (size_t i = 0; i < UART_PORT_COUNT; i++)
+        uart_splitter_init(&uart_ports[i].rx_splitter, uart_ports[i].rx_buf, UART_RX_SPLIT_SIZE, UART_PATTERN_CHR);
+    uart_baud_start();
     
     while (1) 
     {
-        // Check for received data
-        int len = uart_read_bytes(UART_PORT_NUM, rx_buffer, UART_BUF_SIZE, UART_READ_TIMEOUT);
-        if (len > 0) 
+        // Woken by a driver, or by the next timeout of the baud rate negotiation or flow control
+        TickType_t wait = uart_baud_poll();
+#if ( UART_CREDIT_ENABLE == 1 )
+        TickType_t refresh = uart_credit_poll(xMessageBufferSpacesAvailable(uart_msg_buffer));
+        if (refresh < wait)
+            wait = refresh;
+#endif
+        QueueSetMemberHandle_t ready = xQueueSelectFromSet(uart_event_set, wait);
+        if (ready == NULL)
+            continue;
+
+        for (size_t i = 0; i < UART_PORT_COUNT; i++)
         {
-            // Data received, create message and send to queue
-            rx_msg.msg_type = UART_MSG_RECEIVED;
-            memcpy(rx_msg.data, rx_buffer, len);
-            rx_msg.data_len = len;
-            
-            if( xQueueSendFromISR(uart_queue, &rx_msg, pdMS_TO_TICKS(10)) != pdPASS ) 
+            if (uart_ports[i].event_queue == ready)
             {
-                ESP_LOGE(TAG, "Failed to send received data to queue");
-            } else 
+                if (xQueueReceive(uart_ports[i].event_queue, &event, 0) == pdPASS)
+                    uart_handle_event(&uart_ports[i], &event);
+                break;
+            }
+        }
+    }
+}
+
+/**
+ * @brief uart_tx task, writes the queued messages and reports when they are out
+ *
+ * @param pvParameters Task parameters
+ */
+static void uart_tx_task(void *pvParameters)
+{
+    static uint8_t tx_msg[UART_TX_MSG_MAX];
+    uint32_t written = 0;   /* Ports written since the last notification, bit per index */
+
+    while (1)
+    {
+#if ( UART_FRAMED == 1 )
+        // Link records first, a credit grant or a baud switch doesn't wait behind a burst of commands
+        static uint8_t link_msg[UART_LINK_RECORD_MAX];
+        size_t link_len = xMessageBufferReceive(uart_link_buffer, link_msg, sizeof(link_msg), 0);
+        if (link_len > 0)
+        {
+            uart_send_link(link_msg, link_len);
+            continue;
+        }
+#endif
+        size_t len = xMessageBufferReceive(uart_tx_buffer, tx_msg, sizeof(tx_msg), 0);
+        if (len == 0)
+        {
+            // Both empty, every writer notifies after queueing
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+
+        uart_send_message(tx_msg, len, &written);
+
+        // A burst is written back to back, the notification waits for its end on the ports it went to
+        if (xMessageBufferIsEmpty(uart_tx_buffer) == pdTRUE && uart_tx_notify_task != NULL)
+        {
+            for (size_t i = 0; i < UART_PORT_COUNT; i++)
             {
-                ESP_LOGI(TAG, "Received %d bytes, sent to queue", len);
+                if (written & (1UL << i))
+                    uart_wait_tx_done(uart_ports[i].num, UART_TX_DONE_TIMEOUT);
             }
+            written = 0;
+            xTaskNotify(uart_tx_notify_task, uart_tx_notify_bits, eSetBits);
         }
-        
-        // Small delay to prevent CPU hogging
-        vTaskDelay(pdMS_TO_TICKS(10));
     }
 }
 
-esp_err_t uart_init(void) 
+/**
+ * @brief Undo uart_port_init(), in reverse order
+ */
+static void uart_port_deinit(uart_port_ctx_t *port)
+{
+    if (port->event_queue != NULL)
+    {
+        // Out of the set before the driver deletes the queue, only an empty queue can leave
+        xQueueReset(port->event_queue);
+        xQueueRemoveFromSet(port->event_queue, uart_event_set);
+        uart_driver_delete(port->num);
+        port->event_queue = NULL;
+    }
+#if ( UART_FRAMED == 1 )
+    if (port->tx_lock != NULL)
+    {
+        vSemaphoreDelete(port->tx_lock);
+        port->tx_lock = NULL;
+    }
+#endif
+}
+
+/**
+ * @brief Delete what uart_init() created before the ports, in reverse order
+ */
+static void uart_free(void)
+{
+#if ( UART_FRAMED == 1 )
+    if (uart_link_lock != NULL)
+        vSemaphoreDelete(uart_link_lock);
+    if (uart_link_buffer != NULL)
+        vMessageBufferDelete(uart_link_buffer);
+    uart_link_lock = NULL;
+    uart_link_buffer = NULL;
+#endif
+    if (uart_event_set != NULL)
+        vQueueDelete(uart_event_set);
+    if (uart_tx_queue_lock != NULL)
+        vSemaphoreDelete(uart_tx_queue_lock);
+    if (uart_tx_buffer != NULL)
+        vMessageBufferDelete(uart_tx_buffer);
+    if (uart_msg_buffer != NULL)
+        vMessageBufferDelete(uart_msg_buffer);
+    uart_event_set = NULL;
+    uart_tx_queue_lock = NULL;
+    uart_tx_buffer = NULL;
+    uart_msg_buffer = NULL;
+}
+
+/**
+ * @brief Install and configure the driver of one port, the driver is deleted again on failure
+ */
+static esp_err_t uart_port_init(uart_port_ctx_t *port, const uart_port_config_t *config)
 {
     // Configure UART parameters
     uart_config_t uart_config = 
@@ -61,45 +526,101 @@ esp_err_t uart_init(void)
         .flow_ctrl = UART_HW_FLOWCTRL_DISABLE,
     };
 
-    // Create queue for UART messages
-    uart_queue = xQueueCreate(UART_QUEUE_SIZE, sizeof(uart_queue_msg_t));
-    if (uart_queue == NULL) 
+    port->num = config->num;
+#if ( UART_FRAMED == 1 )
+    port->tx_lock = xSemaphoreCreateMutex();
+    if (port->tx_lock == NULL)
     {
-        ESP_LOGE(TAG, "Failed to create UART queue");
+        ESP_LOGE(TAG, "Failed to create UART TX lock");
         return ESP_FAIL;
     }
+#endif
 
-    // Install and configure UART driver
-    esp_err_t ret = uart_driver_install(UART_PORT_NUM, UART_BUF_SIZE * 2, 0, 0, NULL, 0);
+    esp_err_t ret = uart_driver_install(port->num, UART_BUF_SIZE * 2, UART_TX_RING_SIZE, UART_EVENT_QUEUE_SIZE, &port->event_queue, 0);
     if (ret != ESP_OK) 
     {
-        ESP_LOGE(TAG, "UART driver install failed");
-        vQueueDelete(uart_queue);
-        uart_queue = NULL;
+        ESP_LOGE(TAG, "UART %d driver install failed", (int)port->num);
+        port->event_queue = NULL;
+        uart_port_deinit(port);
         return ret;
     }
+    // Joined while still empty, before any pin is connected
+    if (xQueueAddToSet(port->event_queue, uart_event_set) != pdPASS)
+    {
+        ESP_LOGE(TAG, "UART %d event queue not added to the reactor", (int)port->num);
+        uart_port_deinit(port);
+        return ESP_FAIL;
+    }
 
-    ret = uart_param_config(UART_PORT_NUM, &uart_config);
+    ret = uart_param_config(port->num, &uart_config);
     if (ret != ESP_OK) 
     {
-        ESP_LOGE(TAG, "UART parameter config failed");
-        uart_driver_delete(UART_PORT_NUM);
-        vQueueDelete(uart_queue);
-        uart_queue = NULL;
+        ESP_LOGE(TAG, "UART %d parameter config failed", (int)port->num);
+        uart_port_deinit(port);
         return ret;
     }
 
-    ret = uart_set_pin(UART_PORT_NUM, UART_TX_PIN, UART_RX_PIN, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE);
+    ret = uart_set_pin(port->num, config->tx_pin, config->rx_pin, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE);
     if (ret != ESP_OK) 
     {
-        ESP_LOGE(TAG, "UART set pin failed");
-        uart_driver_delete(UART_PORT_NUM);
-        vQueueDelete(uart_queue);
-        uart_queue = NULL;
+        ESP_LOGE(TAG, "UART %d set pin failed", (int)port->num);
+        uart_port_deinit(port);
         return ret;
     }
 
-    ESP_LOGI(TAG, "UART initialized successfully");
+    // Delimiters raise UART_PATTERN_DET, a complete message is read as soon as it arrived
+    ret = uart_enable_pattern_det_baud_intr(port->num, UART_PATTERN_CHR, UART_PATTERN_CHR_NUM, UART_PATTERN_CHR_TOUT, 0, 0);
+    if (ret == ESP_OK)
+        ret = uart_pattern_queue_reset(port->num, UART_PATTERN_QUEUE_SIZE);
+    if (ret != ESP_OK) 
+    {
+        ESP_LOGE(TAG, "UART %d pattern detection failed", (int)port->num);
+        uart_port_deinit(port);
+        return ret;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t uart_init(void) 
+{
+    // Create the message buffer for UART messages, it holds only the bytes of each message
+    uart_msg_buffer = xMessageBufferCreate(UART_MSG_BUFFER_SIZE);
+    uart_tx_buffer = xMessageBufferCreate(UART_TX_MSG_BUFFER_SIZE);
+    uart_tx_queue_lock = xSemaphoreCreateMutex();
+    uart_event_set = xQueueCreateSet(UART_PORT_COUNT * UART_EVENT_QUEUE_SIZE);
+#if ( UART_FRAMED == 1 )
+    uart_link_buffer = xMessageBufferCreate(UART_LINK_BUFFER_SIZE);
+    uart_link_lock = xSemaphoreCreateMutex();
+    if (uart_link_buffer == NULL || uart_link_lock == NULL)
+    {
+        ESP_LOGE(TAG, "Failed to create UART link buffer");
+        uart_free();
+        return ESP_FAIL;
+    }
+#endif
+    if (uart_msg_buffer == NULL || uart_tx_buffer == NULL || uart_tx_queue_lock == NULL || uart_event_set == NULL) 
+    {
+        ESP_LOGE(TAG, "Failed to create UART message buffer");
+        uart_free();
+        return ESP_FAIL;
+    }
+
+    for (size_t i = 0; i < UART_PORT_COUNT; i++)
+    {
+        uart_ports[i].index = i;
+        esp_err_t ret = uart_port_init(&uart_ports[i], &uart_port_configs[i]);
+        if (ret != ESP_OK)
+        {
+            // The failed port freed itself
+            while (i-- > 0)
+                uart_port_deinit(&uart_ports[i]);
+            uart_free();
+            return ret;
+        }
+    }
+
+    ESP_LOGI(TAG, "UART initialized successfully, %d ports", UART_PORT_COUNT);
     return ESP_OK;
 }
 
@@ -113,7 +634,7 @@ esp_err_t uart_start_task(void)
         return ESP_ERR_INVALID_STATE;
     }
 
-    if (uart_queue == NULL) 
+    if (uart_msg_buffer == NULL) 
     {
         ESP_LOGE(TAG, "UART not initialized");
         return ESP_ERR_INVALID_STATE;
@@ -135,37 +656,203 @@ esp_err_t uart_start_task(void)
         return ESP_FAIL;
     }
 
+    task_created = xTaskCreatePinnedToCore(
+        uart_tx_task,
+        "uart_tx",
+        UART_TX_TASK_STACK_SIZE,
+        NULL,
+        UART_TX_TASK_PRIORITY,
+        &uart_tx_task_handle,
+        0
+    );
+
+    if (task_created != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create UART TX task");
+        return ESP_FAIL;
+    }
+
     ESP_LOGI(TAG, "UART task started");
     return ESP_OK;
 }
 
-int uart_send_data(const uint8_t *data, size_t len) {
+/**
+ * @brief uart_send_data(), the ports written are added to *written as bits of their index
+ */
+static int uart_send_message(const uint8_t *data, size_t len, uint32_t *written) {
     if (data == NULL || len == 0) {
         ESP_LOGE(TAG, "Invalid send parameters");
         return -1;
     }
 
-    int bytes_sent = uart_write_bytes(UART_PORT_NUM, (const char *)data, len);
+    size_t first = 0, last = UART_PORT_COUNT;
+#if ( UART_FRAMED == 1 )
+    // "<node id><command>" as the control sources build it, the digits go to the header
+    uint32_t node_id = 0;
+    size_t digits = 0;
+    while (digits < len && digits < 5 && data[digits] >= '0' && data[digits] <= '9')
+        node_id = node_id * 10 + (data[digits++] - '0');
+    if (digits == 0 || node_id >= BRIDGE_NODE_NONE) {
+        node_id = BRIDGE_NODE_NONE;
+        digits = 0;
+    }
+
+    // Only the bridge the node was heard behind, every bridge until then
+    size_t target = (node_id != BRIDGE_NODE_NONE) ? uart_node_port((uint16_t)node_id) : UART_PORT_ALL;
+    if (target != UART_PORT_ALL) {
+        first = target;
+        last = target + 1;
+    }
+#endif
+
+    int bytes_sent = -1;
+    for (size_t i = first; i < last; i++) {
+#if ( UART_FRAMED == 1 )
+        int sent = uart_send_frame(i, BRIDGE_FRAME_CONTROL, (uint16_t)node_id, data + digits, len - digits);
+#else
+        int sent = uart_write_bytes(uart_ports[i].num, (const char *)data, len);
+#endif
+        if (sent < 0)
+            continue;
+        bytes_sent = sent;
+        if (written != NULL)
+            *written |= 1UL << i;
+        taskENTER_CRITICAL(&uart_stats_lock);
+        uart_ports[i].stats.tx_sent++;
+        taskEXIT_CRITICAL(&uart_stats_lock);
+    }
     if (bytes_sent < 0) {
         ESP_LOGE(TAG, "Failed to send data");
         return -1;
     }
 
-    // Create send message for queue (optional, to inform other components)
-    uart_queue_msg_t tx_msg;
-    tx_msg.msg_type = UART_MSG_SEND;
-    memcpy(tx_msg.data, data, len);
-    tx_msg.data_len = len;
-    
-    if (xQueueSend(uart_queue, &tx_msg, 0) != pdPASS) {
-        ESP_LOGW(TAG, "Failed to send TX event to queue");
-        // Continue anyway since data was sent successfully
+    ESP_LOGI(TAG, "Sent %d bytes", bytes_sent);
+    return bytes_sent;
+}
+
+int uart_send_data(const uint8_t *data, size_t len) {
+    return uart_send_message(data, len, NULL);
+}
+
+esp_err_t uart_send_async(const uint8_t *data, size_t len, TickType_t wait) {
+    if (data == NULL || len == 0 || len > UART_TX_MSG_MAX || uart_tx_buffer == NULL)
+        return ESP_ERR_INVALID_ARG;
+
+    xSemaphoreTake(uart_tx_queue_lock, portMAX_DELAY);
+    size_t queued = xMessageBufferSend(uart_tx_buffer, data, len, wait);
+    xSemaphoreGive(uart_tx_queue_lock);
+    if (queued == len && uart_tx_task_handle != NULL)
+        xTaskNotifyGive(uart_tx_task_handle);
+
+    if (queued != len) {
+        taskENTER_CRITICAL(&uart_stats_lock);
+        uart_tx_full++;
+        taskEXIT_CRITICAL(&uart_stats_lock);
+        return ESP_ERR_TIMEOUT;
     }
 
-    ESP_LOGI(TAG, "Sent %d bytes", bytes_sent);
+    return ESP_OK;
+}
+
+void uart_set_tx_notify(TaskHandle_t task, uint32_t notify_bits) {
+    uart_tx_notify_bits = notify_bits;
+    uart_tx_notify_task = task;
+}
+
+#if ( UART_FRAMED == 1 )
+int uart_send_frame(size_t port, uint8_t type, uint16_t node_id, const uint8_t *payload, size_t len) {
+    if (port >= UART_PORT_COUNT)
+        return -1;
+
+    uart_port_ctx_t *ctx = &uart_ports[port];
+    xSemaphoreTake(ctx->tx_lock, portMAX_DELAY);
+    size_t frame_len = bridge_frame_encode(type, node_id, ctx->tx_seq++, payload, len,
+                                           ctx->tx_frame, sizeof(ctx->tx_frame));
+    int bytes_sent = (frame_len > 0) ? uart_write_bytes(ctx->num, (const char *)ctx->tx_frame, frame_len) : -1;
+    xSemaphoreGive(ctx->tx_lock);
+
     return bytes_sent;
 }
 
-QueueHandle_t uart_get_queue(void) {
-    return uart_queue;
+esp_err_t uart_queue_frame(size_t port, uint8_t type, uint16_t node_id, const uint8_t *payload, size_t len) {
+    if (port >= UART_PORT_COUNT || len > UART_LINK_PAYLOAD_MAX || (payload == NULL && len > 0) || uart_link_buffer == NULL)
+        return ESP_ERR_INVALID_ARG;
+
+    xSemaphoreTake(uart_link_lock, portMAX_DELAY);
+    uart_link_record[0] = UART_LINK_FRAME;
+    uart_link_record[1] = (uint8_t)port;
+    uart_link_record[2] = type;
+    uart_link_record[3] = (uint8_t)(node_id >> 8);
+    uart_link_record[4] = (uint8_t)node_id;
+    if (len > 0)
+        memcpy(uart_link_record + UART_LINK_HEADER, payload, len);
+    esp_err_t ret = uart_queue_link(UART_LINK_HEADER + len);
+    xSemaphoreGive(uart_link_lock);
+
+    return ret;
+}
+
+void uart_switch_baud(size_t port, uint32_t baud, bool send_break) {
+    if (port >= UART_PORT_COUNT || uart_link_buffer == NULL)
+        return;
+
+    // Made by the uart_tx task behind the frames queued before, the reactor may be inside the splitter
+    xSemaphoreTake(uart_link_lock, portMAX_DELAY);
+    uart_link_record[0] = UART_LINK_SWITCH;
+    uart_link_record[1] = (uint8_t)port;
+    bridge_put_u32(uart_link_record + 2, baud);
+    uart_link_record[6] = send_break ? 1 : 0;
+    if (uart_queue_link(7) == ESP_OK)
+        uart_ports[port].switch_queued++;
+    else
+        ESP_LOGE(TAG, "Port %d: link buffer full, switch to %lu baud lost", (int)port, (unsigned long)baud);
+    xSemaphoreGive(uart_link_lock);
+}
+#endif
+
+void uart_set_rx_notify(TaskHandle_t task, uint32_t notify_bits) {
+    uart_rx_notify_bits = notify_bits;
+    uart_rx_notify_task = task;
+}
+
+bool uart_receive(uart_queue_msg_t *msg, TickType_t wait) {
+    // Straight into msg->data, the tail is the last bytes of the record
+    size_t len = xMessageBufferReceive(uart_msg_buffer, msg->data, UART_BUF_SIZE, wait);
+    if (len < UART_RECORD_TAIL)
+        return false;
+
+    msg->msg_type = (uart_msg_type_t)msg->data[len - 1];
+    msg->node_id = (uint16_t)((msg->data[len - 3] << 8) | msg->data[len - 2]);
+    msg->data_len = len - UART_RECORD_TAIL;
+#if ( UART_CREDIT_ENABLE == 1 )
+    // Room again, the nodes may send what they held back
+    uart_credit_update(xMessageBufferSpacesAvailable(uart_msg_buffer));
+#endif
+    return true;
+}
+
+void uart_get_frame_stats(size_t port, uart_frame_stats_t *stats) {
+    if (stats == NULL || port > UART_PORT_ALL)
+        return;
+
+    taskENTER_CRITICAL(&uart_stats_lock);
+    if (port != UART_PORT_ALL) {
+        *stats = uart_ports[port].stats;
+    } else {
+        memset(stats, 0, sizeof(*stats));
+        for (size_t i = 0; i < UART_PORT_COUNT; i++) {
+            const uart_frame_stats_t *s = &uart_ports[i].stats;
+            stats->frames += s->frames;
+            stats->errors += s->errors;
+            stats->lost += s->lost;
+            stats->oversized += s->oversized;
+            stats->rx_dropped += s->rx_dropped;
+            stats->tx_sent += s->tx_sent;
+        }
+    }
+    stats->tx_full = uart_tx_full;
+    taskEXIT_CRITICAL(&uart_stats_lock);
+}
+
+bool uart_is_started(void) {
+    return uart_msg_buffer != NULL;
 }
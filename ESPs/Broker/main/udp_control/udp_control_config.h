@@ -0,0 +1,27 @@
+/**
+ * @file udp_control_config.h
+ * @brief UDP control ingress configuration
+ */
+#ifndef UDP_CONTROL_CONFIG_H
+#define UDP_CONTROL_CONFIG_H
+
+#include "Network/sendData/sendData.h"
+
+/**
+ * @brief Listener parameters
+ */
+#define UDP_CONTROL_ENABLE           1
+#define UDP_CONTROL_PORT             NETWORK_STA_RECEIVE_DATA_UDP_PORT_NUM
+#define UDP_CONTROL_KEY_MIN          16     /* Shortest pre-shared HMAC key accepted, bytes */
+#define UDP_CONTROL_KEY_MAX          64
+#define UDP_CONTROL_REPLAY_WINDOW    64     /* Sequence numbers accepted out of order, at most 64 */
+#define UDP_CONTROL_SEQ_CHECKPOINT   32     /* Accepted datagrams between two NVS writes of the replay floor */
+
+/**
+ * @brief Listener task configuration
+ */
+#define UDP_CONTROL_TASK_STACK_SIZE  (1024*4)
+#define UDP_CONTROL_TASK_PRIORITY    6
+#define UDP_CONTROL_TASK_CORE_ID     0
+
+#endif /* UDP_CONTROL_CONFIG_H */
@@ -0,0 +1,66 @@
+/**
+ * @file udp_control_interface.h
+ * @brief One hop control ingress on UDP_CONTROL_PORT
+ *
+ * Latency critical commands can skip the Pi -> MQTT broker -> ESP path: a
+ * datagram goes straight into the control ring of the dispatcher.
+ *
+ * Datagram, big endian:
+ *   'W' 'C' | version 1 | 0 | seq:4 | node id:2 | command | tag:16
+ * Acknowledgement sent back to the source port:
+ *   'W' 'A' | version 1 | status | seq:4 | highest seq:4 | tag:16
+ *
+ * tag is HMAC-SHA256 with the pre-shared key over the bytes before it,
+ * truncated to 16 bytes. Datagrams with a bad tag are dropped silently.
+ * The key is not part of the firmware: it is read from the blob "hmac_key"
+ * in the "udp_control" NVS namespace (UDP_CONTROL_KEY_MIN..UDP_CONTROL_KEY_MAX
+ * bytes, the gateway's CONTROL_UDP_KEY), provisioned with an NVS partition
+ * image. Without it the listener doesn't start.
+ * Sequence numbers are checked against a sliding window of
+ * UDP_CONTROL_REPLAY_WINDOW, so every datagram is accepted once. A floor
+ * kept in NVS carries the protection across reboots, it is written before
+ * a datagram above it is queued or acknowledged; a sender whose seq
+ * falls below it gets UDP_CONTROL_REPLAY with the highest seq and
+ * continues above it.
+ */
+#ifndef UDP_CONTROL_INTERFACE_H
+#define UDP_CONTROL_INTERFACE_H
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "udp_control_config.h"
+
+/**
+ * @brief Acknowledgement status
+ */
+typedef enum {
+    UDP_CONTROL_OK = 0,        /* Queued for the UART bridge */
+    UDP_CONTROL_REPLAY,        /* seq already seen or below the window */
+    UDP_CONTROL_NO_ROUTE,      /* Node never heard on the UART bridge */
+    UDP_CONTROL_DROPPED,       /* Control ring full or command too large */
+} udp_control_status_t;
+
+/**
+ * @brief Listener counters
+ */
+typedef struct {
+    uint32_t accepted;
+    uint32_t bad_tag;          /* Malformed or failed authentication */
+    uint32_t replayed;
+    uint32_t dropped;          /* No route, ring full or too large */
+} udp_control_stats_t;
+
+/**
+ * @brief Load the key and replay floor from NVS and start the listener task
+ *
+ * @return ESP_OK on success, ESP_ERR_NOT_FOUND if no key is provisioned,
+ *         ESP_FAIL if the socket or task can't be created
+ */
+esp_err_t udp_control_start(void);
+
+/**
+ * @brief Copy the listener counters
+ */
+void udp_control_get_stats(udp_control_stats_t *stats);
+
+#endif /* UDP_CONTROL_INTERFACE_H */
@@ -0,0 +1,292 @@
+/**
+ * @file udp_control_program.c
+ * @brief One hop control ingress on UDP_CONTROL_PORT
+ */
+#include <string.h>
+#include <errno.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "nvs.h"
+#include "mbedtls/md.h"
+#include "lwip/sockets.h"
+
+#include "udp_control_interface.h"
+#include "control/control_interface.h"
+#include "mqtt/route/route.h"
+
+#define UDP_CONTROL_VERSION       1
+#define UDP_CONTROL_HEADER_SIZE   10    /* magic, version, flags, seq, node id */
+#define UDP_CONTROL_TAG_SIZE      16
+#define UDP_CONTROL_ACK_SIZE      (12 + UDP_CONTROL_TAG_SIZE)
+#define UDP_CONTROL_NVS_NAMESPACE "udp_control"
+#define UDP_CONTROL_NVS_KEY       "seq_floor"
+#define UDP_CONTROL_NVS_HMAC_KEY  "hmac_key"
+
+static const char *TAG = "UDP_CONTROL";
+
+static int g_sock = -1;
+static uint8_t g_key[UDP_CONTROL_KEY_MAX];   /* Pre-shared HMAC key, from NVS */
+static size_t g_key_len = 0;
+static uint32_t g_highest = 0;        /* Highest accepted seq */
+static uint64_t g_window = ~0ULL;     /* Bit i set: seq g_highest - i was accepted */
+static uint32_t g_checkpoint = 0;     /* Floor stored in NVS, >= every seq accepted so far */
+static portMUX_TYPE g_stats_lock = portMUX_INITIALIZER_UNLOCKED;
+static udp_control_stats_t g_stats;
+
+static inline uint32_t get_u32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static inline void put_u32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+}
+
+static void udp_control_tag(const uint8_t *data, size_t len, uint8_t *tag)
+{
+    uint8_t mac[32];
+
+    mbedtls_md_hmac(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256),
+                    g_key, g_key_len, data, len, mac);
+    memcpy(tag, mac, UDP_CONTROL_TAG_SIZE);
+}
+
+/* Constant time, the compare must not tell how many tag bytes were right */
+static bool udp_control_tag_ok(const uint8_t *data, size_t len, const uint8_t *tag)
+{
+    uint8_t expected[UDP_CONTROL_TAG_SIZE];
+    uint8_t diff = 0;
+
+    udp_control_tag(data, len, expected);
+    for (int i = 0; i < UDP_CONTROL_TAG_SIZE; i++)
+        diff |= expected[i] ^ tag[i];
+
+    return diff == 0;
+}
+
+/* Sliding window check, marks seq as seen when it is new */
+static bool udp_control_fresh(uint32_t seq)
+{
+    if (seq == 0)
+        return false;
+
+    if (seq > g_highest) {
+        uint32_t shift = seq - g_highest;
+        g_window = (shift >= 64) ? 1 : ((g_window << shift) | 1);
+        g_highest = seq;
+        return true;
+    }
+
+    uint32_t age = g_highest - seq;
+    if (age >= UDP_CONTROL_REPLAY_WINDOW || (g_window & (1ULL << age)))
+        return false;
+    g_window |= 1ULL << age;
+    return true;
+}
+
+static esp_err_t udp_control_store_floor(uint32_t floor)
+{
+    nvs_handle_t nvs;
+
+    esp_err_t err = nvs_open(UDP_CONTROL_NVS_NAMESPACE, NVS_READWRITE, &nvs);
+    if (err != ESP_OK)
+        return err;
+    err = nvs_set_u32(nvs, UDP_CONTROL_NVS_KEY, floor);
+    if (err == ESP_OK)
+        err = nvs_commit(nvs);
+    nvs_close(nvs);
+
+    return err;
+}
+
+static void udp_control_ack(const struct sockaddr_in *to, uint32_t seq, udp_control_status_t status)
+{
+    uint8_t ack[UDP_CONTROL_ACK_SIZE] = { 'W', 'A', UDP_CONTROL_VERSION, (uint8_t)status };
+
+    put_u32(ack + 4, seq);
+    put_u32(ack + 8, g_highest);
+    udp_control_tag(ack, 12, ack + 12);
+    sendto(g_sock, ack, sizeof(ack), 0, (const struct sockaddr *)to, sizeof(*to));
+}
+
+/* Command of an authenticated datagram to the control ring */
+static udp_control_status_t udp_control_queue(uint16_t node_id, const uint8_t *cmd, size_t len)
+{
+    const mqtt_route_t *route = mqtt_route_find(node_id);
+    if (route == NULL)
+        return UDP_CONTROL_NO_ROUTE;
+
+    if (len + route->id_len > CONTROL_FRAME_SIZE) {
+        control_drop_oversized(CONTROL_SRC_UDP);
+        return UDP_CONTROL_DROPPED;
+    }
+    control_frame_t *frame = control_reserve(CONTROL_SRC_UDP);
+    if (frame == NULL)
+        return UDP_CONTROL_DROPPED;
+    memcpy(frame->data, route->id_str, route->id_len);   /* Add node ID at first */
+    memcpy(frame->data + route->id_len, cmd, len);
+    frame->len = len + route->id_len;
+    control_commit(CONTROL_SRC_UDP);
+
+    return UDP_CONTROL_OK;
+}
+
+/* Checks and queues one datagram, false if it is malformed or fails authentication */
+static bool udp_control_handle(const uint8_t *rx, size_t len, uint32_t *seq, udp_control_status_t *status)
+{
+    if (len < UDP_CONTROL_HEADER_SIZE + UDP_CONTROL_TAG_SIZE || rx[0] != 'W' || rx[1] != 'C' ||
+        rx[2] != UDP_CONTROL_VERSION)
+        return false;
+    size_t body = len - UDP_CONTROL_TAG_SIZE;
+    if (!udp_control_tag_ok(rx, body, rx + body))
+        return false;
+
+    *seq = get_u32(rx + 4);
+    *status = UDP_CONTROL_REPLAY;
+    /*
+     * The floor goes to NVS before a seq at or above it is marked seen,
+     * queued or acked, after a reboot that seq must still count as seen.
+     * If the write fails the datagram is dropped and the sender retries.
+     */
+    if (*seq >= g_checkpoint) {
+        esp_err_t err = udp_control_store_floor(*seq + UDP_CONTROL_SEQ_CHECKPOINT);
+        if (err == ESP_OK) {
+            g_checkpoint = *seq + UDP_CONTROL_SEQ_CHECKPOINT;
+        } else {
+            ESP_LOGW(TAG, "Replay floor not stored (%s), seq %lu dropped", esp_err_to_name(err), (unsigned long)*seq);
+            *status = UDP_CONTROL_DROPPED;
+        }
+    }
+    if (*status == UDP_CONTROL_REPLAY && udp_control_fresh(*seq)) {
+        uint16_t node_id = ((uint16_t)rx[8] << 8) | rx[9];
+        *status = udp_control_queue(node_id, rx + UDP_CONTROL_HEADER_SIZE, body - UDP_CONTROL_HEADER_SIZE);
+    }
+
+    return true;
+}
+
+static void udp_control_task(void *pvParameters)
+{
+    static uint8_t rx[UDP_CONTROL_HEADER_SIZE + CONTROL_FRAME_SIZE + UDP_CONTROL_TAG_SIZE];
+
+    ESP_LOGI(TAG, "Listening for control datagrams on port %d", UDP_CONTROL_PORT);
+
+    while (1) {
+        struct sockaddr_in from;
+        socklen_t from_len = sizeof(from);
+        uint32_t seq;
+        udp_control_status_t status;
+        int len = recvfrom(g_sock, rx, sizeof(rx), 0, (struct sockaddr *)&from, &from_len);
+        if (len < 0) {
+            ESP_LOGE(TAG, "recvfrom failed, errno %d", errno);
+            vTaskDelay(pdMS_TO_TICKS(100));
+            continue;
+        }
+
+        if (!udp_control_handle(rx, (size_t)len, &seq, &status)) {
+            taskENTER_CRITICAL(&g_stats_lock);
+            g_stats.bad_tag++;
+            taskEXIT_CRITICAL(&g_stats_lock);
+            continue;
+        }
+        udp_control_ack(&from, seq, status);
+
+        taskENTER_CRITICAL(&g_stats_lock);
+        if (status == UDP_CONTROL_OK)
+            g_stats.accepted++;
+        else if (status == UDP_CONTROL_REPLAY)
+            g_stats.replayed++;
+        else
+            g_stats.dropped++;
+        taskEXIT_CRITICAL(&g_stats_lock);
+    }
+}
+
+/* Key and replay floor from NVS, ESP_ERR_NOT_FOUND without a usable key */
+static esp_err_t udp_control_load(void)
+{
+    nvs_handle_t nvs;
+
+    /* Everything up to the stored floor may have been accepted before the reboot */
+    g_key_len = 0;
+    g_checkpoint = 0;
+    if (nvs_open(UDP_CONTROL_NVS_NAMESPACE, NVS_READONLY, &nvs) == ESP_OK) {
+        size_t key_len = sizeof(g_key);
+        if (nvs_get_blob(nvs, UDP_CONTROL_NVS_HMAC_KEY, g_key, &key_len) == ESP_OK)
+            g_key_len = key_len;
+        if (nvs_get_u32(nvs, UDP_CONTROL_NVS_KEY, &g_checkpoint) != ESP_OK)
+            g_checkpoint = 0;
+        nvs_close(nvs);
+    }
+    /* No built in key, without a provisioned one the port stays closed */
+    if (g_key_len < UDP_CONTROL_KEY_MIN) {
+        ESP_LOGE(TAG, "No HMAC key of %d..%d bytes in NVS %s/%s, UDP control disabled",
+                 UDP_CONTROL_KEY_MIN, UDP_CONTROL_KEY_MAX, UDP_CONTROL_NVS_NAMESPACE, UDP_CONTROL_NVS_HMAC_KEY);
+        g_key_len = 0;
+        return ESP_ERR_NOT_FOUND;
+    }
+    g_highest = g_checkpoint;
+    g_window = ~0ULL;
+
+    return ESP_OK;
+}
+
+esp_err_t udp_control_start(void)
+{
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(UDP_CONTROL_PORT),
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+    };
+    esp_err_t err;
+
+    if (g_sock >= 0)
+        return ESP_OK;
+
+    err = udp_control_load();
+    if (err != ESP_OK)
+        return err;
+
+    g_sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (g_sock < 0) {
+        ESP_LOGE(TAG, "Failed to create the control socket");
+        return ESP_FAIL;
+    }
+    if (bind(g_sock, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        ESP_LOGE(TAG, "Failed to bind port %d, errno %d", UDP_CONTROL_PORT, errno);
+        close(g_sock);
+        g_sock = -1;
+        return ESP_FAIL;
+    }
+
+    BaseType_t task_created = xTaskCreatePinnedToCore(
+        udp_control_task,
+        "udp_control",
+        UDP_CONTROL_TASK_STACK_SIZE,
+        NULL,
+        UDP_CONTROL_TASK_PRIORITY,
+        NULL,
+        UDP_CONTROL_TASK_CORE_ID
+    );
+    if (task_created != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create UDP control task");
+        return ESP_FAIL;
+    }
+
+    return ESP_OK;
+}
+
+void udp_control_get_stats(udp_control_stats_t *stats)
+{
+    if (stats == NULL)
+        return;
+
+    taskENTER_CRITICAL(&g_stats_lock);
+    *stats = g_stats;
+    taskEXIT_CRITICAL(&g_stats_lock);
+}
@@ -0,0 +1,45 @@
+/**
+ * @file bench_bridge_frame.c
+ * @brief Framed bridge link against the newline terminated text link
+ *
+ * The text link sent "<node id><reading>\r\n" with Serial1.println. A frame
+ * adds the header, the CRC and the COBS overhead. Prints the encode and
+ * decode rate of the codec, and the readings per second each link carries
+ * at the supported baud rates (8N1, 10 bits per byte).
+ */
+#include <stdbool.h>
+#include <string.h>
+
+#include "host_test.h"
+#include "bridge_frame.h"
+
+int main(void)
+{
+    static const long bauds[] = { 115200, 460800, 921600, 2000000 };
+    const char *reading = "{\"temperature\": 55.3, \"humidity\": 65.2, \"light\": 350, \"pressure\": 1013.2}";
+    size_t len = strlen(reading);
+    uint8_t enc[BRIDGE_FRAME_MAX_ENCODED];
+    bridge_frame_decoder_t decoder = { 0 };
+    bridge_frame_t frame;
+    long n = host_bench_iterations(1000000);
+    long frames = 0;
+    size_t framed = 0;
+
+    double start = host_seconds();
+    for (long i = 0; i < n; i++) {
+        framed = bridge_frame_encode(BRIDGE_FRAME_DATA, 2, (uint16_t)i, (const uint8_t *)reading, len, enc, sizeof(enc));
+        for (size_t j = 0; j < framed; j++)
+            frames += bridge_frame_feed(&decoder, enc[j], &frame);
+    }
+    double elapsed = host_seconds() - start;
+    CHECK_EQ(frames, n);
+
+    size_t text = 1 + len + 2;
+    printf("reading %zu bytes: text line %zu, frame %zu bytes\n", len, text, framed);
+    printf("codec: %.0f frames/s, %.1f MB/s encoded and decoded\n", n / elapsed, n * (double)framed / elapsed / 1e6);
+    for (size_t i = 0; i < sizeof(bauds) / sizeof(bauds[0]); i++)
+        printf("%7ld baud: text %5.0f, framed %5.0f readings/s\n", bauds[i],
+               bauds[i] / 10.0 / text, bauds[i] / 10.0 / framed);
+
+    HOST_TEST_END();
+}
@@ -0,0 +1,136 @@
+/**
+ * @file bench_dispatcher.c
+ * @brief Control command latency through the dispatcher, p50/p99
+ *
+ * dispatcher_program.c runs as built for the chip, between the control
+ * rings and the UART reactor on a pty, a bridge node on the other side.
+ * A command is committed to the MQTT ring the way MQTT_EVENT_DATA does
+ * and timed to uart_send_async (the dispatcher's own samples) and to its
+ * arrival at the node. The 100 ms loop it replaced waited up to a whole
+ * period before looking at the ring. The MQTT side is stubbed out, no
+ * reading is sent in this run.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "host_test.h"
+#include "host_node.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "uart/uart_interface.h"
+#include "control/control_interface.h"
+#include "dispatcher/dispatcher_interface.h"
+#include "mqtt/batch/batch.h"
+#include "mqtt/cbor/cbor.h"
+#include "mqtt/deadband/deadband.h"
+#include "mqtt/ratelimit/ratelimit.h"
+#include "local_broker/local_broker_interface.h"
+
+#define COMMAND          "7led:on"
+#define COMMAND_GAP_US   5000
+#define LEGACY_PERIOD_MS 100     /* vTaskDelay(100) of the former app_main loop */
+
+/*************************** Uplink, not used here ***************************/
+
+bool mqtt_deadband_pass(const mqtt_route_t *route, const uint8_t *payload, size_t len) { return true; }
+bool mqtt_ratelimit_admit(const mqtt_route_t *route, const uint8_t *payload, size_t len) { return true; }
+uint32_t mqtt_ratelimit_release(mqtt_ratelimit_forward_t forward) { return portMAX_DELAY; }
+size_t mqtt_cbor_from_json(const uint8_t *json, size_t len, uint8_t *out, size_t cap) { return 0; }
+esp_err_t local_broker_publish(const char *topic, size_t topic_len, const void *data, size_t len) { return ESP_OK; }
+esp_err_t mqtt_batch_add(const char *node_id, const uint8_t *data, size_t len) { return ESP_OK; }
+void mqtt_batch_set_consumer(TaskHandle_t task, uint32_t notify_bits) { }
+void mqtt_batch_flush_due(void) { }
+
+/*************************** Benchmark ***************************/
+
+static int compare_us(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+/* Wait for the node to have taken count commands, false after a second */
+static bool wait_commands(host_node_t *node, uint32_t count)
+{
+    host_node_stats_t stats;
+
+    for (int waited = 0; waited < 10000; waited++) {
+        host_node_get_stats(node, &stats);
+        if (stats.commands >= count)
+            return true;
+        usleep(100);
+    }
+    return false;
+}
+
+static void bench_latency(host_node_t *node)
+{
+    int n = (int)host_bench_iterations(500);
+    int64_t *latency_us = calloc(n, sizeof(int64_t));
+    int delivered = 0;
+
+    for (int i = 0; i < n; i++) {
+        int64_t start = esp_timer_get_time();
+        CHECK(control_push(CONTROL_SRC_MQTT, (const uint8_t *)COMMAND, strlen(COMMAND)));
+        if (!wait_commands(node, (uint32_t)i + 1))
+            break;
+        latency_us[delivered++] = esp_timer_get_time() - start;
+        usleep(COMMAND_GAP_US);
+    }
+    CHECK_EQ(delivered, n);
+    qsort(latency_us, delivered, sizeof(int64_t), compare_us);
+
+    uint32_t p50_us = 0, p99_us = 0;
+    CHECK_EQ(dispatcher_get_latency(CONTROL_SRC_MQTT, &p50_us, &p99_us), ESP_OK);
+    printf("%d commands, last %d to uart_send_async: p50 %lu us, p99 %lu us\n", delivered,
+           DISPATCHER_LATENCY_SAMPLES, (unsigned long)p50_us, (unsigned long)p99_us);
+    if (delivered > 0)
+        printf("all to the node: p50 %.2f ms, p99 %.2f ms, max %.2f ms (polling loop: up to %d ms)\n",
+               latency_us[delivered / 2] / 1000.0, latency_us[(delivered * 99) / 100] / 1000.0,
+               latency_us[delivered - 1] / 1000.0, LEGACY_PERIOD_MS);
+
+    /* Never a polling period, even on a loaded single core */
+    CHECK(p99_us < LEGACY_PERIOD_MS * 1000);
+    CHECK(delivered > 0 && latency_us[(delivered * 99) / 100] < LEGACY_PERIOD_MS * 1000);
+    CHECK_EQ(dispatcher_get_send_failures(CONTROL_SRC_MQTT), 0);
+    free(latency_us);
+}
+
+static void test_refused(host_node_t *node)
+{
+    host_node_stats_t before, after;
+    const uint8_t none = 0;
+
+    /* An empty frame is refused by uart_send_async: dropped, counted, not measured */
+    host_node_get_stats(node, &before);
+    CHECK(control_push(CONTROL_SRC_UDP, &none, 0));
+    for (int waited = 0; waited < 1000 && dispatcher_get_send_failures(CONTROL_SRC_UDP) == 0; waited++)
+        usleep(1000);
+    CHECK_EQ(dispatcher_get_send_failures(CONTROL_SRC_UDP), 1);
+    CHECK_EQ(dispatcher_get_latency(CONTROL_SRC_UDP, NULL, NULL), ESP_ERR_INVALID_STATE);
+
+    /* The source still works after it */
+    CHECK(control_push(CONTROL_SRC_UDP, (const uint8_t *)COMMAND, strlen(COMMAND)));
+    CHECK(wait_commands(node, before.commands + 1));
+    host_node_get_stats(node, &after);
+    CHECK_EQ(after.commands, before.commands + 1);
+    CHECK_EQ(dispatcher_get_latency(CONTROL_SRC_UDP, NULL, NULL), ESP_OK);
+}
+
+int main(void)
+{
+    CHECK_EQ(control_init(), ESP_OK);
+    CHECK_EQ(uart_start_task(), ESP_OK);
+    host_node_t *node = host_node_start(UART_NUM_1, 0);
+    CHECK_EQ(dispatcher_start(), ESP_OK);
+    usleep(20000);
+
+    bench_latency(node);
+    test_refused(node);
+
+    host_node_stop(node);
+
+    HOST_TEST_END();
+}
@@ -0,0 +1,228 @@
+/**
+ * @file bench_inflight.c
+ * @brief QoS 1 throughput with the in-flight window against a broker with injected latency
+ *
+ * The broker stand-in plays mosquitto behind a slow link: every publish is
+ * acknowledged BROKER_RTT_US after it was sent, from its own thread, the
+ * way MQTT_EVENT_PUBLISHED reaches mqtt_inflight_ack(). The publisher loop
+ * is mqtt_task's: collect, wait for a notification while the window is
+ * full, publish, keep the slot. Stop and wait (one publish per round trip)
+ * is the same loop with a window of one.
+ *
+ * The last run drops the connection with publishes in flight, resends
+ * them after the reconnect and dedups on seq as the gateway does.
+ */
+#include <pthread.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "host_test.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "mqtt/mqtt_config.h"
+#include "mqtt/inflight/inflight.h"
+
+#define BROKER_RTT_US   10000
+#define MAX_MESSAGES    8192
+
+/*************************** Broker stand-in ***************************/
+
+typedef struct {
+    int msg_id;
+    int64_t due_us;
+} pending_ack_t;
+
+static pthread_mutex_t g_broker_lock = PTHREAD_MUTEX_INITIALIZER;
+static pending_ack_t g_acks[MAX_MESSAGES];
+static int g_ack_head, g_ack_tail;
+static int g_next_msg_id = 1;
+static bool g_connected = true;
+static volatile bool g_broker_running = true;
+static TaskHandle_t g_publisher;
+static uint8_t g_delivered[MAX_MESSAGES + 1];   /* Copies of each seq the broker took */
+
+static int broker_publish(uint32_t seq)
+{
+    pthread_mutex_lock(&g_broker_lock);
+    int msg_id = g_next_msg_id++;
+    if (g_connected) {
+        g_acks[g_ack_tail % MAX_MESSAGES] = (pending_ack_t){ msg_id, esp_timer_get_time() + BROKER_RTT_US };
+        g_ack_tail++;
+        if (seq <= MAX_MESSAGES)
+            g_delivered[seq]++;
+    }
+    pthread_mutex_unlock(&g_broker_lock);
+    return msg_id;
+}
+
+static int resend(const mqtt_outbox_slot_t *slot, uint32_t seq)
+{
+    (void)slot;
+    return broker_publish(seq);
+}
+
+/* The link goes down: the acks on their way are lost */
+static void broker_disconnect(void)
+{
+    pthread_mutex_lock(&g_broker_lock);
+    g_connected = false;
+    g_ack_head = g_ack_tail;
+    pthread_mutex_unlock(&g_broker_lock);
+}
+
+static void broker_connect(void)
+{
+    pthread_mutex_lock(&g_broker_lock);
+    g_connected = true;
+    pthread_mutex_unlock(&g_broker_lock);
+}
+
+static void *broker_main(void *arg)
+{
+    (void)arg;
+    while (g_broker_running) {
+        int msg_id = 0;
+        int64_t wait_us = 1000;
+
+        pthread_mutex_lock(&g_broker_lock);
+        if (g_ack_head != g_ack_tail) {
+            pending_ack_t *ack = &g_acks[g_ack_head % MAX_MESSAGES];
+            wait_us = ack->due_us - esp_timer_get_time();
+            if (wait_us <= 0) {
+                msg_id = ack->msg_id;
+                g_ack_head++;
+            }
+        }
+        pthread_mutex_unlock(&g_broker_lock);
+
+        if (msg_id > 0) {
+            if (mqtt_inflight_ack(msg_id))
+                xTaskNotifyGive(g_publisher);
+        } else {
+            usleep((useconds_t)(wait_us < 1000 ? wait_us : 1000));
+        }
+    }
+    return NULL;
+}
+
+/*************************** Publisher, as mqtt_task ***************************/
+
+/* Wait for the window to empty, false if it didn't within timeout_ms */
+static bool drain(int timeout_ms)
+{
+    int64_t until = esp_timer_get_time() + (int64_t)timeout_ms * 1000;
+
+    while (mqtt_inflight_count() > 0) {
+        mqtt_inflight_collect(NULL);
+        if (esp_timer_get_time() > until)
+            return false;
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(MQTT_INFLIGHT_POLL_MS));
+    }
+    return true;
+}
+
+/* Publish count messages keeping at most window in flight, returns messages per second */
+static double run(int count, uint32_t window, uint32_t *first_seq)
+{
+    double start = host_seconds();
+
+    for (int sent = 0; sent < count; ) {
+        mqtt_inflight_collect(NULL);
+        if (mqtt_inflight_full() || mqtt_inflight_count() >= window) {
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(MQTT_INFLIGHT_POLL_MS));
+            continue;
+        }
+        mqtt_outbox_slot_t *slot = mqtt_outbox_reserve("wot/sensors/7", 32, MQTT_LANE_TELEMETRY, MQTT_OUTBOX_RESERVE_WAIT);
+        CHECK(slot != NULL);
+        if (slot == NULL)
+            break;
+        uint32_t seq = mqtt_inflight_next_seq();
+        if (sent == 0 && first_seq != NULL)
+            *first_seq = seq;
+        CHECK_EQ(mqtt_inflight_add(slot, broker_publish(seq), seq), ESP_OK);
+        sent++;
+    }
+    CHECK(drain(2000));
+    return count / (host_seconds() - start);
+}
+
+static void test_reconnect(int count)
+{
+    uint32_t first = 0;
+    int resent = 0;
+
+    memset(g_delivered, 0, sizeof(g_delivered));
+    for (int sent = 0; sent < count; ) {
+        mqtt_inflight_collect(NULL);
+        if (mqtt_inflight_full()) {
+            /* Window full and nothing acked: the link is down, MQTT_EVENT_CONNECTED comes back later */
+            broker_disconnect();
+            usleep(2 * BROKER_RTT_US);
+            broker_connect();
+            resent += (int)mqtt_inflight_resend(resend);
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(MQTT_INFLIGHT_POLL_MS));
+            continue;
+        }
+        mqtt_outbox_slot_t *slot = mqtt_outbox_reserve("wot/sensors/7", 32, MQTT_LANE_TELEMETRY, 0);
+        CHECK(slot != NULL);
+        if (slot == NULL)
+            break;
+        uint32_t seq = mqtt_inflight_next_seq();
+        if (sent == 0)
+            first = seq;
+        CHECK_EQ(mqtt_inflight_add(slot, broker_publish(seq), seq), ESP_OK);
+        sent++;
+        /* Down for good every half window: the publishes sent meanwhile never reach the broker */
+        if (sent % (MQTT_INFLIGHT_WINDOW / 2) == 0)
+            broker_disconnect();
+    }
+    broker_connect();
+    resent += (int)mqtt_inflight_resend(resend);
+    CHECK(drain(2000));
+
+    /* Gateway side: every seq once after dedup, the copies had the same seq */
+    int duplicates = 0, missing = 0;
+    for (uint32_t seq = first; seq < first + (uint32_t)count; seq++) {
+        if (g_delivered[seq] == 0)
+            missing++;
+        else
+            duplicates += g_delivered[seq] - 1;
+    }
+    printf("reconnects: %d publishes, %d resent, %d missing, %d duplicates dropped by seq\n",
+           count, resent, missing, duplicates);
+    CHECK(resent > 0);
+    CHECK_EQ(missing, 0);
+}
+
+int main(void)
+{
+    pthread_t broker;
+    int count = (int)host_bench_iterations(100);
+    uint32_t first = 0;
+
+    if (count > MAX_MESSAGES / 4)
+        count = MAX_MESSAGES / 4;
+    CHECK_EQ(mqtt_outbox_init(), ESP_OK);
+    mqtt_inflight_init();
+    g_publisher = xTaskGetCurrentTaskHandle();
+    pthread_create(&broker, NULL, broker_main, NULL);
+
+    double stop_and_wait = run(count, 1, &first);
+    double pipelined = run(count, MQTT_INFLIGHT_WINDOW, &first);
+    printf("broker round trip %d ms, %d QoS 1 publishes\n", BROKER_RTT_US / 1000, count);
+    printf("stop and wait: %.0f msg/s\n", stop_and_wait);
+    printf("window of %d: %.0f msg/s, %.1fx\n", MQTT_INFLIGHT_WINDOW, pipelined, pipelined / stop_and_wait);
+    CHECK(stop_and_wait <= 1e6 / BROKER_RTT_US);
+    CHECK(pipelined > 3 * stop_and_wait);
+
+    test_reconnect(count);
+    CHECK_EQ(mqtt_outbox_free_slots(), MQTT_OUTBOX_SLOTS);
+
+    g_broker_running = false;
+    pthread_join(broker, NULL);
+
+    HOST_TEST_END();
+}
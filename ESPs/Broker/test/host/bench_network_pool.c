@@ -0,0 +1,184 @@
+/**
+ * @file bench_network_pool.c
+ * @brief Host test and benchmark of the sendData connection pool
+ *
+ * The real sendData, socket and pool sources send one byte readings to a
+ * server on the loopback interface, once with CLOSE_AFTER_SEND (a TCP
+ * handshake and teardown per reading) and once with KEEP_ALIVE through the
+ * pool. The server runs in a child process so it can be killed and
+ * restarted; every reading it parses is counted through a pipe.
+ */
+#include <errno.h>
+#include <stdbool.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+
+#include "host_test.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "lwip/sockets.h"
+#include "Network/sendData/sendData.h"
+#include "Network/pool/pool.h"
+
+uint8_t g_station_connected = 1;
+
+static int g_count_pipe[2];   /* The server writes one byte per reading */
+
+/*************************** Server ***************************/
+
+static bool server_read(int fd, char *buf, size_t len)
+{
+    size_t got = 0;
+
+    while (got < len) {
+        ssize_t n = recv(fd, buf + got, len - got, 0);
+        if (n <= 0)
+            return false;
+        got += (size_t)n;
+    }
+    return true;
+}
+
+/* One connection: header lines of NETWORK_HEADER_LINE_SIZE, the third holds the connection type */
+static void *server_connection(void *arg)
+{
+    int fd = (int)(intptr_t)arg;
+    char header[NETWORK_TOTAL_HEADER_SIZE];
+    char data[256];
+    const char one = 1;
+
+    while (server_read(fd, header, sizeof(header))) {
+        size_t size = (size_t)atoi(header + 3 * NETWORK_HEADER_LINE_SIZE);
+        if (size > sizeof(data) || !server_read(fd, data, size))
+            break;
+        write(g_count_pipe[1], &one, 1);
+        if (atoi(header + 2 * NETWORK_HEADER_LINE_SIZE) == CLOSE_AFTER_SEND)
+            break;
+    }
+    close(fd);
+    return NULL;
+}
+
+static void server_run(void)
+{
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(NETWORK_STA_GENERAL_TCP_PORT_NUM),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    int on = 1;
+
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(sock, 128) != 0)
+        _exit(1);
+    while (1) {
+        int conn = accept(sock, NULL, NULL);
+        if (conn < 0)
+            continue;
+        pthread_t thread;
+        pthread_create(&thread, NULL, server_connection, (void *)(intptr_t)conn);
+        pthread_detach(thread);
+    }
+}
+
+static pid_t server_start(void)
+{
+    pid_t pid = fork();
+    if (pid == 0) {
+        server_run();
+        _exit(0);
+    }
+    vTaskDelay(pdMS_TO_TICKS(100));   /* Listening */
+    return pid;
+}
+
+static void server_stop(pid_t pid)
+{
+    kill(pid, SIGKILL);
+    waitpid(pid, NULL, 0);
+}
+
+/* Readings the server parsed since the last call */
+static long server_count(void)
+{
+    char buf[4096];
+    long n = 0;
+    ssize_t got;
+
+    vTaskDelay(pdMS_TO_TICKS(200));   /* The last ones are still on their way */
+    while ((got = read(g_count_pipe[0], buf, sizeof(buf))) > 0)
+        n += got;
+    return n;
+}
+
+/*************************** Client ***************************/
+
+/* Send n one byte readings, returns messages per second */
+static double send_readings(Network_connection_type_e type, long n, long *fails)
+{
+    uint8_t value = 7;
+
+    *fails = 0;
+    double start = host_seconds();
+    for (long i = 0; i < n; i++) {
+        if (Network_app_send_TCP_data_with_header(SEND_TCP_ONE_BYTE_DATA, type, &value, 1, NULL,
+                                                  NETWORK_STA_GENERAL_TCP_PORT_NUM) != SOCKET_OK)
+            (*fails)++;
+    }
+    return n / (host_seconds() - start);
+}
+
+int main(void)
+{
+    long n = host_bench_iterations(500);
+    long fails;
+    Network_pool_stats_t stats;
+
+    signal(SIGPIPE, SIG_IGN);
+    CHECK_EQ(pipe(g_count_pipe), 0);
+    fcntl(g_count_pipe[0], F_SETFL, O_NONBLOCK);
+    pid_t server = server_start();
+    Network_pool_init();
+
+    double one_shot = send_readings(CLOSE_AFTER_SEND, n, &fails);
+    CHECK_EQ(fails, 0);
+    CHECK_EQ(server_count(), n);
+
+    double pooled = send_readings(KEEP_ALIVE, n, &fails);
+    CHECK_EQ(fails, 0);
+    CHECK_EQ(server_count(), n);
+    printf("CLOSE_AFTER_SEND %.0f msg/s, KEEP_ALIVE %.0f msg/s (x%.1f)\n", one_shot, pooled, pooled / one_shot);
+
+    /* The server closed the pooled connection: reconnected, no reading lost */
+    server_stop(server);
+    server = server_start();
+    send_readings(KEEP_ALIVE, 100, &fails);
+    CHECK_EQ(fails, 0);
+    CHECK_EQ(server_count(), 100);
+
+    /* Idle past the timeout: closed by the Network task's check, the next reading reconnects */
+    host_clock_set_us(esp_timer_get_time());
+    host_clock_advance_ms(NETWORK_POOL_IDLE_TIMEOUT_MS + 1);
+    Network_pool_close_idle();
+    send_readings(KEEP_ALIVE, 10, &fails);
+    CHECK_EQ(fails, 0);
+    CHECK_EQ(server_count(), 10);
+
+    Network_pool_get_stats(&stats);
+    CHECK_EQ(stats.idle_closes, 1);
+    CHECK_EQ(stats.connects, 3);
+    printf("connects %lu, reuses %lu, broken %lu, idle closes %lu, one shots %lu\n",
+           (unsigned long)stats.connects, (unsigned long)stats.reuses, (unsigned long)stats.broken,
+           (unsigned long)stats.idle_closes, (unsigned long)stats.one_shots);
+
+    Network_pool_close_all();
+    server_stop(server);
+    HOST_TEST_END();
+}
@@ -0,0 +1,122 @@
+/**
+ * @file bench_outbox.c
+ * @brief Outbox against the original by-value message queue
+ *
+ * The original path strncpy'd topic and payload into a 64 + 256 byte
+ * mqtt_message_t, xQueueSend copied the struct into mqtt_queue and
+ * xQueueReceive copied it out again in mqtt_task. The outbox path reserves a
+ * block sized for the message, the producer writes the payload in place and
+ * only the slot pointer goes through the queue.
+ *
+ * Prints messages per second, bytes copied per message and arena bytes held
+ * per message, for readings of several sizes.
+ */
+#include <string.h>
+
+#include "host_test.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "mqtt/mqtt_config.h"
+#include "mqtt/outbox/outbox.h"
+
+#define TOPIC       "wot/sensors/17"
+#define QUEUE_LEN   10
+
+/* Baseline message, as in mqtt_interface.h before the outbox */
+typedef struct {
+    char topic[64];
+    char data[256];
+    int  qos;
+    int  retain;
+} legacy_message_t;
+
+static volatile size_t g_sink;   /* Keeps the consumer's reads */
+
+static double bench_legacy(const char *payload, size_t len, long n, size_t *copied)
+{
+    QueueHandle_t queue = xQueueCreate(QUEUE_LEN, sizeof(legacy_message_t));
+    legacy_message_t msg, out;
+    double start = host_seconds();
+
+    for (long i = 0; i < n; i++) {
+        strncpy(msg.topic, TOPIC, sizeof(msg.topic) - 1);
+        msg.topic[sizeof(msg.topic) - 1] = '\0';
+        strncpy(msg.data, payload, sizeof(msg.data) - 1);
+        msg.data[sizeof(msg.data) - 1] = '\0';
+        msg.qos = 0;
+        msg.retain = 0;
+        xQueueSend(queue, &msg, 0);
+
+        xQueueReceive(queue, &out, 0);
+        g_sink += strlen(out.data);
+    }
+
+    double elapsed = host_seconds() - start;
+    vQueueDelete(queue);
+    /* strncpy pads both buffers, then the struct is copied in and out */
+    *copied = sizeof(msg.topic) + sizeof(msg.data) + 2 * sizeof(legacy_message_t);
+    (void)len;
+    return n / elapsed;
+}
+
+static double bench_outbox(const char *payload, size_t len, long n, size_t *copied, size_t *held)
+{
+    QueueHandle_t queue = xQueueCreate(QUEUE_LEN, sizeof(mqtt_outbox_slot_t *));
+    double start = host_seconds();
+
+    for (long i = 0; i < n; i++) {
+        uint32_t before = mqtt_outbox_free_bytes();
+        mqtt_outbox_slot_t *slot = mqtt_outbox_reserve(TOPIC, len, MQTT_LANE_TELEMETRY, 0);
+        if (slot == NULL) {
+            fprintf(stderr, "outbox reserve failed\n");
+            exit(EXIT_FAILURE);
+        }
+        *held = before - mqtt_outbox_free_bytes();
+        memcpy(slot->data, payload, len);
+        slot->data[len] = '\0';
+        slot->data_len = len;
+        xQueueSend(queue, &slot, 0);
+
+        mqtt_outbox_slot_t *out;
+        xQueueReceive(queue, &out, 0);
+        g_sink += out->data_len;
+        mqtt_outbox_release(out);
+    }
+
+    double elapsed = host_seconds() - start;
+    vQueueDelete(queue);
+    /* Topic and payload into the block, then the pointer in and out */
+    *copied = sizeof(TOPIC) + len + 1 + 2 * sizeof(mqtt_outbox_slot_t *);
+    return n / elapsed;
+}
+
+int main(void)
+{
+    static const size_t sizes[] = { 60, 240, 600 };
+    static char payload[MQTT_OUTBOX_MSG_MAX];
+    long n = host_bench_iterations(200000);
+
+    CHECK_EQ(mqtt_outbox_init(), ESP_OK);
+
+    printf("%-8s %-7s %12s %14s %12s\n", "payload", "path", "msg/s", "copied B/msg", "held B/msg");
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        size_t len = sizes[i];
+        size_t copied, held = 0;
+
+        memset(payload, 'x', len);
+        payload[len] = '\0';
+
+        if (len < sizeof(((legacy_message_t *)0)->data)) {
+            double rate = bench_legacy(payload, len, n, &copied);
+            printf("%-8zu %-7s %12.0f %14zu %12zu\n", len, "struct", rate, copied, sizeof(legacy_message_t));
+        } else {
+            printf("%-8zu %-7s %12s %14s %12s\n", len, "struct", "-", "-", "too long");
+        }
+
+        double rate = bench_outbox(payload, len, n, &copied, &held);
+        printf("%-8zu %-7s %12.0f %14zu %12zu\n", len, "outbox", rate, copied, held);
+    }
+
+    CHECK_EQ(mqtt_outbox_free_bytes(), MQTT_OUTBOX_ARENA_SIZE);
+    HOST_TEST_END();
+}
@@ -0,0 +1,140 @@
+/**
+ * @file bench_session.c
+ * @brief Reconnect time with the persistent session, broker killed and restarted
+ *
+ * The broker stand-in keeps the sessions of its clients, as mosquitto does
+ * with clean_session off, and loses them on a restart unless it persists
+ * them to disk. Every reconnect kills and restarts it, then the test plays
+ * the MQTT event handler: CONNACK after a round trip, MQTT_EVENT_CONNECTED
+ * with the session present flag the broker gave, one SUBACK per SUBSCRIBE
+ * a round trip plus the broker's work on it later. The reconnect time is
+ * the one mqtt_session_get_stats() reports, disconnect to subscriptions in
+ * place. The clock is driven by the test, the link is what's modelled.
+ */
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "host_test.h"
+#include "esp_timer.h"
+#include "nvs.h"
+#include "mqtt/mqtt_config.h"
+#include "mqtt/session/session.h"
+
+#define BROKER_RTT_MS      40     /* WiFi to the broker and back */
+#define BROKER_RESTART_MS  500    /* Killed to listening again */
+#define BROKER_SUB_MS      3      /* Broker work per SUBSCRIBE, retained messages included */
+
+static const mqtt_session_sub_t g_subs[] = {
+    { "wot/control/#", 1 },
+    { "wot/ota", 1 },
+    { "wot/config/+", 1 },
+    { "wot/time", 0 },
+    { "wot/gateway/status", 1 },
+};
+#define SUB_COUNT  (sizeof(g_subs) / sizeof(g_subs[0]))
+
+/*************************** Broker stand-in ***************************/
+
+static bool g_persistence;      /* Sessions written to disk, kept over a restart */
+static bool g_has_session;
+static int g_next_msg_id = 1;
+static int g_sent_ids[SUB_COUNT];
+static int g_sent;
+static uint32_t g_subscribes;
+
+int esp_mqtt_client_subscribe(esp_mqtt_client_handle_t client, const char *topic, int qos)
+{
+    (void)client;
+    (void)topic;
+    (void)qos;
+    g_sent_ids[g_sent++] = g_next_msg_id;
+    g_subscribes++;
+    return g_next_msg_id++;
+}
+
+static void broker_restart(void)
+{
+    if (!g_persistence)
+        g_has_session = false;
+    host_clock_advance_ms(BROKER_RESTART_MS);
+}
+
+/* One reconnect of the client, returns the time mqtt_session reports */
+static uint32_t reconnect(void)
+{
+    mqtt_session_stats_t stats;
+
+    mqtt_session_disconnected();
+    broker_restart();
+
+    /* CONNECT, CONNACK */
+    host_clock_advance_ms(BROKER_RTT_MS);
+    g_sent = 0;
+    mqtt_session_connected(NULL, g_has_session);
+    g_has_session = true;
+
+    /* The SUBSCRIBEs go out back to back, the broker handles them in order */
+    if (g_sent > 0) {
+        host_clock_advance_ms(BROKER_RTT_MS);
+        for (int i = 0; i < g_sent; i++) {
+            host_clock_advance_ms(BROKER_SUB_MS);
+            mqtt_session_subscribed(g_sent_ids[i]);
+        }
+    }
+
+    mqtt_session_get_stats(&stats);
+    return stats.last_reconnect_ms;
+}
+
+static double run(bool persistence, int count, uint32_t *subscribes)
+{
+    uint64_t total_ms = 0;
+    uint32_t before = g_subscribes;
+
+    g_persistence = persistence;
+    for (int i = 0; i < count; i++)
+        total_ms += reconnect();
+    *subscribes = g_subscribes - before;
+    return (double)total_ms / count;
+}
+
+int main(void)
+{
+    int count = (int)host_bench_iterations(50);
+    uint32_t lost_subs = 0, kept_subs = 0;
+    mqtt_session_stats_t stats;
+
+    host_clock_set_us(1000000);
+    host_nvs_erase_all();
+    CHECK_EQ(mqtt_session_init(g_subs, SUB_COUNT), ESP_OK);
+
+    /* First connect, then restarts of the node itself keep the record in NVS */
+    g_sent = 0;
+    mqtt_session_connected(NULL, false);
+    for (int i = 0; i < g_sent; i++)
+        mqtt_session_subscribed(g_sent_ids[i]);
+    g_has_session = true;
+    CHECK_EQ(mqtt_session_init(g_subs, SUB_COUNT), ESP_OK);
+
+    double lost_ms = run(false, count, &lost_subs);
+    double kept_ms = run(true, count, &kept_subs);
+
+    printf("%d reconnects each, broker restart %d ms, round trip %d ms, %d subscriptions\n",
+           count, BROKER_RESTART_MS, BROKER_RTT_MS, (int)SUB_COUNT);
+    printf("session lost on restart: %.1f ms to subscriptions in place, %lu SUBSCRIBEs\n",
+           lost_ms, (unsigned long)lost_subs);
+    printf("session kept on restart: %.1f ms, %lu SUBSCRIBEs, %.1f ms saved per reconnect\n",
+           kept_ms, (unsigned long)kept_subs, lost_ms - kept_ms);
+
+    mqtt_session_get_stats(&stats);
+    CHECK_EQ(lost_subs, (uint32_t)count * SUB_COUNT);
+    CHECK_EQ(kept_subs, 0);
+    /* Kept: a single CONNECT round trip after the broker is back */
+    CHECK(kept_ms == BROKER_RESTART_MS + BROKER_RTT_MS);
+    CHECK(lost_ms == kept_ms + BROKER_RTT_MS + SUB_COUNT * BROKER_SUB_MS);
+    CHECK_EQ(stats.reconnects, 2 * (uint32_t)count);
+    CHECK_EQ(stats.resubscribes_skipped, (uint32_t)count);
+
+    HOST_TEST_END();
+}
@@ -0,0 +1,165 @@
+/**
+ * @file bench_uart_msg.c
+ * @brief RAM and throughput of the RX message buffer, against the 1 KB by-value queue it replaced
+ *
+ * The queue is the former one: 10 items of a message with UART_BUF_SIZE
+ * bytes of data, copied whole on send and on receive. The message buffer
+ * is uart_msg_buffer's layout, the bytes of the line and the 3 byte record
+ * tail. On the host a 1 KB copy costs little next to the stubs' locking,
+ * the bytes copied per line are what the chip pays. The second part drives 10k lines/s from a bridge node through the
+ * pty and the reactor to uart_receive().
+ */
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "host_test.h"
+#include "host_node.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/message_buffer.h"
+#include "uart/uart_config.h"
+#include "uart/uart_interface.h"
+
+#define LEGACY_QUEUE_SIZE  10
+#define LINE               "{\"temperature\":21.5,\"humidity\":60.2,\"light\":350,\"id\":7}"
+#define CHIP_SIZE_T        4       /* Length word of a message buffer entry on the chip */
+
+typedef struct {
+    uart_msg_type_t msg_type;
+    uint8_t data[UART_BUF_SIZE];
+    size_t data_len;
+} legacy_msg_t;
+
+/*************************** Queue against message buffer ***************************/
+
+static void bench_buffers(void)
+{
+    static legacy_msg_t rx_msg, out_msg;
+    static uint8_t rx_buffer[UART_BUF_SIZE];
+    static uart_queue_msg_t msg;
+    size_t len = strlen(LINE);
+    long n = host_bench_iterations(1000000);
+    volatile size_t sink = 0;
+
+    /* As the former uart_task: read into rx_buffer, copy to rx_msg, the queue copies the item */
+    QueueHandle_t queue = xQueueCreate(LEGACY_QUEUE_SIZE, sizeof(legacy_msg_t));
+    double start = host_seconds();
+    for (long i = 0; i < n; i++) {
+        memcpy(rx_buffer, LINE, len);
+        rx_msg.msg_type = UART_MSG_RECEIVED;
+        memcpy(rx_msg.data, rx_buffer, len);
+        rx_msg.data_len = len;
+        xQueueSend(queue, &rx_msg, 0);
+        xQueueReceive(queue, &out_msg, 0);
+        sink += out_msg.data_len;
+    }
+    double queue_s = host_seconds() - start;
+    vQueueDelete(queue);
+
+    /* As uart_queue_message() and uart_receive(): the line and its tail, in place */
+    MessageBufferHandle_t buffer = xMessageBufferCreate(UART_MSG_BUFFER_SIZE);
+    start = host_seconds();
+    for (long i = 0; i < n; i++) {
+        memcpy(rx_buffer, LINE, len);
+        rx_buffer[len] = 0;
+        rx_buffer[len + 1] = 7;
+        rx_buffer[len + 2] = UART_MSG_RECEIVED;
+        xMessageBufferSend(buffer, rx_buffer, len + 3, 0);
+        sink += xMessageBufferReceive(buffer, msg.data, UART_BUF_SIZE, 0);
+    }
+    double buffer_s = host_seconds() - start;
+    vMessageBufferDelete(buffer);
+    (void)sink;
+
+    size_t queue_ram = LEGACY_QUEUE_SIZE * sizeof(legacy_msg_t);
+    size_t queue_copied = len + 2 * sizeof(legacy_msg_t);            /* Into rx_msg, into and out of the queue */
+    size_t buffer_copied = 2 * (len + 3 + CHIP_SIZE_T);              /* Into and out of the buffer */
+    printf("%zu byte lines\n", len);
+    printf("queue: %zu bytes for %d lines, %zu bytes copied per line, %.0f lines/s\n",
+           queue_ram, LEGACY_QUEUE_SIZE, queue_copied, n / queue_s);
+    printf("message buffer: %d bytes for %zu lines, %zu bytes copied per line, %.0f lines/s\n", UART_MSG_BUFFER_SIZE,
+           (size_t)UART_MSG_BUFFER_SIZE / (len + 3 + CHIP_SIZE_T), buffer_copied, n / buffer_s);
+    printf("%zu bytes of RAM saved, %.0fx less copied\n", queue_ram - UART_MSG_BUFFER_SIZE,
+           (double)queue_copied / buffer_copied);
+    CHECK(queue_ram > UART_MSG_BUFFER_SIZE);
+    CHECK(buffer_copied < queue_copied);
+}
+
+/*************************** 10k lines/s through the reactor ***************************/
+
+static volatile int g_received;
+static volatile int64_t g_last_us;     /* Of the last line received */
+static volatile bool g_consuming;
+
+static void consumer_task(void *arg)
+{
+    static uart_queue_msg_t msg;
+
+    (void)arg;
+    while (g_consuming) {
+        if (uart_receive(&msg, pdMS_TO_TICKS(10)) && msg.data_len == strlen(LINE)) {
+            g_received++;
+            g_last_us = esp_timer_get_time();
+        }
+    }
+}
+
+static void bench_lines(void)
+{
+    const int rate = 10000;
+    int lines = (int)host_bench_iterations(rate);
+
+    CHECK_EQ(uart_start_task(), ESP_OK);
+    host_node_t *node = host_node_start(UART_NUM_1, 0);
+    g_consuming = true;
+    xTaskCreate(consumer_task, "consumer", 4096, NULL, 5, NULL);
+    usleep(20000);
+
+    /* One line every 100 us, each from its own mesh node so none is coalesced. Slept, not
+     * spun: the reactor and the node may share the one core */
+    int64_t start = esp_timer_get_time();
+    for (int sent = 0; sent < lines; sent++) {
+        int64_t next = start + (int64_t)sent * 1000000 / rate;
+        int64_t now = esp_timer_get_time();
+        if (next > now)
+            usleep((useconds_t)(next - now));
+        host_node_send(node, (uint16_t)(sent % 1000), LINE);
+    }
+    double send_s = (esp_timer_get_time() - start) / 1e6;
+
+    host_node_stats_t node_stats;
+    for (int wait = 0; wait < 200; wait++) {
+        host_node_get_stats(node, &node_stats);
+        if (g_received + (int)(node_stats.dropped + node_stats.coalesced) >= lines && host_node_pending(node) == 0)
+            break;
+        usleep(10000);
+    }
+    double total_s = (g_last_us - start) / 1e6;
+    g_consuming = false;
+
+    uart_frame_stats_t stats;
+    uart_get_frame_stats(UART_PORT_ALL, &stats);
+    host_node_stop(node);
+
+    printf("reactor: %d lines sent in %.2f s, %d received in %.2f s (%.0f lines/s), "
+           "%lu held for credit, %lu dropped by the node, %lu by the broker\n",
+           lines, send_s, g_received, total_s, g_received / total_s, (unsigned long)node_stats.held,
+           (unsigned long)(node_stats.dropped + node_stats.coalesced), (unsigned long)stats.rx_dropped);
+    /* The broker takes every frame sent. The node sheds a few only when the scheduler delays a
+     * credit round trip past its BRIDGE_PENDING slots, more so on a single core */
+    CHECK_EQ(g_received, node_stats.sent);
+    CHECK(g_received >= lines * 99 / 100);
+    CHECK_EQ(stats.rx_dropped, 0);
+    CHECK_EQ(stats.errors, 0);
+}
+
+int main(void)
+{
+    bench_buffers();
+    bench_lines();
+
+    HOST_TEST_END();
+}
@@ -0,0 +1,212 @@
+/**
+ * @file bench_uart_rx.c
+ * @brief RX latency and CPU use of the UART reactor, against the polling task it replaced
+ *
+ * Both read a host pty, see stubs/driver/uart.h. The polling task is the
+ * former uart_task: uart_read_bytes() of UART_BUF_SIZE with a 1 s timeout,
+ * a 1 KB by-value queue item per read and vTaskDelay(10). The reactor is
+ * uart_program.c as built for the chip, fed DATA frames by a bridge node.
+ * The latency runs from the write on the node side to the consumer's
+ * receive, the CPU time is the RX task's own.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "host_test.h"
+#include "host_node.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "uart/uart_config.h"
+#include "uart/uart_interface.h"
+
+#define LINE_PERIOD_US  10000   /* 100 readings/s */
+#define LEGACY_PORT     UART_NUM_2
+
+typedef struct {
+    double p50_ms;
+    double p99_ms;
+    double max_ms;
+    double cpu_percent;
+    int received;
+} rx_result_t;
+
+static int compare_ms(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static void summarize(double *latency_ms, int n, int64_t cpu_us, int64_t wall_us, rx_result_t *r)
+{
+    qsort(latency_ms, n, sizeof(double), compare_ms);
+    r->received = n;
+    r->p50_ms = n > 0 ? latency_ms[n / 2] : 0;
+    r->p99_ms = n > 0 ? latency_ms[(n * 99) / 100] : 0;
+    r->max_ms = n > 0 ? latency_ms[n - 1] : 0;
+    r->cpu_percent = 100.0 * cpu_us / wall_us;
+}
+
+/*************************** Polling task ***************************/
+
+typedef struct {
+    uint8_t data[UART_BUF_SIZE];
+    size_t data_len;
+} legacy_msg_t;
+
+static QueueHandle_t g_legacy_queue;
+static volatile bool g_legacy_running;
+static volatile bool g_legacy_stopped;
+
+static void legacy_task(void *arg)
+{
+    static legacy_msg_t rx_msg;
+    static uint8_t rx_buffer[UART_BUF_SIZE];
+
+    (void)arg;
+    while (g_legacy_running) {
+        int len = uart_read_bytes(LEGACY_PORT, rx_buffer, UART_BUF_SIZE, pdMS_TO_TICKS(1000));
+        if (len > 0) {
+            memcpy(rx_msg.data, rx_buffer, len);
+            rx_msg.data_len = len;
+            xQueueSend(g_legacy_queue, &rx_msg, pdMS_TO_TICKS(10));
+        }
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    g_legacy_stopped = true;
+}
+
+static void run_legacy(int lines, rx_result_t *r)
+{
+    static legacy_msg_t msg;
+    double *latency_ms = calloc(lines, sizeof(double));
+    uart_config_t config = { .baud_rate = UART_BAUD_RATE };
+    char line[32];
+    char partial[64] = "";
+    int received = 0;
+
+    CHECK_EQ(uart_driver_install(LEGACY_PORT, UART_BUF_SIZE * 2, 0, 0, NULL, 0), ESP_OK);
+    uart_param_config(LEGACY_PORT, &config);
+    g_legacy_queue = xQueueCreate(10, sizeof(legacy_msg_t));
+    g_legacy_running = true;
+    xTaskCreate(legacy_task, "uart_legacy", UART_TASK_STACK_SIZE, NULL, UART_TASK_PRIORITY, NULL);
+    usleep(20000);
+
+    int64_t cpu_start = host_task_cpu_us("uart_legacy");
+    int64_t start = esp_timer_get_time();
+    int64_t next = start;
+    int sent = 0;
+
+    /* Lines cut anywhere by the reads, joined back here */
+    while (received < lines) {
+        int64_t now = esp_timer_get_time();
+        if (sent < lines && now >= next) {
+            int len = snprintf(line, sizeof(line), "%lld\n", (long long)now);
+            host_uart_peer_write(LEGACY_PORT, line, len);
+            sent++;
+            next += LINE_PERIOD_US;
+        }
+        if (xQueueReceive(g_legacy_queue, &msg, 1) != pdPASS) {
+            if (sent == lines && now - next > 3000000)
+                break;
+            continue;
+        }
+        now = esp_timer_get_time();
+        for (size_t i = 0; i < msg.data_len; i++) {
+            size_t used = strlen(partial);
+            if (msg.data[i] != '\n') {
+                if (used + 1 < sizeof(partial))
+                    partial[used] = (char)msg.data[i], partial[used + 1] = '\0';
+                continue;
+            }
+            if (received < lines)
+                latency_ms[received++] = (now - atoll(partial)) / 1000.0;
+            partial[0] = '\0';
+        }
+    }
+    int64_t wall = esp_timer_get_time() - start;
+    int64_t cpu = host_task_cpu_us("uart_legacy") - cpu_start;
+
+    g_legacy_running = false;
+    while (!g_legacy_stopped)
+        usleep(10000);
+    uart_driver_delete(LEGACY_PORT);
+    vQueueDelete(g_legacy_queue);
+
+    summarize(latency_ms, received, cpu, wall, r);
+    free(latency_ms);
+}
+
+/*************************** Reactor ***************************/
+
+static void run_reactor(int lines, rx_result_t *r)
+{
+    static uart_queue_msg_t msg;
+    double *latency_ms = calloc(lines, sizeof(double));
+    char payload[32];
+    int received = 0;
+
+    CHECK_EQ(uart_start_task(), ESP_OK);
+    host_node_t *node = host_node_start(UART_NUM_1, 0);
+    usleep(20000);
+
+    int64_t cpu_start = host_task_cpu_us("uart_task");
+    int64_t start = esp_timer_get_time();
+    int64_t next = start;
+    int sent = 0;
+
+    while (received < lines) {
+        int64_t now = esp_timer_get_time();
+        if (sent < lines && now >= next) {
+            snprintf(payload, sizeof(payload), "%lld", (long long)now);
+            host_node_send(node, 7, payload);
+            sent++;
+            next += LINE_PERIOD_US;
+        }
+        if (!uart_receive(&msg, 1)) {
+            if (sent == lines && now - next > 3000000)
+                break;
+            continue;
+        }
+        now = esp_timer_get_time();
+        msg.data[msg.data_len] = '\0';
+        CHECK_EQ(msg.node_id, 7);
+        latency_ms[received++] = (now - atoll((const char *)msg.data)) / 1000.0;
+    }
+    int64_t wall = esp_timer_get_time() - start;
+    int64_t cpu = host_task_cpu_us("uart_task") - cpu_start;
+
+    uart_frame_stats_t stats;
+    uart_get_frame_stats(UART_PORT_ALL, &stats);
+    CHECK_EQ(stats.errors, 0);
+    CHECK_EQ(stats.rx_dropped, 0);
+    host_node_stop(node);
+
+    summarize(latency_ms, received, cpu, wall, r);
+    free(latency_ms);
+}
+
+int main(void)
+{
+    int lines = (int)host_bench_iterations(300);
+    rx_result_t legacy, reactor;
+
+    run_legacy(lines, &legacy);
+    run_reactor(lines, &reactor);
+
+    printf("%d readings at %d/s\n", lines, 1000000 / LINE_PERIOD_US);
+    printf("polling: %d received, latency p50 %.2f ms, p99 %.2f ms, max %.2f ms, RX task CPU %.2f%%\n",
+           legacy.received, legacy.p50_ms, legacy.p99_ms, legacy.max_ms, legacy.cpu_percent);
+    printf("reactor: %d received, latency p50 %.2f ms, p99 %.2f ms, max %.2f ms, RX task CPU %.2f%%\n",
+           reactor.received, reactor.p50_ms, reactor.p99_ms, reactor.max_ms, reactor.cpu_percent);
+
+    CHECK_EQ(legacy.received, lines);
+    CHECK_EQ(reactor.received, lines);
+    /* A line no longer waits for the read to fill or time out */
+    CHECK(reactor.p99_ms < legacy.p50_ms);
+
+    HOST_TEST_END();
+}
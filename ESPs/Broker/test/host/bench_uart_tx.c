@@ -0,0 +1,195 @@
+/**
+ * @file bench_uart_tx.c
+ * @brief Downlink command bursts during uplink load, through uart_send_async() and the uart_tx task
+ *
+ * A bridge node on the pty sends readings at a steady rate from its own
+ * thread. The test first measures the uplink alone, then again while bursts
+ * of commands are queued with uart_send_async(): a refused command waits
+ * for the TX notification and is queued again. Every command must reach
+ * the node, the uplink must not lose a line to them, and nothing of the
+ * downlink may come back through uart_receive() the way the former
+ * uart_send_data() echoed it into the RX queue.
+ */
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "host_test.h"
+#include "host_node.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "uart/uart_config.h"
+#include "uart/uart_interface.h"
+
+#define LINE           "{\"temperature\":21.5,\"humidity\":60.2,\"light\":350,\"id\":7}"
+#define COMMAND        "7led:on,brightness:80,color:ff8000"
+#define UPLINK_RATE    4000    /* Lines per second */
+#define BURST          64      /* Commands queued back to back */
+#define BURST_GAP_US   20000
+#define TX_EVT         (1UL << 0)
+
+static host_node_t *g_node;
+
+/*************************** Uplink ***************************/
+
+static volatile int g_received;
+static volatile int g_echoed;          /* Anything else uart_receive() gave back */
+static volatile bool g_consuming;
+
+static void consumer_task(void *arg)
+{
+    static uart_queue_msg_t msg;
+
+    (void)arg;
+    while (g_consuming) {
+        if (!uart_receive(&msg, pdMS_TO_TICKS(10)))
+            continue;
+        if (msg.msg_type == UART_MSG_RECEIVED && msg.data_len == strlen(LINE))
+            g_received++;
+        else
+            g_echoed++;
+    }
+}
+
+typedef struct {
+    int lines;
+    double seconds;
+} uplink_t;
+
+/* Paced by sleeping, not spinning: the reactor and the node may share the one core */
+static void *uplink_main(void *arg)
+{
+    uplink_t *up = arg;
+    int64_t start = esp_timer_get_time();
+
+    for (int sent = 0; sent < up->lines; sent++) {
+        int64_t next = start + (int64_t)sent * 1000000 / UPLINK_RATE;
+        int64_t now = esp_timer_get_time();
+        if (next > now)
+            usleep((useconds_t)(next - now));
+        host_node_send(g_node, (uint16_t)(sent % 1000), LINE);
+    }
+    up->seconds = (esp_timer_get_time() - start) / 1e6;
+    return NULL;
+}
+
+/* Wait for the lines the node sent to be received, returns the node's counters */
+static void settle(host_node_stats_t *stats)
+{
+    for (int wait = 0; wait < 200; wait++) {
+        host_node_get_stats(g_node, stats);
+        if (host_node_pending(g_node) == 0 && g_received >= (int)stats->sent)
+            break;
+        usleep(10000);
+    }
+}
+
+/*************************** Downlink bursts ***************************/
+
+typedef struct {
+    int queued;
+    int refused;
+    int notified;
+} downlink_t;
+
+static void burst(downlink_t *down)
+{
+    uint32_t bits;
+
+    for (int i = 0; i < BURST; ) {
+        esp_err_t err = uart_send_async((const uint8_t *)COMMAND, strlen(COMMAND), 0);
+        if (err == ESP_OK) {
+            down->queued++;
+            i++;
+            continue;
+        }
+        CHECK_EQ(err, ESP_ERR_TIMEOUT);
+        down->refused++;
+        /* Full: wait for the queued ones to leave the wire */
+        if (xTaskNotifyWait(0, TX_EVT, &bits, pdMS_TO_TICKS(500)) == pdTRUE)
+            down->notified++;
+    }
+}
+
+static bool wait_commands(uint32_t count)
+{
+    host_node_stats_t stats;
+
+    for (int wait = 0; wait < 500; wait++) {
+        host_node_get_stats(g_node, &stats);
+        if (stats.commands >= count)
+            return true;
+        usleep(2000);
+    }
+    return false;
+}
+
+/*************************** Benchmark ***************************/
+
+int main(void)
+{
+    pthread_t uplink;
+    uplink_t alone = { .lines = (int)host_bench_iterations(UPLINK_RATE) };
+    uplink_t loaded = { .lines = alone.lines };
+    downlink_t down = { 0 };
+    host_node_stats_t before, after;
+    uart_frame_stats_t stats_before, stats_after;
+
+    CHECK_EQ(uart_start_task(), ESP_OK);
+    g_node = host_node_start(UART_NUM_1, 0);
+    uart_set_tx_notify(xTaskGetCurrentTaskHandle(), TX_EVT);
+    g_consuming = true;
+    xTaskCreate(consumer_task, "consumer", 4096, NULL, 5, NULL);
+    usleep(20000);
+
+    /* Uplink alone */
+    pthread_create(&uplink, NULL, uplink_main, &alone);
+    pthread_join(uplink, NULL);
+    settle(&before);
+    int received_alone = g_received;
+
+    /* Uplink again, command bursts meanwhile */
+    uart_get_frame_stats(UART_PORT_ALL, &stats_before);
+    int64_t start = esp_timer_get_time();
+    pthread_create(&uplink, NULL, uplink_main, &loaded);
+    int bursts = 0;
+    for (int64_t end = start + (int64_t)(alone.lines * 1000000LL / UPLINK_RATE); esp_timer_get_time() < end; bursts++) {
+        burst(&down);
+        usleep(BURST_GAP_US);
+    }
+    CHECK(wait_commands(before.commands + (uint32_t)down.queued));
+    double downlink_s = (esp_timer_get_time() - start) / 1e6;
+    pthread_join(uplink, NULL);
+    settle(&after);
+    uart_get_frame_stats(UART_PORT_ALL, &stats_after);
+    g_consuming = false;
+
+    int received_loaded = g_received - received_alone;
+    uint32_t commands = after.commands - before.commands;
+    printf("uplink alone: %d of %d lines in %.2f s\n", received_alone, alone.lines, alone.seconds);
+    printf("uplink with bursts: %d of %d lines in %.2f s\n", received_loaded, loaded.lines, loaded.seconds);
+    printf("downlink: %d bursts of %d, %lu commands delivered in %.2f s (%.0f commands/s, %.0f bytes/s), "
+           "%d refused for room, %d TX notifications waited\n", bursts, BURST, (unsigned long)commands, downlink_s,
+           commands / downlink_s, commands * strlen(COMMAND) / downlink_s, down.refused, down.notified);
+
+    /* Every command delivered once, whole */
+    CHECK_EQ(commands, (uint32_t)down.queued);
+    CHECK_EQ(after.errors, 0);
+    CHECK_EQ(strcmp(after.command, COMMAND + 1), 0);
+    CHECK_EQ(after.command_node, 7);
+    CHECK_EQ(stats_after.tx_sent - stats_before.tx_sent, commands);
+    CHECK_EQ(stats_after.tx_full - stats_before.tx_full, (uint32_t)down.refused);
+    CHECK(down.refused == 0 || down.notified > 0);
+
+    /* The uplink is not slowed into losses, and nothing of the downlink came back up */
+    CHECK_EQ(g_echoed, 0);
+    CHECK_EQ(received_loaded, (int)(after.sent - before.sent));
+    CHECK(received_loaded >= loaded.lines * 99 / 100);
+    CHECK_EQ(stats_after.rx_dropped, 0);
+    CHECK_EQ(stats_after.errors, 0);
+
+    host_node_stop(g_node);
+    HOST_TEST_END();
+}
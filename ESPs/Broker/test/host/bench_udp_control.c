@@ -0,0 +1,315 @@
+/**
+ * @file bench_udp_control.c
+ * @brief Control command latency, signed UDP datagram against MQTT publish
+ *
+ * Everything runs on the loopback interface. The UDP path is the control
+ * task as built for the chip, with its HMAC check and NVS replay floor.
+ * The MQTT path is the one it bypasses: the gateway publishes to a broker
+ * (the local broker stands in for mosquitto on the Pi), the broker
+ * delivers to the ESP's subscription, and a client thread commits the
+ * command to the control ring as MQTT_EVENT_DATA does. A command is timed
+ * from the gateway's send to its frame in the ring, where the dispatcher
+ * takes it. On loopback the two are within noise of each other, the HMAC
+ * costs about what the broker relay does. The gain is in the field, where
+ * the broker is a network hop of its own: the estimate adds WIFI_HOP_US
+ * per hop to the measured p50.
+ */
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "host_test.h"
+#include "esp_timer.h"
+#include "nvs.h"
+#include "mbedtls/md.h"
+#include "lwip/sockets.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "control/control_interface.h"
+#include "udp_control/udp_control_interface.h"
+#include "local_broker/local_broker_interface.h"
+#include "mqtt/mqtt_config.h"
+#include "mqtt/mqtt_interface.h"
+#include "mqtt/route/route.h"
+
+#define NODE_ID        7
+#define COMMAND        "led:on"
+#define COMMAND_GAP_US 1000
+#define RING_EVT       (1UL << 0)
+#define RELAY_TOPIC    "bench/control/"   /* The local broker keeps wot/control/ to itself */
+#define WIFI_HOP_US    3000               /* One way over a home access point, for the estimate only */
+
+static const uint8_t g_psk[] = "host-bench-psk-0123456789";
+
+/* Upstream side of the local broker, not used here */
+esp_err_t mqtt_send_buffer(const char *topic, const void *data, size_t len, int qos, int retain, mqtt_lane_t lane)
+{
+    return ESP_OK;
+}
+
+/*************************** Gateway side ***************************/
+
+static uint32_t g_seq;
+
+static int udp_open(void)
+{
+    struct timeval tv = { .tv_sec = 1 };
+    int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    return sock;
+}
+
+/* Signed command datagram, as send_udp_control() of the gateway */
+static void udp_send(int sock)
+{
+    const struct sockaddr_in to = {
+        .sin_family = AF_INET,
+        .sin_port = htons(UDP_CONTROL_PORT),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    uint8_t dgram[64] = { 'W', 'C', 1, 0 };
+    uint8_t mac[32];
+    size_t len = strlen(COMMAND);
+    uint32_t seq = ++g_seq;
+
+    dgram[4] = (uint8_t)(seq >> 24);
+    dgram[5] = (uint8_t)(seq >> 16);
+    dgram[6] = (uint8_t)(seq >> 8);
+    dgram[7] = (uint8_t)seq;
+    dgram[8] = (uint8_t)(NODE_ID >> 8);
+    dgram[9] = (uint8_t)NODE_ID;
+    memcpy(dgram + 10, COMMAND, len);
+    mbedtls_md_hmac(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), g_psk, sizeof(g_psk) - 1, dgram, 10 + len, mac);
+    memcpy(dgram + 10 + len, mac, 16);
+    sendto(sock, dgram, 10 + len + 16, 0, (const struct sockaddr *)&to, sizeof(to));
+}
+
+/* Acknowledgement of the last datagram, status or -1 */
+static int udp_ack(int sock)
+{
+    uint8_t ack[64];
+
+    if (recv(sock, ack, sizeof(ack), 0) < 12 || ack[0] != 'W' || ack[1] != 'A')
+        return -1;
+    return ack[3];
+}
+
+static int mqtt_open(const char *id)
+{
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(LOCAL_BROKER_PORT),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    struct timeval tv = { .tv_sec = 2 };
+    uint8_t connect_pkt[] = { 0x10, 15, 0, 4, 'M', 'Q', 'T', 'T', 4, 0x02, 0, 60, 0, 3, id[0], id[1], id[2] };
+    uint8_t connack[4];
+    int one = 1;
+
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    for (int tries = 0; connect(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0; tries++) {
+        if (tries == 50) {
+            close(sock);
+            return -1;
+        }
+        vTaskDelay(pdMS_TO_TICKS(20));   /* The broker task is still starting */
+    }
+    write(sock, connect_pkt, sizeof(connect_pkt));
+    if (recv(sock, connack, sizeof(connack), MSG_WAITALL) != sizeof(connack) || connack[0] != 0x20) {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+/* QoS 0 PUBLISH of the command on the node's control topic */
+static void mqtt_send(int sock)
+{
+    char topic[32];
+    uint8_t pkt[64];
+    size_t n = (size_t)snprintf(topic, sizeof(topic), "%s%d", RELAY_TOPIC, NODE_ID);
+    size_t len = strlen(COMMAND);
+
+    pkt[0] = 0x30;
+    pkt[1] = (uint8_t)(2 + n + len);
+    pkt[2] = 0;
+    pkt[3] = (uint8_t)n;
+    memcpy(pkt + 4, topic, n);
+    memcpy(pkt + 4 + n, COMMAND, len);
+    write(sock, pkt, 4 + n + len);
+}
+
+/*************************** ESP MQTT client ***************************/
+
+static int g_esp;
+
+/* Read one packet, returns its first byte or -1, the body goes to body */
+static int esp_read(uint8_t *body, size_t cap, size_t *len)
+{
+    uint8_t first, b;
+    size_t remaining = 0;
+    int shift = 0;
+
+    if (recv(g_esp, &first, 1, MSG_WAITALL) != 1)
+        return -1;
+    do {
+        if (recv(g_esp, &b, 1, MSG_WAITALL) != 1)
+            return -1;
+        remaining |= (size_t)(b & 0x7F) << shift;
+        shift += 7;
+    } while (b & 0x80);
+    if (remaining > cap || (remaining > 0 && recv(g_esp, body, remaining, MSG_WAITALL) != (ssize_t)remaining))
+        return -1;
+    *len = remaining;
+    return first;
+}
+
+static bool esp_subscribe(void)
+{
+    uint8_t pkt[32] = { 0x82, 0, 0, 1, 0, (uint8_t)(strlen(RELAY_TOPIC) + 1) };
+    uint8_t body[8];
+    size_t n = strlen(RELAY_TOPIC), len;
+
+    memcpy(pkt + 6, RELAY_TOPIC "#", n + 1);
+    pkt[7 + n] = 0;
+    pkt[1] = (uint8_t)(6 + n);
+    write(g_esp, pkt, 8 + n);
+    return esp_read(body, sizeof(body), &len) == 0x90;
+}
+
+/* The commands the broker delivers go to the ring, as MQTT_EVENT_DATA */
+static void *esp_main(void *arg)
+{
+    uint8_t body[128];
+    size_t len;
+    int first;
+
+    (void)arg;
+    while ((first = esp_read(body, sizeof(body), &len)) >= 0) {
+        if ((first >> 4) != 3)
+            continue;
+        size_t topic_len = ((size_t)body[0] << 8) | body[1];
+        size_t data_len = len - 2 - topic_len;
+        const mqtt_route_t *route = mqtt_route_find(NODE_ID);
+        control_frame_t *frame = control_reserve(CONTROL_SRC_MQTT);
+        if (route == NULL || frame == NULL)
+            continue;
+        memcpy(frame->data, route->id_str, route->id_len);
+        memcpy(frame->data + route->id_len, body + 2 + topic_len, data_len);
+        frame->len = data_len + route->id_len;
+        control_commit(CONTROL_SRC_MQTT);
+    }
+    return NULL;
+}
+
+/*************************** Benchmark ***************************/
+
+static int compare_us(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+/* The command's frame in the ring of src, false after a second */
+static bool wait_frame(control_source_t src)
+{
+    for (int tries = 0; tries < 100; tries++) {
+        if (control_peek(src) != NULL)
+            return true;
+        xTaskNotifyWait(0, RING_EVT, NULL, pdMS_TO_TICKS(10));
+    }
+    return false;
+}
+
+/* Sends n commands one at a time, returns how many reached the ring, latency_us sorted */
+static int run(control_source_t src, int sock, int n, int64_t *latency_us)
+{
+    int delivered = 0;
+
+    for (int i = 0; i < n; i++) {
+        int64_t start = esp_timer_get_time();
+        if (src == CONTROL_SRC_UDP)
+            udp_send(sock);
+        else
+            mqtt_send(sock);
+        if (!wait_frame(src))
+            break;
+        latency_us[delivered++] = esp_timer_get_time() - start;
+        const control_frame_t *frame = control_peek(src);
+        CHECK(frame->len == 1 + strlen(COMMAND) && memcmp(frame->data + 1, COMMAND, strlen(COMMAND)) == 0);
+        control_release(src);
+        if (src == CONTROL_SRC_UDP)
+            CHECK_EQ(udp_ack(sock), UDP_CONTROL_OK);
+        usleep(COMMAND_GAP_US);
+    }
+    qsort(latency_us, delivered, sizeof(int64_t), compare_us);
+    return delivered;
+}
+
+static void report(const char *name, const int64_t *latency_us, int delivered)
+{
+    if (delivered == 0)
+        return;
+    printf("%-24s p50 %5lld us, p99 %5lld us, max %5lld us\n", name, (long long)latency_us[delivered / 2],
+           (long long)latency_us[(delivered * 99) / 100], (long long)latency_us[delivered - 1]);
+}
+
+int main(void)
+{
+    int n = (int)host_bench_iterations(500);
+    int64_t *udp_us = calloc(n, sizeof(int64_t));
+    int64_t *mqtt_us = calloc(n, sizeof(int64_t));
+    udp_control_stats_t stats;
+    nvs_handle_t nvs;
+
+    host_nvs_erase_all();
+    CHECK_EQ(nvs_open("udp_control", NVS_READWRITE, &nvs), ESP_OK);
+    CHECK_EQ(nvs_set_blob(nvs, "hmac_key", g_psk, sizeof(g_psk) - 1), ESP_OK);
+    nvs_close(nvs);
+
+    CHECK_EQ(control_init(), ESP_OK);
+    control_set_consumer(xTaskGetCurrentTaskHandle(), RING_EVT);
+    CHECK_EQ(mqtt_route_init(), ESP_OK);
+    CHECK(mqtt_route_get(NODE_ID) != NULL);
+    if (udp_control_start() != ESP_OK || local_broker_start() != ESP_OK) {
+        fprintf(stderr, "listeners didn't start, port %d or %d busy?\n", UDP_CONTROL_PORT, LOCAL_BROKER_PORT);
+        return EXIT_FAILURE;
+    }
+    int udp = udp_open();
+    int mqtt = mqtt_open("gw1");
+    g_esp = mqtt_open("esp");
+    CHECK(mqtt >= 0 && g_esp >= 0);
+    if (mqtt < 0 || g_esp < 0 || !esp_subscribe())
+        HOST_TEST_END();
+    pthread_t esp;
+    pthread_create(&esp, NULL, esp_main, NULL);
+
+    int udp_delivered = run(CONTROL_SRC_UDP, udp, n, udp_us);
+    int mqtt_delivered = run(CONTROL_SRC_MQTT, mqtt, n, mqtt_us);
+    printf("%d commands each, gateway send to the control ring on loopback\n", n);
+    report("UDP, one hop:", udp_us, udp_delivered);
+    report("MQTT QoS 0, via broker:", mqtt_us, mqtt_delivered);
+    if (udp_delivered > 0 && mqtt_delivered > 0)
+        printf("with %d us per network hop: UDP %.1f ms, MQTT through a remote broker %.1f ms\n", WIFI_HOP_US,
+               (udp_us[udp_delivered / 2] + WIFI_HOP_US) / 1000.0, (mqtt_us[mqtt_delivered / 2] + 2 * WIFI_HOP_US) / 1000.0);
+
+    udp_control_get_stats(&stats);
+    CHECK_EQ(udp_delivered, n);
+    CHECK_EQ(mqtt_delivered, n);
+    CHECK_EQ(stats.accepted, (uint32_t)n);
+    CHECK_EQ(stats.bad_tag + stats.replayed + stats.dropped, 0);
+
+    close(udp);
+    close(mqtt);
+    shutdown(g_esp, SHUT_RDWR);
+    pthread_join(esp, NULL);
+    close(g_esp);
+    free(udp_us);
+    free(mqtt_us);
+    HOST_TEST_END();
+}
@@ -0,0 +1,239 @@
+/**
+ * @file host_node.c
+ * @brief Bridge node of the host tests, see host_node.h
+ */
+#include <poll.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "host_node.h"
+#include "bridge_frame.h"
+
+typedef struct {
+    bool used;
+    uint16_t node_id;
+    uint32_t order;
+    char payload[BRIDGE_FRAME_MAX_PAYLOAD + 1];   /* A String in the sketch, held whole */
+} host_node_pending_t;
+
+struct host_node {
+    uart_port_t port;
+    uint32_t max_baud;
+    pthread_t thread;
+    volatile bool running;
+    pthread_mutex_t lock;               /* Everything below, as bridgeLock */
+    uint8_t tx[BRIDGE_FRAME_MAX_ENCODED];
+    uint16_t seq;
+    uint16_t limit;
+    int64_t verify_end_ms;              /* The COMMIT must come by, 0: committed */
+    uint32_t breaks;                    /* host_uart_breaks() seen */
+    host_node_pending_t pending[HOST_NODE_PENDING];
+    int pending_count;
+    uint32_t order;
+    bridge_frame_decoder_t rx;
+    host_node_stats_t stats;
+};
+
+static int64_t host_node_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* With lock held */
+static void host_node_write(host_node_t *n, uint8_t type, uint16_t node_id, const void *payload, size_t len)
+{
+    size_t frame_len = bridge_frame_encode(type, node_id, n->seq++, payload, len, n->tx, sizeof(n->tx));
+    if (frame_len > 0)
+        host_uart_peer_write(n->port, n->tx, frame_len);
+    if (type == BRIDGE_FRAME_DATA)
+        n->stats.sent++;
+}
+
+/* With lock held */
+static bool host_node_has_credit(host_node_t *n)
+{
+    return !n->stats.credit_active || (int16_t)(n->limit - n->seq) > 0;
+}
+
+/* With lock held */
+static void host_node_set_baud(host_node_t *n, uint32_t baud)
+{
+    host_uart_set_peer_baud(n->port, baud);
+    n->stats.baud = baud;
+    n->rx.len = 0;
+}
+
+/* With lock held: keep the reading until credit comes */
+static void host_node_hold(host_node_t *n, uint16_t node_id, const char *payload)
+{
+    host_node_pending_t *slot = NULL;
+
+    n->stats.held++;
+    for (int i = 0; i < HOST_NODE_PENDING; i++) {
+        if (n->pending[i].used && n->pending[i].node_id == node_id) {
+            snprintf(n->pending[i].payload, sizeof(n->pending[i].payload), "%s", payload);
+            n->stats.coalesced++;
+            return;
+        }
+        if (!n->pending[i].used && slot == NULL)
+            slot = &n->pending[i];
+    }
+    if (slot == NULL) {
+        slot = &n->pending[0];
+        for (int i = 1; i < HOST_NODE_PENDING; i++) {
+            if (n->pending[i].order < slot->order)
+                slot = &n->pending[i];
+        }
+        n->stats.dropped++;
+        n->pending_count--;
+    }
+    slot->used = true;
+    slot->node_id = node_id;
+    slot->order = n->order++;
+    snprintf(slot->payload, sizeof(slot->payload), "%s", payload);
+    n->pending_count++;
+}
+
+/* With lock held: the held readings the credit allows, oldest first */
+static void host_node_flush(host_node_t *n)
+{
+    while (n->pending_count > 0 && host_node_has_credit(n)) {
+        host_node_pending_t *oldest = NULL;
+        for (int i = 0; i < HOST_NODE_PENDING; i++) {
+            if (n->pending[i].used && (oldest == NULL || n->pending[i].order < oldest->order))
+                oldest = &n->pending[i];
+        }
+        host_node_write(n, BRIDGE_FRAME_DATA, oldest->node_id, oldest->payload, strlen(oldest->payload));
+        oldest->used = false;
+        n->pending_count--;
+    }
+}
+
+/* With lock held */
+static void host_node_frame(host_node_t *n, const bridge_frame_t *frame)
+{
+    uint8_t ack[4];
+
+    switch (frame->type) {
+        case BRIDGE_FRAME_CONTROL:
+            n->stats.commands++;
+            n->stats.command_node = frame->node_id;
+            snprintf(n->stats.command, sizeof(n->stats.command), "%.*s", (int)frame->len, (const char *)frame->payload);
+            break;
+        case BRIDGE_FRAME_CREDIT:
+            if (frame->len != 3)
+                break;
+            uint16_t value = (uint16_t)((frame->payload[1] << 8) | frame->payload[2]);
+            n->limit = (frame->payload[0] == BRIDGE_CREDIT_RELATIVE) ? (uint16_t)(n->seq + value) : value;
+            n->stats.credit_active = true;
+            break;
+        case BRIDGE_FRAME_BAUD_REQ:
+            if (frame->len != 4)
+                break;
+            uint32_t baud = bridge_get_u32(frame->payload);
+            bool accept = n->max_baud != 0 && baud <= n->max_baud;
+            bridge_put_u32(ack, accept ? baud : 0);
+            host_node_write(n, BRIDGE_FRAME_BAUD_ACK, BRIDGE_NODE_NONE, ack, sizeof(ack));
+            if (accept) {
+                host_node_set_baud(n, baud);
+                n->verify_end_ms = host_node_ms() + BRIDGE_BAUD_VERIFY_MS;
+            }
+            break;
+        case BRIDGE_FRAME_BAUD_TEST:
+            host_node_write(n, BRIDGE_FRAME_BAUD_TEST, BRIDGE_NODE_NONE, frame->payload, frame->len);
+            break;
+        case BRIDGE_FRAME_BAUD_COMMIT:
+            n->verify_end_ms = 0;
+            break;
+        default:
+            break;
+    }
+}
+
+static void *host_node_main(void *arg)
+{
+    host_node_t *n = arg;
+    int fd = host_uart_peer(n->port);
+    uint8_t buf[512];
+    bridge_frame_t frame;
+
+    while (n->running) {
+        struct pollfd pfd = { .fd = fd, .events = POLLIN };
+        ssize_t got = (poll(&pfd, 1, 1) > 0) ? read(fd, buf, sizeof(buf)) : 0;
+
+        pthread_mutex_lock(&n->lock);
+        for (ssize_t i = 0; i < got; i++) {
+            if (bridge_frame_feed(&n->rx, buf[i], &frame))
+                host_node_frame(n, &frame);
+        }
+        n->stats.errors = n->rx.errors;
+
+        /* No COMMIT in time or a break from the broker: the new rate didn't hold */
+        uint32_t breaks = host_uart_breaks(n->port);
+        if ((n->verify_end_ms != 0 && host_node_ms() >= n->verify_end_ms) || breaks != n->breaks) {
+            n->breaks = breaks;
+            n->verify_end_ms = 0;
+            if (n->stats.baud != BRIDGE_BAUD_BASE)
+                host_node_set_baud(n, BRIDGE_BAUD_BASE);
+        }
+        host_node_flush(n);
+        pthread_mutex_unlock(&n->lock);
+    }
+    return NULL;
+}
+
+host_node_t *host_node_start(uart_port_t port, uint32_t max_baud)
+{
+    static const uint8_t delimiter = BRIDGE_FRAME_DELIMITER;
+    host_node_t *n = calloc(1, sizeof(*n));
+
+    n->port = port;
+    n->max_baud = max_baud;
+    n->stats.baud = BRIDGE_BAUD_BASE;
+    n->breaks = host_uart_breaks(port);
+    pthread_mutex_init(&n->lock, NULL);
+    /* Ends whatever partial frame the broker holds */
+    host_uart_peer_write(port, &delimiter, 1);
+    n->running = true;
+    pthread_create(&n->thread, NULL, host_node_main, n);
+    return n;
+}
+
+void host_node_send(host_node_t *n, uint16_t node_id, const char *payload)
+{
+    pthread_mutex_lock(&n->lock);
+    if (n->pending_count == 0 && host_node_has_credit(n))
+        host_node_write(n, BRIDGE_FRAME_DATA, node_id, payload, strlen(payload));
+    else
+        host_node_hold(n, node_id, payload);
+    pthread_mutex_unlock(&n->lock);
+}
+
+int host_node_pending(host_node_t *n)
+{
+    pthread_mutex_lock(&n->lock);
+    int pending = n->pending_count;
+    pthread_mutex_unlock(&n->lock);
+    return pending;
+}
+
+void host_node_get_stats(host_node_t *n, host_node_stats_t *stats)
+{
+    pthread_mutex_lock(&n->lock);
+    *stats = n->stats;
+    pthread_mutex_unlock(&n->lock);
+}
+
+void host_node_stop(host_node_t *n)
+{
+    n->running = false;
+    pthread_join(n->thread, NULL);
+    pthread_mutex_destroy(&n->lock);
+    free(n);
+}
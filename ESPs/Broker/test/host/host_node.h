@@ -0,0 +1,61 @@
+/**
+ * @file host_node.h
+ * @brief Bridge node of the host tests, the framed side of the Node_2 sketch
+ *
+ * A thread on the node end of a host UART (see driver/uart.h) that behaves
+ * as node_2.ino with BRIDGE_FRAMED: it answers the baud rate negotiation up
+ * to its highest rate, falls back on a break or a missing COMMIT, honours
+ * CREDIT frames and, out of credit, holds the latest reading of each node in
+ * BRIDGE_PENDING slots.
+ */
+#ifndef HOST_NODE_H
+#define HOST_NODE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "driver/uart.h"
+
+#define HOST_NODE_PENDING      8     /* BRIDGE_PENDING of the sketch */
+#define HOST_NODE_PAYLOAD_MAX  128
+
+typedef struct host_node host_node_t;
+
+/**
+ * @brief Counters of a node
+ */
+typedef struct {
+    uint32_t sent;          /* DATA frames written */
+    uint32_t held;          /* Readings that had to wait for credit */
+    uint32_t coalesced;     /* Held readings replaced by a newer one of the node */
+    uint32_t dropped;       /* Held readings pushed out by other nodes */
+    uint32_t commands;      /* CONTROL frames received */
+    uint32_t errors;        /* Bad frames received */
+    uint32_t baud;          /* Current rate */
+    bool credit_active;     /* A CREDIT frame came */
+    uint16_t command_node;  /* Node ID of the last command */
+    char command[HOST_NODE_PAYLOAD_MAX];
+} host_node_stats_t;
+
+/**
+ * @brief Start a node on an installed port
+ *
+ * @param port     Port the broker installed
+ * @param max_baud Highest rate accepted, 0 to refuse every proposal
+ */
+host_node_t *host_node_start(uart_port_t port, uint32_t max_baud);
+
+/**
+ * @brief Send one reading of a mesh node, as bridgeSend() with "<node id><payload>"
+ */
+void host_node_send(host_node_t *node, uint16_t node_id, const char *payload);
+
+/**
+ * @brief Readings held for credit
+ */
+int host_node_pending(host_node_t *node);
+
+void host_node_get_stats(host_node_t *node, host_node_stats_t *stats);
+
+void host_node_stop(host_node_t *node);
+
+#endif /* HOST_NODE_H */
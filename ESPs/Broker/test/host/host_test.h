@@ -0,0 +1,60 @@
+/**
+ * @file host_test.h
+ * @brief Checks of the host tests
+ *
+ * A failed CHECK prints where and goes on, HOST_TEST_END() makes the
+ * process fail if any did.
+ */
+#ifndef HOST_TEST_H
+#define HOST_TEST_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static int host_test_failures = 0;
+
+#define CHECK(cond)                                                                   \
+    do {                                                                              \
+        if (!(cond)) {                                                                \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond);  \
+            host_test_failures++;                                                     \
+        }                                                                             \
+    } while (0)
+
+#define CHECK_EQ(a, b)                                                                \
+    do {                                                                              \
+        long long _a = (long long)(a), _b = (long long)(b);                           \
+        if (_a != _b) {                                                               \
+            fprintf(stderr, "%s:%d: CHECK_EQ(%s, %s) failed: %lld != %lld\n",         \
+                    __FILE__, __LINE__, #a, #b, _a, _b);                              \
+            host_test_failures++;                                                     \
+        }                                                                             \
+    } while (0)
+
+#define HOST_TEST_END()                                                               \
+    do {                                                                              \
+        if (host_test_failures > 0) {                                                 \
+            fprintf(stderr, "%d check(s) failed\n", host_test_failures);              \
+            return EXIT_FAILURE;                                                      \
+        }                                                                             \
+        printf("ok\n");                                                               \
+        return EXIT_SUCCESS;                                                          \
+    } while (0)
+
+/* Seconds on CLOCK_MONOTONIC, for the benchmarks */
+static inline double host_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/* Iterations of a benchmark, HOST_BENCH_SCALE in the environment multiplies them */
+static inline long host_bench_iterations(long base)
+{
+    const char *scale = getenv("HOST_BENCH_SCALE");
+    return (scale != NULL && atol(scale) > 0) ? base * atol(scale) : base;
+}
+
+#endif /* HOST_TEST_H */
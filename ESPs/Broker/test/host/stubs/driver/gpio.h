@@ -0,0 +1,20 @@
+/**
+ * @file gpio.h
+ * @brief Host stand-in of the GPIO numbers, the UART pins only name them
+ */
+#ifndef HOST_DRIVER_GPIO_H
+#define HOST_DRIVER_GPIO_H
+
+typedef enum {
+    GPIO_NUM_NC = -1,
+    GPIO_NUM_4  = 4,
+    GPIO_NUM_5  = 5,
+    GPIO_NUM_6  = 6,
+    GPIO_NUM_7  = 7,
+    GPIO_NUM_15 = 15,
+    GPIO_NUM_16 = 16,
+    GPIO_NUM_17 = 17,
+    GPIO_NUM_18 = 18,
+} gpio_num_t;
+
+#endif /* HOST_DRIVER_GPIO_H */
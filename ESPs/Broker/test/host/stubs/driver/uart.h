@@ -0,0 +1,118 @@
+/**
+ * @file uart.h
+ * @brief Host stand-in of the UART driver, each port is a pseudo terminal
+ *
+ * The broker side of a port is the pty slave, a reader thread per port fills
+ * the RX ring from it in FIFO sized chunks and posts UART_DATA, or
+ * UART_PATTERN_DET when a chunk holds the pattern character. The node side
+ * is the pty master, see host_uart_peer(). Pattern positions aren't tracked,
+ * uart_pattern_pop_pos() gives 0 once per pattern character received.
+ *
+ * A pty has no baud rate. Each end records its own, bytes written while
+ * they differ arrive garbled, and above host_uart_set_line_limit() one byte
+ * in about a hundred does, as on a marginal line.
+ */
+#ifndef HOST_DRIVER_UART_H
+#define HOST_DRIVER_UART_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "driver/gpio.h"
+
+typedef enum {
+    UART_NUM_0,
+    UART_NUM_1,
+    UART_NUM_2,
+    UART_NUM_MAX,
+} uart_port_t;
+
+typedef enum { UART_DATA_8_BITS = 3 } uart_word_length_t;
+typedef enum { UART_PARITY_DISABLE = 0 } uart_parity_t;
+typedef enum { UART_STOP_BITS_1 = 1 } uart_stop_bits_t;
+typedef enum { UART_HW_FLOWCTRL_DISABLE = 0 } uart_hw_flowcontrol_t;
+
+typedef struct {
+    int baud_rate;
+    uart_word_length_t data_bits;
+    uart_parity_t parity;
+    uart_stop_bits_t stop_bits;
+    uart_hw_flowcontrol_t flow_ctrl;
+    uint8_t rx_flow_ctrl_thresh;
+    int source_clk;
+} uart_config_t;
+
+typedef enum {
+    UART_DATA,
+    UART_BREAK,
+    UART_BUFFER_FULL,
+    UART_FIFO_OVF,
+    UART_FRAME_ERR,
+    UART_PARITY_ERR,
+    UART_DATA_BREAK,
+    UART_PATTERN_DET,
+    UART_EVENT_MAX,
+} uart_event_type_t;
+
+typedef struct {
+    uart_event_type_t type;
+    size_t size;
+    bool timeout_flag;
+} uart_event_t;
+
+#define UART_PIN_NO_CHANGE  (-1)
+
+esp_err_t uart_driver_install(uart_port_t port, int rx_buffer_size, int tx_buffer_size, int queue_size,
+                              QueueHandle_t *uart_queue, int intr_alloc_flags);
+esp_err_t uart_driver_delete(uart_port_t port);
+esp_err_t uart_param_config(uart_port_t port, const uart_config_t *config);
+esp_err_t uart_set_pin(uart_port_t port, int tx_io_num, int rx_io_num, int rts_io_num, int cts_io_num);
+esp_err_t uart_set_baudrate(uart_port_t port, uint32_t baudrate);
+esp_err_t uart_get_baudrate(uart_port_t port, uint32_t *baudrate);
+int uart_read_bytes(uart_port_t port, void *buf, uint32_t length, TickType_t ticks_to_wait);
+int uart_write_bytes(uart_port_t port, const void *src, size_t size);
+int uart_write_bytes_with_break(uart_port_t port, const void *src, size_t size, int brk_len);
+esp_err_t uart_wait_tx_done(uart_port_t port, TickType_t ticks_to_wait);
+esp_err_t uart_flush_input(uart_port_t port);
+esp_err_t uart_get_buffered_data_len(uart_port_t port, size_t *size);
+esp_err_t uart_enable_pattern_det_baud_intr(uart_port_t port, char pattern_chr, uint8_t chr_num, int chr_tout,
+                                            int post_idle, int pre_idle);
+esp_err_t uart_pattern_queue_reset(uart_port_t port, int queue_length);
+int uart_pattern_pop_pos(uart_port_t port);
+
+/**
+ * @brief Node end of an installed port, a blocking file descriptor
+ */
+int host_uart_peer(uart_port_t port);
+
+/**
+ * @brief Write from the node end at the node's rate, garbled as the line would
+ *
+ * @return Bytes written, -1 on error
+ */
+int host_uart_peer_write(uart_port_t port, const void *data, size_t len);
+
+/**
+ * @brief Rate the node end is at, 115200 after install
+ */
+void host_uart_set_peer_baud(uart_port_t port, uint32_t baud);
+
+/**
+ * @brief Rate the broker end is at, as set by uart_param_config() or uart_set_baudrate()
+ */
+uint32_t host_uart_baud(uart_port_t port);
+
+/**
+ * @brief Line breaks sent by the broker end so far
+ */
+uint32_t host_uart_breaks(uart_port_t port);
+
+/**
+ * @brief Highest rate the line carries cleanly, 0 for any
+ */
+void host_uart_set_line_limit(uart_port_t port, uint32_t baud);
+
+#endif /* HOST_DRIVER_UART_H */
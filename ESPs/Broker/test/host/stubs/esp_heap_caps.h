@@ -0,0 +1,19 @@
+/**
+ * @file esp_heap_caps.h
+ * @brief Host stand-in of the capability allocator, every capability is plain malloc
+ */
+#ifndef HOST_ESP_HEAP_CAPS_H
+#define HOST_ESP_HEAP_CAPS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MALLOC_CAP_SPIRAM      (1 << 10)
+#define MALLOC_CAP_INTERNAL    (1 << 11)
+#define MALLOC_CAP_8BIT        (1 << 2)
+
+void *heap_caps_malloc(size_t size, uint32_t caps);
+void *heap_caps_calloc(size_t n, size_t size, uint32_t caps);
+void heap_caps_free(void *ptr);
+
+#endif /* HOST_ESP_HEAP_CAPS_H */
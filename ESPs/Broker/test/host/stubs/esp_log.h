@@ -0,0 +1,17 @@
+/**
+ * @file esp_log.h
+ * @brief Host stand-in of the ESP-IDF log, printed to stderr when HOST_LOG is set in the environment
+ */
+#ifndef HOST_ESP_LOG_H
+#define HOST_ESP_LOG_H
+
+#include "esp_err.h"
+
+void host_log(char level, const char *tag, const char *fmt, ...) __attribute__((format(printf, 3, 4)));
+
+#define ESP_LOGE(tag, fmt, ...)  host_log('E', tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...)  host_log('W', tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGI(tag, fmt, ...)  host_log('I', tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGD(tag, fmt, ...)  host_log('D', tag, fmt, ##__VA_ARGS__)
+
+#endif /* HOST_ESP_LOG_H */
@@ -0,0 +1,18 @@
+/**
+ * @file esp_mac.h
+ * @brief Host stand-in of the factory MAC addresses, the same fixed one for every interface
+ */
+#ifndef HOST_ESP_MAC_H
+#define HOST_ESP_MAC_H
+
+#include <stdint.h>
+#include "esp_err.h"
+
+typedef enum {
+    ESP_MAC_WIFI_STA,
+    ESP_MAC_WIFI_SOFTAP,
+} esp_mac_type_t;
+
+esp_err_t esp_read_mac(uint8_t *mac, esp_mac_type_t type);
+
+#endif /* HOST_ESP_MAC_H */
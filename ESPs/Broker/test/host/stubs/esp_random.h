@@ -0,0 +1,12 @@
+/**
+ * @file esp_random.h
+ * @brief Host stand-in of the hardware RNG
+ */
+#ifndef HOST_ESP_RANDOM_H
+#define HOST_ESP_RANDOM_H
+
+#include <stdint.h>
+
+uint32_t esp_random(void);
+
+#endif /* HOST_ESP_RANDOM_H */
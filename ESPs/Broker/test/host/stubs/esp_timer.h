@@ -0,0 +1,20 @@
+/**
+ * @file esp_timer.h
+ * @brief Host stand-in of esp_timer_get_time()
+ *
+ * Follows CLOCK_MONOTONIC until a test takes the clock over with
+ * host_clock_set_us(), from then on time only moves when the test says so.
+ * xTaskGetTickCount() reads the same clock.
+ */
+#ifndef HOST_ESP_TIMER_H
+#define HOST_ESP_TIMER_H
+
+#include <stdint.h>
+#include "esp_err.h"
+
+int64_t esp_timer_get_time(void);
+
+void host_clock_set_us(int64_t now_us);
+void host_clock_advance_ms(uint32_t ms);
+
+#endif /* HOST_ESP_TIMER_H */
@@ -0,0 +1,24 @@
+/**
+ * @file esp_vfs_eventfd.h
+ * @brief Host stand-in of the eventfd VFS, Linux has eventfd natively
+ */
+#ifndef HOST_ESP_VFS_EVENTFD_H
+#define HOST_ESP_VFS_EVENTFD_H
+
+#include <stddef.h>
+#include <sys/eventfd.h>
+#include "esp_err.h"
+
+typedef struct {
+    size_t max_fds;
+} esp_vfs_eventfd_config_t;
+
+#define ESP_VFS_EVENTD_CONFIG_DEFAULT() { .max_fds = 5 }
+
+static inline esp_err_t esp_vfs_eventfd_register(const esp_vfs_eventfd_config_t *config)
+{
+    (void)config;
+    return ESP_OK;
+}
+
+#endif /* HOST_ESP_VFS_EVENTFD_H */
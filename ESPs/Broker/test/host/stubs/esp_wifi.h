@@ -0,0 +1,15 @@
+/**
+ * @file esp_wifi.h
+ * @brief Host stand-in of the Wi-Fi driver, the Network sources rely on what it includes
+ */
+#ifndef HOST_ESP_WIFI_H
+#define HOST_ESP_WIFI_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#endif /* HOST_ESP_WIFI_H */
@@ -0,0 +1,50 @@
+/**
+ * @file FreeRTOS.h
+ * @brief Host stand-in of the FreeRTOS kernel types, see host_rtos.c
+ *
+ * One tick is one millisecond. Critical sections take one process wide
+ * recursive lock, whatever portMUX_TYPE they are given.
+ */
+#ifndef HOST_FREERTOS_H
+#define HOST_FREERTOS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+
+#define pdTRUE                 1
+#define pdFALSE                0
+#define pdPASS                 pdTRUE
+#define pdFAIL                 pdFALSE
+#define portMAX_DELAY          ((TickType_t)0xFFFFFFFFu)
+#define configTICK_RATE_HZ     1000
+#define portTICK_PERIOD_MS     (1000 / configTICK_RATE_HZ)
+#define pdMS_TO_TICKS(ms)      ((TickType_t)(((uint64_t)(ms) * configTICK_RATE_HZ) / 1000))
+#define pdTICKS_TO_MS(ticks)   ((uint32_t)(((uint64_t)(ticks) * 1000) / configTICK_RATE_HZ))
+#define configASSERT(x)        ((void)0)
+#define portYIELD_FROM_ISR(x)  ((void)(x))
+#define IRAM_ATTR
+
+typedef struct {
+    int unused;
+} portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED  { 0 }
+
+void taskENTER_CRITICAL(portMUX_TYPE *mux);
+void taskEXIT_CRITICAL(portMUX_TYPE *mux);
+#define portENTER_CRITICAL(mux)  taskENTER_CRITICAL(mux)
+#define portEXIT_CRITICAL(mux)   taskEXIT_CRITICAL(mux)
+
+typedef struct QueueDefinition *QueueHandle_t;
+typedef struct QueueDefinition *SemaphoreHandle_t;
+typedef struct QueueDefinition *QueueSetHandle_t;
+typedef struct QueueDefinition *QueueSetMemberHandle_t;
+typedef struct MessageBufferDef *MessageBufferHandle_t;
+typedef struct TimerDef *TimerHandle_t;
+typedef struct TaskDef *TaskHandle_t;
+
+#endif /* HOST_FREERTOS_H */
@@ -0,0 +1,19 @@
+/**
+ * @file message_buffer.h
+ * @brief Host stand-in of the FreeRTOS message buffers, see host_rtos.c
+ *
+ * Each message takes its length plus sizeof(size_t) of the buffer, as on target.
+ */
+#ifndef HOST_MESSAGE_BUFFER_H
+#define HOST_MESSAGE_BUFFER_H
+
+#include "FreeRTOS.h"
+
+MessageBufferHandle_t xMessageBufferCreate(size_t size);
+void vMessageBufferDelete(MessageBufferHandle_t buffer);
+size_t xMessageBufferSend(MessageBufferHandle_t buffer, const void *data, size_t len, TickType_t wait);
+size_t xMessageBufferReceive(MessageBufferHandle_t buffer, void *data, size_t cap, TickType_t wait);
+size_t xMessageBufferSpacesAvailable(MessageBufferHandle_t buffer);
+BaseType_t xMessageBufferIsEmpty(MessageBufferHandle_t buffer);
+
+#endif /* HOST_MESSAGE_BUFFER_H */
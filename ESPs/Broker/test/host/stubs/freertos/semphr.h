@@ -0,0 +1,18 @@
+/**
+ * @file semphr.h
+ * @brief Host stand-in of the FreeRTOS semaphores, queues of empty items as on target
+ */
+#ifndef HOST_SEMPHR_H
+#define HOST_SEMPHR_H
+
+#include "queue.h"
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void);
+SemaphoreHandle_t xSemaphoreCreateBinary(void);
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max, UBaseType_t initial);
+#define xSemaphoreTake(sem, wait)   xQueueReceive(sem, NULL, wait)
+#define xSemaphoreGive(sem)         xQueueSend(sem, NULL, 0)
+#define vSemaphoreDelete(sem)       vQueueDelete(sem)
+#define uxSemaphoreGetCount(sem)    uxQueueMessagesWaiting(sem)
+
+#endif /* HOST_SEMPHR_H */
@@ -0,0 +1,35 @@
+/**
+ * @file timers.h
+ * @brief Host stand-in of the FreeRTOS software timers
+ *
+ * Nothing fires on its own, a test runs an expired timer's callback with
+ * host_timer_fire().
+ */
+#ifndef HOST_TIMERS_H
+#define HOST_TIMERS_H
+
+#include "FreeRTOS.h"
+
+typedef void (*TimerCallbackFunction_t)(TimerHandle_t timer);
+
+TimerHandle_t xTimerCreate(const char *name, TickType_t period, UBaseType_t reload, void *id,
+                           TimerCallbackFunction_t callback);
+BaseType_t xTimerStart(TimerHandle_t timer, TickType_t wait);
+BaseType_t xTimerStop(TimerHandle_t timer, TickType_t wait);
+BaseType_t xTimerChangePeriod(TimerHandle_t timer, TickType_t period, TickType_t wait);
+BaseType_t xTimerIsTimerActive(TimerHandle_t timer);
+void *pvTimerGetTimerID(TimerHandle_t timer);
+
+/**
+ * @brief Run the callback of an active timer, as the timer task would once it expired
+ *
+ * @return true if the timer was active
+ */
+bool host_timer_fire(TimerHandle_t timer);
+
+/**
+ * @brief Timer created last, for the modules that keep theirs static
+ */
+TimerHandle_t host_timer_last(void);
+
+#endif /* HOST_TIMERS_H */
@@ -0,0 +1,208 @@
+/**
+ * @file host_nvs.c
+ * @brief RAM backed NVS and the MAC address of the host tests, see nvs.h and esp_mac.h
+ */
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "nvs.h"
+#include "esp_mac.h"
+
+#define HOST_NVS_NAMESPACES  8
+#define HOST_NVS_ENTRIES     32
+#define HOST_NVS_NAME_SIZE   16     /* As NVS_KEY_NAME_MAX_SIZE */
+#define HOST_NVS_VALUE_SIZE  64
+
+typedef struct {
+    char key[HOST_NVS_NAME_SIZE];
+    uint8_t value[HOST_NVS_VALUE_SIZE];
+    size_t len;
+} host_nvs_entry_t;
+
+typedef struct {
+    char name[HOST_NVS_NAME_SIZE];
+    uint32_t writes;
+    host_nvs_entry_t entries[HOST_NVS_ENTRIES];
+} host_nvs_namespace_t;
+
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+static host_nvs_namespace_t g_namespaces[HOST_NVS_NAMESPACES];
+
+static host_nvs_namespace_t *host_nvs_find(const char *name)
+{
+    for (int i = 0; i < HOST_NVS_NAMESPACES; i++) {
+        if (g_namespaces[i].name[0] != '\0' && strcmp(g_namespaces[i].name, name) == 0)
+            return &g_namespaces[i];
+    }
+    return NULL;
+}
+
+/* Handle is the namespace index + 1 */
+static host_nvs_namespace_t *host_nvs_get(nvs_handle_t handle)
+{
+    return (handle >= 1 && handle <= HOST_NVS_NAMESPACES) ? &g_namespaces[handle - 1] : NULL;
+}
+
+static host_nvs_entry_t *host_nvs_entry(host_nvs_namespace_t *ns, const char *key, bool create)
+{
+    host_nvs_entry_t *free_entry = NULL;
+
+    for (int i = 0; i < HOST_NVS_ENTRIES; i++) {
+        host_nvs_entry_t *e = &ns->entries[i];
+        if (e->key[0] == '\0') {
+            if (free_entry == NULL)
+                free_entry = e;
+        } else if (strcmp(e->key, key) == 0) {
+            return e;
+        }
+    }
+    if (!create || free_entry == NULL)
+        return NULL;
+    snprintf(free_entry->key, sizeof(free_entry->key), "%s", key);
+    return free_entry;
+}
+
+esp_err_t nvs_open(const char *name, nvs_open_mode_t mode, nvs_handle_t *handle)
+{
+    esp_err_t err = ESP_OK;
+
+    if (name == NULL || handle == NULL || strlen(name) >= HOST_NVS_NAME_SIZE)
+        return ESP_ERR_INVALID_ARG;
+
+    pthread_mutex_lock(&g_lock);
+    host_nvs_namespace_t *ns = host_nvs_find(name);
+    if (ns == NULL && mode == NVS_READWRITE) {
+        for (int i = 0; ns == NULL && i < HOST_NVS_NAMESPACES; i++) {
+            if (g_namespaces[i].name[0] == '\0')
+                ns = &g_namespaces[i];
+        }
+        if (ns != NULL)
+            snprintf(ns->name, sizeof(ns->name), "%s", name);
+    }
+    if (ns == NULL)
+        err = (mode == NVS_READONLY) ? ESP_ERR_NVS_NOT_FOUND : ESP_ERR_NO_MEM;
+    else
+        *handle = (nvs_handle_t)(ns - g_namespaces) + 1;
+    pthread_mutex_unlock(&g_lock);
+    return err;
+}
+
+void nvs_close(nvs_handle_t handle)
+{
+    (void)handle;
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle)
+{
+    return host_nvs_get(handle) != NULL ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out, size_t *len)
+{
+    esp_err_t err = ESP_OK;
+    host_nvs_namespace_t *ns = host_nvs_get(handle);
+
+    if (ns == NULL || key == NULL || len == NULL)
+        return ESP_ERR_INVALID_ARG;
+
+    pthread_mutex_lock(&g_lock);
+    host_nvs_entry_t *e = host_nvs_entry(ns, key, false);
+    if (e == NULL) {
+        err = ESP_ERR_NVS_NOT_FOUND;
+    } else if (out == NULL) {
+        *len = e->len;
+    } else if (*len < e->len) {
+        err = ESP_ERR_NVS_INVALID_LENGTH;
+    } else {
+        memcpy(out, e->value, e->len);
+        *len = e->len;
+    }
+    pthread_mutex_unlock(&g_lock);
+    return err;
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t len)
+{
+    esp_err_t err = ESP_OK;
+    host_nvs_namespace_t *ns = host_nvs_get(handle);
+
+    if (ns == NULL || key == NULL || strlen(key) >= HOST_NVS_NAME_SIZE || len > HOST_NVS_VALUE_SIZE)
+        return ESP_ERR_INVALID_ARG;
+
+    pthread_mutex_lock(&g_lock);
+    host_nvs_entry_t *e = host_nvs_entry(ns, key, true);
+    if (e == NULL) {
+        err = ESP_ERR_NO_MEM;
+    } else {
+        memcpy(e->value, value, len);
+        e->len = len;
+        ns->writes++;
+    }
+    pthread_mutex_unlock(&g_lock);
+    return err;
+}
+
+esp_err_t nvs_get_u32(nvs_handle_t handle, const char *key, uint32_t *out)
+{
+    size_t len = sizeof(*out);
+    uint32_t value;
+
+    esp_err_t err = nvs_get_blob(handle, key, &value, &len);
+    if (err == ESP_OK && len != sizeof(value))
+        err = ESP_ERR_NVS_NOT_FOUND;   /* Stored with another type */
+    if (err == ESP_OK && out != NULL)
+        *out = value;
+    return err;
+}
+
+esp_err_t nvs_set_u32(nvs_handle_t handle, const char *key, uint32_t value)
+{
+    return nvs_set_blob(handle, key, &value, sizeof(value));
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key)
+{
+    esp_err_t err = ESP_OK;
+    host_nvs_namespace_t *ns = host_nvs_get(handle);
+
+    if (ns == NULL || key == NULL)
+        return ESP_ERR_INVALID_ARG;
+
+    pthread_mutex_lock(&g_lock);
+    host_nvs_entry_t *e = host_nvs_entry(ns, key, false);
+    if (e == NULL) {
+        err = ESP_ERR_NVS_NOT_FOUND;
+    } else {
+        memset(e, 0, sizeof(*e));
+        ns->writes++;
+    }
+    pthread_mutex_unlock(&g_lock);
+    return err;
+}
+
+void host_nvs_erase_all(void)
+{
+    pthread_mutex_lock(&g_lock);
+    memset(g_namespaces, 0, sizeof(g_namespaces));
+    pthread_mutex_unlock(&g_lock);
+}
+
+uint32_t host_nvs_writes(const char *name)
+{
+    pthread_mutex_lock(&g_lock);
+    host_nvs_namespace_t *ns = host_nvs_find(name);
+    uint32_t writes = (ns != NULL) ? ns->writes : 0;
+    pthread_mutex_unlock(&g_lock);
+    return writes;
+}
+
+esp_err_t esp_read_mac(uint8_t *mac, esp_mac_type_t type)
+{
+    static const uint8_t host_mac[6] = { 0x24, 0x0a, 0xc4, 0x12, 0x34, 0x56 };
+
+    (void)type;
+    memcpy(mac, host_mac, sizeof(host_mac));
+    return ESP_OK;
+}
@@ -0,0 +1,61 @@
+/**
+ * @file host_partition.c
+ * @brief RAM backed partition of the host tests, see esp_partition.h
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_partition.h"
+
+#define HOST_SECTOR_SIZE  4096
+
+static esp_partition_t g_partition = { .type = ESP_PARTITION_TYPE_DATA, .label = "host" };
+static uint8_t *g_flash = NULL;
+
+void host_partition_set(uint32_t size)
+{
+    free(g_flash);
+    g_flash = NULL;
+    g_partition.size = size;
+    if (size > 0) {
+        g_flash = malloc(size);
+        memset(g_flash, 0x55, size);   /* Not erased */
+    }
+}
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype, const char *label)
+{
+    (void)type;
+    (void)subtype;
+    (void)label;
+    return (g_flash != NULL) ? &g_partition : NULL;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t src_offset, void *dst, size_t size)
+{
+    if (partition != &g_partition || src_offset + size > g_partition.size)
+        return ESP_ERR_INVALID_ARG;
+    memcpy(dst, g_flash + src_offset, size);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *partition, size_t dst_offset, const void *src, size_t size)
+{
+    if (partition != &g_partition || dst_offset + size > g_partition.size)
+        return ESP_ERR_INVALID_ARG;
+    for (size_t i = 0; i < size; i++) {
+        if (g_flash[dst_offset + i] != 0xFF)
+            return ESP_FAIL;   /* Not erased since the last write */
+        g_flash[dst_offset + i] = ((const uint8_t *)src)[i];
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition, size_t offset, size_t size)
+{
+    if (partition != &g_partition || offset % HOST_SECTOR_SIZE != 0 || size % HOST_SECTOR_SIZE != 0 ||
+        offset + size > g_partition.size)
+        return ESP_ERR_INVALID_ARG;
+    memset(g_flash + offset, 0xFF, size);
+    return ESP_OK;
+}
@@ -0,0 +1,740 @@
+/**
+ * @file host_rtos.c
+ * @brief FreeRTOS and ESP-IDF stand-ins for the host tests, on pthreads
+ *
+ * Blocking calls really block, so modules shared by several tasks can be run
+ * from several threads. Waits are measured on CLOCK_MONOTONIC even when a
+ * test drives esp_timer_get_time() by hand.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/timers.h"
+#include "freertos/message_buffer.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "esp_random.h"
+
+/*************************** Clock ***************************/
+
+static pthread_mutex_t g_clock_lock = PTHREAD_MUTEX_INITIALIZER;
+static bool g_clock_manual = false;
+static int64_t g_clock_us = 0;
+
+static int64_t host_monotonic_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+int64_t esp_timer_get_time(void)
+{
+    pthread_mutex_lock(&g_clock_lock);
+    int64_t now = g_clock_manual ? g_clock_us : host_monotonic_us();
+    pthread_mutex_unlock(&g_clock_lock);
+    return now;
+}
+
+void host_clock_set_us(int64_t now_us)
+{
+    pthread_mutex_lock(&g_clock_lock);
+    g_clock_manual = true;
+    g_clock_us = now_us;
+    pthread_mutex_unlock(&g_clock_lock);
+}
+
+void host_clock_advance_ms(uint32_t ms)
+{
+    pthread_mutex_lock(&g_clock_lock);
+    g_clock_manual = true;
+    g_clock_us += (int64_t)ms * 1000;
+    pthread_mutex_unlock(&g_clock_lock);
+}
+
+/* Absolute CLOCK_MONOTONIC deadline of a wait, the condition variables run on it */
+static struct timespec host_deadline(TickType_t wait)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    uint64_t ns = (uint64_t)ts.tv_nsec + (uint64_t)pdTICKS_TO_MS(wait) * 1000000;
+    ts.tv_sec += (time_t)(ns / 1000000000);
+    ts.tv_nsec = (long)(ns % 1000000000);
+    return ts;
+}
+
+static void host_cond_init(pthread_cond_t *cond)
+{
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+/* Wait on cond until the deadline, false once it passed */
+static bool host_cond_wait(pthread_cond_t *cond, pthread_mutex_t *lock, TickType_t wait, const struct timespec *deadline)
+{
+    if (wait == 0)
+        return false;
+    if (wait == portMAX_DELAY) {
+        pthread_cond_wait(cond, lock);
+        return true;
+    }
+    return pthread_cond_timedwait(cond, lock, deadline) != ETIMEDOUT;
+}
+
+/*************************** Critical sections ***************************/
+
+static pthread_mutex_t g_critical;
+static pthread_once_t g_critical_once = PTHREAD_ONCE_INIT;
+
+static void host_critical_init(void)
+{
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&g_critical, &attr);
+    pthread_mutexattr_destroy(&attr);
+}
+
+void taskENTER_CRITICAL(portMUX_TYPE *mux)
+{
+    (void)mux;
+    pthread_once(&g_critical_once, host_critical_init);
+    pthread_mutex_lock(&g_critical);
+}
+
+void taskEXIT_CRITICAL(portMUX_TYPE *mux)
+{
+    (void)mux;
+    pthread_mutex_unlock(&g_critical);
+}
+
+/*************************** Tasks ***************************/
+
+struct TaskDef {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint32_t value;
+    char name[16];
+    pthread_t thread;
+    struct TaskDef *next;       /* Of g_tasks, created tasks only */
+};
+
+static __thread struct TaskDef *t_self = NULL;
+static pthread_mutex_t g_tasks_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct TaskDef *g_tasks = NULL;   /* Newest first */
+
+TickType_t xTaskGetTickCount(void)
+{
+    return (TickType_t)(esp_timer_get_time() / (1000000 / configTICK_RATE_HZ));
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    struct timespec ts = { .tv_sec = pdTICKS_TO_MS(ticks) / 1000, .tv_nsec = (long)(pdTICKS_TO_MS(ticks) % 1000) * 1000000 };
+    nanosleep(&ts, NULL);
+}
+
+void vTaskSetTimeOutState(TimeOut_t *timeout)
+{
+    timeout->entered = (TickType_t)(host_monotonic_us() / 1000);
+}
+
+BaseType_t xTaskCheckForTimeOut(TimeOut_t *timeout, TickType_t *remaining)
+{
+    if (*remaining == portMAX_DELAY)
+        return pdFALSE;
+
+    TickType_t now = (TickType_t)(host_monotonic_us() / 1000);
+    TickType_t elapsed = now - timeout->entered;
+    if (elapsed < *remaining) {
+        *remaining -= elapsed;
+        timeout->entered = now;
+        return pdFALSE;
+    }
+    *remaining = 0;
+    return pdTRUE;
+}
+
+static struct TaskDef *host_task_new(void)
+{
+    struct TaskDef *task = calloc(1, sizeof(*task));
+    pthread_mutex_init(&task->lock, NULL);
+    host_cond_init(&task->cond);
+    return task;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    if (t_self == NULL)
+        t_self = host_task_new();
+    return t_self;
+}
+
+typedef struct {
+    TaskFunction_t fn;
+    void *arg;
+    struct TaskDef *task;
+} host_task_start_t;
+
+static void *host_task_main(void *p)
+{
+    host_task_start_t start = *(host_task_start_t *)p;
+
+    free(p);
+    t_self = start.task;
+    pthread_mutex_lock(&g_tasks_lock);
+    start.task->thread = pthread_self();
+    start.task->next = g_tasks;
+    g_tasks = start.task;
+    pthread_mutex_unlock(&g_tasks_lock);
+    start.fn(start.arg);
+    return NULL;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack, void *arg,
+                                   UBaseType_t priority, TaskHandle_t *handle, BaseType_t core)
+{
+    host_task_start_t *start = malloc(sizeof(*start));
+    pthread_t thread;
+
+    (void)stack;
+    (void)priority;
+    (void)core;
+    start->fn = fn;
+    start->arg = arg;
+    start->task = host_task_new();
+    snprintf(start->task->name, sizeof(start->task->name), "%s", name);
+    if (handle != NULL)
+        *handle = start->task;
+    if (pthread_create(&thread, NULL, host_task_main, start) != 0) {
+        free(start);
+        return pdFAIL;
+    }
+    pthread_detach(thread);
+    return pdPASS;
+}
+
+int64_t host_task_cpu_us(const char *name)
+{
+    int64_t cpu_us = -1;
+    clockid_t clock;
+    struct timespec ts;
+
+    pthread_mutex_lock(&g_tasks_lock);
+    for (struct TaskDef *task = g_tasks; task != NULL; task = task->next) {
+        if (strcmp(task->name, name) != 0)
+            continue;
+        if (pthread_getcpuclockid(task->thread, &clock) == 0 && clock_gettime(clock, &ts) == 0)
+            cpu_us = (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+        break;
+    }
+    pthread_mutex_unlock(&g_tasks_lock);
+    return cpu_us;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack, void *arg,
+                       UBaseType_t priority, TaskHandle_t *handle)
+{
+    return xTaskCreatePinnedToCore(fn, name, stack, arg, priority, handle, 0);
+}
+
+BaseType_t xTaskNotify(TaskHandle_t task, uint32_t value, eNotifyAction action)
+{
+    pthread_mutex_lock(&task->lock);
+    switch (action) {
+        case eSetBits:
+            task->value |= value;
+            break;
+        case eIncrement:
+            task->value++;
+            break;
+        case eSetValueWithOverwrite:
+        case eSetValueWithoutOverwrite:
+            task->value = value;
+            break;
+        default:
+            break;
+    }
+    pthread_cond_broadcast(&task->cond);
+    pthread_mutex_unlock(&task->lock);
+    return pdPASS;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    return xTaskNotify(task, 0, eIncrement);
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t wait)
+{
+    TaskHandle_t self = xTaskGetCurrentTaskHandle();
+    struct timespec deadline = host_deadline(wait);
+
+    pthread_mutex_lock(&self->lock);
+    while (self->value == 0 && host_cond_wait(&self->cond, &self->lock, wait, &deadline))
+        ;
+    uint32_t value = self->value;
+    if (value > 0)
+        self->value = clear ? 0 : value - 1;
+    pthread_mutex_unlock(&self->lock);
+    return value;
+}
+
+BaseType_t xTaskNotifyWait(uint32_t clear_on_entry, uint32_t clear_on_exit, uint32_t *value, TickType_t wait)
+{
+    TaskHandle_t self = xTaskGetCurrentTaskHandle();
+    struct timespec deadline = host_deadline(wait);
+
+    pthread_mutex_lock(&self->lock);
+    self->value &= ~clear_on_entry;
+    while (self->value == 0 && host_cond_wait(&self->cond, &self->lock, wait, &deadline))
+        ;
+    BaseType_t notified = self->value != 0 ? pdTRUE : pdFALSE;
+    if (value != NULL)
+        *value = self->value;
+    if (notified)
+        self->value &= ~clear_on_exit;
+    pthread_mutex_unlock(&self->lock);
+    return notified;
+}
+
+/*************************** Queues and semaphores ***************************/
+
+struct QueueDefinition {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    uint8_t *items;
+    size_t item_size;     /* 0 for semaphores */
+    size_t length;
+    size_t head;
+    size_t count;
+    struct QueueDefinition *set;   /* Queue set the queue is a member of */
+};
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+    struct QueueDefinition *q = calloc(1, sizeof(*q));
+    if (q == NULL)
+        return NULL;
+    q->items = calloc(length, item_size > 0 ? item_size : 1);
+    q->item_size = item_size;
+    q->length = length;
+    pthread_mutex_init(&q->lock, NULL);
+    host_cond_init(&q->changed);
+    return q;
+}
+
+void vQueueDelete(QueueHandle_t queue)
+{
+    if (queue == NULL)
+        return;
+    pthread_cond_destroy(&queue->changed);
+    pthread_mutex_destroy(&queue->lock);
+    free(queue->items);
+    free(queue);
+}
+
+static BaseType_t host_queue_send(QueueHandle_t q, const void *item, TickType_t wait, bool front)
+{
+    struct timespec deadline = host_deadline(wait);
+
+    pthread_mutex_lock(&q->lock);
+    while (q->count == q->length) {
+        if (!host_cond_wait(&q->changed, &q->lock, wait, &deadline) && q->count == q->length) {
+            pthread_mutex_unlock(&q->lock);
+            return errQUEUE_FULL;
+        }
+    }
+    size_t at = front ? (q->head + q->length - 1) % q->length : (q->head + q->count) % q->length;
+    if (q->item_size > 0)
+        memcpy(q->items + at * q->item_size, item, q->item_size);
+    if (front)
+        q->head = at;
+    q->count++;
+    pthread_cond_broadcast(&q->changed);
+    QueueSetHandle_t set = q->set;
+    pthread_mutex_unlock(&q->lock);
+
+    /* A set holds as many handles as its members hold items, it never fills up */
+    if (set != NULL)
+        host_queue_send(set, &q, 0, false);
+    return pdPASS;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t wait)
+{
+    return host_queue_send(queue, item, wait, false);
+}
+
+BaseType_t xQueueSendToFront(QueueHandle_t queue, const void *item, TickType_t wait)
+{
+    return host_queue_send(queue, item, wait, true);
+}
+
+static BaseType_t host_queue_receive(QueueHandle_t q, void *item, TickType_t wait, bool remove)
+{
+    struct timespec deadline = host_deadline(wait);
+
+    pthread_mutex_lock(&q->lock);
+    while (q->count == 0) {
+        if (!host_cond_wait(&q->changed, &q->lock, wait, &deadline) && q->count == 0) {
+            pthread_mutex_unlock(&q->lock);
+            return pdFALSE;
+        }
+    }
+    if (q->item_size > 0 && item != NULL)
+        memcpy(item, q->items + q->head * q->item_size, q->item_size);
+    if (remove) {
+        q->head = (q->head + 1) % q->length;
+        q->count--;
+        pthread_cond_broadcast(&q->changed);
+    }
+    pthread_mutex_unlock(&q->lock);
+    return pdPASS;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t wait)
+{
+    return host_queue_receive(queue, item, wait, true);
+}
+
+BaseType_t xQueuePeek(QueueHandle_t queue, void *item, TickType_t wait)
+{
+    return host_queue_receive(queue, item, wait, false);
+}
+
+BaseType_t xQueueReset(QueueHandle_t queue)
+{
+    pthread_mutex_lock(&queue->lock);
+    queue->head = queue->count = 0;
+    pthread_cond_broadcast(&queue->changed);
+    pthread_mutex_unlock(&queue->lock);
+    return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+    pthread_mutex_lock(&queue->lock);
+    UBaseType_t count = (UBaseType_t)queue->count;
+    pthread_mutex_unlock(&queue->lock);
+    return count;
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t queue)
+{
+    pthread_mutex_lock(&queue->lock);
+    UBaseType_t spaces = (UBaseType_t)(queue->length - queue->count);
+    pthread_mutex_unlock(&queue->lock);
+    return spaces;
+}
+
+QueueSetHandle_t xQueueCreateSet(UBaseType_t length)
+{
+    return xQueueCreate(length, sizeof(QueueSetMemberHandle_t));
+}
+
+BaseType_t xQueueAddToSet(QueueSetMemberHandle_t member, QueueSetHandle_t set)
+{
+    pthread_mutex_lock(&member->lock);
+    bool ok = member->set == NULL && member->count == 0;
+    if (ok)
+        member->set = set;
+    pthread_mutex_unlock(&member->lock);
+    return ok ? pdPASS : pdFAIL;
+}
+
+BaseType_t xQueueRemoveFromSet(QueueSetMemberHandle_t member, QueueSetHandle_t set)
+{
+    pthread_mutex_lock(&member->lock);
+    bool ok = member->set == set && member->count == 0;
+    if (ok)
+        member->set = NULL;
+    pthread_mutex_unlock(&member->lock);
+    return ok ? pdPASS : pdFAIL;
+}
+
+QueueSetMemberHandle_t xQueueSelectFromSet(QueueSetHandle_t set, TickType_t wait)
+{
+    QueueSetMemberHandle_t member = NULL;
+    return xQueueReceive(set, &member, wait) == pdPASS ? member : NULL;
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max, UBaseType_t initial)
+{
+    SemaphoreHandle_t sem = xQueueCreate(max, 0);
+    if (sem != NULL)
+        sem->count = initial;
+    return sem;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    return xSemaphoreCreateCounting(1, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    return xSemaphoreCreateCounting(1, 1);
+}
+
+/*************************** Message buffers ***************************/
+
+struct MessageBufferDef {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    uint8_t *buf;
+    size_t size;
+    size_t head;
+    size_t used;
+};
+
+MessageBufferHandle_t xMessageBufferCreate(size_t size)
+{
+    struct MessageBufferDef *mb = calloc(1, sizeof(*mb));
+    if (mb == NULL)
+        return NULL;
+    mb->buf = malloc(size);
+    mb->size = size;
+    pthread_mutex_init(&mb->lock, NULL);
+    host_cond_init(&mb->changed);
+    return mb;
+}
+
+void vMessageBufferDelete(MessageBufferHandle_t buffer)
+{
+    if (buffer == NULL)
+        return;
+    pthread_cond_destroy(&buffer->changed);
+    pthread_mutex_destroy(&buffer->lock);
+    free(buffer->buf);
+    free(buffer);
+}
+
+/* Up to the end of the ring, then from its start, as the FreeRTOS stream buffer copies */
+static void mb_put(MessageBufferHandle_t mb, const void *src, size_t len)
+{
+    size_t tail = (mb->head + mb->used) % mb->size;
+    size_t first = (len < mb->size - tail) ? len : mb->size - tail;
+
+    memcpy(mb->buf + tail, src, first);
+    memcpy(mb->buf, (const uint8_t *)src + first, len - first);
+    mb->used += len;
+}
+
+static void mb_take(MessageBufferHandle_t mb, void *dst, size_t len)
+{
+    size_t first = (len < mb->size - mb->head) ? len : mb->size - mb->head;
+
+    if (dst != NULL) {
+        memcpy(dst, mb->buf + mb->head, first);
+        memcpy((uint8_t *)dst + first, mb->buf, len - first);
+    }
+    mb->head = (mb->head + len) % mb->size;
+    mb->used -= len;
+}
+
+size_t xMessageBufferSend(MessageBufferHandle_t buffer, const void *data, size_t len, TickType_t wait)
+{
+    struct timespec deadline = host_deadline(wait);
+    size_t need = len + sizeof(size_t);
+
+    if (need > buffer->size)
+        return 0;
+
+    pthread_mutex_lock(&buffer->lock);
+    while (buffer->size - buffer->used < need) {
+        if (!host_cond_wait(&buffer->changed, &buffer->lock, wait, &deadline) && buffer->size - buffer->used < need) {
+            pthread_mutex_unlock(&buffer->lock);
+            return 0;
+        }
+    }
+    mb_put(buffer, &len, sizeof(len));
+    mb_put(buffer, data, len);
+    pthread_cond_broadcast(&buffer->changed);
+    pthread_mutex_unlock(&buffer->lock);
+    return len;
+}
+
+size_t xMessageBufferReceive(MessageBufferHandle_t buffer, void *data, size_t cap, TickType_t wait)
+{
+    struct timespec deadline = host_deadline(wait);
+    size_t len;
+
+    pthread_mutex_lock(&buffer->lock);
+    while (buffer->used == 0) {
+        if (!host_cond_wait(&buffer->changed, &buffer->lock, wait, &deadline) && buffer->used == 0) {
+            pthread_mutex_unlock(&buffer->lock);
+            return 0;
+        }
+    }
+    size_t head = buffer->head;
+    mb_take(buffer, &len, sizeof(len));
+    if (len > cap) {
+        /* Left in the buffer, as on target */
+        buffer->head = head;
+        buffer->used += sizeof(len);
+        pthread_mutex_unlock(&buffer->lock);
+        return 0;
+    }
+    mb_take(buffer, data, len);
+    pthread_cond_broadcast(&buffer->changed);
+    pthread_mutex_unlock(&buffer->lock);
+    return len;
+}
+
+size_t xMessageBufferSpacesAvailable(MessageBufferHandle_t buffer)
+{
+    pthread_mutex_lock(&buffer->lock);
+    size_t free_bytes = buffer->size - buffer->used;
+    pthread_mutex_unlock(&buffer->lock);
+    return free_bytes;
+}
+
+BaseType_t xMessageBufferIsEmpty(MessageBufferHandle_t buffer)
+{
+    pthread_mutex_lock(&buffer->lock);
+    BaseType_t empty = buffer->used == 0 ? pdTRUE : pdFALSE;
+    pthread_mutex_unlock(&buffer->lock);
+    return empty;
+}
+
+/*************************** Timers ***************************/
+
+struct TimerDef {
+    TickType_t period;
+    bool reload;
+    bool active;
+    void *id;
+    TimerCallbackFunction_t callback;
+};
+
+static TimerHandle_t g_timer_last;
+
+TimerHandle_t xTimerCreate(const char *name, TickType_t period, UBaseType_t reload, void *id,
+                           TimerCallbackFunction_t callback)
+{
+    (void)name;
+    struct TimerDef *t = calloc(1, sizeof(*t));
+    if (t == NULL)
+        return NULL;
+    t->period = period;
+    t->reload = reload != 0;
+    t->id = id;
+    t->callback = callback;
+    g_timer_last = t;
+    return t;
+}
+
+BaseType_t xTimerStart(TimerHandle_t timer, TickType_t wait)
+{
+    (void)wait;
+    timer->active = true;
+    return pdPASS;
+}
+
+BaseType_t xTimerStop(TimerHandle_t timer, TickType_t wait)
+{
+    (void)wait;
+    timer->active = false;
+    return pdPASS;
+}
+
+BaseType_t xTimerChangePeriod(TimerHandle_t timer, TickType_t period, TickType_t wait)
+{
+    (void)wait;
+    timer->period = period;
+    timer->active = true;
+    return pdPASS;
+}
+
+BaseType_t xTimerIsTimerActive(TimerHandle_t timer)
+{
+    return timer->active ? pdTRUE : pdFALSE;
+}
+
+void *pvTimerGetTimerID(TimerHandle_t timer)
+{
+    return timer->id;
+}
+
+bool host_timer_fire(TimerHandle_t timer)
+{
+    if (timer == NULL || !timer->active)
+        return false;
+    timer->active = timer->reload;
+    timer->callback(timer);
+    return true;
+}
+
+TimerHandle_t host_timer_last(void)
+{
+    return g_timer_last;
+}
+
+/*************************** ESP-IDF ***************************/
+
+const char *esp_err_to_name(esp_err_t code)
+{
+    switch (code) {
+        case ESP_OK:              return "ESP_OK";
+        case ESP_FAIL:            return "ESP_FAIL";
+        case ESP_ERR_NO_MEM:      return "ESP_ERR_NO_MEM";
+        case ESP_ERR_INVALID_ARG: return "ESP_ERR_INVALID_ARG";
+        case ESP_ERR_NOT_FOUND:   return "ESP_ERR_NOT_FOUND";
+        case ESP_ERR_TIMEOUT:     return "ESP_ERR_TIMEOUT";
+        default:                  return "ESP_ERR";
+    }
+}
+
+void host_log(char level, const char *tag, const char *fmt, ...)
+{
+    static int enabled = -1;
+    if (enabled < 0)
+        enabled = getenv("HOST_LOG") != NULL;
+    if (!enabled)
+        return;
+
+    va_list args;
+    va_start(args, fmt);
+    fprintf(stderr, "%c (%s) ", level, tag);
+    vfprintf(stderr, fmt, args);
+    fputc('\n', stderr);
+    va_end(args);
+}
+
+void *heap_caps_malloc(size_t size, uint32_t caps)
+{
+    (void)caps;
+    return malloc(size);
+}
+
+void *heap_caps_calloc(size_t n, size_t size, uint32_t caps)
+{
+    (void)caps;
+    return calloc(n, size);
+}
+
+void heap_caps_free(void *ptr)
+{
+    free(ptr);
+}
+
+uint32_t esp_random(void)
+{
+    return ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+}
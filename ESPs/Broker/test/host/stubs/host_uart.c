@@ -0,0 +1,372 @@
+/**
+ * @file host_uart.c
+ * @brief UART driver of the host tests on pseudo terminals, see driver/uart.h
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "driver/uart.h"
+
+#define HOST_UART_FIFO      120     /* Bytes per RX chunk, the driver's default full threshold */
+#define HOST_UART_BASE      115200
+#define HOST_UART_NOISE     100     /* One byte in about this many garbled above the line limit */
+
+typedef struct {
+    bool installed;
+    int fd;                   /* Broker end, the pty slave */
+    int peer;                 /* Node end, the pty master */
+    pthread_t reader;
+    volatile bool running;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    uint8_t *rx;              /* RX ring */
+    size_t rx_size;
+    size_t rx_head;
+    size_t rx_used;
+    bool rx_full;             /* UART_BUFFER_FULL posted, not read since */
+    QueueHandle_t events;
+    int pattern;              /* Pattern character, -1 none */
+    uint32_t patterns;        /* Pattern characters not popped yet */
+    volatile uint32_t baud;
+    volatile uint32_t peer_baud;
+    volatile uint32_t line_limit;
+    uint32_t breaks;
+    unsigned int seed_tx;     /* Garbling of each direction, each has one writer */
+    unsigned int seed_rx;
+} host_uart_t;
+
+static host_uart_t g_uarts[UART_NUM_MAX];
+
+static void host_uart_post(host_uart_t *u, uart_event_type_t type, size_t size)
+{
+    uart_event_t event = { .type = type, .size = size };
+
+    /* The driver drops events when the queue is full, the bytes stay buffered */
+    if (u->events != NULL)
+        xQueueSend(u->events, &event, 0);
+}
+
+/* Garble bytes in flight from an end at from_baud to one at to_baud */
+static void host_uart_line(host_uart_t *u, uint8_t *data, size_t len, uint32_t from_baud, uint32_t to_baud,
+                           unsigned int *seed)
+{
+    bool limited = u->line_limit != 0 && from_baud > u->line_limit;
+
+    for (size_t i = 0; i < len; i++) {
+        if (from_baud != to_baud)
+            data[i] = (uint8_t)rand_r(seed);
+        else if (limited && rand_r(seed) % HOST_UART_NOISE == 0)
+            data[i] ^= (uint8_t)(1 + rand_r(seed) % 255);
+    }
+}
+
+static void *host_uart_reader(void *arg)
+{
+    host_uart_t *u = arg;
+    uint8_t chunk[HOST_UART_FIFO];
+
+    while (u->running) {
+        pthread_mutex_lock(&u->lock);
+        size_t room = u->rx_size - u->rx_used;
+        if (room == 0 && !u->rx_full) {
+            u->rx_full = true;
+            host_uart_post(u, UART_BUFFER_FULL, 0);
+        }
+        pthread_mutex_unlock(&u->lock);
+
+        /* A full ring leaves the bytes in the pty, as a full FIFO holds them */
+        struct pollfd pfd = { .fd = u->fd, .events = POLLIN };
+        if (room == 0 || poll(&pfd, 1, 10) <= 0) {
+            if (room == 0)
+                usleep(1000);
+            continue;
+        }
+        ssize_t n = read(u->fd, chunk, room < sizeof(chunk) ? room : sizeof(chunk));
+        if (n <= 0)
+            continue;
+
+        pthread_mutex_lock(&u->lock);
+        uint32_t found = 0;
+        for (ssize_t i = 0; i < n; i++) {
+            u->rx[(u->rx_head + u->rx_used + i) % u->rx_size] = chunk[i];
+            found += (u->pattern >= 0 && chunk[i] == (uint8_t)u->pattern);
+        }
+        u->rx_used += (size_t)n;
+        u->patterns += found;
+        pthread_cond_broadcast(&u->changed);
+        pthread_mutex_unlock(&u->lock);
+
+        host_uart_post(u, found > 0 ? UART_PATTERN_DET : UART_DATA, (size_t)n);
+    }
+    return NULL;
+}
+
+esp_err_t uart_driver_install(uart_port_t port, int rx_buffer_size, int tx_buffer_size, int queue_size,
+                              QueueHandle_t *uart_queue, int intr_alloc_flags)
+{
+    (void)tx_buffer_size;
+    (void)intr_alloc_flags;
+    if (port >= UART_NUM_MAX || g_uarts[port].installed)
+        return ESP_ERR_INVALID_ARG;
+
+    host_uart_t *u = &g_uarts[port];
+    struct termios tio;
+
+    memset(u, 0, sizeof(*u));
+    u->peer = posix_openpt(O_RDWR | O_NOCTTY);
+    if (u->peer < 0 || grantpt(u->peer) != 0 || unlockpt(u->peer) != 0)
+        return ESP_FAIL;
+    u->fd = open(ptsname(u->peer), O_RDWR | O_NOCTTY);
+    if (u->fd < 0) {
+        close(u->peer);
+        return ESP_FAIL;
+    }
+    /* Raw both ways, every byte value passes unchanged */
+    tcgetattr(u->fd, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(u->fd, TCSANOW, &tio);
+    tcgetattr(u->peer, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(u->peer, TCSANOW, &tio);
+
+    u->rx_size = (size_t)rx_buffer_size;
+    u->rx = malloc(u->rx_size);
+    /* No event queue asked for: the caller polls uart_read_bytes() */
+    if (queue_size > 0 && uart_queue != NULL)
+        u->events = xQueueCreate((UBaseType_t)queue_size, sizeof(uart_event_t));
+    u->pattern = -1;
+    u->baud = u->peer_baud = HOST_UART_BASE;
+    u->seed_tx = (unsigned int)port + 1;
+    u->seed_rx = (unsigned int)port + 101;
+    pthread_mutex_init(&u->lock, NULL);
+    pthread_cond_init(&u->changed, NULL);
+    u->running = true;
+    u->installed = true;
+    pthread_create(&u->reader, NULL, host_uart_reader, u);
+
+    if (uart_queue != NULL)
+        *uart_queue = u->events;
+    return ESP_OK;
+}
+
+esp_err_t uart_driver_delete(uart_port_t port)
+{
+    if (port >= UART_NUM_MAX || !g_uarts[port].installed)
+        return ESP_ERR_INVALID_ARG;
+
+    host_uart_t *u = &g_uarts[port];
+    u->running = false;
+    pthread_join(u->reader, NULL);
+    close(u->fd);
+    close(u->peer);
+    if (u->events != NULL)
+        vQueueDelete(u->events);
+    free(u->rx);
+    pthread_cond_destroy(&u->changed);
+    pthread_mutex_destroy(&u->lock);
+    u->installed = false;
+    return ESP_OK;
+}
+
+esp_err_t uart_param_config(uart_port_t port, const uart_config_t *config)
+{
+    if (port >= UART_NUM_MAX || config == NULL)
+        return ESP_ERR_INVALID_ARG;
+    g_uarts[port].baud = (uint32_t)config->baud_rate;
+    return ESP_OK;
+}
+
+esp_err_t uart_set_pin(uart_port_t port, int tx_io_num, int rx_io_num, int rts_io_num, int cts_io_num)
+{
+    (void)tx_io_num;
+    (void)rx_io_num;
+    (void)rts_io_num;
+    (void)cts_io_num;
+    return port < UART_NUM_MAX ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t uart_set_baudrate(uart_port_t port, uint32_t baudrate)
+{
+    if (port >= UART_NUM_MAX)
+        return ESP_ERR_INVALID_ARG;
+    g_uarts[port].baud = baudrate;
+    return ESP_OK;
+}
+
+esp_err_t uart_get_baudrate(uart_port_t port, uint32_t *baudrate)
+{
+    if (port >= UART_NUM_MAX || baudrate == NULL)
+        return ESP_ERR_INVALID_ARG;
+    *baudrate = g_uarts[port].baud;
+    return ESP_OK;
+}
+
+/* As on target: returns once length bytes were read or the wait is over */
+int uart_read_bytes(uart_port_t port, void *buf, uint32_t length, TickType_t ticks_to_wait)
+{
+    host_uart_t *u = &g_uarts[port];
+    struct timespec deadline;
+    size_t got = 0;
+
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    uint64_t ns = (uint64_t)deadline.tv_nsec + (uint64_t)pdTICKS_TO_MS(ticks_to_wait) * 1000000;
+    deadline.tv_sec += (time_t)(ns / 1000000000);
+    deadline.tv_nsec = (long)(ns % 1000000000);
+
+    pthread_mutex_lock(&u->lock);
+    while (got < length) {
+        while (got < length && u->rx_used > 0) {
+            ((uint8_t *)buf)[got++] = u->rx[u->rx_head];
+            u->rx_head = (u->rx_head + 1) % u->rx_size;
+            u->rx_used--;
+            u->rx_full = false;
+        }
+        if (got == length || ticks_to_wait == 0 ||
+            pthread_cond_timedwait(&u->changed, &u->lock, &deadline) == ETIMEDOUT)
+            break;
+    }
+    pthread_mutex_unlock(&u->lock);
+    return (int)got;
+}
+
+int uart_write_bytes(uart_port_t port, const void *src, size_t size)
+{
+    host_uart_t *u = &g_uarts[port];
+    uint8_t *bytes = malloc(size);
+    size_t done = 0;
+
+    memcpy(bytes, src, size);
+    host_uart_line(u, bytes, size, u->baud, u->peer_baud, &u->seed_tx);
+    while (done < size) {
+        ssize_t n = write(u->fd, bytes + done, size - done);
+        if (n < 0 && errno != EINTR && errno != EAGAIN)
+            break;
+        if (n > 0)
+            done += (size_t)n;
+    }
+    free(bytes);
+    return done == size ? (int)size : -1;
+}
+
+int uart_write_bytes_with_break(uart_port_t port, const void *src, size_t size, int brk_len)
+{
+    (void)brk_len;
+    int written = uart_write_bytes(port, src, size);
+    __atomic_add_fetch(&g_uarts[port].breaks, 1, __ATOMIC_SEQ_CST);
+    return written;
+}
+
+esp_err_t uart_wait_tx_done(uart_port_t port, TickType_t ticks_to_wait)
+{
+    (void)ticks_to_wait;
+    /* write() returned once the bytes were in the pty, they are on the wire */
+    return port < UART_NUM_MAX ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t uart_flush_input(uart_port_t port)
+{
+    host_uart_t *u = &g_uarts[port];
+
+    pthread_mutex_lock(&u->lock);
+    u->rx_head = u->rx_used = 0;
+    u->rx_full = false;
+    pthread_mutex_unlock(&u->lock);
+    return ESP_OK;
+}
+
+esp_err_t uart_get_buffered_data_len(uart_port_t port, size_t *size)
+{
+    host_uart_t *u = &g_uarts[port];
+
+    pthread_mutex_lock(&u->lock);
+    *size = u->rx_used;
+    pthread_mutex_unlock(&u->lock);
+    return ESP_OK;
+}
+
+esp_err_t uart_enable_pattern_det_baud_intr(uart_port_t port, char pattern_chr, uint8_t chr_num, int chr_tout,
+                                            int post_idle, int pre_idle)
+{
+    (void)chr_num;
+    (void)chr_tout;
+    (void)post_idle;
+    (void)pre_idle;
+    pthread_mutex_lock(&g_uarts[port].lock);
+    g_uarts[port].pattern = (uint8_t)pattern_chr;
+    pthread_mutex_unlock(&g_uarts[port].lock);
+    return ESP_OK;
+}
+
+esp_err_t uart_pattern_queue_reset(uart_port_t port, int queue_length)
+{
+    (void)queue_length;
+    pthread_mutex_lock(&g_uarts[port].lock);
+    g_uarts[port].patterns = 0;
+    pthread_mutex_unlock(&g_uarts[port].lock);
+    return ESP_OK;
+}
+
+int uart_pattern_pop_pos(uart_port_t port)
+{
+    host_uart_t *u = &g_uarts[port];
+    int pos = -1;
+
+    pthread_mutex_lock(&u->lock);
+    if (u->patterns > 0) {
+        u->patterns--;
+        pos = 0;
+    }
+    pthread_mutex_unlock(&u->lock);
+    return pos;
+}
+
+int host_uart_peer(uart_port_t port)
+{
+    return g_uarts[port].peer;
+}
+
+int host_uart_peer_write(uart_port_t port, const void *data, size_t len)
+{
+    host_uart_t *u = &g_uarts[port];
+    uint8_t *bytes = malloc(len);
+    size_t done = 0;
+
+    memcpy(bytes, data, len);
+    host_uart_line(u, bytes, len, u->peer_baud, u->baud, &u->seed_rx);
+    while (done < len) {
+        ssize_t n = write(u->peer, bytes + done, len - done);
+        if (n < 0 && errno != EINTR && errno != EAGAIN)
+            break;
+        if (n > 0)
+            done += (size_t)n;
+    }
+    free(bytes);
+    return done == len ? (int)len : -1;
+}
+
+void host_uart_set_peer_baud(uart_port_t port, uint32_t baud)
+{
+    g_uarts[port].peer_baud = baud;
+}
+
+uint32_t host_uart_baud(uart_port_t port)
+{
+    return g_uarts[port].baud;
+}
+
+uint32_t host_uart_breaks(uart_port_t port)
+{
+    return __atomic_load_n(&g_uarts[port].breaks, __ATOMIC_SEQ_CST);
+}
+
+void host_uart_set_line_limit(uart_port_t port, uint32_t baud)
+{
+    g_uarts[port].line_limit = baud;
+}
@@ -0,0 +1,13 @@
+/**
+ * @file netdb.h
+ * @brief Host stand-in of the lwIP resolver and socket headers
+ */
+#ifndef HOST_LWIP_NETDB_H
+#define HOST_LWIP_NETDB_H
+
+#include <stdio.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "lwip/sockets.h"
+
+#endif /* HOST_LWIP_NETDB_H */
@@ -0,0 +1,16 @@
+/**
+ * @file sockets.h
+ * @brief Host stand-in of the lwIP socket API, the POSIX one
+ */
+#ifndef HOST_LWIP_SOCKETS_H
+#define HOST_LWIP_SOCKETS_H
+
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <unistd.h>
+
+#endif /* HOST_LWIP_SOCKETS_H */
@@ -0,0 +1,14 @@
+/**
+ * @file mqtt_client.h
+ * @brief Host stand-in of the ESP-MQTT client, only the types the broker headers use
+ *
+ * The calls a module under test makes are defined by the test itself.
+ */
+#ifndef HOST_MQTT_CLIENT_H
+#define HOST_MQTT_CLIENT_H
+
+typedef struct esp_mqtt_client *esp_mqtt_client_handle_t;
+
+int esp_mqtt_client_subscribe(esp_mqtt_client_handle_t client, const char *topic, int qos);
+
+#endif /* HOST_MQTT_CLIENT_H */
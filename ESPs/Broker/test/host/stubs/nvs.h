@@ -0,0 +1,39 @@
+/**
+ * @file nvs.h
+ * @brief Host stand-in of the NVS key-value store, kept in RAM for the life of the process
+ *
+ * A module that stores something and is initialised again sees what it
+ * stored, as after a restart. host_nvs_erase_all() is a fresh flash.
+ */
+#ifndef HOST_NVS_H
+#define HOST_NVS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#define ESP_ERR_NVS_NOT_FOUND       0x1102
+#define ESP_ERR_NVS_INVALID_LENGTH  0x110c
+
+typedef uint32_t nvs_handle_t;
+
+typedef enum {
+    NVS_READONLY,
+    NVS_READWRITE,
+} nvs_open_mode_t;
+
+esp_err_t nvs_open(const char *name, nvs_open_mode_t mode, nvs_handle_t *handle);
+void nvs_close(nvs_handle_t handle);
+esp_err_t nvs_commit(nvs_handle_t handle);
+esp_err_t nvs_get_u32(nvs_handle_t handle, const char *key, uint32_t *out);
+esp_err_t nvs_set_u32(nvs_handle_t handle, const char *key, uint32_t value);
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out, size_t *len);
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t len);
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key);
+
+void host_nvs_erase_all(void);
+
+/* Writes to the namespace so far, to check how often a module hits the flash */
+uint32_t host_nvs_writes(const char *name);
+
+#endif /* HOST_NVS_H */
@@ -0,0 +1,10 @@
+/**
+ * @file sdkconfig.h
+ * @brief Host stand-in of the generated project configuration, the options the modules read
+ */
+#ifndef HOST_SDKCONFIG_H
+#define HOST_SDKCONFIG_H
+
+#define CONFIG_LWIP_MAX_SOCKETS 32   /* As in ESPs/Broker/sdkconfig */
+
+#endif /* HOST_SDKCONFIG_H */
@@ -0,0 +1,215 @@
+/**
+ * @file test_alias.c
+ * @brief Host tests of the MQTT 5 topic aliases, and the bytes they save
+ *
+ * The test plays mqtt_task: look the topic up, "send" the publish, report
+ * it with mqtt_alias_sent(). The last run publishes the readings of a few
+ * nodes round robin and reports the topic bytes saved and the lookups per
+ * second, then does it again with more nodes than aliases.
+ */
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "host_test.h"
+#include "mqtt/mqtt_config.h"
+#include "mqtt/alias/alias.h"
+
+#define PROPERTY_SIZE  3     /* Topic Alias property: identifier + 2 bytes */
+
+/* One publish as mqtt_task does it, returns the alias, *full if the topic went out */
+static uint16_t publish(const char *topic, bool *full)
+{
+    uint16_t alias;
+    const char *sent = mqtt_alias_lookup(topic, &alias);
+
+    *full = sent[0] != '\0';
+    CHECK(*full ? sent == topic : alias != 0);
+    mqtt_alias_sent(alias, strlen(topic), *full);
+    return alias;
+}
+
+static void topic_of(char *topic, size_t size, int node)
+{
+    snprintf(topic, size, "wot/sensors/node-%d", node);
+}
+
+/*************************** Tests ***************************/
+
+static void test_establish(void)
+{
+    mqtt_alias_stats_t before, after;
+    const char *topic = "wot/sensors/node-1";
+    bool full;
+
+    mqtt_alias_get_stats(&before);
+    uint16_t alias = publish(topic, &full);
+    CHECK(alias >= 1 && alias <= MQTT5_TOPIC_ALIAS_MAX);
+    CHECK(full);
+    CHECK_EQ(publish(topic, &full), alias);
+    CHECK(!full);
+    CHECK_EQ(publish(topic, &full), alias);
+    CHECK(!full);
+
+    /* A lookup whose publish didn't go out establishes nothing */
+    uint16_t other;
+    CHECK(mqtt_alias_lookup("wot/sensors/node-2", &other)[0] != '\0');
+    CHECK(other != 0 && other != alias);
+    CHECK(mqtt_alias_lookup("wot/sensors/node-2", &other)[0] != '\0');
+
+    mqtt_alias_get_stats(&after);
+    CHECK_EQ(after.assigned - before.assigned, 2);
+    CHECK_EQ(after.aliased - before.aliased, 2);
+    CHECK_EQ(after.bytes_saved - before.bytes_saved, 2 * (strlen(topic) - PROPERTY_SIZE));
+}
+
+static void test_reset(void)
+{
+    mqtt_alias_stats_t before, after;
+    const char *topic = "wot/sensors/node-1";
+    bool full;
+
+    /* A new connection: same alias, the topic goes out once more */
+    mqtt_alias_get_stats(&before);
+    uint16_t alias = publish(topic, &full);
+    CHECK(!full);
+    mqtt_alias_reset();
+    CHECK_EQ(publish(topic, &full), alias);
+    CHECK(full);
+    CHECK_EQ(publish(topic, &full), alias);
+    CHECK(!full);
+
+    /* Twice in a row, or before anything was sent on the connection */
+    mqtt_alias_reset();
+    mqtt_alias_reset();
+    CHECK_EQ(publish(topic, &full), alias);
+    CHECK(full);
+    mqtt_alias_get_stats(&after);
+    CHECK_EQ(after.assigned, before.assigned);
+    CHECK_EQ(after.aliased - before.aliased, 2);
+}
+
+static void test_lru(void)
+{
+    char topic[32];
+    uint16_t aliases[MQTT5_TOPIC_ALIAS_MAX + 1];
+    bool full;
+
+    /* Every alias taken, node 0 the least recently used but for node 1 ... */
+    mqtt_alias_reset();
+    for (int n = 0; n < MQTT5_TOPIC_ALIAS_MAX; n++) {
+        topic_of(topic, sizeof(topic), 100 + n);
+        aliases[n] = publish(topic, &full);
+    }
+    for (int n = 0; n < MQTT5_TOPIC_ALIAS_MAX; n++) {
+        for (int m = n + 1; m < MQTT5_TOPIC_ALIAS_MAX; m++)
+            CHECK(aliases[n] != aliases[m]);
+    }
+
+    /* ... until node 0 is used again: node 1 is the oldest now and loses its alias */
+    topic_of(topic, sizeof(topic), 100);
+    CHECK_EQ(publish(topic, &full), aliases[0]);
+    CHECK(!full);
+    topic_of(topic, sizeof(topic), 100 + MQTT5_TOPIC_ALIAS_MAX);
+    aliases[MQTT5_TOPIC_ALIAS_MAX] = publish(topic, &full);
+    CHECK(full);
+    CHECK_EQ(aliases[MQTT5_TOPIC_ALIAS_MAX], aliases[1]);
+
+    /* The rebound alias starts over: node 1 takes the next oldest, node 2's */
+    topic_of(topic, sizeof(topic), 101);
+    CHECK_EQ(publish(topic, &full), aliases[2]);
+    CHECK(full);
+    CHECK_EQ(publish(topic, &full), aliases[2]);
+    CHECK(!full);
+    topic_of(topic, sizeof(topic), 100 + MQTT5_TOPIC_ALIAS_MAX);
+    CHECK_EQ(publish(topic, &full), aliases[1]);
+    CHECK(!full);
+}
+
+static void test_cutoff(void)
+{
+    char topic[64];
+    uint16_t alias;
+    bool full;
+
+    /* As long as the property or shorter: sending the topic is cheaper */
+    CHECK(strcmp(mqtt_alias_lookup("a/b", &alias), "a/b") == 0);
+    CHECK_EQ(alias, 0);
+    CHECK(strcmp(mqtt_alias_lookup("abc", &alias), "abc") == 0);
+    CHECK_EQ(alias, 0);
+    CHECK(strcmp(mqtt_alias_lookup("", &alias), "") == 0);
+    CHECK_EQ(alias, 0);
+
+    /* One byte longer saves one byte */
+    mqtt_alias_stats_t before, after;
+    mqtt_alias_get_stats(&before);
+    CHECK(publish("a/bc", &full) != 0);
+    CHECK(publish("a/bc", &full) != 0);
+    CHECK(!full);
+    mqtt_alias_get_stats(&after);
+    CHECK_EQ(after.bytes_saved - before.bytes_saved, 1);
+
+    /* Too long for an entry: always sent in full */
+    memset(topic, 'x', 48);
+    topic[48] = '\0';
+    CHECK(mqtt_alias_lookup(topic, &alias) == topic);
+    CHECK_EQ(alias, 0);
+    topic[47] = '\0';
+    CHECK(publish(topic, &full) != 0);
+    CHECK(publish(topic, &full) != 0);
+    CHECK(!full);
+}
+
+/*************************** Bytes saved ***************************/
+
+static void bench_nodes(int nodes, int rounds)
+{
+    mqtt_alias_stats_t before, after;
+    char topic[32];
+    uint64_t topic_bytes = 0;
+    bool full;
+
+    mqtt_alias_reset();
+    mqtt_alias_get_stats(&before);
+    double start = host_seconds();
+    for (int r = 0; r < rounds; r++) {
+        for (int n = 0; n < nodes; n++) {
+            topic_of(topic, sizeof(topic), nodes * 100 + n);
+            publish(topic, &full);
+            topic_bytes += strlen(topic);
+        }
+    }
+    double elapsed = host_seconds() - start;
+    mqtt_alias_get_stats(&after);
+
+    uint32_t count = (uint32_t)(rounds * nodes);
+    uint32_t aliased = after.aliased - before.aliased;
+    uint32_t saved = after.bytes_saved - before.bytes_saved;
+    printf("%2d nodes, %d aliases: %lu of %lu publishes aliased, %lu of %llu topic bytes saved (%.0f%%), %.0f msg/s\n",
+           nodes, MQTT5_TOPIC_ALIAS_MAX, (unsigned long)aliased, (unsigned long)count, (unsigned long)saved,
+           (unsigned long long)topic_bytes, 100.0 * saved / topic_bytes, count / elapsed);
+
+    if (nodes <= MQTT5_TOPIC_ALIAS_MAX) {
+        /* Each topic goes out once per connection */
+        CHECK_EQ(aliased, count - nodes);
+        CHECK(saved * 100 / topic_bytes >= 75);
+    } else {
+        /* Round robin over more topics than aliases: LRU rebinds every time */
+        CHECK_EQ(aliased, 0);
+        CHECK_EQ(after.assigned - before.assigned, count);
+    }
+}
+
+int main(void)
+{
+    int rounds = (int)host_bench_iterations(2000);
+
+    test_establish();
+    test_reset();
+    test_lru();
+    test_cutoff();
+    bench_nodes(8, rounds);
+    bench_nodes(MQTT5_TOPIC_ALIAS_MAX + 2, rounds);
+
+    HOST_TEST_END();
+}
@@ -0,0 +1,244 @@
+/**
+ * @file test_batch.c
+ * @brief Host tests and benchmark of the telemetry batching
+ *
+ * mqtt_send_slot() is replaced by a decoder of the batch layout in batch.h,
+ * the same walk decode_batch() does on the gateway. The benchmark feeds
+ * readings of 32 nodes through the batching and through one publish per
+ * reading, and reports publishes per second and the bytes on the air.
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "host_test.h"
+#include "freertos/task.h"
+#include "freertos/timers.h"
+#include "mqtt/mqtt_config.h"
+#include "mqtt/mqtt_interface.h"
+#include "mqtt/batch/batch.h"
+
+/* 802.11 MAC header and FCS, LLC/SNAP, IPv4 and TCP headers of one publish */
+#define AIR_OVERHEAD  (28 + 8 + 20 + 20)
+#define BATCH_EVT     (1UL << 3)
+
+static int g_publishes;
+static int g_readings;          /* Records decoded from every batch */
+static int g_last_count;        /* Records of the last batch */
+static size_t g_last_len;
+static size_t g_air_bytes;      /* Bytes the publishes would put on the air */
+static bool g_decode = true;
+static char g_last_node[8];
+
+/* One MQTT PUBLISH: fixed header, topic length, topic and payload */
+static size_t air_bytes(const char *topic, size_t len)
+{
+    size_t remaining = 2 + strlen(topic) + len;
+    return AIR_OVERHEAD + 1 + (remaining < 128 ? 1 : 2) + remaining;
+}
+
+/* Walk a batch as the gateway does, returns the number of records or -1 */
+static int decode(const uint8_t *p, size_t len)
+{
+    if (len < MQTT_BATCH_HEADER_SIZE || p[0] != MQTT_BATCH_MAGIC_0 || p[1] != MQTT_BATCH_MAGIC_1 ||
+        p[2] != MQTT_BATCH_VERSION)
+        return -1;
+
+    size_t off = MQTT_BATCH_HEADER_SIZE;
+    for (int i = 0; i < p[3]; i++) {
+        if (off + 1 > len)
+            return -1;
+        size_t id_len = p[off++];
+        if (off + id_len + 2 > len)
+            return -1;
+        snprintf(g_last_node, sizeof(g_last_node), "%.*s", (int)id_len, (const char *)p + off);
+        off += id_len;
+        size_t data_len = ((size_t)p[off] << 8) | p[off + 1];
+        off += 2 + data_len;
+        if (off > len)
+            return -1;
+    }
+    return off == len ? p[3] : -1;
+}
+
+/* As mqtt_program.c with empty lanes, nothing to evict */
+mqtt_outbox_slot_t *mqtt_reserve_slot(const char *topic, size_t data_cap, mqtt_lane_t lane)
+{
+    return mqtt_outbox_reserve(topic, data_cap, lane, 0);
+}
+
+esp_err_t mqtt_send_slot(mqtt_outbox_slot_t *slot)
+{
+    g_publishes++;
+    g_last_len = slot->data_len;
+    g_air_bytes += air_bytes(slot->topic, slot->data_len);
+    if (g_decode) {
+        CHECK_EQ(strcmp(slot->topic, MQTT_BATCH_TOPIC), 0);
+        g_last_count = decode((const uint8_t *)slot->data, slot->data_len);
+        CHECK(g_last_count > 0);
+        g_readings += g_last_count;
+    }
+    mqtt_outbox_release(slot);
+    return ESP_OK;
+}
+
+static void reset(void)
+{
+    mqtt_batch_flush();
+    g_publishes = g_readings = g_last_count = 0;
+    g_air_bytes = 0;
+}
+
+static esp_err_t add(int node, const char *reading)
+{
+    char id[8];
+    snprintf(id, sizeof(id), "%d", node);
+    return mqtt_batch_add(id, (const uint8_t *)reading, strlen(reading));
+}
+
+/*************************** Tests ***************************/
+
+static void test_count(void)
+{
+    reset();
+    for (int i = 0; i < MQTT_BATCH_MAX_COUNT; i++)
+        CHECK_EQ(add(i, "{\"t\":1}"), ESP_OK);
+    CHECK_EQ(g_publishes, 1);
+    CHECK_EQ(g_last_count, MQTT_BATCH_MAX_COUNT);
+    CHECK_EQ(strcmp(g_last_node, "15"), 0);
+    CHECK(!xTimerIsTimerActive(host_timer_last()));
+}
+
+static void test_bytes(void)
+{
+    char reading[200];
+
+    reset();
+    memset(reading, 'x', sizeof(reading) - 1);
+    reading[sizeof(reading) - 1] = '\0';
+
+    /* Three records of 1 + 1 + 2 + 199 bytes leave no room for a fourth in MQTT_BATCH_MAX_BYTES */
+    for (int i = 0; i < 5; i++)
+        CHECK_EQ(add(i, reading), ESP_OK);
+    CHECK_EQ(g_publishes, 1);
+    CHECK_EQ(g_last_count, 3);
+    CHECK(g_last_len <= MQTT_BATCH_MAX_BYTES);
+
+    /* A reading larger than a batch goes out alone */
+    char big[MQTT_BATCH_MAX_BYTES + 10];
+    memset(big, 'y', sizeof(big) - 1);
+    big[sizeof(big) - 1] = '\0';
+    CHECK_EQ(add(9, big), ESP_OK);
+    CHECK_EQ(g_publishes, 3);
+    CHECK_EQ(g_last_count, 1);
+    CHECK_EQ(g_readings, 6);
+}
+
+static void test_latency(void)
+{
+    reset();
+    CHECK_EQ(add(1, "{\"t\":1}"), ESP_OK);
+    CHECK_EQ(add(2, "{\"t\":2}"), ESP_OK);
+    CHECK_EQ(g_publishes, 0);
+
+    /* The timer task runs the callback MQTT_BATCH_MAX_LATENCY_MS after the first reading, it
+     * only wakes the consumer, which publishes */
+    CHECK(host_timer_fire(host_timer_last()));
+    CHECK_EQ(g_publishes, 0);
+    CHECK_EQ(ulTaskNotifyTake(pdTRUE, 0), BATCH_EVT);
+    mqtt_batch_flush_due();
+    CHECK_EQ(g_publishes, 1);
+    CHECK_EQ(g_last_count, 2);
+    CHECK(!host_timer_fire(host_timer_last()));
+
+    /* Nothing due for a batch opened after the flush */
+    CHECK_EQ(add(3, "{\"t\":3}"), ESP_OK);
+    mqtt_batch_flush_due();
+    CHECK_EQ(g_publishes, 1);
+
+    mqtt_batch_stats_t stats;
+    mqtt_batch_get_stats(&stats);
+    CHECK_EQ(stats.dropped, 0);
+}
+
+static void test_full(void)
+{
+    mqtt_outbox_slot_t *held[MQTT_OUTBOX_SLOTS];
+    mqtt_batch_stats_t before, after;
+    int count = 0;
+
+    /* Telemetry held by the MQTT task, as QoS 1 publishes waiting for their acks */
+    reset();
+    while (count < MQTT_OUTBOX_SLOTS &&
+           (held[count] = mqtt_outbox_reserve("wot/sensors/1", 200, MQTT_LANE_TELEMETRY, 0)) != NULL)
+        count++;
+    CHECK(count > 0);
+
+    /* Refused at once with the batch lock held, not after MQTT_OUTBOX_RESERVE_WAIT */
+    mqtt_batch_get_stats(&before);
+    double start = host_seconds();
+    CHECK_EQ(add(1, "{\"t\":1}"), ESP_FAIL);
+    double waited_ms = (host_seconds() - start) * 1000.0;
+    mqtt_batch_get_stats(&after);
+    CHECK_EQ(after.dropped, before.dropped + 1);
+    CHECK(waited_ms < 10.0);
+
+    for (int i = 0; i < count; i++)
+        mqtt_outbox_release(held[i]);
+    CHECK_EQ(add(1, "{\"t\":1}"), ESP_OK);
+    reset();
+}
+
+/*************************** Benchmark ***************************/
+
+static void bench(void)
+{
+    const char *reading = "{\"temperature\":21.5,\"humidity\":60.2}";
+    size_t len = strlen(reading);
+    long n = host_bench_iterations(200000);
+    char topic[32];
+
+    /* One publish per reading, as app_main did */
+    reset();
+    g_decode = false;
+    double start = host_seconds();
+    for (long i = 0; i < n; i++) {
+        snprintf(topic, sizeof(topic), "wot/sensors/%ld", i % 32);
+        mqtt_outbox_slot_t *slot = mqtt_outbox_reserve(topic, len, MQTT_LANE_TELEMETRY, 0);
+        memcpy(slot->data, reading, len);
+        slot->data_len = len;
+        mqtt_send_slot(slot);
+    }
+    double single_s = host_seconds() - start;
+    int single_publishes = g_publishes;
+    size_t single_air = g_air_bytes;
+
+    reset();
+    g_decode = true;
+    start = host_seconds();
+    for (long i = 0; i < n; i++)
+        add((int)(i % 32), reading);
+    mqtt_batch_flush();
+    double batch_s = host_seconds() - start;
+    CHECK_EQ(g_readings, n);
+
+    printf("single: %d publishes, %.0f readings/s, %.1f air bytes/reading\n",
+           single_publishes, n / single_s, (double)single_air / n);
+    printf("batched: %d publishes, %.0f readings/s, %.1f air bytes/reading, %.0f%% of the air bytes saved\n",
+           g_publishes, n / batch_s, (double)g_air_bytes / n, 100.0 * (1.0 - (double)g_air_bytes / single_air));
+    CHECK(g_air_bytes < single_air);
+}
+
+int main(void)
+{
+    CHECK_EQ(mqtt_outbox_init(), ESP_OK);
+    CHECK_EQ(mqtt_batch_init(), ESP_OK);
+    mqtt_batch_set_consumer(xTaskGetCurrentTaskHandle(), BATCH_EVT);
+
+    test_count();
+    test_bytes();
+    test_latency();
+    test_full();
+    bench();
+
+    HOST_TEST_END();
+}
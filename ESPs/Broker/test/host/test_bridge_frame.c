@@ -0,0 +1,134 @@
+/**
+ * @file test_bridge_frame.c
+ * @brief Host tests of the bridge link framing in bridge_frame.h
+ */
+#include <stdbool.h>
+#include <string.h>
+
+#include "host_test.h"
+#include "bridge_frame.h"
+
+static bridge_frame_decoder_t g_decoder;
+
+/* Feed encoded bytes, returns the number of frames completed, the last one in frame */
+static int feed(const uint8_t *data, size_t len, bridge_frame_t *frame)
+{
+    int frames = 0;
+    for (size_t i = 0; i < len; i++)
+        frames += bridge_frame_feed(&g_decoder, data[i], frame);
+    return frames;
+}
+
+static void test_crc(void)
+{
+    /* Check value of CRC-16/CCITT-FALSE */
+    CHECK_EQ(bridge_crc16((const uint8_t *)"123456789", 9, 0xFFFF), 0x29B1);
+}
+
+/* Random payloads, a quarter of their bytes 0x00, up to the largest frame */
+static void test_round_trip(void)
+{
+    uint8_t payload[BRIDGE_FRAME_MAX_PAYLOAD];
+    uint8_t enc[BRIDGE_FRAME_MAX_ENCODED];
+    bridge_frame_t frame;
+
+    srand(1);
+    for (int it = 0; it < 20000; it++) {
+        size_t len = (it == 0) ? BRIDGE_FRAME_MAX_PAYLOAD : (size_t)rand() % (BRIDGE_FRAME_MAX_PAYLOAD + 1);
+        for (size_t i = 0; i < len; i++)
+            payload[i] = (rand() % 4 == 0) ? 0 : (uint8_t)rand();
+
+        size_t n = bridge_frame_encode(BRIDGE_FRAME_DATA, (uint16_t)it, (uint16_t)(it * 7), payload, len, enc, sizeof(enc));
+        CHECK(n > 0 && n <= sizeof(enc));
+        CHECK_EQ(enc[n - 1], BRIDGE_FRAME_DELIMITER);
+        CHECK(memchr(enc, BRIDGE_FRAME_DELIMITER, n - 1) == NULL);
+
+        CHECK_EQ(feed(enc, n, &frame), 1);
+        CHECK_EQ(frame.type, BRIDGE_FRAME_DATA);
+        CHECK_EQ(frame.node_id, (uint16_t)it);
+        CHECK_EQ(frame.seq, (uint16_t)(it * 7));
+        CHECK_EQ(frame.len, len);
+        CHECK(memcmp(frame.payload, payload, len) == 0);
+    }
+    CHECK_EQ(g_decoder.errors, 0);
+}
+
+/* A corrupted frame is dropped and counted, the next one decodes */
+static void test_resync(void)
+{
+    uint8_t payload[64];
+    uint8_t enc[BRIDGE_FRAME_MAX_ENCODED];
+    bridge_frame_t frame;
+    int passed = 0;
+
+    for (int it = 0; it < 5000; it++) {
+        for (size_t i = 0; i < sizeof(payload); i++)
+            payload[i] = (uint8_t)rand();
+        size_t n = bridge_frame_encode(BRIDGE_FRAME_DATA, 2, (uint16_t)it, payload, sizeof(payload), enc, sizeof(enc));
+
+        /* Any byte but the delimiter, changed to anything, 0x00 included */
+        enc[rand() % (n - 1)] ^= (uint8_t)(1 + rand() % 255);
+        passed += feed(enc, n, &frame);
+
+        n = bridge_frame_encode(BRIDGE_FRAME_DATA, 2, (uint16_t)it, payload, sizeof(payload), enc, sizeof(enc));
+        CHECK_EQ(feed(enc, n, &frame), 1);
+        CHECK(memcmp(frame.payload, payload, sizeof(payload)) == 0);
+    }
+    /* CRC-16 lets about one in 65536 through */
+    CHECK(passed <= 2);
+    CHECK(g_decoder.errors >= 5000 - (uint32_t)passed);
+}
+
+static void test_limits(void)
+{
+    uint8_t enc[BRIDGE_FRAME_MAX_ENCODED];
+    uint8_t small[10];
+    bridge_frame_t frame;
+
+    memset(enc, 0, sizeof(enc));
+    CHECK_EQ(bridge_frame_encode(BRIDGE_FRAME_DATA, 1, 1, enc, BRIDGE_FRAME_MAX_PAYLOAD + 1, enc, sizeof(enc)), 0);
+    CHECK_EQ(bridge_frame_encode(BRIDGE_FRAME_DATA, 1, 1, (const uint8_t *)"hello world", 11, small, sizeof(small)), 0);
+
+    /* Empty frames are ignored, a run longer than any frame is dropped once */
+    uint32_t errors = g_decoder.errors;
+    CHECK_EQ(feed((const uint8_t *)"\0\0\0", 3, &frame), 0);
+    CHECK_EQ(g_decoder.errors, errors);
+    memset(enc, 0x55, sizeof(enc));
+    for (int i = 0; i < 3; i++)
+        feed(enc, sizeof(enc), &frame);
+    CHECK_EQ(feed((const uint8_t *)"", 1, &frame), 0);
+    CHECK_EQ(g_decoder.errors, errors + 1);
+
+    size_t n = bridge_frame_encode(BRIDGE_FRAME_CREDIT, BRIDGE_NODE_NONE, 9, (const uint8_t *)"\0\0\x10", 3, enc, sizeof(enc));
+    CHECK_EQ(feed(enc, n, &frame), 1);
+    CHECK_EQ(frame.node_id, BRIDGE_NODE_NONE);
+    CHECK_EQ(frame.len, 3);
+}
+
+static void test_track(void)
+{
+    bridge_frame_seq_t s = { 0 };
+
+    CHECK_EQ(bridge_frame_track(&s, 5), 0);       /* First frame seen */
+    CHECK_EQ(bridge_frame_track(&s, 8), 2);
+    CHECK_EQ(bridge_frame_track(&s, 0), 0);       /* Sender restarted */
+    CHECK_EQ(bridge_frame_track(&s, 0xFFFF), 0);
+    CHECK_EQ(bridge_frame_track(&s, 0), 0);       /* Wraps */
+    CHECK_EQ(bridge_frame_track(&s, 2), 1);
+    CHECK_EQ(s.lost, 3);
+
+    uint8_t b[4];
+    bridge_put_u32(b, 921600);
+    CHECK_EQ(bridge_get_u32(b), 921600);
+}
+
+int main(void)
+{
+    test_crc();
+    test_round_trip();
+    test_resync();
+    test_limits();
+    test_track();
+
+    HOST_TEST_END();
+}
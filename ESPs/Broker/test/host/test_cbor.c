@@ -0,0 +1,107 @@
+/**
+ * @file test_cbor.c
+ * @brief Host tests and benchmark of the JSON -> CBOR transcoding
+ *
+ * The expected bytes were checked against RFC 8949. The benchmark reports
+ * bytes per message as JSON and as CBOR, and the transcoding rate.
+ */
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "host_test.h"
+#include "mqtt/mqtt_config.h"
+#include "mqtt/cbor/cbor.h"
+
+static size_t transcode(const char *json, uint8_t *out, size_t cap)
+{
+    return mqtt_cbor_from_json((const uint8_t *)json, strlen(json), out, cap);
+}
+
+static void check_bytes(const char *json, const char *expect, size_t expect_len)
+{
+    uint8_t out[MQTT_CBOR_MAX_SIZE];
+    size_t n = transcode(json, out, sizeof(out));
+
+    CHECK_EQ(n, expect_len);
+    if (n != expect_len || memcmp(out, expect, n) != 0) {
+        fprintf(stderr, "wrong CBOR for %s\n", json);
+        CHECK(false);
+    }
+}
+
+static void test_vectors(void)
+{
+    /* Known keys as their index, decimals as tag 4 [-1, m] */
+    check_bytes("{\"temperature\": 42.1, \"humidity\": 65.2, \"light\": 350, \"pressure\": 1013.2}",
+                "\xd9\xd9\xf7\xa4"
+                "\x00\xc4\x82\x20\x19\x01\xa5"
+                "\x01\xc4\x82\x20\x19\x02\x8c"
+                "\x02\x19\x01\x5e"
+                "\x03\xc4\x82\x20\x19\x27\x94", 29);
+    /* Other keys as text, the other scalars */
+    check_bytes("{\"id\":\"n7\",\"on\":true,\"err\":null,\"ok\":false,\"n\":-25}",
+                "\xd9\xd9\xf7\xa5"
+                "\x62id\x62n7"
+                "\x62on\xf5"
+                "\x63" "err\xf6"
+                "\x62ok\xf4"
+                "\x61n\x38\x18", 27);
+    /* Exponent folded into the decimal fraction */
+    check_bytes("{\"e\":1.5e3}", "\xd9\xd9\xf7\xa1\x61" "e\xc4\x82\x02\x0f", 10);
+    /* More than 18 digits, float64 */
+    check_bytes("{\"big\":12345678901234567890}",
+                "\xd9\xd9\xf7\xa1\x63" "big\xfb\x43\xe5\x6a\x95\x31\x9d\x63\xe1", 17);
+    check_bytes("{}", "\xd9\xd9\xf7\xa0", 4);
+}
+
+static void test_left_as_json(void)
+{
+    uint8_t out[MQTT_CBOR_MAX_SIZE];
+
+    CHECK_EQ(transcode("{\"s\":\"a\\\"b\"}", out, sizeof(out)), 0);   /* Escaped string */
+    CHECK_EQ(transcode("{\"a\":{\"b\":1}}", out, sizeof(out)), 0);
+    CHECK_EQ(transcode("hello", out, sizeof(out)), 0);
+    /* Doesn't fit the output */
+    CHECK_EQ(transcode("{\"temperature\":42.1}", out, 8), 0);
+    CHECK_EQ(transcode("{\"temperature\":42.1}", NULL, 0), 0);
+}
+
+static void bench(void)
+{
+    static const char *const readings[] = {
+        "{\"temperature\": 42.1, \"humidity\": 65.2, \"light\": 350, \"pressure\": 1013.2}",
+        "{\"temperature\":21.5,\"humidity\":60.2}",
+        "{\"light\":1023}",
+    };
+    uint8_t out[MQTT_CBOR_MAX_SIZE];
+    long n = host_bench_iterations(500000);
+    volatile size_t sink = 0;
+
+    for (size_t r = 0; r < sizeof(readings) / sizeof(readings[0]); r++) {
+        const char *json = readings[r];
+        size_t json_len = strlen(json);
+        size_t cbor_len = 0;
+
+        double start = host_seconds();
+        for (long i = 0; i < n; i++) {
+            cbor_len = mqtt_cbor_from_json((const uint8_t *)json, json_len, out, sizeof(out));
+            sink += out[cbor_len - 1];
+        }
+        double elapsed = host_seconds() - start;
+
+        printf("%zu bytes JSON -> %zu bytes CBOR (%.0f%%), %.0f transcodes/s\n",
+               json_len, cbor_len, 100.0 * cbor_len / json_len, n / elapsed);
+        CHECK(cbor_len > 0 && cbor_len < json_len);
+    }
+    (void)sink;
+}
+
+int main(void)
+{
+    test_vectors();
+    test_left_as_json();
+    bench();
+
+    HOST_TEST_END();
+}
@@ -0,0 +1,150 @@
+/**
+ * @file test_deadband.c
+ * @brief Host tests of the deadband filter and its suppression ratio
+ *
+ * The clock is driven by the test. The bands are those of mqtt_config.h:
+ * temperature 0.2 absolute, light the default 1% relative.
+ */
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "host_test.h"
+#include "esp_timer.h"
+#include "mqtt/mqtt_config.h"
+#include "mqtt/route/route.h"
+#include "mqtt/deadband/deadband.h"
+
+static const mqtt_route_t *g_node;
+
+static bool pass(const mqtt_route_t *route, const char *reading)
+{
+    return mqtt_deadband_pass(route, (const uint8_t *)reading, strlen(reading));
+}
+
+static void test_absolute(void)
+{
+    /* Against the last forwarded value, a slow drift still gets through */
+    CHECK(pass(g_node, "{\"temperature\":21.5}"));
+    CHECK(!pass(g_node, "{\"temperature\":21.5}"));
+    CHECK(!pass(g_node, "{\"temperature\":21.6}"));
+    CHECK(!pass(g_node, "{\"temperature\":21.35}"));
+    CHECK(pass(g_node, "{\"temperature\":21.8}"));
+    CHECK(!pass(g_node, "{\"temperature\":21.95}"));
+    CHECK(pass(g_node, "{\"temperature\":22.05}"));
+    CHECK(pass(g_node, "{\"temperature\":21.7}"));
+}
+
+static void test_relative(void)
+{
+    /* 1% of 350 is 3.5 */
+    CHECK(pass(g_node, "{\"light\":350}"));
+    CHECK(!pass(g_node, "{\"light\":353}"));
+    CHECK(!pass(g_node, "{\"light\":347}"));
+    CHECK(pass(g_node, "{\"light\":354}"));
+    /* The band scales with the value */
+    CHECK(pass(g_node, "{\"light\":10000}"));
+    CHECK(!pass(g_node, "{\"light\":10090}"));
+    CHECK(pass(g_node, "{\"light\":10110}"));
+    /* No band around zero */
+    CHECK(pass(g_node, "{\"light\":0}"));
+    CHECK(pass(g_node, "{\"light\":0.001}"));
+}
+
+static void test_shape(void)
+{
+    CHECK(pass(g_node, "{\"temperature\":21.5,\"state\":\"on\"}"));
+    CHECK(!pass(g_node, "{\"state\":\"on\",\"temperature\":21.5}"));
+    /* Non numeric values pass on any change, of value or of type */
+    CHECK(pass(g_node, "{\"temperature\":21.5,\"state\":\"off\"}"));
+    CHECK(pass(g_node, "{\"temperature\":21.5,\"state\":1}"));
+    CHECK(pass(g_node, "{\"temperature\":21.5,\"state\":\"1\"}"));
+    /* A field appears or goes away */
+    CHECK(pass(g_node, "{\"temperature\":21.5,\"state\":\"1\",\"light\":5}"));
+    CHECK(pass(g_node, "{\"temperature\":21.5,\"state\":\"1\"}"));
+    /* Not a flat object: always forwarded, the next reading starts over */
+    CHECK(pass(g_node, "hello"));
+    CHECK(pass(g_node, "hello"));
+    CHECK(pass(g_node, "{\"temperature\":21.5,\"state\":\"1\"}"));
+    CHECK(!pass(g_node, "{\"temperature\":21.5,\"state\":\"1\"}"));
+
+    /* Every node has its own last values */
+    const mqtt_route_t *other = mqtt_route_get(8);
+    CHECK(other != NULL && other != g_node);
+    CHECK(pass(other, "{\"temperature\":21.5,\"state\":\"1\"}"));
+    CHECK(!pass(other, "{\"temperature\":21.5,\"state\":\"1\"}"));
+}
+
+static void test_heartbeat(void)
+{
+    mqtt_deadband_stats_t before, after;
+
+    mqtt_deadband_get_stats(&before);
+    CHECK(pass(g_node, "{\"temperature\":30}"));
+    host_clock_advance_ms(MQTT_DEADBAND_HEARTBEAT_MS - 1);
+    CHECK(!pass(g_node, "{\"temperature\":30}"));
+    host_clock_advance_ms(1);
+    CHECK(pass(g_node, "{\"temperature\":30}"));
+    CHECK(!pass(g_node, "{\"temperature\":30}"));
+    /* A change restarts the interval */
+    host_clock_advance_ms(MQTT_DEADBAND_HEARTBEAT_MS / 2);
+    CHECK(pass(g_node, "{\"temperature\":31}"));
+    host_clock_advance_ms(MQTT_DEADBAND_HEARTBEAT_MS / 2);
+    CHECK(!pass(g_node, "{\"temperature\":31}"));
+    mqtt_deadband_get_stats(&after);
+    CHECK_EQ(after.heartbeats - before.heartbeats, 1);
+    CHECK_EQ(after.received - before.received, 6);
+    CHECK_EQ(after.suppressed - before.suppressed, 3);
+}
+
+static void test_ratio(void)
+{
+    mqtt_deadband_stats_t before, after;
+    char reading[96];
+    const int seconds = 3600;
+
+    /* An hour of a sensor read every second: temperature jitters by +-0.08, light steps every 10 minutes */
+    mqtt_deadband_get_stats(&before);
+    const mqtt_route_t *node = mqtt_route_get(9);
+    int forwarded = 0;
+    for (int s = 0; s < seconds; s++) {
+        double temperature = 21.5 + ((s * 7) % 5 - 2) * 0.04;
+        int light = 300 + (s / 600) * 20;
+        snprintf(reading, sizeof(reading), "{\"temperature\":%.2f,\"light\":%d}", temperature, light);
+        forwarded += pass(node, reading);
+        host_clock_advance_ms(1000);
+    }
+    mqtt_deadband_get_stats(&after);
+
+    uint32_t received = after.received - before.received;
+    uint32_t suppressed = after.suppressed - before.suppressed;
+    uint32_t heartbeats = after.heartbeats - before.heartbeats;
+    printf("%lu readings, %d forwarded (%lu heartbeats), %lu suppressed, %.1f%% suppressed\n",
+           (unsigned long)received, forwarded, (unsigned long)heartbeats, (unsigned long)suppressed,
+           100.0 * suppressed / received);
+    CHECK_EQ(received, seconds);
+    CHECK_EQ(after.forwarded - before.forwarded, forwarded);
+    CHECK_EQ(received, forwarded + suppressed);
+    /* The first reading and the light steps, the heartbeat forwards the quiet minutes */
+    CHECK_EQ(forwarded - heartbeats, seconds / 600);
+    CHECK(heartbeats > 0);
+    CHECK(suppressed * 100 / received >= 95);
+    CHECK_EQ(after.suppressed_pct, (uint64_t)after.suppressed * 100 / after.received);
+}
+
+int main(void)
+{
+    host_clock_set_us(1000000);
+    CHECK_EQ(mqtt_route_init(), ESP_OK);
+    CHECK_EQ(mqtt_deadband_init(), ESP_OK);
+    g_node = mqtt_route_get(7);
+    CHECK(g_node != NULL);
+
+    test_absolute();
+    test_relative();
+    test_shape();
+    test_heartbeat();
+    test_ratio();
+
+    HOST_TEST_END();
+}
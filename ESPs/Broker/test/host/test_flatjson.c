@@ -0,0 +1,107 @@
+/**
+ * @file test_flatjson.c
+ * @brief Host tests of the flat JSON tokenizer
+ */
+#include <stdbool.h>
+#include <string.h>
+
+#include "host_test.h"
+#include "mqtt/flatjson/flatjson.h"
+
+static int parse(const char *json, mqtt_flatjson_field_t *fields, int max_fields)
+{
+    return mqtt_flatjson_parse((const uint8_t *)json, strlen(json), fields, max_fields);
+}
+
+static bool field_is(const mqtt_flatjson_field_t *f, const char *key, const char *val, mqtt_flatjson_type_t type)
+{
+    return f->key_len == strlen(key) && memcmp(f->key, key, f->key_len) == 0 &&
+           f->val_len == strlen(val) && memcmp(f->val, val, f->val_len) == 0 && f->type == type;
+}
+
+static void test_reading(void)
+{
+    mqtt_flatjson_field_t f[8];
+    const char *json = " { \"temperature\" : 42.1,\"humidity\":65.2,\r\n\"light\":350 ,\"pressure\":-1.0e+3 } ";
+
+    CHECK_EQ(parse(json, f, 8), 4);
+    CHECK(field_is(&f[0], "temperature", "42.1", MQTT_FLATJSON_NUMBER));
+    CHECK(field_is(&f[1], "humidity", "65.2", MQTT_FLATJSON_NUMBER));
+    CHECK(field_is(&f[2], "light", "350", MQTT_FLATJSON_NUMBER));
+    CHECK(field_is(&f[3], "pressure", "-1.0e+3", MQTT_FLATJSON_NUMBER));
+    /* In place, no copy */
+    CHECK(f[0].key == (const uint8_t *)json + 4);
+}
+
+static void test_scalars(void)
+{
+    mqtt_flatjson_field_t f[8];
+
+    CHECK_EQ(parse("{\"id\":\"n\\\"7\",\"on\":true,\"ok\":false,\"err\":null}", f, 8), 4);
+    CHECK(field_is(&f[0], "id", "n\\\"7", MQTT_FLATJSON_STRING));   /* Escapes left as is */
+    CHECK(field_is(&f[1], "on", "true", MQTT_FLATJSON_TRUE));
+    CHECK(field_is(&f[2], "ok", "false", MQTT_FLATJSON_FALSE));
+    CHECK(field_is(&f[3], "err", "null", MQTT_FLATJSON_NULL));
+
+    CHECK_EQ(parse("{}", f, 8), 0);
+    CHECK_EQ(parse("{ }", f, 0), 0);
+}
+
+static void test_rejected(void)
+{
+    static const char *const bad[] = {
+        "",
+        "[1,2]",
+        "{\"a\":{\"b\":1}}",        /* Nested object */
+        "{\"a\":[1]}",              /* Array */
+        "{\"a\":1,}",
+        "{\"a\" 1}",
+        "{\"a\":1",                 /* Cut short */
+        "{\"a\":\"x}",
+        "{\"a\\\"b\":1}",           /* Escaped key */
+        "{\"a\":-}",
+        "{\"a\":1.}",
+        "{\"a\":1e}",
+        "{\"a\":01x}",
+        "{\"a\":tru}",
+        "{a:1}",
+    };
+    mqtt_flatjson_field_t f[8];
+
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        if (parse(bad[i], f, 8) != -1) {
+            fprintf(stderr, "accepted: %s\n", bad[i]);
+            CHECK(false);
+        }
+    }
+
+    /* More fields than the caller has room for */
+    CHECK_EQ(parse("{\"a\":1,\"b\":2,\"c\":3}", f, 2), -1);
+    CHECK_EQ(mqtt_flatjson_parse(NULL, 0, f, 8), -1);
+}
+
+/* Every prefix of a valid object is rejected, none is read past its length */
+static void test_prefixes(void)
+{
+    const char *json = "{\"temperature\":42.1,\"id\":\"node\",\"on\":true}";
+    size_t len = strlen(json);
+    mqtt_flatjson_field_t f[8];
+
+    for (size_t n = 0; n < len; n++) {
+        uint8_t *copy = malloc(n + 1);   /* Exact size, sanitizers catch a read past it */
+        memcpy(copy, json, n);
+        CHECK_EQ(mqtt_flatjson_parse(copy, n, f, 8), -1);
+        free(copy);
+    }
+    CHECK_EQ(parse(json, f, 8), 3);
+}
+
+int main(void)
+{
+    test_reading();
+    test_scalars();
+    test_rejected();
+    test_prefixes();
+
+    HOST_TEST_END();
+}
@@ -0,0 +1,121 @@
+/**
+ * @file test_inflight.c
+ * @brief Host tests of the QoS 1 in-flight window
+ */
+#include <string.h>
+
+#include "host_test.h"
+#include "esp_timer.h"
+#include "mqtt/mqtt_config.h"
+#include "mqtt/inflight/inflight.h"
+
+static uint32_t g_resent[MQTT_INFLIGHT_WINDOW];
+static int g_resent_count;
+
+static int resend(const mqtt_outbox_slot_t *slot, uint32_t seq)
+{
+    (void)slot;
+    g_resent[g_resent_count++] = seq;
+    return 1000 + (int)seq;
+}
+
+/* Fill the window with msg_id 1.. and seq 1.. */
+static void fill_window(void)
+{
+    for (int i = 0; i < MQTT_INFLIGHT_WINDOW; i++) {
+        mqtt_outbox_slot_t *slot = mqtt_outbox_reserve("wot/sensors/1", 16, MQTT_LANE_TELEMETRY, 0);
+        CHECK(slot != NULL);
+        CHECK_EQ(mqtt_inflight_add(slot, i + 1, mqtt_inflight_next_seq()), ESP_OK);
+    }
+    CHECK(mqtt_inflight_full());
+}
+
+static void test_ack(void)
+{
+    uint32_t lost = 99;
+
+    mqtt_inflight_init();
+    fill_window();
+    CHECK(mqtt_inflight_add(NULL, 100, 100) == ESP_ERR_NO_MEM);
+
+    CHECK(mqtt_inflight_ack(3));
+    CHECK(!mqtt_inflight_ack(3));
+    CHECK_EQ(mqtt_inflight_collect(&lost), 1);
+    CHECK_EQ(lost, 0);
+    CHECK(!mqtt_inflight_full());
+
+    /* An ack that beats mqtt_inflight_add() */
+    CHECK(!mqtt_inflight_ack(50));
+    mqtt_outbox_slot_t *slot = mqtt_outbox_reserve("wot/sensors/1", 16, MQTT_LANE_TELEMETRY, 0);
+    CHECK_EQ(mqtt_inflight_add(slot, 50, mqtt_inflight_next_seq()), ESP_OK);
+    CHECK_EQ(mqtt_inflight_collect(&lost), 1);
+
+    for (int i = 1; i <= MQTT_INFLIGHT_WINDOW; i++)
+        mqtt_inflight_ack(i);
+    CHECK_EQ(mqtt_inflight_collect(NULL), MQTT_INFLIGHT_WINDOW - 1);
+    CHECK_EQ(mqtt_inflight_count(), 0);
+    CHECK_EQ(mqtt_outbox_free_slots(), MQTT_OUTBOX_SLOTS);
+}
+
+static void test_deleted(void)
+{
+    uint32_t lost = 0;
+
+    mqtt_inflight_init();
+    fill_window();
+
+    /* The client deleted two publishes, they are lost and their slots come back */
+    CHECK(mqtt_inflight_drop(2));
+    CHECK(mqtt_inflight_drop(5));
+    CHECK(!mqtt_inflight_drop(77));
+    CHECK(mqtt_inflight_ack(1));
+    CHECK_EQ(mqtt_inflight_collect(&lost), 3);
+    CHECK_EQ(lost, 2);
+    CHECK_EQ(mqtt_inflight_count(), MQTT_INFLIGHT_WINDOW - 3);
+
+    for (int i = 1; i <= MQTT_INFLIGHT_WINDOW; i++)
+        mqtt_inflight_drop(i);
+    CHECK_EQ(mqtt_inflight_collect(&lost), MQTT_INFLIGHT_WINDOW - 3);
+    CHECK_EQ(mqtt_outbox_free_slots(), MQTT_OUTBOX_SLOTS);
+}
+
+static void test_timeout(void)
+{
+    uint32_t lost = 0;
+
+    host_clock_set_us(1000000);
+    mqtt_inflight_init();
+    fill_window();
+
+    host_clock_advance_ms(MQTT_INFLIGHT_ACK_TIMEOUT_MS - 1);
+    CHECK_EQ(mqtt_inflight_collect(&lost), 0);
+
+    /* A retransmission restarts the deadline of what it sent */
+    g_resent_count = 0;
+    CHECK(mqtt_inflight_ack(1));
+    CHECK_EQ(mqtt_inflight_resend(resend), MQTT_INFLIGHT_WINDOW - 1);
+    CHECK_EQ(g_resent[0], 2);
+    CHECK_EQ(g_resent[MQTT_INFLIGHT_WINDOW - 2], MQTT_INFLIGHT_WINDOW);
+    CHECK_EQ(mqtt_inflight_collect(&lost), 1);
+
+    host_clock_advance_ms(MQTT_INFLIGHT_ACK_TIMEOUT_MS - 1);
+    CHECK_EQ(mqtt_inflight_collect(&lost), 0);
+    CHECK(mqtt_inflight_ack(1002));   /* New msg_id of seq 2 */
+    host_clock_advance_ms(1);
+    CHECK_EQ(mqtt_inflight_collect(&lost), MQTT_INFLIGHT_WINDOW - 1);
+    CHECK_EQ(lost, MQTT_INFLIGHT_WINDOW - 2);
+    CHECK_EQ(mqtt_inflight_count(), 0);
+    CHECK(!mqtt_inflight_full());
+    CHECK_EQ(mqtt_outbox_free_slots(), MQTT_OUTBOX_SLOTS);
+}
+
+int main(void)
+{
+    CHECK_EQ(mqtt_outbox_init(), ESP_OK);
+
+    test_ack();
+    test_deleted();
+    test_timeout();
+
+    HOST_TEST_END();
+}
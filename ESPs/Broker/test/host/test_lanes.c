@@ -0,0 +1,258 @@
+/**
+ * @file test_lanes.c
+ * @brief Host tests of the MQTT priority lanes over the outbox
+ *
+ * The order, DROP_OLDEST eviction and the starvation counter are checked
+ * on their own, then a telemetry producer saturates the outbox while a
+ * control message goes in every few milliseconds. A consumer stands in
+ * for mqtt_task, a publish takes PUBLISH_US. The queueing delay of the
+ * control messages must stay within a couple of publishes.
+ */
+#include <pthread.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "host_test.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "mqtt/mqtt_config.h"
+#include "mqtt/outbox/outbox.h"
+#include "mqtt/lanes/lanes.h"
+
+#define PUBLISH_US       200     /* Time mqtt_task spends on one publish */
+#define PRODUCER_GAP_US  50      /* Telemetry offered 4 times faster than published */
+#define CONTROL_GAP_US   5000
+#define CONTROL_MAX_US   20000   /* Bound of the control queueing delay, leaves room for the host scheduler */
+
+static uint32_t g_drops[MQTT_LANE_COUNT];
+
+void mqtt_stats_drop(mqtt_lane_t lane)
+{
+    __atomic_fetch_add(&g_drops[lane], 1, __ATOMIC_RELAXED);
+}
+
+static mqtt_outbox_slot_t *make(mqtt_lane_t lane, int n)
+{
+    mqtt_outbox_slot_t *slot = mqtt_outbox_reserve(lane == MQTT_LANE_CONTROL ? "wot/control/7" : "wot/sensors/7",
+                                                   16, lane, 0);
+    if (slot != NULL) {
+        slot->data_len = (size_t)snprintf(slot->data, slot->data_cap + 1, "%d", n);
+        slot->enqueue_us = esp_timer_get_time();
+    }
+    return slot;
+}
+
+static int take(mqtt_lane_t *lane)
+{
+    mqtt_outbox_slot_t *slot = mqtt_lanes_pop(0);
+    *lane = MQTT_LANE_COUNT;
+    if (slot == NULL)
+        return -1;
+    int n = atoi(slot->data);
+    *lane = slot->lane;
+    mqtt_outbox_release(slot);
+    return n;
+}
+
+static void drain(void)
+{
+    mqtt_lane_t lane;
+    while (mqtt_lanes_depth() > 0)
+        take(&lane);
+    memset(g_drops, 0, sizeof(g_drops));
+}
+
+/*************************** Tests ***************************/
+
+static void test_order(void)
+{
+    mqtt_lane_t lane;
+
+    CHECK_EQ(mqtt_lanes_push(make(MQTT_LANE_TELEMETRY, 1)), ESP_OK);
+    CHECK_EQ(mqtt_lanes_push(make(MQTT_LANE_TELEMETRY, 2)), ESP_OK);
+    CHECK_EQ(mqtt_lanes_push(make(MQTT_LANE_CONTROL, 3)), ESP_OK);
+    CHECK_EQ(mqtt_lanes_depth(), 3);
+
+    /* Control first, each lane in its own order */
+    CHECK_EQ(take(&lane), 3);
+    CHECK_EQ(lane, MQTT_LANE_CONTROL);
+    CHECK_EQ(take(&lane), 1);
+    CHECK_EQ(take(&lane), 2);
+    CHECK_EQ(lane, MQTT_LANE_TELEMETRY);
+    CHECK_EQ(take(&lane), -1);
+}
+
+static void test_drop_oldest(void)
+{
+    uint32_t free_slots = mqtt_outbox_free_slots();
+    mqtt_lane_t lane;
+
+    /* Three more than the lane holds: the three oldest go back to the outbox */
+    for (int n = 0; n < MQTT_LANE_TELEMETRY_SIZE + 3; n++)
+        CHECK_EQ(mqtt_lanes_push(make(MQTT_LANE_TELEMETRY, n)), ESP_OK);
+    CHECK_EQ(g_drops[MQTT_LANE_TELEMETRY], 3);
+    CHECK_EQ(mqtt_lanes_depth(), MQTT_LANE_TELEMETRY_SIZE);
+    CHECK_EQ(mqtt_outbox_free_slots(), free_slots - MQTT_LANE_TELEMETRY_SIZE);
+
+    /* A producer out of outbox room evicts once more */
+    CHECK_EQ(mqtt_lanes_evict(MQTT_LANE_TELEMETRY), ESP_OK);
+    CHECK_EQ(g_drops[MQTT_LANE_TELEMETRY], 4);
+    CHECK_EQ(mqtt_outbox_free_slots(), free_slots - MQTT_LANE_TELEMETRY_SIZE + 1);
+
+    for (int n = 4; n < MQTT_LANE_TELEMETRY_SIZE + 3; n++)
+        CHECK_EQ(take(&lane), n);
+    CHECK_EQ(take(&lane), -1);
+    CHECK_EQ(mqtt_outbox_free_slots(), free_slots);
+
+    /* Nothing to evict, and never from the control lane */
+    CHECK_EQ(mqtt_lanes_evict(MQTT_LANE_TELEMETRY), ESP_ERR_NOT_FOUND);
+    CHECK_EQ(mqtt_lanes_push(make(MQTT_LANE_CONTROL, 1)), ESP_OK);
+    CHECK_EQ(mqtt_lanes_evict(MQTT_LANE_CONTROL), ESP_ERR_NOT_FOUND);
+    drain();
+}
+
+static void test_drop_newest(void)
+{
+    /* A full control lane keeps its slots, the new one waits then is refused */
+    for (int n = 0; n < MQTT_LANE_CONTROL_SIZE; n++)
+        CHECK_EQ(mqtt_lanes_push(make(MQTT_LANE_CONTROL, n)), ESP_OK);
+    mqtt_outbox_slot_t *slot = make(MQTT_LANE_CONTROL, 99);
+    double start = host_seconds();
+    CHECK_EQ(mqtt_lanes_push(slot), ESP_ERR_TIMEOUT);
+    CHECK(host_seconds() - start >= 0.9 * MQTT_LANE_CONTROL_WAIT / 1000.0);
+    CHECK_EQ(g_drops[MQTT_LANE_CONTROL], 0);
+    mqtt_outbox_release(slot);
+
+    mqtt_lane_t lane;
+    CHECK_EQ(take(&lane), 0);
+    drain();
+}
+
+static void test_starvation(void)
+{
+    mqtt_lane_t lane;
+
+    /* Control never runs dry: telemetry is served once it was passed over MQTT_LANE_STARVE_LIMIT times */
+    CHECK_EQ(mqtt_lanes_push(make(MQTT_LANE_TELEMETRY, 1000)), ESP_OK);
+    CHECK_EQ(mqtt_lanes_push(make(MQTT_LANE_TELEMETRY, 1001)), ESP_OK);
+    int served_at[2] = { 0, 0 };
+    int telemetry = 0;
+    for (int pop = 1, n = 0; pop <= 2 * MQTT_LANE_STARVE_LIMIT; pop++) {
+        while (mqtt_lanes_depth() < 3)
+            CHECK_EQ(mqtt_lanes_push(make(MQTT_LANE_CONTROL, n++)), ESP_OK);
+        take(&lane);
+        if (lane == MQTT_LANE_TELEMETRY && telemetry < 2)
+            served_at[telemetry++] = pop;
+    }
+    CHECK_EQ(served_at[0], MQTT_LANE_STARVE_LIMIT);
+    CHECK_EQ(served_at[1], 2 * MQTT_LANE_STARVE_LIMIT);
+    drain();
+}
+
+/*************************** Saturating telemetry ***************************/
+
+static volatile bool g_running;
+static uint32_t g_offered, g_published[MQTT_LANE_COUNT];
+static int64_t g_control_delay_us[4096];
+static int g_control_count;
+
+static void *telemetry_main(void *arg)
+{
+    (void)arg;
+    for (int n = 0; g_running; n++) {
+        /* As mqtt_reserve_slot(): no wait, evict the oldest queued reading or count a drop */
+        mqtt_outbox_slot_t *slot = make(MQTT_LANE_TELEMETRY, n);
+        if (slot == NULL && mqtt_lanes_evict(MQTT_LANE_TELEMETRY) == ESP_OK)
+            slot = make(MQTT_LANE_TELEMETRY, n);
+        g_offered++;
+        if (slot == NULL)
+            mqtt_stats_drop(MQTT_LANE_TELEMETRY);
+        else if (mqtt_lanes_push(slot) != ESP_OK)
+            mqtt_outbox_release(slot);
+        usleep(PRODUCER_GAP_US);
+    }
+    return NULL;
+}
+
+static void *consumer_main(void *arg)
+{
+    (void)arg;
+    while (g_running || mqtt_lanes_depth() > 0) {
+        mqtt_outbox_slot_t *slot = mqtt_lanes_pop(pdMS_TO_TICKS(10));
+        if (slot == NULL)
+            continue;
+        if (slot->lane == MQTT_LANE_CONTROL && g_control_count < (int)(sizeof(g_control_delay_us) / sizeof(int64_t)))
+            g_control_delay_us[g_control_count++] = esp_timer_get_time() - slot->enqueue_us;
+        g_published[slot->lane]++;
+        usleep(PUBLISH_US);
+        mqtt_outbox_release(slot);
+    }
+    return NULL;
+}
+
+static int compare_us(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void test_saturated(void)
+{
+    pthread_t telemetry, consumer;
+    int controls = (int)host_bench_iterations(200);
+    int sent = 0;
+
+    g_running = true;
+    pthread_create(&consumer, NULL, consumer_main, NULL);
+    pthread_create(&telemetry, NULL, telemetry_main, NULL);
+    usleep(50000);
+
+    /* The outbox is out of room by now, control still gets its reserve */
+    for (int i = 0; i < controls; i++) {
+        mqtt_outbox_slot_t *slot = mqtt_outbox_reserve("wot/control/7", 16, MQTT_LANE_CONTROL, MQTT_OUTBOX_RESERVE_WAIT);
+        CHECK(slot != NULL);
+        if (slot != NULL) {
+            slot->enqueue_us = esp_timer_get_time();
+            CHECK_EQ(mqtt_lanes_push(slot), ESP_OK);
+            sent++;
+        }
+        usleep(CONTROL_GAP_US);
+    }
+    g_running = false;
+    pthread_join(telemetry, NULL);
+    pthread_join(consumer, NULL);
+
+    qsort(g_control_delay_us, g_control_count, sizeof(int64_t), compare_us);
+    int64_t p50 = g_control_count > 0 ? g_control_delay_us[g_control_count / 2] : 0;
+    int64_t p99 = g_control_count > 0 ? g_control_delay_us[(g_control_count * 99) / 100] : 0;
+    printf("telemetry: %lu offered, %lu published, %lu dropped\n", (unsigned long)g_offered,
+           (unsigned long)g_published[MQTT_LANE_TELEMETRY], (unsigned long)g_drops[MQTT_LANE_TELEMETRY]);
+    printf("control: %d published, queueing p50 %lld us, p99 %lld us, max %lld us (publish %d us)\n",
+           g_control_count, (long long)p50, (long long)p99,
+           (long long)(g_control_count > 0 ? g_control_delay_us[g_control_count - 1] : 0), PUBLISH_US);
+
+    CHECK_EQ(g_control_count, sent);
+    CHECK_EQ(g_drops[MQTT_LANE_CONTROL], 0);
+    /* Saturated: readings were shed, yet telemetry kept moving */
+    CHECK(g_drops[MQTT_LANE_TELEMETRY] > 0);
+    CHECK(g_published[MQTT_LANE_TELEMETRY] > (uint32_t)sent);
+    CHECK(p99 < CONTROL_MAX_US);
+    CHECK_EQ(mqtt_outbox_free_slots(), MQTT_OUTBOX_SLOTS);
+}
+
+int main(void)
+{
+    CHECK_EQ(mqtt_outbox_init(), ESP_OK);
+    CHECK_EQ(mqtt_lanes_init(), ESP_OK);
+
+    test_order();
+    test_drop_oldest();
+    test_drop_newest();
+    test_starvation();
+    test_saturated();
+
+    HOST_TEST_END();
+}
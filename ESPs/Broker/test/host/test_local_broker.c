@@ -0,0 +1,262 @@
+/**
+ * @file test_local_broker.c
+ * @brief Host test and benchmark of the embedded MQTT broker
+ *
+ * The broker task runs on a thread and serves real TCP clients on the
+ * loopback interface. The benchmark sends QoS 0 publishes from one client
+ * to a subscriber and reports messages per second and the publish to
+ * delivery latency.
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "host_test.h"
+#include "esp_timer.h"
+#include "lwip/sockets.h"
+#include "local_broker/local_broker_interface.h"
+#include "control/control_interface.h"
+#include "mqtt/mqtt_config.h"
+#include "mqtt/mqtt_interface.h"
+#include "mqtt/route/route.h"
+
+/* Upstream side of the bridge */
+static int g_upstream;
+
+esp_err_t mqtt_send_buffer(const char *topic, const void *data, size_t len, int qos, int retain, mqtt_lane_t lane)
+{
+    (void)topic;
+    (void)data;
+    (void)len;
+    (void)qos;
+    (void)retain;
+    (void)lane;
+    g_upstream++;
+    return ESP_OK;
+}
+
+/*************************** Test client ***************************/
+
+static int client_connect(const char *id)
+{
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(LOCAL_BROKER_PORT),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    struct timeval tv = { .tv_sec = 2 };
+    uint8_t pkt[64] = { 0x10, 0, 0, 4, 'M', 'Q', 'T', 'T', 4, 0x02, 0, 60, 0, 0 };
+    size_t id_len = strlen(id);
+    int one = 1;
+
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    for (int tries = 0; connect(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0; tries++) {
+        if (tries == 50) {
+            close(sock);
+            return -1;
+        }
+        vTaskDelay(pdMS_TO_TICKS(20));   /* The broker task is still starting */
+    }
+
+    pkt[13] = (uint8_t)id_len;
+    memcpy(pkt + 14, id, id_len);
+    pkt[1] = (uint8_t)(12 + id_len);
+    write(sock, pkt, 14 + id_len);
+    return sock;
+}
+
+/* Read one packet, returns its first byte or -1, the body goes to body */
+static int client_read(int sock, uint8_t *body, size_t cap, size_t *len)
+{
+    uint8_t first, b;
+    size_t remaining = 0;
+    int shift = 0;
+
+    if (recv(sock, &first, 1, MSG_WAITALL) != 1)
+        return -1;
+    do {
+        if (recv(sock, &b, 1, MSG_WAITALL) != 1)
+            return -1;
+        remaining |= (size_t)(b & 0x7F) << shift;
+        shift += 7;
+    } while (b & 0x80);
+    if (remaining > cap || (remaining > 0 && recv(sock, body, remaining, MSG_WAITALL) != (ssize_t)remaining))
+        return -1;
+    *len = remaining;
+    return first;
+}
+
+static void client_subscribe(int sock, const char *filter)
+{
+    uint8_t pkt[96] = { 0x82, 0, 0, 1, 0 };
+    size_t n = strlen(filter);
+
+    pkt[1] = (uint8_t)(2 + 2 + n + 1);
+    pkt[5] = (uint8_t)n;
+    memcpy(pkt + 6, filter, n);
+    pkt[6 + n] = 0;
+    write(sock, pkt, 7 + n);
+}
+
+static void client_publish(int sock, const char *topic, const void *data, size_t len)
+{
+    uint8_t pkt[300];
+    size_t n = strlen(topic);
+    size_t remaining = 2 + n + len;
+
+    pkt[0] = 0x30;
+    pkt[1] = (uint8_t)remaining;   /* Test payloads stay below 128 bytes */
+    pkt[2] = 0;
+    pkt[3] = (uint8_t)n;
+    memcpy(pkt + 4, topic, n);
+    memcpy(pkt + 4 + n, data, len);
+    write(sock, pkt, 2 + remaining);
+}
+
+/* Next PUBLISH of a subscriber, payload copied to data */
+static bool client_next_publish(int sock, char *data, size_t cap)
+{
+    uint8_t body[512];
+    size_t len;
+    int first;
+
+    while ((first = client_read(sock, body, sizeof(body), &len)) >= 0) {
+        if ((first >> 4) != 3)
+            continue;
+        size_t topic_len = ((size_t)body[0] << 8) | body[1];
+        size_t n = len - 2 - topic_len;
+        if (n >= cap)
+            n = cap - 1;
+        memcpy(data, body + 2 + topic_len, n);
+        data[n] = '\0';
+        return true;
+    }
+    return false;
+}
+
+/*************************** Tests ***************************/
+
+static void test_pub_sub(int pub, int sub)
+{
+    char data[64];
+    local_broker_stats_t stats;
+    uint8_t body[8];
+    size_t len;
+
+    CHECK_EQ(client_read(pub, body, sizeof(body), &len), 0x20);   /* CONNACK */
+    CHECK_EQ(client_read(sub, body, sizeof(body), &len), 0x20);
+    client_subscribe(sub, "wot/sensors/#");
+    CHECK_EQ(client_read(sub, body, sizeof(body), &len), 0x90);   /* SUBACK */
+
+    client_publish(pub, "wot/sensors/5", "{\"t\":1}", 7);
+    CHECK(client_next_publish(sub, data, sizeof(data)));
+    CHECK_EQ(strcmp(data, "{\"t\":1}"), 0);
+
+    /* From another task, e.g. node telemetry */
+    CHECK_EQ(local_broker_publish("wot/sensors/7", 13, "{\"t\":2}", 7), ESP_OK);
+    CHECK(client_next_publish(sub, data, sizeof(data)));
+    CHECK_EQ(strcmp(data, "{\"t\":2}"), 0);
+
+    local_broker_get_stats(&stats);
+    CHECK_EQ(stats.clients, 2);
+    CHECK_EQ(g_upstream, 1);   /* The LAN publish under wot/ was bridged */
+}
+
+static void test_control_refused(int pub, int sub)
+{
+    char data[64];
+    local_broker_stats_t stats;
+
+    /* Unauthenticated LAN commands don't reach the UART or the upstream broker */
+    mqtt_route_get(5);
+    int upstream = g_upstream;
+    client_publish(pub, MQTT_CONTROL_TOPIC_PREFIX "5", "on", 2);
+    client_publish(pub, MQTT_CONTROL_TOPIC_PREFIX "999", "on", 2);
+    /* Publishes of one client are handled in order, this one marks the end */
+    client_publish(pub, "wot/sensors/5", "end", 3);
+    CHECK(client_next_publish(sub, data, sizeof(data)));
+    CHECK_EQ(strcmp(data, "end"), 0);
+
+    local_broker_get_stats(&stats);
+#if ( LOCAL_BROKER_CONTROL_ENABLE == 1 )
+    CHECK(control_peek(CONTROL_SRC_LOCAL_BROKER) != NULL);
+#else
+    CHECK_EQ(stats.refused, 2);
+    CHECK(control_peek(CONTROL_SRC_LOCAL_BROKER) == NULL);
+#endif
+    CHECK_EQ(g_upstream, upstream + 1);
+    CHECK(mqtt_route_find(999) == NULL);
+}
+
+static int compare_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void bench_round_trip(int pub, int sub)
+{
+    long n = host_bench_iterations(5000);
+    uint32_t *latency = malloc(n * sizeof(uint32_t));
+    char data[64];
+
+    double start = host_seconds();
+    for (long i = 0; i < n; i++) {
+        int64_t sent_us = esp_timer_get_time();
+        client_publish(pub, "wot/sensors/5", "{\"temperature\":21.5}", 20);
+        if (!client_next_publish(sub, data, sizeof(data))) {
+            CHECK(false);
+            break;
+        }
+        latency[i] = (uint32_t)(esp_timer_get_time() - sent_us);
+    }
+    double elapsed = host_seconds() - start;
+
+    qsort(latency, n, sizeof(uint32_t), compare_u32);
+    printf("one at a time: %.0f msg/s, latency p50 %lu us, p99 %lu us\n", n / elapsed,
+           (unsigned long)latency[n / 2], (unsigned long)latency[n * 99 / 100]);
+    free(latency);
+
+    /* Pipelined: the publisher doesn't wait, the subscriber takes them as they come */
+    start = host_seconds();
+    long got = 0;
+    for (long i = 0; i < n; i++) {
+        client_publish(pub, "wot/sensors/5", "{\"temperature\":21.5}", 20);
+        if (i % 16 == 15) {
+            while (got <= i - 8 && client_next_publish(sub, data, sizeof(data)))
+                got++;
+        }
+    }
+    while (got < n && client_next_publish(sub, data, sizeof(data)))
+        got++;
+    elapsed = host_seconds() - start;
+    printf("pipelined: %.0f msg/s, %ld of %ld delivered\n", got / elapsed, got, n);
+    CHECK(got > n * 9 / 10);   /* QoS 0, a full socket may drop a few */
+}
+
+int main(void)
+{
+    CHECK_EQ(control_init(), ESP_OK);
+    CHECK_EQ(mqtt_route_init(), ESP_OK);
+    if (local_broker_start() != ESP_OK) {
+        fprintf(stderr, "broker didn't start, port %d busy?\n", LOCAL_BROKER_PORT);
+        return EXIT_FAILURE;
+    }
+
+    int pub = client_connect("pub");
+    int sub = client_connect("sub");
+    CHECK(pub >= 0 && sub >= 0);
+    if (pub < 0 || sub < 0)
+        HOST_TEST_END();
+
+    test_pub_sub(pub, sub);
+    test_control_refused(pub, sub);
+    bench_round_trip(pub, sub);
+
+    close(pub);
+    close(sub);
+    HOST_TEST_END();
+}
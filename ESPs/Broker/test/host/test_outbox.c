@@ -0,0 +1,256 @@
+/**
+ * @file test_outbox.c
+ * @brief Host tests of the variable length MQTT outbox
+ */
+#include <pthread.h>
+#include <string.h>
+
+#include "host_test.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "mqtt/mqtt_config.h"
+#include "mqtt/outbox/outbox.h"
+
+#define TOPIC "wot/sensors/1"
+
+static mqtt_outbox_slot_t *reserve(size_t cap, mqtt_lane_t lane)
+{
+    return mqtt_outbox_reserve(TOPIC, cap, lane, 0);
+}
+
+/* Fill the payload with a pattern of the slot, checked before release */
+static void fill(mqtt_outbox_slot_t *slot, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+        slot->data[i] = (char)(slot->index * 31 + i);
+    slot->data[len] = '\0';
+    slot->data_len = len;
+}
+
+static bool intact(const mqtt_outbox_slot_t *slot)
+{
+    if (strcmp(slot->topic, TOPIC) != 0)
+        return false;
+    for (size_t i = 0; i < slot->data_len; i++) {
+        if (slot->data[i] != (char)(slot->index * 31 + i))
+            return false;
+    }
+    return true;
+}
+
+static void test_sized_blocks(void)
+{
+    uint32_t before = mqtt_outbox_free_bytes();
+    mqtt_outbox_slot_t *a = reserve(60, MQTT_LANE_TELEMETRY);
+
+    CHECK(a != NULL);
+    CHECK_EQ(a->data_cap, 60);
+    CHECK_EQ(strcmp(a->topic, TOPIC), 0);
+    /* Header + topic + NUL + payload + NUL, rounded to 4 */
+    CHECK(before - mqtt_outbox_free_bytes() <= 4 + sizeof(TOPIC) + 60 + 1 + 3);
+    CHECK(before - mqtt_outbox_free_bytes() < 100);
+
+    /* Larger than the old 256 byte payload limit */
+    mqtt_outbox_slot_t *b = reserve(700, MQTT_LANE_TELEMETRY);
+    CHECK(b != NULL);
+    fill(b, 700);
+    CHECK(intact(b));
+
+    mqtt_outbox_release(a);
+    mqtt_outbox_release(b);
+    CHECK_EQ(mqtt_outbox_free_bytes(), MQTT_OUTBOX_ARENA_SIZE);
+    CHECK_EQ(mqtt_outbox_free_slots(), MQTT_OUTBOX_SLOTS);
+
+    CHECK(reserve(MQTT_OUTBOX_MSG_MAX, MQTT_LANE_CONTROL) == NULL);
+}
+
+static void test_out_of_order_release(void)
+{
+    mqtt_outbox_slot_t *s[4];
+    for (int i = 0; i < 4; i++) {
+        s[i] = reserve(100, MQTT_LANE_TELEMETRY);
+        fill(s[i], 100);
+    }
+    uint32_t held = mqtt_outbox_free_bytes();
+
+    /* Newer ones first: only marked, the oldest still holds the head */
+    mqtt_outbox_release(s[2]);
+    mqtt_outbox_release(s[1]);
+    CHECK_EQ(mqtt_outbox_free_bytes(), held);
+    CHECK(intact(s[0]) && intact(s[3]));
+
+    mqtt_outbox_release(s[0]);
+    CHECK(mqtt_outbox_free_bytes() > held);
+    mqtt_outbox_release(s[3]);
+    CHECK_EQ(mqtt_outbox_free_bytes(), MQTT_OUTBOX_ARENA_SIZE);
+}
+
+static void test_wrap(void)
+{
+    mqtt_outbox_slot_t *s[MQTT_OUTBOX_SLOTS];
+    int n = 0;
+
+    /* Fill the arena with the control lane, it may take every byte */
+    while (n < MQTT_OUTBOX_SLOTS && (s[n] = reserve(400, MQTT_LANE_CONTROL)) != NULL) {
+        fill(s[n], 400);
+        n++;
+    }
+    CHECK(n >= 2 && n < MQTT_OUTBOX_SLOTS);
+    CHECK(reserve(400, MQTT_LANE_CONTROL) == NULL);
+
+    /* Room at the start only: the block goes there, the end of the arena is skipped */
+    mqtt_outbox_release(s[0]);
+    mqtt_outbox_release(s[1]);
+    mqtt_outbox_slot_t *w = reserve(600, MQTT_LANE_CONTROL);
+    CHECK(w != NULL);
+    if (w != NULL) {
+        CHECK_EQ(w->block, 0);
+        fill(w, 600);
+    }
+    for (int i = 2; i < n; i++) {
+        CHECK(intact(s[i]));
+        mqtt_outbox_release(s[i]);
+    }
+    if (w != NULL) {
+        CHECK(intact(w));
+        mqtt_outbox_release(w);
+    }
+    CHECK_EQ(mqtt_outbox_free_bytes(), MQTT_OUTBOX_ARENA_SIZE);
+}
+
+static void test_control_reserve(void)
+{
+    mqtt_outbox_slot_t *s[MQTT_OUTBOX_SLOTS];
+    int n = 0;
+
+    while (n < MQTT_OUTBOX_SLOTS - 1 && (s[n] = reserve(600, MQTT_LANE_TELEMETRY)) != NULL)
+        n++;
+    /* Telemetry stopped short of the control lane's bytes */
+    CHECK(n < MQTT_OUTBOX_SLOTS - 1);
+    CHECK(mqtt_outbox_free_bytes() >= MQTT_OUTBOX_CONTROL_RESERVE);
+
+    mqtt_outbox_slot_t *c = reserve(600, MQTT_LANE_CONTROL);
+    CHECK(c != NULL && c->lane == MQTT_LANE_CONTROL);
+
+    mqtt_outbox_release(c);
+    while (n-- > 0)
+        mqtt_outbox_release(s[n]);
+    CHECK_EQ(mqtt_outbox_free_bytes(), MQTT_OUTBOX_ARENA_SIZE);
+}
+
+static void test_trim(void)
+{
+    /* Newest block: the tail moves back */
+    mqtt_outbox_slot_t *a = reserve(768, MQTT_LANE_TELEMETRY);
+    uint32_t reserved = mqtt_outbox_free_bytes();
+    fill(a, 40);
+    mqtt_outbox_trim(a);
+    CHECK(mqtt_outbox_free_bytes() >= reserved + 700);
+    CHECK_EQ(a->data_cap, 40);
+    CHECK(intact(a));
+
+    /* Older block: the rest becomes a hole, reusable once the head passes it */
+    mqtt_outbox_slot_t *b = reserve(768, MQTT_LANE_TELEMETRY);
+    mqtt_outbox_slot_t *c = reserve(40, MQTT_LANE_TELEMETRY);
+    fill(b, 40);
+    fill(c, 40);
+    uint32_t before = mqtt_outbox_free_bytes();
+    mqtt_outbox_trim(b);
+    CHECK_EQ(mqtt_outbox_free_bytes(), before);
+    CHECK(intact(b) && intact(c));
+
+    mqtt_outbox_release(a);
+    mqtt_outbox_release(b);
+    CHECK(intact(c));
+    mqtt_outbox_release(c);
+    CHECK_EQ(mqtt_outbox_free_bytes(), MQTT_OUTBOX_ARENA_SIZE);
+}
+
+static mqtt_outbox_slot_t *g_held;
+
+static void *release_later(void *arg)
+{
+    (void)arg;
+    vTaskDelay(pdMS_TO_TICKS(20));
+    mqtt_outbox_release(g_held);
+    return NULL;
+}
+
+static void test_wait_for_room(void)
+{
+    mqtt_outbox_slot_t *s[MQTT_OUTBOX_SLOTS];
+    int n = 0;
+
+    while (n < MQTT_OUTBOX_SLOTS && (s[n] = reserve(900, MQTT_LANE_CONTROL)) != NULL)
+        n++;
+    CHECK(n >= 2 && n < MQTT_OUTBOX_SLOTS);
+    CHECK(reserve(900, MQTT_LANE_CONTROL) == NULL);
+
+    /* A free descriptor but no bytes: the producer waits for the release */
+    pthread_t thread;
+    g_held = s[0];
+    pthread_create(&thread, NULL, release_later, NULL);
+    mqtt_outbox_slot_t *waited = mqtt_outbox_reserve(TOPIC, 900, MQTT_LANE_CONTROL, pdMS_TO_TICKS(1000));
+    pthread_join(thread, NULL);
+    CHECK(waited != NULL);
+
+    /* Times out once nothing is released */
+    CHECK(mqtt_outbox_reserve(TOPIC, 900, MQTT_LANE_CONTROL, pdMS_TO_TICKS(30)) == NULL);
+    CHECK_EQ(mqtt_outbox_free_slots(), MQTT_OUTBOX_SLOTS - n);
+
+    mqtt_outbox_release(waited);
+    for (int i = 1; i < n; i++)
+        mqtt_outbox_release(s[i]);
+    CHECK_EQ(mqtt_outbox_free_bytes(), MQTT_OUTBOX_ARENA_SIZE);
+    CHECK_EQ(mqtt_outbox_free_slots(), MQTT_OUTBOX_SLOTS);
+}
+
+/* Random sizes released in random order, as lanes and the in-flight window do */
+static void test_random(void)
+{
+    mqtt_outbox_slot_t *live[MQTT_OUTBOX_SLOTS];
+    int n = 0;
+    unsigned long reserved = 0;
+
+    srand(1);
+    for (int round = 0; round < 200000; round++) {
+        if (n > 0 && (rand() % 2 == 0 || n == MQTT_OUTBOX_SLOTS)) {
+            int i = rand() % n;
+            CHECK(intact(live[i]));
+            mqtt_outbox_release(live[i]);
+            live[i] = live[--n];
+            continue;
+        }
+        size_t cap = (rand() % 8 == 0) ? 300 + rand() % 700 : 20 + rand() % 120;
+        mqtt_outbox_slot_t *s = reserve(cap, (rand() % 4 == 0) ? MQTT_LANE_CONTROL : MQTT_LANE_TELEMETRY);
+        if (s == NULL)
+            continue;
+        size_t len = (rand() % 3 == 0) ? cap / 2 : cap;
+        fill(s, len);
+        if (len < cap && rand() % 2 == 0)
+            mqtt_outbox_trim(s);
+        live[n++] = s;
+        reserved++;
+    }
+    while (n > 0)
+        mqtt_outbox_release(live[--n]);
+
+    CHECK(reserved > 50000);
+    CHECK_EQ(mqtt_outbox_free_bytes(), MQTT_OUTBOX_ARENA_SIZE);
+    CHECK_EQ(mqtt_outbox_free_slots(), MQTT_OUTBOX_SLOTS);
+}
+
+int main(void)
+{
+    CHECK_EQ(mqtt_outbox_init(), ESP_OK);
+
+    test_sized_blocks();
+    test_out_of_order_release();
+    test_wrap();
+    test_control_reserve();
+    test_trim();
+    test_wait_for_room();
+    test_random();
+
+    HOST_TEST_END();
+}
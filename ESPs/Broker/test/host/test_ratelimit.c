@@ -0,0 +1,153 @@
+/**
+ * @file test_ratelimit.c
+ * @brief Host tests of the per node token bucket under a flooding node
+ *
+ * The test plays the dispatcher on a clock it drives: readings are admitted
+ * as they arrive, mqtt_ratelimit_release() runs after them and again when
+ * the wait it returned is over. One node sends at 100 times
+ * MQTT_RATELIMIT_RATE, another at the rate, with its own bucket it must
+ * not notice the first. The flooding node's gaps vary around their mean:
+ * a token that comes back between two readings releases the held one, one
+ * that comes back with a reading goes to that reading.
+ */
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "host_test.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "mqtt/mqtt_config.h"
+#include "mqtt/ratelimit/ratelimit.h"
+
+#define FLOOD_FACTOR  100
+#define RUN_S         20
+
+static mqtt_route_t g_flood = { .node_id = 7, .index = 3 };
+static mqtt_route_t g_normal = { .node_id = 8, .index = 4 };
+
+static uint32_t g_released[2];
+static int g_last_released;       /* Counter of the last reading of the flooding node released */
+
+static void forward(const mqtt_route_t *route, const uint8_t *payload, size_t len)
+{
+    char text[16];
+
+    CHECK(len < sizeof(text));
+    memcpy(text, payload, len);
+    text[len] = '\0';
+    g_released[route == &g_normal]++;
+    if (route == &g_flood)
+        g_last_released = atoi(text);
+}
+
+static bool admit(const mqtt_route_t *route, int n)
+{
+    char reading[16];
+    int len = snprintf(reading, sizeof(reading), "%d", n);
+    return mqtt_ratelimit_admit(route, (const uint8_t *)reading, (size_t)len);
+}
+
+static void test_flood(void)
+{
+    mqtt_ratelimit_stats_t before, after;
+    static const uint32_t gaps_ms[] = { 3, 7, 4, 6, 5, 6, 4 };   /* Mean 1000 / (MQTT_RATELIMIT_RATE * FLOOD_FACTOR) */
+    const uint32_t flood_ms = 1000 / (MQTT_RATELIMIT_RATE * FLOOD_FACTOR);
+    const uint32_t normal_ms = 1000 / MQTT_RATELIMIT_RATE;
+    uint32_t offered[2] = { 0, 0 }, admitted[2] = { 0, 0 };
+    uint32_t release_due = UINT32_MAX;
+    uint32_t flood_due = gaps_ms[0];
+    int last_offered = 0;
+
+    mqtt_ratelimit_get_stats(&before);
+    for (uint32_t ms = 1; ms <= RUN_S * 1000; ms++) {
+        host_clock_advance_ms(1);
+        bool woke = false;
+
+        if (ms == flood_due) {
+            flood_due += gaps_ms[offered[0] % (sizeof(gaps_ms) / sizeof(gaps_ms[0]))];
+            last_offered = (int)offered[0];
+            admitted[0] += admit(&g_flood, (int)offered[0]++);
+            woke = true;
+        }
+        if (ms % normal_ms == 0) {
+            admitted[1] += admit(&g_normal, (int)offered[1]++);
+            woke = true;
+        }
+        if (woke || ms >= release_due) {
+            uint32_t wait = mqtt_ratelimit_release(forward);
+            release_due = (wait == portMAX_DELAY) ? UINT32_MAX : ms + pdTICKS_TO_MS(wait);
+        }
+    }
+    mqtt_ratelimit_get_stats(&after);
+
+    uint32_t limited = after.limited - before.limited;
+    uint32_t held = after.held - before.held;
+    uint32_t replaced = after.replaced - before.replaced;
+    uint32_t released = after.released - before.released;
+    printf("flooding node: %lu offered in %d s, %lu admitted, %lu released, %lu limited (%lu held, %lu replaced)\n",
+           (unsigned long)offered[0], RUN_S, (unsigned long)admitted[0], (unsigned long)g_released[0],
+           (unsigned long)limited, (unsigned long)held, (unsigned long)replaced);
+    printf("normal node: %lu offered, %lu admitted\n", (unsigned long)offered[1], (unsigned long)admitted[1]);
+
+    /* The normal node goes through untouched, nothing of it is ever held */
+    CHECK_EQ(offered[1], RUN_S * MQTT_RATELIMIT_RATE);
+    CHECK_EQ(admitted[1], offered[1]);
+    CHECK_EQ(g_released[1], 0);
+
+    /* The flooding node gets its burst and its rate, every token used */
+    CHECK(offered[0] >= RUN_S * MQTT_RATELIMIT_RATE * FLOOD_FACTOR - 5);
+    CHECK(offered[0] <= RUN_S * MQTT_RATELIMIT_RATE * FLOOD_FACTOR);
+    uint32_t sent = admitted[0] + g_released[0];
+    CHECK(sent >= MQTT_RATELIMIT_BURST + RUN_S * MQTT_RATELIMIT_RATE - 1);
+    CHECK(sent <= MQTT_RATELIMIT_BURST + RUN_S * MQTT_RATELIMIT_RATE);
+
+    /* Counters: the readings over the limit are the flooding node's, each one held */
+    CHECK_EQ(after.admitted - before.admitted, admitted[0] + admitted[1]);
+    CHECK_EQ(limited, offered[0] - admitted[0]);
+    CHECK_EQ(held, limited);
+    CHECK_EQ(released, g_released[0]);
+    CHECK(released > 0);
+    /* A held reading is released, replaced by a newer one, or still held at the end */
+    CHECK(held - replaced - released <= 1);
+
+    /* What is released is the latest reading, not the first one held */
+    CHECK(g_last_released > last_offered - (int)(1000 / MQTT_RATELIMIT_RATE / flood_ms));
+}
+
+static void test_recover(void)
+{
+    mqtt_ratelimit_stats_t before, after;
+
+    /* Quiet for long enough, the flooding node has its whole burst back */
+    host_clock_advance_ms(1000 * MQTT_RATELIMIT_BURST / MQTT_RATELIMIT_RATE);
+    CHECK_EQ(mqtt_ratelimit_release(forward), portMAX_DELAY);
+    host_clock_advance_ms(1000 / MQTT_RATELIMIT_RATE);
+    mqtt_ratelimit_get_stats(&before);
+    for (int n = 0; n < MQTT_RATELIMIT_BURST; n++)
+        CHECK(admit(&g_flood, n));
+    CHECK(!admit(&g_flood, MQTT_RATELIMIT_BURST));
+    CHECK(admit(&g_normal, 0));
+
+    /* A reading within the limit drops the held one, it is older */
+    host_clock_advance_ms(1000 / MQTT_RATELIMIT_RATE);
+    CHECK(admit(&g_flood, MQTT_RATELIMIT_BURST + 1));
+    CHECK_EQ(mqtt_ratelimit_release(forward), portMAX_DELAY);
+    mqtt_ratelimit_get_stats(&after);
+    CHECK_EQ(after.admitted - before.admitted, MQTT_RATELIMIT_BURST + 2);
+    CHECK_EQ(after.held - before.held, 1);
+    CHECK_EQ(after.replaced - before.replaced, 1);
+    CHECK_EQ(after.released, before.released);
+}
+
+int main(void)
+{
+    host_clock_set_us(1000000);
+    CHECK_EQ(mqtt_ratelimit_init(), ESP_OK);
+
+    test_flood();
+    test_recover();
+
+    HOST_TEST_END();
+}
@@ -0,0 +1,80 @@
+/**
+ * @file test_route.c
+ * @brief Host tests of the node routing table
+ */
+#include <string.h>
+
+#include "host_test.h"
+#include "mqtt/mqtt_config.h"
+#include "mqtt/route/route.h"
+
+static const mqtt_route_t *from_topic(const char *topic)
+{
+    return mqtt_route_from_topic(topic, strlen(topic));
+}
+
+static void test_line_inserts(void)
+{
+    size_t off = 0;
+    const uint8_t line[] = "42{\"temperature\":21.5}";
+
+    CHECK(mqtt_route_find(42) == NULL);
+    const mqtt_route_t *r = mqtt_route_from_line(line, sizeof(line) - 1, &off);
+    CHECK(r != NULL);
+    CHECK_EQ(off, 2);
+    CHECK_EQ(r->node_id, 42);
+    CHECK_EQ(strcmp(r->id_str, "42"), 0);
+    CHECK_EQ(strcmp(r->sensor_topic, MQTT_SENSOR_TOPIC_PREFIX "42"), 0);
+    CHECK(mqtt_route_find(42) == r);
+    CHECK(mqtt_route_get(42) == r);
+    CHECK_EQ(mqtt_route_count(), 1);
+
+    CHECK(mqtt_route_from_line((const uint8_t *)"{}", 2, &off) == NULL);
+    CHECK(mqtt_route_from_line((const uint8_t *)"70000{}", 7, &off) == NULL);
+}
+
+static void test_topics_read_only(void)
+{
+    uint32_t count = mqtt_route_count();
+
+    CHECK(from_topic(MQTT_CONTROL_TOPIC_PREFIX "42") == mqtt_route_find(42));
+
+    /* Unknown nodes are not added by a command */
+    for (int id = 1000; id < 1100; id++) {
+        char topic[32];
+        snprintf(topic, sizeof(topic), "%s%d", MQTT_CONTROL_TOPIC_PREFIX, id);
+        CHECK(from_topic(topic) == NULL);
+    }
+    CHECK(mqtt_route_find(1000) == NULL);
+    CHECK_EQ(mqtt_route_count(), count);
+
+    CHECK(from_topic(MQTT_CONTROL_TOPIC_PREFIX "42x") == NULL);
+    CHECK(from_topic(MQTT_CONTROL_TOPIC_PREFIX) == NULL);
+    CHECK(from_topic(MQTT_SENSOR_TOPIC_PREFIX "42") == NULL);
+}
+
+static void test_full_table(void)
+{
+    uint32_t count = mqtt_route_count();
+
+    for (uint32_t id = 2000; count < MQTT_ROUTE_MAX_NODES; id++, count++)
+        CHECK(mqtt_route_get((uint16_t)id) != NULL);
+    CHECK_EQ(mqtt_route_count(), MQTT_ROUTE_MAX_NODES);
+    CHECK(mqtt_route_get(60000) == NULL);
+
+    /* Dense indexes, every route still found */
+    CHECK_EQ(mqtt_route_find(42)->index, 0);
+    CHECK(mqtt_route_find(2000) != NULL);
+    CHECK(mqtt_route_find((uint16_t)(2000 + MQTT_ROUTE_MAX_NODES - 2))->index == MQTT_ROUTE_MAX_NODES - 1);
+}
+
+int main(void)
+{
+    CHECK_EQ(mqtt_route_init(), ESP_OK);
+
+    test_line_inserts();
+    test_topics_read_only();
+    test_full_table();
+
+    HOST_TEST_END();
+}
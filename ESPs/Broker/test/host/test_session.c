@@ -0,0 +1,192 @@
+/**
+ * @file test_session.c
+ * @brief Host tests of the persistent session and its acknowledged subscription record
+ *
+ * The test plays the MQTT event handler: it calls the session hooks in the
+ * order ESP-MQTT raises the events and acknowledges the SUBSCRIBEs itself.
+ * NVS is the RAM stand-in, so a second mqtt_session_init() is a restart
+ * that finds what the first run stored.
+ */
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "host_test.h"
+#include "esp_timer.h"
+#include "nvs.h"
+#include "mqtt/mqtt_config.h"
+#include "mqtt/session/session.h"
+
+static const mqtt_session_sub_t g_subs[] = {
+    { "wot/control/#", 1 },
+    { "wot/ota", 1 },
+    { "wot/config/+", 0 },
+};
+#define SUB_COUNT  (sizeof(g_subs) / sizeof(g_subs[0]))
+
+/*************************** Client stand-in ***************************/
+
+static int g_next_msg_id = 1;
+static int g_sent_ids[16];
+static int g_sent;
+static const char *g_refuse;    /* Topic whose SUBSCRIBE can't be sent */
+
+int esp_mqtt_client_subscribe(esp_mqtt_client_handle_t client, const char *topic, int qos)
+{
+    (void)client;
+    (void)qos;
+    if (g_refuse != NULL && strcmp(topic, g_refuse) == 0)
+        return -1;
+    g_sent_ids[g_sent++] = g_next_msg_id;
+    return g_next_msg_id++;
+}
+
+/* MQTT_EVENT_CONNECTED, returns the number of SUBSCRIBEs sent */
+static int connect(bool session_present)
+{
+    g_sent = 0;
+    mqtt_session_connected(NULL, session_present);
+    return g_sent;
+}
+
+static void suback_all(void)
+{
+    for (int i = 0; i < g_sent; i++)
+        mqtt_session_subscribed(g_sent_ids[i]);
+}
+
+static bool recorded(void)
+{
+    nvs_handle_t nvs;
+    uint32_t fingerprint = 0;
+
+    if (nvs_open("mqtt_session", NVS_READONLY, &nvs) != ESP_OK)
+        return false;
+    esp_err_t err = nvs_get_u32(nvs, "sub_fp", &fingerprint);
+    nvs_close(nvs);
+    return err == ESP_OK && fingerprint != 0;
+}
+
+/*************************** Tests ***************************/
+
+static void test_client_id(void)
+{
+    CHECK_EQ(strcmp(mqtt_session_client_id(), MQTT_CLIENT_ID_PREFIX "240ac4123456"), 0);
+}
+
+static void test_record(void)
+{
+    mqtt_session_stats_t before, after;
+
+    mqtt_session_get_stats(&before);
+
+    /* First boot: nothing recorded, the broker has no session either */
+    CHECK(!recorded());
+    CHECK_EQ(connect(true), SUB_COUNT);
+
+    /* Recorded once the last SUBACK is in, not before */
+    mqtt_session_subscribed(g_sent_ids[0]);
+    mqtt_session_subscribed(g_sent_ids[1]);
+    mqtt_session_subscribed(1000);      /* Not ours */
+    CHECK(!recorded());
+    mqtt_session_subscribed(g_sent_ids[2]);
+    CHECK(recorded());
+
+    /* The link drops, the broker kept the session: nothing to subscribe */
+    mqtt_session_disconnected();
+    host_clock_advance_ms(250);
+    CHECK_EQ(connect(true), 0);
+    CHECK(recorded());
+
+    mqtt_session_get_stats(&after);
+    CHECK_EQ(after.resubscribes - before.resubscribes, 1);
+    CHECK_EQ(after.resubscribes_skipped - before.resubscribes_skipped, 1);
+    CHECK_EQ(after.reconnects - before.reconnects, 1);
+    CHECK_EQ(after.last_reconnect_ms, 250);
+}
+
+static void test_restart(void)
+{
+    /* The record survives a restart of the broker node */
+    CHECK_EQ(mqtt_session_init(g_subs, SUB_COUNT), ESP_OK);
+    CHECK_EQ(connect(true), 0);
+
+    /* The broker lost the session: the record goes before subscribing again */
+    mqtt_session_disconnected();
+    CHECK_EQ(connect(false), SUB_COUNT);
+    CHECK(!recorded());
+    suback_all();
+    CHECK(recorded());
+}
+
+static void test_changed_set(void)
+{
+    /* New firmware with one subscription less: session present, still subscribes */
+    CHECK_EQ(mqtt_session_init(g_subs, SUB_COUNT - 1), ESP_OK);
+    mqtt_session_disconnected();
+    CHECK_EQ(connect(true), SUB_COUNT - 1);
+    CHECK(!recorded());
+    suback_all();
+    CHECK(recorded());
+
+    /* The QoS is part of the set too */
+    static const mqtt_session_sub_t qos0[] = { { "wot/control/#", 0 }, { "wot/ota", 1 } };
+    CHECK_EQ(mqtt_session_init(qos0, 2), ESP_OK);
+    mqtt_session_disconnected();
+    CHECK_EQ(connect(true), 2);
+    suback_all();
+    CHECK_EQ(mqtt_session_init(g_subs, SUB_COUNT - 1), ESP_OK);
+    mqtt_session_disconnected();
+    CHECK_EQ(connect(true), SUB_COUNT - 1);
+    suback_all();
+}
+
+static void test_incomplete(void)
+{
+    mqtt_session_stats_t before, after;
+
+    CHECK_EQ(mqtt_session_init(g_subs, SUB_COUNT), ESP_OK);
+    mqtt_session_disconnected();
+    CHECK_EQ(connect(false), SUB_COUNT);
+    suback_all();
+    CHECK(recorded());
+
+    /* One SUBSCRIBE can't be sent: the others are acknowledged, the set is not recorded */
+    mqtt_session_get_stats(&before);
+    mqtt_session_disconnected();
+    g_refuse = "wot/ota";
+    CHECK_EQ(connect(false), SUB_COUNT - 1);
+    suback_all();
+    g_refuse = NULL;
+    CHECK(!recorded());
+    mqtt_session_get_stats(&after);
+    CHECK_EQ(after.resubscribes - before.resubscribes, 1);
+
+    /* So the next connect subscribes everything again, session present or not */
+    mqtt_session_disconnected();
+    CHECK_EQ(connect(true), SUB_COUNT);
+    suback_all();
+    CHECK(recorded());
+
+    /* Disconnected before the SUBACKs: late ones are ignored, nothing recorded */
+    mqtt_session_disconnected();
+    CHECK_EQ(connect(false), SUB_COUNT);
+    mqtt_session_disconnected();
+    suback_all();
+    CHECK(!recorded());
+}
+
+int main(void)
+{
+    host_clock_set_us(1000000);
+    host_nvs_erase_all();
+    CHECK_EQ(mqtt_session_init(g_subs, SUB_COUNT), ESP_OK);
+
+    test_client_id();
+    test_record();
+    test_restart();
+    test_changed_set();
+    test_incomplete();
+
+    HOST_TEST_END();
+}
@@ -0,0 +1,165 @@
+/**
+ * @file test_splitter.c
+ * @brief Host tests, fuzz and benchmark of the UART stream splitter
+ *
+ * The fuzz test cuts a stream of random messages at random read
+ * boundaries, from single bytes to several buffers, and checks every
+ * message comes out once, whole and in order, oversized ones dropped and
+ * counted. It prints the rate the splitter reached.
+ */
+#include <stdbool.h>
+#include <string.h>
+
+#include "host_test.h"
+#include "uart/splitter/splitter.h"
+
+#define SPLIT_CAP   1024
+
+/*************************** Node lines ***************************/
+
+static char g_lines[8][32];
+static int g_line_count;
+
+static void keep_line(uint8_t *msg, size_t len, void *ctx)
+{
+    (void)ctx;
+    snprintf(g_lines[g_line_count++ % 8], sizeof(g_lines[0]), "%.*s", (int)len, (const char *)msg);
+}
+
+/* Read text in as many reads as the buffer's room takes */
+static size_t feed_text(uart_splitter_t *s, const char *text)
+{
+    size_t len = strlen(text);
+    size_t emitted = 0;
+
+    while (len > 0) {
+        size_t room;
+        uint8_t *space = uart_splitter_space(s, &room);
+        size_t n = (len < room) ? len : room;
+
+        memcpy(space, text, n);
+        emitted += uart_splitter_feed(s, n, keep_line, NULL);
+        text += n;
+        len -= n;
+    }
+    return emitted;
+}
+
+/* Two node lines in one read, then a line cut across two reads */
+static void test_lines(void)
+{
+    static uint8_t buf[64];
+    uart_splitter_t s;
+
+    uart_splitter_init(&s, buf, sizeof(buf), '\n');
+    g_line_count = 0;
+
+    CHECK_EQ(feed_text(&s, "1{\"t\":1}\n2{\"t\":2}\n3{\"t\""), 2);
+    CHECK_EQ(strcmp(g_lines[0], "1{\"t\":1}"), 0);
+    CHECK_EQ(strcmp(g_lines[1], "2{\"t\":2}"), 0);
+    CHECK_EQ(feed_text(&s, ":3}\n\n"), 2);
+    CHECK_EQ(strcmp(g_lines[2], "3{\"t\":3}"), 0);
+    CHECK_EQ(strcmp(g_lines[3], ""), 0);   /* Back-to-back delimiters */
+
+    /* Bytes were lost, the partial line goes */
+    CHECK_EQ(feed_text(&s, "4{\"t\""), 0);
+    uart_splitter_reset(&s);
+    CHECK_EQ(feed_text(&s, "5{}\n"), 1);
+    CHECK_EQ(strcmp(g_lines[4], "5{}"), 0);
+
+    /* A line longer than the buffer is dropped once, the next one comes through */
+    char longer[80];
+    memset(longer, 'x', sizeof(longer) - 1);
+    longer[sizeof(longer) - 1] = '\0';
+    CHECK_EQ(feed_text(&s, "6"), 0);
+    CHECK_EQ(feed_text(&s, longer + 20), 0);
+    CHECK_EQ(feed_text(&s, longer + 20), 0);
+    CHECK_EQ(feed_text(&s, "x\n7{}\n"), 1);
+    CHECK_EQ(strcmp(g_lines[5], "7{}"), 0);
+    CHECK_EQ(s.overflows, 1);
+    CHECK_EQ(s.len, 0);
+}
+
+/*************************** Fuzz ***************************/
+
+typedef struct {
+    const uint8_t *stream;    /* Reference messages, delimiter separated */
+    size_t next;              /* Offset of the next message expected */
+    size_t messages;
+    bool ok;
+} fuzz_ctx_t;
+
+static void check_message(uint8_t *msg, size_t len, void *p)
+{
+    fuzz_ctx_t *ctx = p;
+    const uint8_t *ref = ctx->stream + ctx->next;
+    size_t ref_len;
+
+    /* Oversized messages are skipped, the reference has no 0x00 but the delimiters */
+    while ((ref_len = strlen((const char *)ref)) >= SPLIT_CAP)
+        ref += ref_len + 1;
+
+    if (ref_len != len || memcmp(ref, msg, len) != 0)
+        ctx->ok = false;
+    ctx->next = (size_t)(ref - ctx->stream) + len + 1;
+    ctx->messages++;
+    memset(msg, 0xEE, len);   /* The callback may modify the message */
+}
+
+static void test_fuzz(void)
+{
+    size_t size = (size_t)host_bench_iterations(16) << 20;
+    uint8_t *stream = malloc(size);
+    static uint8_t buf[SPLIT_CAP];
+    size_t len = 0, messages = 0, oversized = 0;
+    uart_splitter_t s;
+
+    srand(7);
+    while (len < size - 4096) {
+        size_t n = (rand() % 50 == 0) ? 1024 + (size_t)(rand() % 1500) : (size_t)(rand() % 300);
+        for (size_t i = 0; i < n; i++)
+            stream[len + i] = (uint8_t)(1 + rand() % 255);
+        len += n;
+        stream[len++] = 0;
+        messages++;
+        oversized += (n >= SPLIT_CAP);
+    }
+
+    fuzz_ctx_t ctx = { .stream = stream, .ok = true };
+    size_t emitted = 0;
+    uart_splitter_init(&s, buf, sizeof(buf), 0);
+
+    double start = host_seconds();
+    for (size_t off = 0; off < len;) {
+        size_t room;
+        uint8_t *space = uart_splitter_space(&s, &room);
+        size_t chunk = 1 + (size_t)rand() % ((rand() % 4) ? 120 : 4096);
+
+        CHECK(room > 0);
+        if (chunk > room)
+            chunk = room;
+        if (chunk > len - off)
+            chunk = len - off;
+        memcpy(space, stream + off, chunk);
+        off += chunk;
+        emitted += uart_splitter_feed(&s, chunk, check_message, &ctx);
+    }
+    double elapsed = host_seconds() - start;
+
+    CHECK(ctx.ok);
+    CHECK_EQ(emitted, messages - oversized);
+    CHECK_EQ(ctx.messages, emitted);
+    CHECK_EQ(s.overflows, oversized);
+    CHECK_EQ(s.len, 0);
+    printf("%zu messages, %zu oversized, %.1f MB at %.0f MB/s, %.0f messages/s\n",
+           messages, oversized, len / 1e6, len / 1e6 / elapsed, emitted / elapsed);
+    free(stream);
+}
+
+int main(void)
+{
+    test_lines();
+    test_fuzz();
+
+    HOST_TEST_END();
+}
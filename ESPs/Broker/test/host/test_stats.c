@@ -0,0 +1,171 @@
+/**
+ * @file test_stats.c
+ * @brief Host tests of the MQTT latency histograms and the throughput window
+ *
+ * The clock is driven by the test, every latency is known exactly. The
+ * counters of the other modules in the JSON report are stubbed out.
+ */
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "host_test.h"
+#include "esp_timer.h"
+#include "mqtt/mqtt_config.h"
+#include "mqtt/stats/stats.h"
+#include "mqtt/session/session.h"
+#include "mqtt/alias/alias.h"
+#include "mqtt/deadband/deadband.h"
+#include "mqtt/ratelimit/ratelimit.h"
+
+void mqtt_session_get_stats(mqtt_session_stats_t *stats) { memset(stats, 0, sizeof(*stats)); stats->reconnects = 3; }
+void mqtt_alias_get_stats(mqtt_alias_stats_t *stats) { memset(stats, 0, sizeof(*stats)); }
+void mqtt_deadband_get_stats(mqtt_deadband_stats_t *stats) { memset(stats, 0, sizeof(*stats)); }
+void mqtt_ratelimit_get_stats(mqtt_ratelimit_stats_t *stats) { memset(stats, 0, sizeof(*stats)); }
+
+/* Within one bucket of the exact value: 4 sub-buckets per power of two, the top of it is reported */
+static bool within_bucket(uint32_t reported, uint32_t exact)
+{
+    return reported >= exact && reported <= exact + exact / 4 + 1;
+}
+
+static void test_histogram(void)
+{
+    mqtt_hist_t hist;
+
+    /* Empty, then the small values each have their own bucket */
+    memset(&hist, 0, sizeof(hist));
+    CHECK_EQ(mqtt_hist_percentile(&hist, 50), 0);
+    for (uint32_t v = 0; v < 4; v++)
+        mqtt_hist_record(&hist, v);
+    CHECK_EQ(mqtt_hist_percentile(&hist, 25), 0);
+    CHECK_EQ(mqtt_hist_percentile(&hist, 50), 1);
+    CHECK_EQ(mqtt_hist_percentile(&hist, 100), 3);
+
+    /* 1..10000 us: p50 and p99 within their bucket, never above the maximum */
+    memset(&hist, 0, sizeof(hist));
+    for (uint32_t v = 1; v <= 10000; v++)
+        mqtt_hist_record(&hist, v);
+    CHECK_EQ(hist.total, 10000);
+    CHECK_EQ(hist.max, 10000);
+    CHECK_EQ(hist.sum, 10000ull * 10001 / 2);
+    CHECK(within_bucket(mqtt_hist_percentile(&hist, 50), 5000));
+    CHECK(within_bucket(mqtt_hist_percentile(&hist, 99), 9900));
+    CHECK_EQ(mqtt_hist_percentile(&hist, 100), 10000);
+
+    /* One slow sample out of a hundred shows in p99 only */
+    memset(&hist, 0, sizeof(hist));
+    for (int i = 0; i < 99; i++)
+        mqtt_hist_record(&hist, 100);
+    mqtt_hist_record(&hist, 4000000000u);
+    CHECK(within_bucket(mqtt_hist_percentile(&hist, 50), 100));
+    CHECK(within_bucket(mqtt_hist_percentile(&hist, 99), 100));
+    CHECK_EQ(mqtt_hist_percentile(&hist, 100), 4000000000u);
+}
+
+static void test_path(void)
+{
+    mqtt_stats_t s;
+
+    host_clock_set_us(1000000);
+    mqtt_stats_reset();
+
+    /* Telemetry waits 5 ms in its lane, its QoS 1 publish is acked 20 ms later */
+    int64_t enqueued = esp_timer_get_time();
+    mqtt_stats_enqueued();
+    host_clock_advance_ms(5);
+    mqtt_stats_dequeued(MQTT_LANE_TELEMETRY, enqueued, 3);
+    mqtt_stats_published(42, enqueued);
+    host_clock_advance_ms(20);
+    mqtt_stats_acked(42);
+
+    /* A control message, QoS 0: done at the publish */
+    enqueued = esp_timer_get_time();
+    mqtt_stats_enqueued();
+    host_clock_advance_ms(1);
+    mqtt_stats_dequeued(MQTT_LANE_CONTROL, enqueued, 0);
+    mqtt_stats_published(0, enqueued);
+
+    mqtt_stats_drop(MQTT_LANE_TELEMETRY);
+    mqtt_stats_retry(2);
+    mqtt_stats_lost(1);
+    mqtt_stats_acked(7);    /* Never published, ignored */
+
+    mqtt_stats_snapshot(&s);
+    CHECK_EQ(s.enqueued, 2);
+    CHECK_EQ(s.published, 2);
+    CHECK_EQ(s.acked, 1);
+    CHECK_EQ(s.drops, 1);
+    CHECK_EQ(s.lane_drops[MQTT_LANE_TELEMETRY], 1);
+    CHECK_EQ(s.lane_drops[MQTT_LANE_CONTROL], 0);
+    CHECK_EQ(s.retries, 2);
+    CHECK_EQ(s.lost, 1);
+    CHECK_EQ(s.queue_depth, 0);
+    CHECK_EQ(s.queue_depth_max, 3);
+    CHECK_EQ(s.queue_us.total, 2);
+    CHECK_EQ(s.lane_queue_us[MQTT_LANE_TELEMETRY].max, 5000);
+    CHECK_EQ(s.lane_queue_us[MQTT_LANE_CONTROL].max, 1000);
+    CHECK_EQ(s.ack_us.total, 1);
+    CHECK_EQ(s.ack_us.max, 20000);
+    CHECK_EQ(s.total_us.total, 2);
+    CHECK_EQ(s.total_us.max, 25000);
+    CHECK(within_bucket(mqtt_hist_percentile(&s.total_us, 50), 1000));
+
+    /* More QoS 1 publishes outstanding than tracked: the oldest acks are lost */
+    mqtt_stats_reset();
+    for (int id = 1; id <= MQTT_STATS_INFLIGHT + 2; id++)
+        mqtt_stats_published(id, esp_timer_get_time());
+    for (int id = 1; id <= MQTT_STATS_INFLIGHT + 2; id++)
+        mqtt_stats_acked(id);
+    mqtt_stats_snapshot(&s);
+    CHECK_EQ(s.untracked, 2);
+    CHECK_EQ(s.acked, MQTT_STATS_INFLIGHT);
+}
+
+static void test_window(void)
+{
+    host_clock_set_us(50000000);
+    mqtt_stats_reset();
+
+    /* 50 publishes in the first second, 10 in the next two */
+    for (int i = 0; i < 50; i++) {
+        mqtt_stats_published(0, esp_timer_get_time());
+        host_clock_advance_ms(20);
+    }
+    CHECK_EQ(mqtt_stats_window_rate(), 50);
+    for (int i = 0; i < 10; i++) {
+        mqtt_stats_published(0, esp_timer_get_time());
+        host_clock_advance_ms(200);
+    }
+    CHECK_EQ(mqtt_stats_window_rate(), 5);
+
+    /* Nothing published, or no time passed */
+    host_clock_advance_ms(1000);
+    CHECK_EQ(mqtt_stats_window_rate(), 0);
+    CHECK_EQ(mqtt_stats_window_rate(), 0);
+
+    /* The report closes the window too */
+    for (int i = 0; i < 30; i++)
+        mqtt_stats_published(0, esp_timer_get_time());
+    host_clock_advance_ms(MQTT_STATS_PERIOD_MS);
+    char json[1280];
+    int len = mqtt_stats_to_json(json, sizeof(json));
+    CHECK(len > 0 && len < (int)sizeof(json));
+    CHECK(strstr(json, "\"published_per_s\": 3,") != NULL);
+    CHECK(strstr(json, "\"reconnects\": 3,") != NULL);
+    CHECK_EQ(json[len - 1], '}');
+    CHECK_EQ(mqtt_stats_window_rate(), 0);
+
+    /* Refused rather than cut short */
+    CHECK_EQ(mqtt_stats_to_json(json, 200), -1);
+    printf("report of %d bytes\n", len);
+}
+
+int main(void)
+{
+    test_histogram();
+    test_path();
+    test_window();
+
+    HOST_TEST_END();
+}
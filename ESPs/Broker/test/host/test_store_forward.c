@@ -0,0 +1,86 @@
+/**
+ * @file test_store_forward.c
+ * @brief Host tests of the store and forward log
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "host_test.h"
+#include "esp_partition.h"
+#include "mqtt/mqtt_config.h"
+#include "mqtt/store_forward/store_forward.h"
+
+#define TOPIC "wot/sensors/1"
+
+static int g_expect;        /* Number of the next message the replay must give */
+static int g_fail_every;    /* Refuse every n-th publish, 0 never */
+static int g_calls;
+
+static int publish(const char *topic, const char *data, size_t len, int qos, int retain, mqtt_lane_t lane)
+{
+    char text[64];
+    int number = -1;
+
+    (void)retain;
+    if (g_fail_every > 0 && ++g_calls % g_fail_every == 0)
+        return -1;
+
+    snprintf(text, sizeof(text), "%.*s", (int)(len < 32 ? len : 32), data);
+    sscanf(text, "msg %d", &number);
+    CHECK_EQ(number, g_expect);
+    CHECK_EQ(strcmp(topic, TOPIC), 0);
+    /* The message keeps the lane and QoS it was stored with */
+    CHECK_EQ(lane, (number % 5 == 0) ? MQTT_LANE_CONTROL : MQTT_LANE_TELEMETRY);
+    CHECK_EQ(qos, number % 2);
+    g_expect++;
+    return 0;
+}
+
+static esp_err_t store(int number, size_t pad)
+{
+    char topic[] = TOPIC;
+    char data[512];
+    mqtt_outbox_slot_t slot = { .topic = topic, .data = data };
+
+    slot.data_len = (size_t)snprintf(data, sizeof(data), "msg %d %*s", number, (int)pad, "");
+    slot.qos = number % 2;
+    slot.lane = (number % 5 == 0) ? MQTT_LANE_CONTROL : MQTT_LANE_TELEMETRY;
+    return mqtt_sf_store(&slot);
+}
+
+int main(void)
+{
+    int next = 0;
+    mqtt_sf_stats_t stats;
+
+    host_partition_set(64 * 1024);
+    CHECK_EQ(mqtt_sf_init(), ESP_OK);
+
+    /* Outages that overflow RAM into flash, replays cut short by refused publishes */
+    srand(1);
+    for (int round = 0; round < 20; round++) {
+        int n = 300 + rand() % 400;
+        for (int i = 0; i < n; i++) {
+            if (store(next, (size_t)(rand() % 200)) != ESP_OK)
+                break;
+            next++;
+        }
+        g_fail_every = (round % 3) ? 7 : 0;
+        int k = rand() % 500;
+        for (int i = 0; i < k; i++)
+            mqtt_sf_replay(publish, 3);
+    }
+    g_fail_every = 0;
+    while (mqtt_sf_pending())
+        mqtt_sf_replay(publish, 10);
+
+    CHECK_EQ(g_expect, next);
+    mqtt_sf_get_stats(&stats);
+    CHECK_EQ(stats.buffered_records, 0);
+    CHECK_EQ(stats.replayed, (uint32_t)next);
+    CHECK(stats.dropped > 0);   /* RAM and flash filled up at least once */
+    printf("stored %lu, replayed %lu, dropped %lu\n",
+           (unsigned long)stats.stored, (unsigned long)stats.replayed, (unsigned long)stats.dropped);
+
+    HOST_TEST_END();
+}
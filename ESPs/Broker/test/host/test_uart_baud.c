@@ -0,0 +1,173 @@
+/**
+ * @file test_uart_baud.c
+ * @brief Host test of the baud rate negotiation over a pty, with a throughput report
+ *
+ * One scenario per run, the reactor starts once per process:
+ *   (none)  the node goes up to 2000000, readings flow at that rate, then
+ *           the line degrades and the link falls back to the base rate
+ *   limit   the line garbles above 921600, 2000000 fails its test pattern
+ *           and 921600 is committed
+ *   refuse  the node stops at 460800, the rates above are refused
+ *
+ * A pty moves bytes at any rate, the throughput report gives what was
+ * measured through it and what the line would carry at each rate.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "host_test.h"
+#include "host_node.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "uart/uart_config.h"
+#include "uart/uart_interface.h"
+#include "uart/baud/baud.h"
+
+#define PORT     UART_NUM_1
+#define READING  "{\"temperature\":21.5,\"humidity\":60.2,\"light\":350,\"pressure\":1013.2}"
+
+/* Wait until the port's rate settled at baud, false after timeout_ms */
+static bool wait_baud(uint32_t baud, uint32_t attempts, int timeout_ms, uart_baud_stats_t *stats)
+{
+    for (int waited = 0; waited < timeout_ms; waited += 10) {
+        uart_baud_get_stats(0, stats);
+        if (stats->baud == baud && stats->attempts >= attempts && host_uart_baud(PORT) == baud)
+            return true;
+        usleep(10000);
+    }
+    return false;
+}
+
+/* Readings sent through the link and checked on uart_receive(), returns the ones received */
+static int send_readings(host_node_t *node, int count, double *seconds)
+{
+    static uart_queue_msg_t msg;
+    int sent = 0, received = 0;
+    double start = host_seconds();
+
+    while (received < count) {
+        /* Kept within credit, a held reading of a node would be coalesced */
+        while (sent < count && host_node_pending(node) == 0)
+            host_node_send(node, (uint16_t)(sent++ % 1000), READING);
+        if (!uart_receive(&msg, pdMS_TO_TICKS(1000)))
+            break;
+        CHECK_EQ(msg.data_len, strlen(READING));
+        received++;
+    }
+    *seconds = host_seconds() - start;
+    return received;
+}
+
+static void report(uint32_t baud, uint32_t verify_kbps, int readings, double seconds)
+{
+    size_t frame = strlen(READING) + BRIDGE_FRAME_HEADER_SIZE + BRIDGE_FRAME_CRC_SIZE + 2;   /* COBS code + delimiter */
+
+    printf("committed %lu baud, echo test %lu kbit/s\n", (unsigned long)baud, (unsigned long)verify_kbps);
+    printf("%d readings of %zu frame bytes in %.3f s through the pty, %.0f readings/s\n",
+           readings, frame, seconds, readings / seconds);
+    printf("line ceiling: %.0f readings/s at %d baud, %.0f at %lu baud\n",
+           BRIDGE_BAUD_BASE / 10.0 / frame, BRIDGE_BAUD_BASE, baud / 10.0 / frame, (unsigned long)baud);
+}
+
+/* Highest rate, readings at it, then a line too poor for it */
+static void test_negotiate(void)
+{
+    host_node_t *node = host_node_start(PORT, 2000000);
+    uart_baud_stats_t stats;
+    host_node_stats_t node_stats;
+    double seconds;
+
+    CHECK(wait_baud(2000000, 1, 3000, &stats));
+    CHECK_EQ(stats.failures, 0);
+    CHECK(stats.verify_kbps > 0);
+    host_node_get_stats(node, &node_stats);
+    CHECK_EQ(node_stats.baud, 2000000);
+
+    int count = (int)host_bench_iterations(2000);
+    int received = send_readings(node, count, &seconds);
+    CHECK_EQ(received, count);
+    report(stats.baud, stats.verify_kbps, received, seconds);
+
+    /* Bad frames in a row at the committed rate: break, both ends back at the base rate */
+    host_uart_set_line_limit(PORT, 921600);
+    for (int i = 0; i < 2000 && stats.fallbacks == 0; i++) {
+        host_node_send(node, (uint16_t)(i % 1000), READING READING READING);
+        usleep(1000);
+        uart_baud_get_stats(0, &stats);
+    }
+    CHECK_EQ(stats.fallbacks, 1);
+    CHECK(wait_baud(BRIDGE_BAUD_BASE, 1, 2000, &stats));
+    usleep(100000);
+    host_node_get_stats(node, &node_stats);
+    CHECK_EQ(node_stats.baud, BRIDGE_BAUD_BASE);
+    CHECK(host_uart_breaks(PORT) > 0);
+
+    /* Readings flow again at the base rate */
+    static uart_queue_msg_t msg;
+    while (uart_receive(&msg, 0))
+        ;
+    host_node_send(node, 7, READING);
+    CHECK(uart_receive(&msg, pdMS_TO_TICKS(1000)));
+    CHECK_EQ(msg.node_id, 7);
+
+    host_node_stop(node);
+}
+
+/* 2000000 garbled by the line, its test fails and the next candidate holds */
+static void test_limit(void)
+{
+    host_uart_set_line_limit(PORT, 921600);
+    host_node_t *node = host_node_start(PORT, 2000000);
+    uart_baud_stats_t stats;
+    double seconds;
+
+    CHECK(wait_baud(921600, 2, 5000, &stats));
+    CHECK_EQ(stats.attempts, 2);
+    CHECK_EQ(stats.failures, 1);
+    CHECK_EQ(host_uart_breaks(PORT), 1);
+
+    int count = (int)host_bench_iterations(2000);
+    int received = send_readings(node, count, &seconds);
+    CHECK_EQ(received, count);
+    report(stats.baud, stats.verify_kbps, received, seconds);
+
+    host_node_stop(node);
+}
+
+/* Proposals above the node's rate refused without a switch */
+static void test_refuse(void)
+{
+    host_node_t *node = host_node_start(PORT, 460800);
+    uart_baud_stats_t stats;
+    host_node_stats_t node_stats;
+
+    CHECK(wait_baud(460800, 3, 3000, &stats));
+    CHECK_EQ(stats.attempts, 3);
+    CHECK_EQ(stats.failures, 0);
+    CHECK_EQ(host_uart_breaks(PORT), 0);
+    host_node_get_stats(node, &node_stats);
+    CHECK_EQ(node_stats.baud, 460800);
+
+    host_node_stop(node);
+}
+
+int main(int argc, char **argv)
+{
+    const char *scenario = argc > 1 ? argv[1] : "";
+
+    CHECK_EQ(uart_start_task(), ESP_OK);
+
+    if (strcmp(scenario, "limit") == 0)
+        test_limit();
+    else if (strcmp(scenario, "refuse") == 0)
+        test_refuse();
+    else
+        test_negotiate();
+
+    uart_frame_stats_t frames;
+    uart_get_frame_stats(UART_PORT_ALL, &frames);
+    CHECK_EQ(frames.rx_dropped, 0);
+
+    HOST_TEST_END();
+}
@@ -0,0 +1,121 @@
+/**
+ * @file test_uart_credit.c
+ * @brief Host test of the bridge flow control with a slow consumer
+ *
+ * A bridge node forwards readings of 8 mesh nodes faster than the
+ * consumer of uart_receive() takes them, as when MQTT is slow, and for a
+ * while takes none, as when MQTT is down. The broker
+ * must drop nothing: the node runs out of credit, holds the latest reading
+ * of each mesh node and sends it once the consumer caught up.
+ *
+ * The readings are about half of UART_CREDIT_SLOT_BYTES so that a whole
+ * window of them fits the RX ring, the pty delivers it at once. The first
+ * refresh of the pause hands out the last room, the second grants none.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "host_test.h"
+#include "host_node.h"
+#include "freertos/FreeRTOS.h"
+#include "uart/uart_config.h"
+#include "uart/uart_interface.h"
+#include "uart/credit/credit.h"
+
+#define MESH_NODES   8
+#define BURST_MS     10     /* Every mesh node sends once per burst */
+#define CONSUME_MS   50     /* The consumer takes one reading per this */
+#define PAD          250    /* Filler bytes of a reading */
+#define RUN_MS       3000
+#define PAUSE_FROM   500    /* The consumer takes nothing until PAUSE_TO, two refreshes fall in between */
+#define PAUSE_TO     2700
+
+static int g_last_sent[MESH_NODES];
+static int g_last_received[MESH_NODES];
+
+static void take(uart_queue_msg_t *msg)
+{
+    int node, value;
+
+    msg->data[msg->data_len] = '\0';
+    CHECK(msg->node_id < MESH_NODES);
+    CHECK_EQ(sscanf((const char *)msg->data, "{\"node\":%d,\"n\":%d,", &node, &value), 2);
+    CHECK_EQ(node, msg->node_id);
+    if (msg->node_id < MESH_NODES) {
+        /* Held readings are coalesced, never reordered */
+        CHECK(value > g_last_received[node]);
+        g_last_received[node] = value;
+    }
+}
+
+int main(void)
+{
+    static uart_queue_msg_t msg;
+    char reading[64 + PAD];
+    char pad[PAD + 1];
+    int received = 0;
+
+    memset(pad, 'x', PAD);
+    pad[PAD] = '\0';
+    CHECK_EQ(uart_start_task(), ESP_OK);
+    host_node_t *node = host_node_start(UART_NUM_1, 0);
+    host_node_stats_t node_stats;
+    /* Limited from the first burst, an unlimited one would overflow the RX ring of the pty */
+    for (int waited = 0; waited < 1000; waited++) {
+        host_node_get_stats(node, &node_stats);
+        if (node_stats.credit_active)
+            break;
+        usleep(1000);
+    }
+    CHECK(node_stats.credit_active);
+
+    /* The node outpaces the consumer 40 times */
+    for (int t = 0, n = 1; t < RUN_MS; t += BURST_MS, n++) {
+        for (int id = 0; id < MESH_NODES; id++) {
+            snprintf(reading, sizeof(reading), "{\"node\":%d,\"n\":%d,\"pad\":\"%s\"}", id, n, pad);
+            host_node_send(node, (uint16_t)id, reading);
+            g_last_sent[id] = n;
+        }
+        bool paused = t >= PAUSE_FROM && t < PAUSE_TO;
+        if (!paused && t % CONSUME_MS == 0 && uart_receive(&msg, 0)) {
+            take(&msg);
+            received++;
+        }
+        usleep(BURST_MS * 1000);
+    }
+
+    /* Caught up: whatever the node held comes through */
+    while (uart_receive(&msg, pdMS_TO_TICKS(200))) {
+        take(&msg);
+        received++;
+    }
+
+    uart_frame_stats_t frames;
+    uart_credit_stats_t credit;
+    uart_get_frame_stats(UART_PORT_ALL, &frames);
+    uart_credit_get_stats(0, &credit);
+    host_node_get_stats(node, &node_stats);
+
+    printf("%d readings sent, %d received\n", MESH_NODES * (RUN_MS / BURST_MS), received);
+    printf("broker: %lu dropped, %lu credit grants, %lu stalls\n",
+           (unsigned long)frames.rx_dropped, (unsigned long)credit.grants, (unsigned long)credit.stalls);
+    printf("node: %lu sent, %lu held, %lu coalesced, %lu dropped\n", (unsigned long)node_stats.sent,
+           (unsigned long)node_stats.held, (unsigned long)node_stats.coalesced, (unsigned long)node_stats.dropped);
+
+    CHECK_EQ(frames.rx_dropped, 0);
+    CHECK_EQ(frames.lost, 0);
+    CHECK(credit.stalls > 0);
+    CHECK(node_stats.held > 0);
+    CHECK(node_stats.coalesced > 0);
+    /* One slot per mesh node, none pushed out */
+    CHECK_EQ(node_stats.dropped, 0);
+    CHECK_EQ(host_node_pending(node), 0);
+    CHECK_EQ(node_stats.sent, received);
+    for (int id = 0; id < MESH_NODES; id++)
+        CHECK_EQ(g_last_received[id], g_last_sent[id]);
+
+    host_node_stop(node);
+
+    HOST_TEST_END();
+}
@@ -0,0 +1,138 @@
+/**
+ * @file test_uart_ports.c
+ * @brief Host test of the reactor serving several bridge UARTs at once
+ *
+ * Built with three ports in UART_PORTS, each a pty with its own bridge
+ * node. The nodes send at the same time from their own threads, every
+ * reading must come in with the statistics of its port, and a command
+ * must go out only on the port its node was heard on.
+ */
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "host_test.h"
+#include "host_node.h"
+#include "freertos/FreeRTOS.h"
+#include "uart/uart_config.h"
+#include "uart/uart_interface.h"
+
+#define MESH_NODES  4       /* Behind each bridge, IDs 100 * port + n */
+
+typedef struct {
+    host_node_t *node;
+    size_t port;
+    int count;
+    pthread_t thread;
+} sender_t;
+
+static const uart_port_t g_nums[UART_PORT_COUNT] = { UART_NUM_0, UART_NUM_1, UART_NUM_2 };
+static int g_received[UART_PORT_COUNT][MESH_NODES];
+
+static void *sender_main(void *arg)
+{
+    sender_t *s = arg;
+    char reading[64];
+
+    for (int i = 0; i < s->count; i++) {
+        /* Never more than one held, nothing is coalesced */
+        while (host_node_pending(s->node) > 0)
+            usleep(100);
+        snprintf(reading, sizeof(reading), "{\"port\":%d,\"n\":%d}", (int)s->port, i);
+        host_node_send(s->node, (uint16_t)(100 * s->port + i % MESH_NODES), reading);
+    }
+    return NULL;
+}
+
+static void test_fan_in(sender_t *senders, int count)
+{
+    static uart_queue_msg_t msg;
+    int total = 0;
+
+    double start = host_seconds();
+    for (size_t p = 0; p < UART_PORT_COUNT; p++) {
+        senders[p].count = count;
+        pthread_create(&senders[p].thread, NULL, sender_main, &senders[p]);
+    }
+    while (total < UART_PORT_COUNT * count && uart_receive(&msg, pdMS_TO_TICKS(1000))) {
+        int port, n;
+        msg.data[msg.data_len] = '\0';
+        CHECK_EQ(sscanf((const char *)msg.data, "{\"port\":%d,\"n\":%d}", &port, &n), 2);
+        CHECK_EQ(msg.node_id / 100, port);
+        if (port >= 0 && port < UART_PORT_COUNT && msg.node_id % 100 < MESH_NODES)
+            g_received[port][msg.node_id % 100]++;
+        total++;
+    }
+    double seconds = host_seconds() - start;
+    for (size_t p = 0; p < UART_PORT_COUNT; p++)
+        pthread_join(senders[p].thread, NULL);
+
+    printf("%d readings from %d bridges in %.3f s, %.0f readings/s\n",
+           total, UART_PORT_COUNT, seconds, total / seconds);
+    CHECK_EQ(total, UART_PORT_COUNT * count);
+
+    uart_frame_stats_t stats, sum = { 0 };
+    for (size_t p = 0; p < UART_PORT_COUNT; p++) {
+        uart_get_frame_stats(p, &stats);
+        printf("port %zu: %lu frames, %lu errors, %lu lost, %lu dropped\n", p, (unsigned long)stats.frames,
+               (unsigned long)stats.errors, (unsigned long)stats.lost, (unsigned long)stats.rx_dropped);
+        CHECK_EQ(stats.frames, count);
+        CHECK_EQ(stats.errors, 0);
+        CHECK_EQ(stats.lost, 0);
+        for (int n = 0; n < MESH_NODES; n++)
+            CHECK_EQ(g_received[p][n], count / MESH_NODES);
+        sum.frames += stats.frames;
+    }
+    uart_get_frame_stats(UART_PORT_ALL, &stats);
+    CHECK_EQ(stats.frames, sum.frames);
+    CHECK_EQ(stats.rx_dropped, 0);
+}
+
+static void test_commands(sender_t *senders)
+{
+    host_node_stats_t node_stats;
+    const char *command = "201led:on";
+
+    /* Node 201 was heard behind port 2 only */
+    CHECK(uart_send_data((const uint8_t *)command, strlen(command)) > 0);
+    usleep(100000);
+    for (size_t p = 0; p < UART_PORT_COUNT; p++) {
+        host_node_get_stats(senders[p].node, &node_stats);
+        CHECK_EQ(node_stats.commands, p == 2 ? 1 : 0);
+    }
+    host_node_get_stats(senders[2].node, &node_stats);
+    CHECK_EQ(node_stats.command_node, 201);
+    CHECK_EQ(strcmp(node_stats.command, "led:on"), 0);
+
+    /* Never heard of: every bridge */
+    command = "77led:off";
+    CHECK(uart_send_data((const uint8_t *)command, strlen(command)) > 0);
+    usleep(100000);
+    for (size_t p = 0; p < UART_PORT_COUNT; p++) {
+        host_node_get_stats(senders[p].node, &node_stats);
+        CHECK_EQ(node_stats.commands, p == 2 ? 2 : 1);
+        CHECK_EQ(node_stats.command_node, 77);
+    }
+}
+
+int main(void)
+{
+    sender_t senders[UART_PORT_COUNT];
+    int count = (int)host_bench_iterations(2000);
+
+    CHECK_EQ(uart_start_task(), ESP_OK);
+    for (size_t p = 0; p < UART_PORT_COUNT; p++) {
+        senders[p].node = host_node_start(g_nums[p], 0);
+        senders[p].port = p;
+    }
+    usleep(20000);
+
+    test_fan_in(senders, count);
+    test_commands(senders);
+
+    for (size_t p = 0; p < UART_PORT_COUNT; p++)
+        host_node_stop(senders[p].node);
+
+    HOST_TEST_END();
+}
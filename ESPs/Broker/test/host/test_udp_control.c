@@ -0,0 +1,224 @@
+/**
+ * @file test_udp_control.c
+ * @brief Host tests of the UDP control authentication and replay window
+ *
+ * The program file is compiled into the test so its static checks can be
+ * called directly, the datagrams go to udp_control_handle() without a
+ * socket. NVS is the RAM stand-in: udp_control_load() once more is a
+ * reboot that finds the replay floor the first run stored.
+ */
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "host_test.h"
+#include "udp_control/udp_control_program.c"
+
+#define NODE_ID  7
+
+static const uint8_t g_psk[] = "host-test-psk-0123456789";
+
+static void provision(const void *key, size_t len)
+{
+    nvs_handle_t nvs;
+
+    CHECK_EQ(nvs_open(UDP_CONTROL_NVS_NAMESPACE, NVS_READWRITE, &nvs), ESP_OK);
+    CHECK_EQ(nvs_set_blob(nvs, UDP_CONTROL_NVS_HMAC_KEY, key, len), ESP_OK);
+    nvs_close(nvs);
+}
+
+static uint32_t stored_floor(void)
+{
+    nvs_handle_t nvs;
+    uint32_t floor = 0;
+
+    if (nvs_open(UDP_CONTROL_NVS_NAMESPACE, NVS_READONLY, &nvs) == ESP_OK) {
+        nvs_get_u32(nvs, UDP_CONTROL_NVS_KEY, &floor);
+        nvs_close(nvs);
+    }
+    return floor;
+}
+
+/* Signed datagram as the gateway sends it, returns its length */
+static size_t datagram(uint8_t *out, uint32_t seq, uint16_t node_id, const char *cmd)
+{
+    size_t len = strlen(cmd);
+
+    out[0] = 'W';
+    out[1] = 'C';
+    out[2] = UDP_CONTROL_VERSION;
+    out[3] = 0;
+    put_u32(out + 4, seq);
+    out[8] = (uint8_t)(node_id >> 8);
+    out[9] = (uint8_t)node_id;
+    memcpy(out + UDP_CONTROL_HEADER_SIZE, cmd, len);
+    udp_control_tag(out, UDP_CONTROL_HEADER_SIZE + len, out + UDP_CONTROL_HEADER_SIZE + len);
+    return UDP_CONTROL_HEADER_SIZE + len + UDP_CONTROL_TAG_SIZE;
+}
+
+/* Status of one datagram, -1 if it was refused before the replay check */
+static int send_seq(uint32_t seq)
+{
+    uint8_t rx[64];
+    uint32_t got = 0;
+    udp_control_status_t status;
+
+    size_t len = datagram(rx, seq, NODE_ID, "led:on");
+    if (!udp_control_handle(rx, len, &got, &status))
+        return -1;
+    CHECK_EQ(got, seq);
+    if (status == UDP_CONTROL_OK)
+        control_release(CONTROL_SRC_UDP);
+    return (int)status;
+}
+
+/*************************** Tests ***************************/
+
+static void test_hmac(void)
+{
+    /* RFC 4231 test case 2, the stand-in of mbedTLS against the reference */
+    static const uint8_t expected[32] = {
+        0x5b, 0xdc, 0xc1, 0x46, 0xbf, 0x60, 0x75, 0x4e, 0x6a, 0x04, 0x24, 0x26, 0x08, 0x95, 0x75, 0xc7,
+        0x5a, 0x00, 0x3f, 0x08, 0x9d, 0x27, 0x39, 0x83, 0x9d, 0xec, 0x58, 0xb9, 0x64, 0xec, 0x38, 0x43,
+    };
+    const char *data = "what do ya want for nothing?";
+    uint8_t mac[32];
+
+    CHECK_EQ(mbedtls_md_hmac(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), (const uint8_t *)"Jefe", 4,
+                             (const uint8_t *)data, strlen(data), mac), 0);
+    CHECK_EQ(memcmp(mac, expected, sizeof(mac)), 0);
+}
+
+static void test_tag(void)
+{
+    uint8_t rx[64];
+    size_t len = datagram(rx, 1, NODE_ID, "led:on");
+    size_t body = len - UDP_CONTROL_TAG_SIZE;
+
+    CHECK(udp_control_tag_ok(rx, body, rx + body));
+
+    /* Any bit of the tag or of what it covers */
+    int accepted = 0;
+    for (size_t bit = 0; bit < len * 8; bit++) {
+        rx[bit / 8] ^= (uint8_t)(1 << (bit % 8));
+        accepted += udp_control_tag_ok(rx, body, rx + body);
+        rx[bit / 8] ^= (uint8_t)(1 << (bit % 8));
+    }
+    CHECK_EQ(accepted, 0);
+
+    /* Cut short, or tagged with another key */
+    CHECK(!udp_control_tag_ok(rx, body - 1, rx + body));
+    uint8_t key[UDP_CONTROL_KEY_MAX];
+    size_t key_len = g_key_len;
+    memcpy(key, g_key, key_len);
+    g_key[0] ^= 1;
+    datagram(rx, 1, NODE_ID, "led:on");
+    memcpy(g_key, key, key_len);
+    CHECK(!udp_control_tag_ok(rx, body, rx + body));
+
+    /* Malformed datagrams never reach the replay window */
+    udp_control_status_t status;
+    uint32_t seq;
+    len = datagram(rx, 1, NODE_ID, "led:on");
+    CHECK(!udp_control_handle(rx, UDP_CONTROL_HEADER_SIZE + UDP_CONTROL_TAG_SIZE - 1, &seq, &status));
+    rx[2] = UDP_CONTROL_VERSION + 1;
+    CHECK(!udp_control_handle(rx, len, &seq, &status));
+    rx[2] = UDP_CONTROL_VERSION;
+    rx[len - 1] ^= 0x80;
+    CHECK(!udp_control_handle(rx, len, &seq, &status));
+    CHECK_EQ(g_highest, 0);
+}
+
+static void test_window(void)
+{
+    /* seq 0 is never valid */
+    CHECK(!udp_control_fresh(0));
+
+    CHECK(udp_control_fresh(100));
+    CHECK(!udp_control_fresh(100));
+    /* Out of order within the window, once each */
+    CHECK(udp_control_fresh(98));
+    CHECK(!udp_control_fresh(98));
+    CHECK(udp_control_fresh(99));
+    CHECK(udp_control_fresh(100 - (UDP_CONTROL_REPLAY_WINDOW - 1)));
+    CHECK(!udp_control_fresh(100 - UDP_CONTROL_REPLAY_WINDOW));
+    /* A jump over the whole window forgets it */
+    CHECK(udp_control_fresh(100 + 2 * UDP_CONTROL_REPLAY_WINDOW));
+    CHECK(udp_control_fresh(100 + UDP_CONTROL_REPLAY_WINDOW + 1));
+    CHECK(!udp_control_fresh(100 + UDP_CONTROL_REPLAY_WINDOW));
+    CHECK(!udp_control_fresh(100 + UDP_CONTROL_REPLAY_WINDOW + 1));
+}
+
+static void test_floor(void)
+{
+    /* A first boot: nothing stored */
+    CHECK_EQ(udp_control_load(), ESP_OK);
+    CHECK_EQ(g_checkpoint, 0);
+    uint32_t writes = host_nvs_writes(UDP_CONTROL_NVS_NAMESPACE);
+
+    /* The first datagram stores the floor ahead of it, then one write per checkpoint */
+    CHECK_EQ(send_seq(1), UDP_CONTROL_OK);
+    CHECK_EQ(stored_floor(), 1 + UDP_CONTROL_SEQ_CHECKPOINT);
+    for (uint32_t seq = 2; seq <= UDP_CONTROL_SEQ_CHECKPOINT; seq++)
+        CHECK_EQ(send_seq(seq), UDP_CONTROL_OK);
+    CHECK_EQ(host_nvs_writes(UDP_CONTROL_NVS_NAMESPACE) - writes, 1);
+    CHECK_EQ(send_seq(1 + UDP_CONTROL_SEQ_CHECKPOINT), UDP_CONTROL_OK);
+    CHECK_EQ(stored_floor(), 1 + 2 * UDP_CONTROL_SEQ_CHECKPOINT);
+    CHECK_EQ(host_nvs_writes(UDP_CONTROL_NVS_NAMESPACE) - writes, 2);
+    CHECK_EQ(send_seq(5), UDP_CONTROL_REPLAY);
+
+    /* Reboot: everything up to the floor counts as seen, accepted before or not */
+    uint32_t floor = stored_floor();
+    CHECK_EQ(udp_control_load(), ESP_OK);
+    CHECK_EQ(g_highest, floor);
+    CHECK_EQ(send_seq(UDP_CONTROL_SEQ_CHECKPOINT), UDP_CONTROL_REPLAY);
+    CHECK_EQ(send_seq(floor - 1), UDP_CONTROL_REPLAY);
+    /* The floor itself moves the checkpoint on, it is still refused */
+    CHECK_EQ(send_seq(floor), UDP_CONTROL_REPLAY);
+    CHECK_EQ(stored_floor(), floor + UDP_CONTROL_SEQ_CHECKPOINT);
+    CHECK_EQ(send_seq(floor + 1), UDP_CONTROL_OK);
+
+    /* Another reboot straight away, the seq just accepted is still refused */
+    CHECK_EQ(udp_control_load(), ESP_OK);
+    CHECK_EQ(send_seq(floor + 1), UDP_CONTROL_REPLAY);
+    CHECK_EQ(send_seq(floor + 1 + UDP_CONTROL_SEQ_CHECKPOINT), UDP_CONTROL_OK);
+
+    /* A node never heard on the UART bridge: fresh, but no route */
+    uint8_t rx[64];
+    uint32_t seq;
+    udp_control_status_t status;
+    size_t len = datagram(rx, g_highest + 1, 999, "led:on");
+    CHECK(udp_control_handle(rx, len, &seq, &status));
+    CHECK_EQ(status, UDP_CONTROL_NO_ROUTE);
+}
+
+static void test_key(void)
+{
+    /* No key, or one too short: the listener doesn't start */
+    host_nvs_erase_all();
+    CHECK_EQ(udp_control_load(), ESP_ERR_NOT_FOUND);
+    provision(g_psk, UDP_CONTROL_KEY_MIN - 1);
+    CHECK_EQ(udp_control_load(), ESP_ERR_NOT_FOUND);
+    CHECK_EQ(g_key_len, 0);
+    provision(g_psk, UDP_CONTROL_KEY_MIN);
+    CHECK_EQ(udp_control_load(), ESP_OK);
+    CHECK_EQ(g_key_len, UDP_CONTROL_KEY_MIN);
+    provision(g_psk, sizeof(g_psk) - 1);
+    CHECK_EQ(udp_control_load(), ESP_OK);
+}
+
+int main(void)
+{
+    host_nvs_erase_all();
+    CHECK_EQ(control_init(), ESP_OK);
+    CHECK_EQ(mqtt_route_init(), ESP_OK);
+    CHECK(mqtt_route_get(NODE_ID) != NULL);
+
+    test_hmac();
+    test_key();
+    test_tag();
+    test_window();
+    test_floor();
+
+    HOST_TEST_END();
+}
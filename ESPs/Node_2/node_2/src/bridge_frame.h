@@ -0,0 +1 @@
+../../../common/bridge_frame.h
\ No newline at end of file
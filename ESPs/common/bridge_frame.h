@@ -0,0 +1,311 @@
+/**
+ * @file bridge_frame.h
+ * @brief Framing of the Node <-> Broker UART bridge, header only, C and C++
+ *
+ * A frame is
+ *   type:1 | node id:2 | seq:2 | payload | crc:2          (big endian)
+ * COBS encoded and terminated by a 0x00 delimiter. COBS removes every 0x00
+ * from the encoded bytes, so a delimiter always ends a frame: a corrupted
+ * or truncated frame fails its CRC-16/CCITT-FALSE and the receiver is back
+ * in sync at the next delimiter. Empty frames (two delimiters in a row) are
+ * ignored, a sender starts with a delimiter to end any partial frame the
+ * receiver holds.
+ *
+ * seq counts the frames of a sender (per link, not per node), the receiver
+ * derives lost frames from the gaps.
+ *
+ * Baud rate negotiation, the link starts at BRIDGE_BAUD_BASE:
+ *   Broker BAUD_REQ(rate) -> Node BAUD_ACK(rate), both switch to rate
+ *   Broker BAUD_TEST(pattern) x n -> Node echoes every BAUD_TEST
+ *   Broker checks the echoes, BAUD_COMMIT -> Node keeps the rate
+ * A node without the COMMIT after BRIDGE_BAUD_VERIFY_MS, or seeing a line
+ * break, returns to BRIDGE_BAUD_BASE. The break is how the Broker resets the
+ * node whatever rate it is at.
+ *
+ * Flow control: once a node got a CREDIT frame it sends DATA frames only
+ * while their seq is below the limit granted (modulo 2^16), other frames
+ * are exempt but still take a seq. The Broker grants
+ *   limit = seq it expects next + messages its RX buffer still holds
+ * so frames in flight are already paid for, and repeats the grant
+ * periodically in case a CREDIT frame is lost. A node silent for a period
+ * gets a RELATIVE grant again, the DATA frames it lost are not owed. A node
+ * that never got one is not limited, the Broker may not do flow control.
+ *
+ * Shared by the Broker firmware and the node sketches (symlinked into their
+ * src/ folder), keep it free of platform includes.
+ */
+#ifndef BRIDGE_FRAME_H
+#define BRIDGE_FRAME_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+
+#define BRIDGE_FRAME_DELIMITER     0x00
+#define BRIDGE_FRAME_HEADER_SIZE   5
+#define BRIDGE_FRAME_CRC_SIZE      2
+#define BRIDGE_FRAME_MAX_PAYLOAD   512
+#define BRIDGE_FRAME_MAX_RAW       (BRIDGE_FRAME_HEADER_SIZE + BRIDGE_FRAME_MAX_PAYLOAD + BRIDGE_FRAME_CRC_SIZE)
+#define BRIDGE_FRAME_MAX_ENCODED   (BRIDGE_FRAME_MAX_RAW + BRIDGE_FRAME_MAX_RAW / 254 + 2)   /* COBS codes + delimiter */
+#define BRIDGE_NODE_NONE           0xFFFF   /* Frame not addressed to one node */
+
+/**
+ * @brief Frame types
+ */
+typedef enum {
+    BRIDGE_FRAME_DATA        = 1,   /* Node -> Broker, a reading */
+    BRIDGE_FRAME_CONTROL     = 2,   /* Broker -> Node, a command */
+    BRIDGE_FRAME_BAUD_REQ    = 3,   /* Broker -> Node, proposed rate:4 */
+    BRIDGE_FRAME_BAUD_ACK    = 4,   /* Node -> Broker, rate:4 it switches to, 0: refused */
+    BRIDGE_FRAME_BAUD_TEST   = 5,   /* Test pattern, the node echoes it */
+    BRIDGE_FRAME_BAUD_COMMIT = 6,   /* Broker -> Node, keep the rate */
+    BRIDGE_FRAME_CREDIT      = 7,   /* Broker -> Node, mode:1 value:2, see bridge_credit_mode_t */
+} bridge_frame_type_t;
+
+/**
+ * @brief How a CREDIT frame's value reads
+ */
+typedef enum {
+    BRIDGE_CREDIT_LIMIT    = 0,     /* seq limit, exclusive */
+    BRIDGE_CREDIT_RELATIVE = 1,     /* Frames from the node's next seq, the Broker saw none yet */
+} bridge_credit_mode_t;
+
+#define BRIDGE_BAUD_BASE           115200
+#define BRIDGE_BAUD_VERIFY_MS      1000     /* Node falls back to BRIDGE_BAUD_BASE without a COMMIT in time */
+
+/**
+ * @brief Decoded frame, payload points into the decoding buffer
+ */
+typedef struct {
+    uint8_t        type;
+    uint16_t       node_id;
+    uint16_t       seq;
+    const uint8_t *payload;
+    size_t         len;
+} bridge_frame_t;
+
+/**
+ * @brief Receiver of a byte stream, see bridge_frame_feed()
+ */
+typedef struct {
+    uint8_t  buf[BRIDGE_FRAME_MAX_ENCODED];
+    size_t   len;
+    bool     discard;    /* Frame too long, skip to the next delimiter */
+    uint32_t errors;     /* Frames dropped: bad COBS, bad CRC, too long */
+} bridge_frame_decoder_t;
+
+/**
+ * @brief Lost frame detection of one link
+ */
+typedef struct {
+    bool     valid;
+    uint16_t next;       /* seq expected next */
+    uint32_t lost;
+} bridge_frame_seq_t;
+
+static inline void bridge_put_u32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+}
+
+static inline uint32_t bridge_get_u32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+/* CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF), a nibble at a time */
+static inline uint16_t bridge_crc16(const uint8_t *data, size_t len, uint16_t crc)
+{
+    static const uint16_t table[16] = {
+        0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50a5, 0x60c6, 0x70e7,
+        0x8108, 0x9129, 0xa14a, 0xb16b, 0xc18c, 0xd1ad, 0xe1ce, 0xf1ef,
+    };
+
+    for (size_t i = 0; i < len; i++) {
+        crc = (uint16_t)((crc << 4) ^ table[(crc >> 12) ^ (data[i] >> 4)]);
+        crc = (uint16_t)((crc << 4) ^ table[(crc >> 12) ^ (data[i] & 0x0F)]);
+    }
+
+    return crc;
+}
+
+/**
+ * @brief COBS output cursor
+ */
+typedef struct {
+    uint8_t *out;
+    size_t   cap;
+    size_t   pos;        /* Next byte */
+    size_t   code_pos;   /* Code byte of the current block */
+    uint8_t  code;
+    bool     overflow;
+} bridge_cobs_writer_t;
+
+static inline void bridge_cobs_start(bridge_cobs_writer_t *w, uint8_t *out, size_t cap)
+{
+    w->out = out;
+    w->cap = cap;
+    w->pos = 1;
+    w->code_pos = 0;
+    w->code = 1;
+    w->overflow = (cap < 2);
+}
+
+static inline void bridge_cobs_put(bridge_cobs_writer_t *w, uint8_t byte)
+{
+    if (w->overflow || w->pos >= w->cap) {
+        w->overflow = true;
+        return;
+    }
+    if (byte != 0) {
+        w->out[w->pos++] = byte;
+        if (++w->code != 0xFF)
+            return;
+    }
+    /* A zero, or a full block of 254 bytes, ends the block */
+    w->out[w->code_pos] = w->code;
+    w->code_pos = w->pos++;
+    w->code = 1;
+}
+
+static inline void bridge_cobs_write(bridge_cobs_writer_t *w, const uint8_t *data, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+        bridge_cobs_put(w, data[i]);
+}
+
+/* Close the last block and add the delimiter, 0 if out was too small */
+static inline size_t bridge_cobs_finish(bridge_cobs_writer_t *w)
+{
+    if (w->overflow || w->code_pos >= w->cap || w->pos >= w->cap)
+        return 0;
+    w->out[w->code_pos] = w->code;
+    w->out[w->pos++] = BRIDGE_FRAME_DELIMITER;
+    return w->pos;
+}
+
+/* COBS decode, out may be in. Returns the decoded length, 0 if in isn't valid COBS */
+static inline size_t bridge_cobs_decode(const uint8_t *in, size_t len, uint8_t *out)
+{
+    size_t r = 0;
+    size_t w = 0;
+
+    while (r < len) {
+        uint8_t code = in[r++];
+        if (code == 0 || r + code - 1 > len)
+            return 0;
+        for (uint8_t i = 1; i < code; i++)
+            out[w++] = in[r++];
+        if (code != 0xFF && r < len)
+            out[w++] = 0;
+    }
+
+    return w;
+}
+
+/**
+ * @brief Encode a frame, delimiter included
+ *
+ * @return Bytes written to out, 0 if the payload or out is too large/small
+ */
+static inline size_t bridge_frame_encode(uint8_t type, uint16_t node_id, uint16_t seq,
+                                         const uint8_t *payload, size_t len, uint8_t *out, size_t cap)
+{
+    uint8_t header[BRIDGE_FRAME_HEADER_SIZE] = {
+        type, (uint8_t)(node_id >> 8), (uint8_t)node_id, (uint8_t)(seq >> 8), (uint8_t)seq
+    };
+    bridge_cobs_writer_t w;
+
+    if (len > BRIDGE_FRAME_MAX_PAYLOAD)
+        return 0;
+
+    uint16_t crc = bridge_crc16(header, sizeof(header), 0xFFFF);
+    crc = bridge_crc16(payload, len, crc);
+    uint8_t trailer[BRIDGE_FRAME_CRC_SIZE] = { (uint8_t)(crc >> 8), (uint8_t)crc };
+
+    bridge_cobs_start(&w, out, cap);
+    bridge_cobs_write(&w, header, sizeof(header));
+    bridge_cobs_write(&w, payload, len);
+    bridge_cobs_write(&w, trailer, sizeof(trailer));
+    return bridge_cobs_finish(&w);
+}
+
+/**
+ * @brief Decode one encoded frame in place
+ *
+ * @param buf   Encoded bytes, a trailing delimiter is allowed. Overwritten
+ * @param len   Encoded length
+ * @param frame Filled on success, frame->payload points into buf
+ * @return true if the frame is valid
+ */
+static inline bool bridge_frame_decode(uint8_t *buf, size_t len, bridge_frame_t *frame)
+{
+    if (len > 0 && buf[len - 1] == BRIDGE_FRAME_DELIMITER)
+        len--;
+
+    size_t raw = bridge_cobs_decode(buf, len, buf);
+    if (raw < BRIDGE_FRAME_HEADER_SIZE + BRIDGE_FRAME_CRC_SIZE)
+        return false;
+
+    size_t body = raw - BRIDGE_FRAME_CRC_SIZE;
+    uint16_t crc = (uint16_t)((buf[body] << 8) | buf[body + 1]);
+    if (bridge_crc16(buf, body, 0xFFFF) != crc)
+        return false;
+
+    frame->type = buf[0];
+    frame->node_id = (uint16_t)((buf[1] << 8) | buf[2]);
+    frame->seq = (uint16_t)((buf[3] << 8) | buf[4]);
+    frame->payload = buf + BRIDGE_FRAME_HEADER_SIZE;
+    frame->len = body - BRIDGE_FRAME_HEADER_SIZE;
+    return true;
+}
+
+/**
+ * @brief Feed one received byte
+ *
+ * @return true when a valid frame was completed, it stays valid until the next call
+ */
+static inline bool bridge_frame_feed(bridge_frame_decoder_t *d, uint8_t byte, bridge_frame_t *frame)
+{
+    bool ok = false;
+
+    if (byte != BRIDGE_FRAME_DELIMITER) {
+        if (d->len < sizeof(d->buf))
+            d->buf[d->len++] = byte;
+        else
+            d->discard = true;
+        return false;
+    }
+
+    if (d->discard)
+        d->errors++;
+    else if (d->len > 0 && !(ok = bridge_frame_decode(d->buf, d->len, frame)))
+        d->errors++;
+
+    d->len = 0;
+    d->discard = false;
+    return ok;
+}
+
+/**
+ * @brief Account a received seq, a jump back is taken as a restarted sender
+ *
+ * @return Frames lost before this one
+ */
+static inline uint16_t bridge_frame_track(bridge_frame_seq_t *s, uint16_t seq)
+{
+    uint16_t gap = (uint16_t)(seq - s->next);
+
+    if (!s->valid || gap >= 0x8000)
+        gap = 0;
+    s->valid = true;
+    s->next = (uint16_t)(seq + 1);
+    s->lost += gap;
+    return gap;
+}
+
+#endif /* BRIDGE_FRAME_H */
@@ -1,12 +1,21 @@
 import asyncio
+import hashlib
+import hmac
 import json
 import logging
 import os
+import socket
 import sqlite3
+import struct
+import threading
+import time
 import uuid
+from collections import deque
 from datetime import datetime, timedelta
+from decimal import Decimal
 from typing import Dict, List, Optional, Union
 
+import cbor2
 import paho.mqtt.client as mqtt
 from fastapi import Depends, FastAPI, HTTPException, Request, WebSocket, WebSocketDisconnect, status
 from fastapi.middleware.cors import CORSMiddleware
@@ -36,6 +45,26 @@ MQTT_BROKER = os.getenv("MQTT_BROKER", "localhost")
 MQTT_PORT = int(os.getenv("MQTT_PORT", "1883"))
 MQTT_SENSOR_TOPIC = "wot/sensors/#"
 MQTT_CONTROL_TOPIC = "wot/control/#"
+MQTT_BATCH_TOPIC = "wot/sensors/batch"
+# The ESP broker publishes with MQTT 5 topic aliases. This client advertises no
+# Topic Alias Maximum, so the broker forwards every message with its full topic.
+MQTT_PROTOCOL_V5 = os.getenv("MQTT_PROTOCOL", "5") == "5"
+RELIABLE_DEDUP_WINDOW = 1024  # Sequence numbers remembered per ESP boot
+CBOR_MARKER = b"\xd9\xd9\xf7"  # CBOR self-describe tag, first bytes of a CBOR reading
+CBOR_KEYS = ["temperature", "humidity", "light", "pressure"]  # MQTT_CBOR_KEYS of the ESP broker
+
+# One hop UDP control path to the ESP broker, MQTT is used when unset or on failure
+CONTROL_UDP_HOST = os.getenv("CONTROL_UDP_HOST", "")
+CONTROL_UDP_PORT = int(os.getenv("CONTROL_UDP_PORT", "8888"))
+CONTROL_UDP_KEY = os.getenv("CONTROL_UDP_KEY", "").encode()  # hmac_key in the udp_control NVS namespace of the ESP broker
+CONTROL_UDP_KEY_MIN = 16  # UDP_CONTROL_KEY_MIN of the ESP broker
+CONTROL_UDP_TIMEOUT = 0.2  # Seconds to wait for the acknowledgement
+CONTROL_UDP_TAG_SIZE = 16
+
+# There is no built in key, without one the UDP path stays off and commands go over MQTT
+if CONTROL_UDP_HOST and len(CONTROL_UDP_KEY) < CONTROL_UDP_KEY_MIN:
+    logger.error(f"CONTROL_UDP_KEY must be at least {CONTROL_UDP_KEY_MIN} bytes, UDP control disabled")
+    CONTROL_UDP_HOST = ""
 
 # JWT Configuration
 SECRET_KEY = os.getenv("SECRET_KEY", "Badawy_random_secret_key")
@@ -354,46 +383,180 @@ def init_db():
 
 
 # MQTT client setup
-def on_connect(client, userdata, flags, rc):
+def on_connect(client, userdata, flags, rc, properties=None):
     """Callback for when the client connects to the MQTT broker"""
     if rc == 0:
         logger.info("Connected to MQTT broker")
-        client.subscribe(MQTT_SENSOR_TOPIC)
+        # QoS 1 so the reliable telemetry of the ESP broker stays QoS 1 up to here
+        client.subscribe(MQTT_SENSOR_TOPIC, qos=1)
         logger.info(f"Subscribed to {MQTT_SENSOR_TOPIC}")
     else:
         logger.error(f"Failed to connect to MQTT broker with code {rc}")
 
 
+# boot id -> (set of recent seqs, deque of the same seqs in arrival order)
+reliable_seen = {}
+
+
+def strip_reliable_header(data):
+    """Remove the header of a reliable (QoS 1) publish of the ESP broker.
+
+    Layout (big endian): 'W' 'R' <boot id:2> <seq:4>, then the payload.
+    Returns the payload, or None if this seq was already received (a
+    retransmission). Payloads without the header are returned unchanged.
+    """
+    if len(data) < 8 or data[0:2] != b"WR":
+        return data
+
+    boot_id, seq = struct.unpack_from(">HI", data, 2)
+    seen, order = reliable_seen.setdefault(boot_id, (set(), deque()))
+    if seq in seen:
+        return None
+
+    seen.add(seq)
+    order.append(seq)
+    if len(order) > RELIABLE_DEDUP_WINDOW:
+        seen.discard(order.popleft())
+    return data[8:]
+
+
+def decode_batch(data):
+    """Split a batch published by the ESP broker into (node_id, payload) records.
+
+    Layout (big endian): 'W' 'B' <version:1> <count:1>, then count records of
+    <id_len:1> <node id> <data_len:2> <data>.
+    """
+    if len(data) < 4 or data[0:2] != b"WB" or data[2] != 1:
+        raise ValueError("Not a telemetry batch")
+
+    records = []
+    offset = 4
+    for _ in range(data[3]):
+        id_len = data[offset]
+        node_id = data[offset + 1:offset + 1 + id_len].decode()
+        offset += 1 + id_len
+        (data_len,) = struct.unpack_from(">H", data, offset)
+        offset += 2
+        records.append((node_id, data[offset:offset + data_len]))
+        offset += data_len
+    return records
+
+
+def decode_reading(raw):
+    """Decode one reading, CBOR if it starts with the self-describe tag, JSON otherwise.
+
+    CBOR keys may be indexes in CBOR_KEYS and decimals arrive as Decimal,
+    both are mapped back to what the node sent as JSON.
+    """
+    if raw[:3] != CBOR_MARKER:
+        return json.loads(raw.decode())
+
+    reading = {}
+    for key, value in cbor2.loads(raw).items():
+        if isinstance(key, int) and 0 <= key < len(CBOR_KEYS):
+            key = CBOR_KEYS[key]
+        if isinstance(value, Decimal):
+            value = float(value)
+        reading[key] = value
+    return reading
+
+
+def handle_sensor_payload(node_id, raw):
+    """Store and broadcast one sensor reading"""
+    payload = decode_reading(raw)
+    logger.info(f"Received reading from node {node_id}: {payload}")
+
+    # Add timestamp if not present
+    if "timestamp" not in payload:
+        payload["timestamp"] = datetime.now().isoformat()
+        
+    # Add node_id if not present
+    if "node_id" not in payload:
+        payload["node_id"] = node_id
+    
+    # Store in SQLite
+    store_sensor_data(payload)
+    
+    # Broadcast to WebSocket clients
+    asyncio.run_coroutine_threadsafe(
+        manager.broadcast({"type": "sensor_data", "data": payload}),
+        loop
+    )
+
+
 def on_message(client, userdata, msg):
     """Callback for when a message is received from the MQTT broker"""
     try:
         topic = msg.topic
-        payload = json.loads(msg.payload.decode())
-        logger.info(f"Received message on topic {topic}: {payload}")
+        payload = strip_reliable_header(msg.payload)
+        if payload is None:
+            logger.debug(f"Duplicate publish on {topic} dropped")
+            return
+        
+        # Several nodes readings packed in one publish
+        if topic == MQTT_BATCH_TOPIC:
+            for node_id, raw in decode_batch(payload):
+                try:
+                    handle_sensor_payload(node_id, raw)
+                except Exception as e:
+                    logger.error(f"Error processing reading of node {node_id}: {e}")
+            return
         
         # Parse node_id from topic (format: wot/sensors/node_id)
         node_id = topic.split("/")[-1]
-        
-        # Add timestamp if not present
-        if "timestamp" not in payload:
-            payload["timestamp"] = datetime.now().isoformat()
-            
-        # Add node_id if not present
-        if "node_id" not in payload:
-            payload["node_id"] = node_id
-        
-        # Store in SQLite
-        store_sensor_data(payload)
-        
-        # Broadcast to WebSocket clients
-        asyncio.run_coroutine_threadsafe(
-            manager.broadcast({"type": "sensor_data", "data": payload}),
-            loop
-        )
+        handle_sensor_payload(node_id, payload)
     except Exception as e:
         logger.error(f"Error processing MQTT message: {e}")
 
 
+udp_control_seq = 0
+udp_control_lock = threading.Lock()
+
+
+def udp_control_tag(data):
+    return hmac.new(CONTROL_UDP_KEY, data, hashlib.sha256).digest()[:CONTROL_UDP_TAG_SIZE]
+
+
+def send_udp_control(node_id, command):
+    """Send a command on the UDP control path of the ESP broker.
+
+    Returns the round trip in ms once the ESP acknowledged it, None otherwise.
+    """
+    global udp_control_seq
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.settimeout(CONTROL_UDP_TIMEOUT)
+    try:
+        for _ in range(2):
+            with udp_control_lock:
+                # Tenths of a second keep seq above the ESP's floor across gateway restarts
+                udp_control_seq = max(udp_control_seq + 1, int(time.time() * 10) & 0xFFFFFFFF)
+                seq = udp_control_seq
+            body = b"WC\x01\x00" + struct.pack(">IH", seq, node_id) + command
+            start = time.perf_counter()
+            sock.sendto(body + udp_control_tag(body), (CONTROL_UDP_HOST, CONTROL_UDP_PORT))
+            ack = sock.recv(64)
+            rtt_ms = (time.perf_counter() - start) * 1000
+
+            if len(ack) != 12 + CONTROL_UDP_TAG_SIZE or ack[:3] != b"WA\x01" or \
+                    not hmac.compare_digest(ack[12:], udp_control_tag(ack[:12])):
+                return None
+            ack_seq, highest = struct.unpack(">II", ack[4:12])
+            if ack_seq != seq:
+                return None
+            if ack[3] == 0:
+                return rtt_ms
+            if ack[3] != 1:
+                return None
+            # Replay: the ESP's floor is above our seq (it rebooted), continue above it
+            with udp_control_lock:
+                udp_control_seq = max(udp_control_seq, highest)
+        return None
+    except OSError:
+        return None
+    finally:
+        sock.close()
+
+
 def store_sensor_data(data):
     """Store sensor data in SQLite database"""
     conn = sqlite3.connect(DB_FILE)
@@ -441,7 +604,7 @@ def store_control_command(data):
 
 
 # Initialize MQTT client
-mqtt_client = mqtt.Client()
+mqtt_client = mqtt.Client(protocol=mqtt.MQTTv5 if MQTT_PROTOCOL_V5 else mqtt.MQTTv311)
 mqtt_client.on_connect = on_connect
 mqtt_client.on_message = on_message
 
@@ -646,8 +809,16 @@ async def send_control_command(command: ControlCommand, current_user: User = Dep
             "timestamp": datetime.now().isoformat()
         }
         
-        # Publish to MQTT
-        mqtt_client.publish(f"wot/control/{command.node_id}", json.dumps(payload))
+        message = json.dumps(payload)
+        rtt_ms = None
+        if CONTROL_UDP_HOST and command.node_id.isdigit() and int(command.node_id) <= 0xFFFF:
+            rtt_ms = await asyncio.get_running_loop().run_in_executor(
+                None, send_udp_control, int(command.node_id), message.encode())
+        if rtt_ms is not None:
+            logger.info(f"Control command sent over UDP, round trip {rtt_ms:.1f} ms")
+        else:
+            # Publish to MQTT
+            mqtt_client.publish(f"wot/control/{command.node_id}", message)
         
         # Store in database
         store_control_command({